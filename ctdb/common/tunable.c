@@ -162,6 +162,8 @@ static struct {
 		offsetof(struct ctdb_tunable_list, ip_alloc_algorithm) },
 	{ "AllowMixedVersions", 0, false,
 		offsetof(struct ctdb_tunable_list, allow_mixed_versions) },
+	{ "RecoverParallelDBs", 0, false,
+		offsetof(struct ctdb_tunable_list, recover_parallel_dbs) },
 	{ .obsolete = true, }
 };
 
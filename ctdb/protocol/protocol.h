@@ -673,6 +673,7 @@ struct ctdb_tunable_list {
 	uint32_t queue_buffer_size;
 	uint32_t ip_alloc_algorithm;
 	uint32_t allow_mixed_versions;
+	uint32_t recover_parallel_dbs;
 };
 
 struct ctdb_tickle_list {
@@ -2696,7 +2696,8 @@ size_t ctdb_tunable_list_len(struct ctdb_tunable_list *in)
 		ctdb_uint32_len(&in->rec_buffer_size_limit) +
 		ctdb_uint32_len(&in->queue_buffer_size) +
 		ctdb_uint32_len(&in->ip_alloc_algorithm) +
-		ctdb_uint32_len(&in->allow_mixed_versions);
+		ctdb_uint32_len(&in->allow_mixed_versions) +
+		ctdb_uint32_len(&in->recover_parallel_dbs);
 }
 
 void ctdb_tunable_list_push(struct ctdb_tunable_list *in, uint8_t *buf,
@@ -2890,6 +2891,9 @@ void ctdb_tunable_list_push(struct ctdb_tunable_list *in, uint8_t *buf,
 	ctdb_uint32_push(&in->allow_mixed_versions, buf+offset, &np);
 	offset += np;
 
+	ctdb_uint32_push(&in->recover_parallel_dbs, buf+offset, &np);
+	offset += np;
+
 	*npush = offset;
 }
 
@@ -3335,6 +3339,13 @@ static int ctdb_tunable_list_pull_elems(uint8_t *buf, size_t buflen,
 	}
 	offset += np;
 
+	ret = ctdb_uint32_pull(buf+offset, buflen-offset,
+			       &out->recover_parallel_dbs, &np);
+	if (ret != 0) {
+		return ret;
+	}
+	offset += np;
+
 	*npull = offset;
 	return 0;
 }
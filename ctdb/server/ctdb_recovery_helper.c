@@ -506,11 +506,6 @@ static const char *recdb_name(struct recdb_context *recdb)
 	return recdb->db_name;
 }
 
-static const char *recdb_path(struct recdb_context *recdb)
-{
-	return recdb->db_path;
-}
-
 static struct tdb_context *recdb_tdb(struct recdb_context *recdb)
 {
 	return recdb->db->tdb;
@@ -610,98 +605,64 @@ static int recbuf_filter_add(struct ctdb_rec_buffer *recbuf, bool persistent,
 	return 0;
 }
 
-struct recdb_file_traverse_state {
+/*
+ * Fill a record buffer with the records from recdb starting at *pkey,
+ * until the buffer exceeds max_size.  *pkey is advanced to the first
+ * record not added yet and set to tdb_null after the last record.
+ *
+ * This allows pushing recdb one buffer at a time without writing
+ * out a second copy of it first.
+ */
+static int recdb_next_buffer(struct recdb_context *recdb,
+			     TALLOC_CTX *mem_ctx,
+			     uint32_t dmaster,
+			     size_t max_size,
+			     TDB_DATA *pkey,
+			     struct ctdb_rec_buffer **out)
+{
+	struct tdb_context *tdb = recdb_tdb(recdb);
 	struct ctdb_rec_buffer *recbuf;
-	struct recdb_context *recdb;
-	TALLOC_CTX *mem_ctx;
-	uint32_t dmaster;
-	uint32_t reqid;
-	bool persistent;
-	bool failed;
-	int fd;
-	size_t max_size;
-	unsigned int num_buffers;
-};
-
-static int recdb_file_traverse(struct tdb_context *tdb,
-			       TDB_DATA key, TDB_DATA data,
-			       void *private_data)
-{
-	struct recdb_file_traverse_state *state =
-		(struct recdb_file_traverse_state *)private_data;
+	TDB_DATA key = *pkey;
 	int ret;
 
-	ret = recbuf_filter_add(state->recbuf, state->persistent,
-				state->reqid, state->dmaster, key, data);
-	if (ret != 0) {
-		state->failed = true;
-		return ret;
+	recbuf = ctdb_rec_buffer_init(mem_ctx, recdb_id(recdb));
+	if (recbuf == NULL) {
+		return ENOMEM;
 	}
 
-	if (ctdb_rec_buffer_len(state->recbuf) > state->max_size) {
-		ret = ctdb_rec_buffer_write(state->recbuf, state->fd);
-		if (ret != 0) {
-			D_ERR("Failed to collect recovery records for %s\n",
-			      recdb_name(state->recdb));
-			state->failed = true;
-			return ret;
+	while (key.dptr != NULL) {
+		TDB_DATA data, next;
+
+		data = tdb_fetch(tdb, key);
+		if (data.dptr != NULL) {
+			ret = recbuf_filter_add(recbuf,
+						recdb_persistent(recdb),
+						0,
+						dmaster,
+						key,
+						data);
+			free(data.dptr);
+			if (ret != 0) {
+				*pkey = key;
+				talloc_free(recbuf);
+				return ret;
+			}
 		}
 
-		state->num_buffers += 1;
+		next = tdb_nextkey(tdb, key);
+		free(key.dptr);
+		key = next;
 
-		TALLOC_FREE(state->recbuf);
-		state->recbuf = ctdb_rec_buffer_init(state->mem_ctx,
-						     recdb_id(state->recdb));
-		if (state->recbuf == NULL) {
-			state->failed = true;
-			return ENOMEM;
+		if (ctdb_rec_buffer_len(recbuf) > max_size) {
+			break;
 		}
 	}
 
+	*pkey = key;
+	*out = recbuf;
 	return 0;
 }
 
-static int recdb_file(struct recdb_context *recdb, TALLOC_CTX *mem_ctx,
-		      uint32_t dmaster, int fd, int max_size)
-{
-	struct recdb_file_traverse_state state;
-	int ret;
-
-	state.recbuf = ctdb_rec_buffer_init(mem_ctx, recdb_id(recdb));
-	if (state.recbuf == NULL) {
-		return -1;
-	}
-	state.recdb = recdb;
-	state.mem_ctx = mem_ctx;
-	state.dmaster = dmaster;
-	state.reqid = 0;
-	state.persistent = recdb_persistent(recdb);
-	state.failed = false;
-	state.fd = fd;
-	state.max_size = max_size;
-	state.num_buffers = 0;
-
-	ret = tdb_traverse_read(recdb_tdb(recdb), recdb_file_traverse, &state);
-	if (ret == -1 || state.failed) {
-		TALLOC_FREE(state.recbuf);
-		return -1;
-	}
-
-	ret = ctdb_rec_buffer_write(state.recbuf, fd);
-	if (ret != 0) {
-		D_ERR("Failed to collect recovery records for %s\n",
-		      recdb_name(recdb));
-		TALLOC_FREE(state.recbuf);
-		return -1;
-	}
-	state.num_buffers += 1;
-
-	D_DEBUG("Wrote %d buffers of recovery records for %s\n",
-		state.num_buffers, recdb_name(recdb));
-
-	return state.num_buffers;
-}
-
 /*
  * Pull database from a single node
  */
@@ -918,12 +879,15 @@ struct push_database_state {
 	unsigned int count;
 	uint64_t srvid;
 	uint32_t dmaster;
-	int fd;
-	int num_buffers;
+	size_t max_size;
+	TDB_DATA key;
+	bool recdb_done;
 	int num_buffers_sent;
 	unsigned int num_records;
 };
 
+static void push_database_cleanup(struct tevent_req *req,
+				  enum tevent_req_state req_state);
 static void push_database_started(struct tevent_req *subreq);
 static void push_database_send_msg(struct tevent_req *req);
 static void push_database_send_done(struct tevent_req *subreq);
@@ -942,8 +906,6 @@ static struct tevent_req *push_database_send(
 	struct push_database_state *state;
 	struct ctdb_req_control request;
 	struct ctdb_pulldb_ext pulldb_ext;
-	char *filename;
-	off_t offset;
 
 	req = tevent_req_create(mem_ctx, &state,
 				struct push_database_state);
@@ -951,6 +913,8 @@ static struct tevent_req *push_database_send(
 		return NULL;
 	}
 
+	tevent_req_set_cleanup_fn(req, push_database_cleanup);
+
 	state->ev = ev;
 	state->client = client;
 	state->recdb = recdb;
@@ -959,35 +923,12 @@ static struct tevent_req *push_database_send(
 
 	state->srvid = srvid_next();
 	state->dmaster = ctdb_client_pnn(client);
+	state->max_size = max_size;
+	state->key = tdb_firstkey(recdb_tdb(recdb));
+	state->recdb_done = false;
 	state->num_buffers_sent = 0;
 	state->num_records = 0;
 
-	filename = talloc_asprintf(state, "%s.dat", recdb_path(recdb));
-	if (tevent_req_nomem(filename, req)) {
-		return tevent_req_post(req, ev);
-	}
-
-	state->fd = open(filename, O_RDWR|O_CREAT, 0644);
-	if (state->fd == -1) {
-		tevent_req_error(req, errno);
-		return tevent_req_post(req, ev);
-	}
-	unlink(filename);
-	talloc_free(filename);
-
-	state->num_buffers = recdb_file(recdb, state, state->dmaster,
-					state->fd, max_size);
-	if (state->num_buffers == -1) {
-		tevent_req_error(req, ENOMEM);
-		return tevent_req_post(req, ev);
-	}
-
-	offset = lseek(state->fd, 0, SEEK_SET);
-	if (offset != 0) {
-		tevent_req_error(req, EIO);
-		return tevent_req_post(req, ev);
-	}
-
 	pulldb_ext.db_id = recdb_id(recdb);
 	pulldb_ext.srvid = state->srvid;
 
@@ -1003,6 +944,16 @@ static struct tevent_req *push_database_send(
 	return req;
 }
 
+static void push_database_cleanup(struct tevent_req *req,
+				  enum tevent_req_state req_state)
+{
+	struct push_database_state *state = tevent_req_data(
+		req, struct push_database_state);
+
+	free(state->key.dptr);
+	state->key = tdb_null;
+}
+
 static void push_database_started(struct tevent_req *subreq)
 {
 	struct tevent_req *req = tevent_req_callback_data(
@@ -1052,7 +1003,7 @@ static void push_database_send_msg(struct tevent_req *req)
 	size_t np;
 	int ret;
 
-	if (state->num_buffers_sent == state->num_buffers) {
+	if (state->recdb_done) {
 		struct ctdb_req_control request;
 
 		ctdb_req_control_db_push_confirm(&request,
@@ -1069,11 +1020,24 @@ static void push_database_send_msg(struct tevent_req *req)
 		return;
 	}
 
-	ret = ctdb_rec_buffer_read(state->fd, state, &recbuf);
+	/*
+	 * The last buffer may be empty, it is still sent as before.
+	 */
+	ret = recdb_next_buffer(state->recdb,
+				state,
+				state->dmaster,
+				state->max_size,
+				&state->key,
+				&recbuf);
 	if (ret != 0) {
+		D_ERR("Failed to collect recovery records for %s\n",
+		      recdb_name(state->recdb));
 		tevent_req_error(req, ret);
 		return;
 	}
+	if (state->key.dptr == NULL) {
+		state->recdb_done = true;
+	}
 
 	data.dsize = ctdb_rec_buffer_len(recbuf);
 	data.dptr = talloc_size(state, data.dsize);
@@ -1467,8 +1431,29 @@ struct recover_db_state {
 
 	const char *db_name, *db_path;
 	struct recdb_context *recdb;
+
+	struct timeval start;
+	struct timeval phase_start;
+	struct {
+		double setup;
+		double freeze;
+		double collect;
+		double wipe;
+		double push;
+		double commit;
+		double thaw;
+	} timing;
 };
 
+static double recover_db_phase_end(struct recover_db_state *state)
+{
+	struct timeval now = timeval_current();
+	double elapsed = timeval_elapsed2(&state->phase_start, &now);
+
+	state->phase_start = now;
+	return elapsed;
+}
+
 static void recover_db_name_done(struct tevent_req *subreq);
 static void recover_db_create_missing_done(struct tevent_req *subreq);
 static void recover_db_path_done(struct tevent_req *subreq);
@@ -1503,6 +1488,9 @@ static struct tevent_req *recover_db_send(TALLOC_CTX *mem_ctx,
 	state->nlist = nlist;
 	state->db = db;
 
+	state->start = timeval_current();
+	state->phase_start = state->start;
+
 	state->destnode = ctdb_client_pnn(client);
 	state->transdb.db_id = db->db_id;
 	state->transdb.tid = generation;
@@ -1672,6 +1660,8 @@ static void recover_db_path_done(struct tevent_req *subreq)
 
 	talloc_free(reply);
 
+	state->timing.setup = recover_db_phase_end(state);
+
 	ctdb_req_control_db_freeze(&request, state->db->db_id);
 	subreq = ctdb_client_control_multi_send(state,
 						state->ev,
@@ -1770,6 +1760,8 @@ static void recover_db_transaction_started(struct tevent_req *subreq)
 		return;
 	}
 
+	state->timing.freeze = recover_db_phase_end(state);
+
 	flags = state->db->db_flags;
 	state->recdb = recdb_create(state,
 				    state->db->db_id,
@@ -1825,6 +1817,8 @@ static void recover_db_collect_done(struct tevent_req *subreq)
 		return;
 	}
 
+	state->timing.collect = recover_db_phase_end(state);
+
 	ctdb_req_control_wipe_database(&request, &state->transdb);
 	subreq = ctdb_client_control_multi_send(state,
 						state->ev,
@@ -1871,6 +1865,8 @@ static void recover_db_wipedb_done(struct tevent_req *subreq)
 		return;
 	}
 
+	state->timing.wipe = recover_db_phase_end(state);
+
 	subreq = push_database_send(state,
 				    state->ev,
 				    state->client,
@@ -1903,6 +1899,8 @@ static void recover_db_pushdb_done(struct tevent_req *subreq)
 
 	TALLOC_FREE(state->recdb);
 
+	state->timing.push = recover_db_phase_end(state);
+
 	ctdb_req_control_db_transaction_commit(&request, &state->transdb);
 	subreq = ctdb_client_control_multi_send(state,
 						state->ev,
@@ -1951,6 +1949,8 @@ static void recover_db_transaction_committed(struct tevent_req *subreq)
 		return;
 	}
 
+	state->timing.commit = recover_db_phase_end(state);
+
 	ctdb_req_control_db_thaw(&request, state->db->db_id);
 	subreq = ctdb_client_control_multi_send(state,
 						state->ev,
@@ -1997,6 +1997,21 @@ static void recover_db_thaw_done(struct tevent_req *subreq)
 		return;
 	}
 
+	state->timing.thaw = recover_db_phase_end(state);
+
+	D_NOTICE("recovered db %s in %.3lf seconds"
+		 " (setup %.3lf, freeze %.3lf, collect %.3lf, wipe %.3lf,"
+		 " push %.3lf, commit %.3lf, thaw %.3lf)\n",
+		 state->db_name,
+		 timeval_elapsed2(&state->start, &state->phase_start),
+		 state->timing.setup,
+		 state->timing.freeze,
+		 state->timing.collect,
+		 state->timing.wipe,
+		 state->timing.push,
+		 state->timing.commit,
+		 state->timing.thaw);
+
 	tevent_req_done(req);
 }
 
@@ -2009,12 +2024,20 @@ static bool recover_db_recv(struct tevent_req *req)
 /*
  * Start database recovery for each database
  *
+ * At most RecoverParallelDBs databases are recovered at the same
+ * time, 0 means no limit.
+ *
  * Try to recover each database 5 times before failing recovery.
  */
 
 struct db_recovery_state {
 	struct tevent_context *ev;
+	struct ctdb_client_context *client;
 	struct db_list *dblist;
+	struct ctdb_tunable_list *tun_list;
+	struct node_list *nlist;
+	uint32_t generation;
+	struct db *next_db;
 	unsigned int num_replies;
 	unsigned int num_failed;
 };
@@ -2030,6 +2053,7 @@ struct db_recovery_one_state {
 	int num_fails;
 };
 
+static bool db_recovery_start_next(struct tevent_req *req);
 static void db_recovery_one_done(struct tevent_req *subreq);
 
 static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
@@ -2040,9 +2064,9 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 					   struct node_list *nlist,
 					   uint32_t generation)
 {
-	struct tevent_req *req, *subreq;
+	struct tevent_req *req;
 	struct db_recovery_state *state;
-	struct db *db;
+	unsigned int i, num_parallel;
 
 	req = tevent_req_create(mem_ctx, &state, struct db_recovery_state);
 	if (req == NULL) {
@@ -2050,7 +2074,12 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 	}
 
 	state->ev = ev;
+	state->client = client;
 	state->dblist = dblist;
+	state->tun_list = tun_list;
+	state->nlist = nlist;
+	state->generation = generation;
+	state->next_db = dblist->db;
 	state->num_replies = 0;
 	state->num_failed = 0;
 
@@ -2059,38 +2088,60 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
-	for (db = dblist->db; db != NULL; db = db->next) {
-		struct db_recovery_one_state *substate;
+	num_parallel = tun_list->recover_parallel_dbs;
+	if (num_parallel == 0 || num_parallel > dblist->num_dbs) {
+		num_parallel = dblist->num_dbs;
+	}
 
-		substate = talloc_zero(state, struct db_recovery_one_state);
-		if (tevent_req_nomem(substate, req)) {
+	for (i = 0; i < num_parallel; i++) {
+		if (! db_recovery_start_next(req)) {
 			return tevent_req_post(req, ev);
 		}
+	}
 
-		substate->req = req;
-		substate->client = client;
-		substate->dblist = dblist;
-		substate->tun_list = tun_list;
-		substate->nlist = nlist;
-		substate->generation = generation;
-		substate->db = db;
+	return req;
+}
 
-		subreq = recover_db_send(state,
-					 ev,
-					 client,
-					 tun_list,
-					 nlist,
-					 generation,
-					 substate->db);
-		if (tevent_req_nomem(subreq, req)) {
-			return tevent_req_post(req, ev);
-		}
-		tevent_req_set_callback(subreq, db_recovery_one_done,
-					substate);
-		D_NOTICE("recover database 0x%08x\n", substate->db->db_id);
+static bool db_recovery_start_next(struct tevent_req *req)
+{
+	struct db_recovery_state *state = tevent_req_data(
+		req, struct db_recovery_state);
+	struct db_recovery_one_state *substate;
+	struct tevent_req *subreq;
+
+	if (state->next_db == NULL) {
+		return true;
 	}
 
-	return req;
+	substate = talloc_zero(state, struct db_recovery_one_state);
+	if (tevent_req_nomem(substate, req)) {
+		return false;
+	}
+
+	substate->req = req;
+	substate->client = state->client;
+	substate->dblist = state->dblist;
+	substate->tun_list = state->tun_list;
+	substate->nlist = state->nlist;
+	substate->generation = state->generation;
+	substate->db = state->next_db;
+
+	state->next_db = state->next_db->next;
+
+	subreq = recover_db_send(state,
+				 state->ev,
+				 substate->client,
+				 substate->tun_list,
+				 substate->nlist,
+				 substate->generation,
+				 substate->db);
+	if (tevent_req_nomem(subreq, req)) {
+		return false;
+	}
+	tevent_req_set_callback(subreq, db_recovery_one_done, substate);
+	D_NOTICE("recover database 0x%08x\n", substate->db->db_id);
+
+	return true;
 }
 
 static void db_recovery_one_done(struct tevent_req *subreq)
@@ -2136,7 +2187,10 @@ done:
 
 	if (state->num_replies == state->dblist->num_dbs) {
 		tevent_req_done(req);
+		return;
 	}
+
+	db_recovery_start_next(req);
 }
 
 static bool db_recovery_recv(struct tevent_req *req, unsigned int *count)
@@ -2384,6 +2438,8 @@ struct recovery_state {
 	struct ctdb_tunable_list *tun_list;
 	struct ctdb_vnn_map *vnnmap;
 	struct db_list *dblist;
+	struct timeval start;
+	struct timeval db_recovery_start;
 };
 
 static void recovery_tunables_done(struct tevent_req *subreq);
@@ -2417,6 +2473,7 @@ static struct tevent_req *recovery_send(TALLOC_CTX *mem_ctx,
 	state->client = client;
 	state->generation = generation;
 	state->destnode = ctdb_client_pnn(client);
+	state->start = timeval_current();
 
 	ctdb_req_control_get_all_tunables(&request);
 	subreq = ctdb_client_control_send(state, state->ev, state->client,
@@ -2943,6 +3000,8 @@ static void recovery_vnnmap_update_done(struct tevent_req *subreq)
 
 	D_NOTICE("updated VNNMAP\n");
 
+	state->db_recovery_start = timeval_current();
+
 	subreq = db_recovery_send(state,
 				  state->ev,
 				  state->client,
@@ -2969,7 +3028,10 @@ static void recovery_db_recovery_done(struct tevent_req *subreq)
 	status = db_recovery_recv(subreq, &count);
 	TALLOC_FREE(subreq);
 
-	D_ERR("%d of %d databases recovered\n", count, state->dblist->num_dbs);
+	D_ERR("%d of %d databases recovered in %.3lf seconds\n",
+	      count,
+	      state->dblist->num_dbs,
+	      timeval_elapsed(&state->db_recovery_start));
 
 	if (! status) {
 		subreq = ban_node_send(state,
@@ -3095,6 +3157,8 @@ static void recovery_end_recovery_done(struct tevent_req *subreq)
 	}
 
 	D_ERR("recovered event finished\n");
+	D_NOTICE("recovery took %.3lf seconds\n",
+		 timeval_elapsed(&state->start));
 
 	tevent_req_done(req);
 }
@@ -0,0 +1,119 @@
+#!/usr/bin/env bash
+
+# Test recovery of several databases, one at a time, with records
+# larger than RecBufferSizeLimit
+
+# With RecoverParallelDBs=1 the recovery helper has to start the next
+# database whenever one is done.  With every record larger than
+# RecBufferSizeLimit each pushed buffer contains a single record, so
+# the push has to be resumed from the recovery database many times.
+
+. "${TEST_SCRIPTS_DIR}/integration.bash"
+
+set -e
+
+ctdb_test_init
+
+#
+# Main test
+#
+VOLATILE_DBS="parallel_volatile1.tdb parallel_volatile2.tdb parallel_volatile3.tdb"
+PERSISTENT_DBS="parallel_persistent1.tdb parallel_persistent2.tdb"
+NUM_RECORDS=40
+
+ctdb_get_all_pnns
+# shellcheck disable=SC2154
+# $all_pnns is set above by ctdb_get_all_pnns()
+num_nodes=$(echo "$all_pnns" | wc -w | tr -d '[:space:]')
+
+# 600 bytes, record_value() adds a unique prefix
+v1="1234567890"
+v2="$v1$v1$v1$v1$v1$v1$v1$v1$v1$v1"
+v3="$v2$v2$v2$v2$v2$v2"
+
+record_value ()
+{
+	_db="$1"
+	_i="$2"
+
+	echo "${_db}_${_i}_${v3}"
+}
+
+for db in $VOLATILE_DBS ; do
+	echo "create volatile test database $db"
+	try_command_on_node 0 $CTDB attach "$db"
+	try_command_on_node 0 $CTDB wipedb "$db"
+
+	# Spread the records over all nodes
+	echo "Adding $NUM_RECORDS records to $db"
+	for i in $(seq 1 $NUM_RECORDS) ; do
+		pnn=$((i % num_nodes))
+		try_command_on_node $pnn $CTDB writekey "$db" "record$i" \
+				    "$(record_value "$db" "$i")"
+	done
+done
+
+for db in $PERSISTENT_DBS ; do
+	echo "create persistent test database $db"
+	try_command_on_node 0 $CTDB attach "$db" persistent
+	try_command_on_node 0 $CTDB wipedb "$db"
+
+	echo "Adding $NUM_RECORDS records to $db"
+	for i in $(seq 1 $NUM_RECORDS) ; do
+		try_command_on_node 0 $CTDB pstore "$db" "record$i" \
+				    "$(record_value "$db" "$i")"
+	done
+done
+
+echo
+echo "Recover one database at a time, one record per buffer"
+try_command_on_node all $CTDB setvar RecoverParallelDBs 1
+try_command_on_node all $CTDB setvar RecBufferSizeLimit 500
+
+echo "force recovery"
+try_command_on_node 0 $CTDB recover
+
+wait_until_node_has_status 0 recovered 30
+
+check_records ()
+{
+	_pnn="$1"
+	_db="$2"
+
+	num_records=$(db_ctdb_cattdb_count_records "$_pnn" "$_db")
+	if [ "$num_records" != "$NUM_RECORDS" ] ; then
+		echo "BAD: $_db has $num_records of $NUM_RECORDS records on node $_pnn"
+		exit 1
+	fi
+}
+
+for db in $VOLATILE_DBS ; do
+	for pnn in $all_pnns ; do
+		check_records "$pnn" "$db"
+	done
+
+	for i in $(seq 1 $NUM_RECORDS) ; do
+		value=$(record_value "$db" "$i")
+		ctdb_onnode 1 readkey "$db" "record$i"
+		if [ "$out" != "Data: size:${#value} ptr:[${value}]" ] ; then
+			echo "BAD: record$i in $db has wrong data: $out"
+			exit 1
+		fi
+	done
+	echo "OK: volatile database $db recovered correctly"
+done
+
+for db in $PERSISTENT_DBS ; do
+	for pnn in $all_pnns ; do
+		check_records "$pnn" "$db"
+	done
+
+	for i in $(seq 1 $NUM_RECORDS) ; do
+		ctdb_onnode 1 pfetch "$db" "record$i"
+		if [ "$out" != "$(record_value "$db" "$i")" ] ; then
+			echo "BAD: record$i in $db has wrong data: $out"
+			exit 1
+		fi
+	done
+	echo "OK: persistent database $db recovered correctly"
+done
@@ -60,6 +60,7 @@ RecBufferSizeLimit=1000000
 QueueBufferSize=1024
 IPAllocAlgorithm=2
 AllowMixedVersions=0
+RecoverParallelDBs=0
 "
 
 ok_tunable_defaults ()
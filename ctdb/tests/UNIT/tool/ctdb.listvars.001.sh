@@ -61,6 +61,7 @@ RecBufferSizeLimit         = 1000000
 QueueBufferSize            = 1024
 IPAllocAlgorithm           = 2
 AllowMixedVersions         = 0
+RecoverParallelDBs         = 0
 EOF
 
 simple_test
@@ -669,6 +669,7 @@ void fill_ctdb_tunable_list(TALLOC_CTX *mem_ctx, struct ctdb_tunable_list *p)
 	p->queue_buffer_size = rand32();
 	p->ip_alloc_algorithm = rand32();
 	p->allow_mixed_versions = rand32();
+	p->recover_parallel_dbs = rand32();
 }
 
 void verify_ctdb_tunable_list(struct ctdb_tunable_list *p1,
@@ -736,6 +737,7 @@ void verify_ctdb_tunable_list(struct ctdb_tunable_list *p1,
 	assert(p1->queue_buffer_size == p2->queue_buffer_size);
 	assert(p1->ip_alloc_algorithm == p2->ip_alloc_algorithm);
 	assert(p1->allow_mixed_versions == p2->allow_mixed_versions);
+	assert(p1->recover_parallel_dbs == p2->recover_parallel_dbs);
 }
 
 void fill_ctdb_tickle_list(TALLOC_CTX *mem_ctx, struct ctdb_tickle_list *p)
@@ -32,6 +32,10 @@
 #include "lib/util/byteorder.h"
 #include "lib/util/bytearray.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /*
  * DEBUG_NO_LZ77_MATCHES toggles the encoding of matches as matches. If it is
  * false the potential match is written as a series of literals, which is a
@@ -70,6 +74,15 @@
 #define MAX_MATCH_LENGTH (64 * 1024 * 1024)
 
 
+/*
+ * Codes of up to LZX_HUFF_FAST_BITS bits are resolved with a single lookup in
+ * bitstream.fast_table, longer ones walk bitstream.table bit by bit. Most
+ * codes in most blocks are short, because that is the point of Huffman
+ * coding.
+ */
+#define LZX_HUFF_FAST_BITS 10
+#define LZX_HUFF_FAST_MASK ((1 << LZX_HUFF_FAST_BITS) - 1)
+
 struct bitstream {
 	const uint8_t *bytes;
 	size_t byte_pos;
@@ -77,6 +90,8 @@ struct bitstream {
 	uint32_t bits;
 	int remaining_bits;
 	uint16_t *table;
+	/* (code length << 9) | symbol, or 0 for longer codes */
+	uint16_t fast_table[1 << LZX_HUFF_FAST_BITS];
 };
 
 
@@ -632,45 +647,46 @@ static int generate_huffman_codes(struct huffman_node *leaf_nodes,
  */
 #define LZX_HUFF_COMP_HASH_SEARCH_ATTEMPTS 5
 
-static inline void store_match(uint16_t *hash_table,
-			       uint16_t h,
-			       uint16_t offset)
+/*
+ * match_length() counts the number of leading bytes two buffers have in
+ * common, up to max_len.
+ *
+ * This is where most of the time in the LZ77 stage goes, so we compare
+ * 16 bytes at a time with SSE2 (which every x86-64 CPU has), or 8 bytes at a
+ * time on other little-endian machines, before falling back to single bytes.
+ * The buffers may overlap; we only ever read from them.
+ */
+static inline size_t match_length(const uint8_t *here,
+				  const uint8_t *there,
+				  size_t max_len)
 {
-	int i;
-	uint16_t o = hash_table[h];
-	uint16_t h2;
-	uint16_t worst_h;
-	int worst_score;
-
-	if (o == 0xffff) {
-		/* there is nothing there yet */
-		hash_table[h] = offset;
-		return;
-	}
-	for (i = 1; i < LZX_HUFF_COMP_HASH_SEARCH_ATTEMPTS; i++) {
-		h2 = (h + i) & HASH_MASK;
-		if (hash_table[h2] == 0xffff) {
-			hash_table[h2] = offset;
-			return;
+	size_t len = 0;
+
+#if defined(__SSE2__) && __has_builtin(__builtin_ctz)
+	while (len + 16 <= max_len) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(here + len));
+		__m128i b = _mm_loadu_si128((const __m128i *)(there + len));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+		if (mask != 0xffff) {
+			return len + __builtin_ctz(~mask);
 		}
-	}
-	/*
-	 * There are no slots, but we really want to store this, so we'll kick
-	 * out the one with the longest distance.
-	 */
-	worst_h = h;
-	worst_score = offset - o;
-	for (i = 1; i < LZX_HUFF_COMP_HASH_SEARCH_ATTEMPTS; i++) {
-		int score;
-		h2 = (h + i) & HASH_MASK;
-		o = hash_table[h2];
-		score = offset - o;
-		if (score > worst_score) {
-			worst_score = score;
-			worst_h = h2;
+		len += 16;
+	}
+#elif defined(HAVE_LITTLE_ENDIAN) && __has_builtin(__builtin_ctzll)
+	while (len + 8 <= max_len) {
+		uint64_t a, b;
+		memcpy(&a, here + len, 8);
+		memcpy(&b, there + len, 8);
+		if (a != b) {
+			return len + __builtin_ctzll(a ^ b) / 8;
 		}
+		len += 8;
 	}
-	hash_table[worst_h] = offset;
+#endif
+	while (len < max_len && here[len] == there[len]) {
+		len++;
+	}
+	return len;
 }
 
 
@@ -683,20 +699,31 @@ struct match {
 };
 
 
+/*
+ * lookup_match() looks for the best match in the hash table. If store is
+ * true, it also stores the offset of the current position in the table: in
+ * the first empty slot if there is one, otherwise in place of the entry with
+ * the longest distance. Doing both in one walk saves walking the table twice.
+ */
 static inline struct match lookup_match(uint16_t *hash_table,
 					uint16_t h,
 					const uint8_t *data,
 					const uint8_t *here,
-					size_t max_len)
+					size_t max_len,
+					bool store,
+					uint16_t offset)
 {
 	int i;
 	uint16_t o = hash_table[h];
 	uint16_t h2;
+	uint16_t worst_h = h;
+	int worst_score = 0;
 	size_t len;
 	const uint8_t *there = NULL;
 	struct match best = {0};
 
 	for (i = 0; i < LZX_HUFF_COMP_HASH_SEARCH_ATTEMPTS; i++) {
+		int score;
 		h2 = (h + i) & HASH_MASK;
 		o = hash_table[h2];
 		if (o == 0xffff) {
@@ -704,8 +731,17 @@ static inline struct match lookup_match(uint16_t *hash_table,
 			 * in setting this, we would never have stepped over
 			 * an 0xffff, so we won't now.
 			 */
+			if (store) {
+				hash_table[h2] = offset;
+				store = false;
+			}
 			break;
 		}
+		score = offset - o;
+		if (i == 0 || score > worst_score) {
+			worst_score = score;
+			worst_h = h2;
+		}
 		there = data + o;
 		if (here - there > 65534 || there > here) {
 			continue;
@@ -720,11 +756,7 @@ static inline struct match lookup_match(uint16_t *hash_table,
 			continue;
 		}
 
-		for (len = 0;
-		     len < max_len && here[len] == there[len];
-		     len++) {
-			/* counting */
-		}
+		len = match_length(here, there, max_len);
 		if (len > 2) {
 			/*
 			 * As a tiebreaker, we prefer the closer match which
@@ -737,6 +769,13 @@ static inline struct match lookup_match(uint16_t *hash_table,
 			}
 		}
 	}
+	if (store) {
+		/*
+		 * There are no slots, but we really want to store this, so
+		 * we'll kick out the one with the longest distance.
+		 */
+		hash_table[worst_h] = offset;
+	}
 	return best;
 }
 
@@ -806,7 +845,9 @@ static ssize_t lz77_encode_block(struct lzxhuff_compressor_context *cmp_ctx,
 					     h,
 					     data,
 					     here,
-					     max_len);
+					     max_len,
+					     true,
+					     i);
 
 			if (match.there == NULL && prev_hash_table != NULL) {
 				/*
@@ -820,11 +861,11 @@ static ssize_t lz77_encode_block(struct lzxhuff_compressor_context *cmp_ctx,
 						     h,
 						     prev_block,
 						     here,
-						     remaining_size - i);
+						     remaining_size - i,
+						     false,
+						     0);
 			}
 
-			store_match(hash_table, h, i);
-
 			if (match.there == NULL) {
 				/* add a literal and move on. */
 				uint8_t c = data[i];
@@ -1592,6 +1633,7 @@ static bool fill_decomp_table(struct bitstream *input)
 		/* prefill the table head */
 		input->table[i] = 0xffff;
 	}
+	memset(input->fast_table, 0, sizeof(input->fast_table));
 	code = -1;
 	prev_len = 0;
 	for (i = 0; i < n_symbols; i++) {
@@ -1609,12 +1651,35 @@ static bool fill_decomp_table(struct bitstream *input)
 		if (code >= 65535) {
 			return false;
 		}
+		if (code >= (1 << (len + 1)) - 1) {
+			/*
+			 * There are more codes of this length than there is
+			 * room for. The check for the last code below would
+			 * catch this, but we don't want to write outside the
+			 * fast table in the meantime.
+			 */
+			return false;
+		}
 		input->table[code] = s;
 		for(prefix = (code - 1) >> 1;
 		    prefix > 31;
 		    prefix = (prefix - 1) >> 1) {
 			input->table[prefix] = 0xffff;
 		}
+
+		if (len <= LZX_HUFF_FAST_BITS) {
+			/*
+			 * Every LZX_HUFF_FAST_BITS wide bit pattern that
+			 * starts with this code resolves to this symbol.
+			 */
+			size_t value = code - ((1 << len) - 1);
+			size_t shift = LZX_HUFF_FAST_BITS - len;
+			size_t j;
+			for (j = 0; j < (1 << shift); j++) {
+				input->fast_table[(value << shift) + j] =
+					(len << 9) | s;
+			}
+		}
 	}
 	if (CHECK_DEBUGLVL(10)) {
 		debug_tree_codes(input);
@@ -1681,6 +1746,93 @@ static inline ssize_t pull_bits(struct bitstream *input)
 }
 
 
+/*
+ * read_bits() consumes n bits (at most 16) and returns their value.
+ *
+ * The 16 bit words are pulled in exactly where the bit-at-a-time reading
+ * described in MS-XCA would pull them in, which matters because the extra
+ * match length bytes are read from the same stream in between.
+ */
+static inline ssize_t read_bits(struct bitstream *input,
+				int n,
+				uint32_t *value)
+{
+	uint32_t v = 0;
+
+	while (n > 0) {
+		int take;
+		if (input->remaining_bits == 16) {
+			ssize_t ret = pull_bits(input);
+			if (ret) {
+				return ret;
+			}
+		}
+		take = MIN(n, input->remaining_bits - 16);
+		input->remaining_bits -= take;
+		v <<= take;
+		v |= (input->bits >> input->remaining_bits) & ((1U << take) - 1);
+		n -= take;
+	}
+	*value = v;
+	return 0;
+}
+
+
+/*
+ * read_symbol() decodes the next Huffman code.
+ */
+static inline ssize_t read_symbol(struct bitstream *input, uint16_t *symbol)
+{
+	uint32_t peek;
+	uint16_t entry;
+	size_t index;
+	ssize_t ret;
+
+	if (input->remaining_bits == 16) {
+		ret = pull_bits(input);
+		if (ret) {
+			return ret;
+		}
+	}
+
+	/*
+	 * There are always more than 16 bits in the buffer at this point, so
+	 * we can look at the next LZX_HUFF_FAST_BITS without consuming them.
+	 */
+	peek = input->bits >> (input->remaining_bits - LZX_HUFF_FAST_BITS);
+	peek &= LZX_HUFF_FAST_MASK;
+	entry = input->fast_table[peek];
+	if (entry != 0) {
+		*symbol = entry & 511;
+		return read_bits(input, entry >> 9, &peek);
+	}
+
+	/*
+	 * A long code. The first LZX_HUFF_FAST_BITS are a prefix, and the
+	 * rest is walked in the implicit tree (see fill_decomp_table()).
+	 */
+	ret = read_bits(input, LZX_HUFF_FAST_BITS, &peek);
+	if (ret) {
+		return ret;
+	}
+	index = (1 << LZX_HUFF_FAST_BITS) - 1 + peek;
+	do {
+		uint32_t b;
+		ret = read_bits(input, 1, &b);
+		if (ret) {
+			return ret;
+		}
+		index = (index << 1) + b + 1;
+		if (index >= 65535) {
+			return LZXPRESS_ERROR;
+		}
+	} while (input->table[index] == 0xffff);
+
+	*symbol = input->table[index] & 511;
+	return 0;
+}
+
+
 /*
  * Decompress a block. The actual decompressed size is returned (or -1 on
  * error). The putative block length is 64k (or shorter, if the message ends
@@ -1700,10 +1852,7 @@ static ssize_t lzx_huffman_decompress_block(struct bitstream *input,
 {
 	size_t output_pos = 0;
 	uint16_t symbol;
-	size_t index;
-	uint16_t distance_bits_wanted = 0;
-	size_t distance = 0;
-	size_t length = 0;
+	size_t index = 0;
 	bool ok;
 	uint32_t tmp;
 	bool seen_eof_marker = false;
@@ -1724,19 +1873,9 @@ static ssize_t lzx_huffman_decompress_block(struct bitstream *input,
 	input->remaining_bits = 32;
 
 	/*
-	 * This loop iterates over individual *bits*. These are read from
-	 * little-endian 16 bit words, most significant bit first.
-	 *
-	 * At points in the bitstream, the following are possible:
-	 *
-	 * # the source word is empty and needs to be refilled from the input
-	 *    stream.
-	 * # an incomplete codeword is being extended.
-	 * # a codeword is resolved, either as a literal or a match.
-	 * # a literal is written.
-	 * # a match is collecting distance bits.
-	 * # the output stream is copied, as specified by a match.
-	 * # input bytes are read for match lengths.
+	 * This loop iterates over symbols. Each is either a literal, or the
+	 * start of a match, which is followed by some extra length bytes from
+	 * the input stream and some distance bits from the bitstream.
 	 *
 	 * Note that we *don't* specifically check for the EOF marker (symbol
 	 * 256) in this loop, because the precondition for stopping for the
@@ -1745,93 +1884,79 @@ static ssize_t lzx_huffman_decompress_block(struct bitstream *input,
 	 * we *always* want to stop when the buffer is full. So we work out if
 	 * there is an EOF in another loop after we stop writing.
 	 */
-
-	index = 0;
 	while (output_pos < block_size) {
-		uint16_t b;
-		if (input->remaining_bits == 16) {
-			ssize_t ret = pull_bits(input);
-			if (ret) {
-				return ret;
-			}
-		}
-		input->remaining_bits--;
+		uint16_t distance_bits_wanted;
+		size_t distance;
+		size_t length;
+		size_t end;
+		uint8_t *here = NULL;
+		uint8_t *there = NULL;
+		ssize_t ret;
 
-		b = (input->bits >> input->remaining_bits) & 1;
-		if (length == 0) {
-			/* not in a match; pulling a codeword */
-			index <<= 1;
-			index += b + 1;
-			if (input->table[index] == 0xffff) {
-				/* incomplete codeword, the common case */
-				continue;
-			}
-			/* found the symbol, reset the code string */
-			symbol = input->table[index] & 511;
-			index = 0;
-			if (symbol < 256) {
-				/* a literal, the easy case */
-				output[output_pos] = symbol;
-				output_pos++;
-				continue;
-			}
+		ret = read_symbol(input, &symbol);
+		if (ret) {
+			return ret;
+		}
+		if (symbol < 256) {
+			/* a literal, the easy case */
+			output[output_pos] = symbol;
+			output_pos++;
+			continue;
+		}
 
-			/* the beginning of a match */
-			distance_bits_wanted = (symbol >> 4) & 15;
-			distance = 1 << distance_bits_wanted;
-			length = symbol & 15;
-			if (length == 15) {
-				CHECK_READ_8(tmp);
-				length += tmp;
-				if (length == 255 + 15) {
-					/*
-					 * note, we discard (don't add) the
-					 * length so far.
-					 */
-					CHECK_READ_16(length);
-					if (length == 0) {
-						CHECK_READ_32(length);
-					}
+		/* the beginning of a match */
+		distance_bits_wanted = (symbol >> 4) & 15;
+		length = symbol & 15;
+		if (length == 15) {
+			CHECK_READ_8(tmp);
+			length += tmp;
+			if (length == 255 + 15) {
+				/*
+				 * note, we discard (don't add) the
+				 * length so far.
+				 */
+				CHECK_READ_16(length);
+				if (length == 0) {
+					CHECK_READ_32(length);
 				}
 			}
-			length += 3;
-		} else {
-			/* we are pulling extra distance bits */
-			distance_bits_wanted--;
-			distance |= b << distance_bits_wanted;
 		}
+		length += 3;
+
+		ret = read_bits(input, distance_bits_wanted, &tmp);
+		if (ret) {
+			return ret;
+		}
+		distance = (1 << distance_bits_wanted) | tmp;
 
-		if (distance_bits_wanted == 0) {
+		/*
+		 * It is possible that this match will extend beyond the end
+		 * of the expected block. That's fine, so long as it doesn't
+		 * extend past the total output size.
+		 */
+		end = output_pos + length;
+		here = output + output_pos;
+		there = here - distance;
+		if (end > output_size ||
+		    previous_size + output_pos < distance ||
+		    unlikely(end < output_pos || there > here)) {
+			return LZXPRESS_ERROR;
+		}
+		if (distance >= length) {
+			memcpy(here, there, length);
+		} else if (distance == 1) {
+			memset(here, *there, length);
+		} else {
 			/*
-			 * We have a complete match, and it is time to do the
-			 * copy (byte by byte, because the ranges can overlap,
-			 * and we might need to copy bytes we just copied in).
-			 *
-			 * It is possible that this match will extend beyond
-			 * the end of the expected block. That's fine, so long
-			 * as it doesn't extend past the total output size.
+			 * The ranges overlap, and we might need to copy
+			 * bytes we just copied in.
 			 */
 			size_t i;
-			size_t end = output_pos + length;
-			uint8_t *here = output + output_pos;
-			uint8_t *there = here - distance;
-			if (end > output_size ||
-			    previous_size + output_pos < distance ||
-			    unlikely(end < output_pos || there > here)) {
-				return LZXPRESS_ERROR;
-			}
 			for (i = 0; i < length; i++) {
 				here[i] = there[i];
 			}
-			output_pos += length;
-			distance = 0;
-			length = 0;
 		}
-	}
-
-	if (length != 0 || index != 0) {
-		/* it seems like we've hit an early end, mid-code */
-		return LZXPRESS_ERROR;
+		output_pos += length;
 	}
 
 	if (input->byte_pos + 256 < input->byte_size) {
@@ -0,0 +1,257 @@
+/*
+ * Samba compression library - LGPLv3
+ *
+ * Copyright © Samba Team 2024
+ *
+ *  ** NOTE! The following LGPL license applies to this file.
+ *  ** It does NOT imply that all of Samba is released under the LGPL
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * bench_lzx_huffman compresses and decompresses a corpus of files with
+ * LZ77+Huffman and reports the throughput in MB/s (of uncompressed data).
+ *
+ * Usage: bench_lzx_huffman [-n ITERATIONS] [FILE|DIRECTORY ...]
+ *
+ * The default corpus is testdata/compression/decompressed plus COPYING,
+ * relative to the top of the source tree.
+ */
+
+#include "replace.h"
+#include <talloc.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "lzxpress_huffman.h"
+
+struct corpus {
+	size_t n_files;
+	uint8_t **data;
+	size_t *sizes;
+	size_t total;
+};
+
+static bool corpus_add_file(struct corpus *c, const char *path)
+{
+	FILE *fh = NULL;
+	struct stat s;
+	uint8_t *buf = NULL;
+	size_t n;
+	int ret;
+
+	ret = stat(path, &s);
+	if (ret != 0 || !S_ISREG(s.st_mode) || s.st_size == 0) {
+		return true;
+	}
+
+	fh = fopen(path, "rb");
+	if (fh == NULL) {
+		fprintf(stderr, "could not open %s: %s\n",
+			path, strerror(errno));
+		return false;
+	}
+
+	buf = talloc_array(c, uint8_t, s.st_size);
+	if (buf == NULL) {
+		fclose(fh);
+		return false;
+	}
+	n = fread(buf, 1, s.st_size, fh);
+	fclose(fh);
+	if (n != (size_t)s.st_size) {
+		fprintf(stderr, "short read on %s\n", path);
+		return false;
+	}
+
+	c->data = talloc_realloc(c, c->data, uint8_t *, c->n_files + 1);
+	c->sizes = talloc_realloc(c, c->sizes, size_t, c->n_files + 1);
+	if (c->data == NULL || c->sizes == NULL) {
+		return false;
+	}
+	c->data[c->n_files] = buf;
+	c->sizes[c->n_files] = n;
+	c->n_files++;
+	c->total += n;
+	return true;
+}
+
+static bool corpus_add(struct corpus *c, const char *path)
+{
+	DIR *dir = NULL;
+	struct dirent *de = NULL;
+	bool ok = true;
+
+	dir = opendir(path);
+	if (dir == NULL) {
+		return corpus_add_file(c, path);
+	}
+
+	while (ok && (de = readdir(dir)) != NULL) {
+		char *name = NULL;
+
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		name = talloc_asprintf(c, "%s/%s", path, de->d_name);
+		if (name == NULL) {
+			ok = false;
+			break;
+		}
+		ok = corpus_add_file(c, name);
+		TALLOC_FREE(name);
+	}
+	closedir(dir);
+	return ok;
+}
+
+static double elapsed(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) +
+		(end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int main(int argc, const char *argv[])
+{
+	TALLOC_CTX *mem_ctx = talloc_new(NULL);
+	struct corpus *c = NULL;
+	struct lzxhuff_compressor_mem *cmp_mem = NULL;
+	uint8_t **compressed = NULL;
+	size_t *compressed_sizes = NULL;
+	size_t compressed_total = 0;
+	uint8_t *out = NULL;
+	size_t max_size = 0;
+	unsigned iterations = 10;
+	struct timespec start;
+	double comp_secs;
+	double decomp_secs;
+	double mb;
+	unsigned it;
+	size_t i;
+	int argi = 1;
+	bool ok = true;
+
+	if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		iterations = atoi(argv[2]);
+		argi = 3;
+	}
+	if (iterations == 0) {
+		fprintf(stderr,
+			"Usage: %s [-n ITERATIONS] [FILE|DIRECTORY ...]\n",
+			argv[0]);
+		return 1;
+	}
+
+	c = talloc_zero(mem_ctx, struct corpus);
+	cmp_mem = talloc(mem_ctx, struct lzxhuff_compressor_mem);
+	if (c == NULL || cmp_mem == NULL) {
+		return 1;
+	}
+
+	if (argi == argc) {
+		ok = corpus_add(c, "testdata/compression/decompressed") &&
+			corpus_add(c, "COPYING");
+	}
+	for (; ok && argi < argc; argi++) {
+		ok = corpus_add(c, argv[argi]);
+	}
+	if (!ok || c->n_files == 0) {
+		fprintf(stderr, "no corpus to work on\n");
+		return 1;
+	}
+
+	compressed = talloc_zero_array(mem_ctx, uint8_t *, c->n_files);
+	compressed_sizes = talloc_zero_array(mem_ctx, size_t, c->n_files);
+	if (compressed == NULL || compressed_sizes == NULL) {
+		return 1;
+	}
+	for (i = 0; i < c->n_files; i++) {
+		size_t size = lzxpress_huffman_max_compressed_size(c->sizes[i]);
+		compressed[i] = talloc_array(compressed, uint8_t, size);
+		if (compressed[i] == NULL) {
+			return 1;
+		}
+		max_size = MAX(max_size, c->sizes[i]);
+	}
+	out = talloc_array(mem_ctx, uint8_t, max_size);
+	if (out == NULL) {
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (it = 0; it < iterations; it++) {
+		for (i = 0; i < c->n_files; i++) {
+			ssize_t ret = lzxpress_huffman_compress(
+				cmp_mem,
+				c->data[i],
+				c->sizes[i],
+				compressed[i],
+				lzxpress_huffman_max_compressed_size(
+					c->sizes[i]));
+			if (ret < 0) {
+				fprintf(stderr, "compression failed\n");
+				return 1;
+			}
+			compressed_sizes[i] = ret;
+		}
+	}
+	comp_secs = elapsed(&start);
+
+	for (i = 0; i < c->n_files; i++) {
+		ssize_t ret = lzxpress_huffman_decompress(compressed[i],
+							  compressed_sizes[i],
+							  out,
+							  c->sizes[i]);
+		if (ret != c->sizes[i] ||
+		    memcmp(out, c->data[i], c->sizes[i]) != 0) {
+			fprintf(stderr, "round trip failed\n");
+			return 1;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (it = 0; it < iterations; it++) {
+		for (i = 0; i < c->n_files; i++) {
+			ssize_t ret = lzxpress_huffman_decompress(
+				compressed[i],
+				compressed_sizes[i],
+				out,
+				c->sizes[i]);
+			if (ret != c->sizes[i]) {
+				fprintf(stderr, "decompression failed\n");
+				return 1;
+			}
+		}
+	}
+	decomp_secs = elapsed(&start);
+
+	for (i = 0; i < c->n_files; i++) {
+		compressed_total += compressed_sizes[i];
+	}
+
+	mb = (double)c->total * iterations / (1024 * 1024);
+	printf("files:       %zu\n", c->n_files);
+	printf("size:        %zu\n", c->total);
+	printf("compressed:  %zu (%.2f%%)\n",
+	       compressed_total, 100.0 * compressed_total / c->total);
+	printf("compress:    %.1f MB/s\n", mb / comp_secs);
+	printf("decompress:  %.1f MB/s\n", mb / decomp_secs);
+
+	TALLOC_FREE(mem_ctx);
+	return 0;
+}
@@ -336,6 +336,126 @@ NTSTATUS dbwrap_fetch(struct db_context *db, TALLOC_CTX *mem_ctx,
 	return NT_STATUS_OK;
 }
 
+struct dbwrap_parse_many_fallback_state {
+	size_t idx;
+	void (*parser)(size_t idx,
+		       TDB_DATA key,
+		       TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+};
+
+static void dbwrap_parse_many_fallback_parser(TDB_DATA key,
+					      TDB_DATA data,
+					      void *private_data)
+{
+	struct dbwrap_parse_many_fallback_state *state = private_data;
+
+	state->parser(state->idx, key, data, state->private_data);
+}
+
+NTSTATUS dbwrap_parse_many(struct db_context *db,
+			   const TDB_DATA *keys,
+			   size_t num_keys,
+			   void (*parser)(size_t idx,
+					  TDB_DATA key,
+					  TDB_DATA data,
+					  void *private_data),
+			   void *private_data)
+{
+	struct dbwrap_parse_many_fallback_state state = {
+		.parser = parser, .private_data = private_data,
+	};
+
+	if (db->parse_many != NULL) {
+		return db->parse_many(db, keys, num_keys, parser, private_data);
+	}
+
+	for (state.idx = 0; state.idx < num_keys; state.idx++) {
+		NTSTATUS status;
+
+		status = dbwrap_parse_record(db,
+					     keys[state.idx],
+					     dbwrap_parse_many_fallback_parser,
+					     &state);
+		if (NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND)) {
+			continue;
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+	}
+
+	return NT_STATUS_OK;
+}
+
+struct dbwrap_fetch_many_state {
+	TALLOC_CTX *mem_ctx;
+	TDB_DATA *values;
+	bool oom;
+};
+
+static void dbwrap_fetch_many_parser(size_t idx,
+				     TDB_DATA key,
+				     TDB_DATA data,
+				     void *private_data)
+{
+	struct dbwrap_fetch_many_state *state = private_data;
+	uint8_t *dptr = NULL;
+
+	/*
+	 * Use talloc_size() for empty records, so that they
+	 * can be distinguished from records not found.
+	 */
+	dptr = talloc_size(state->mem_ctx, data.dsize);
+	if (dptr == NULL) {
+		state->oom = true;
+		return;
+	}
+	if (data.dsize != 0) {
+		memcpy(dptr, data.dptr, data.dsize);
+	}
+
+	state->values[idx] = (TDB_DATA) {
+		.dptr = dptr, .dsize = data.dsize,
+	};
+}
+
+NTSTATUS dbwrap_fetch_many(struct db_context *db,
+			   TALLOC_CTX *mem_ctx,
+			   const TDB_DATA *keys,
+			   TDB_DATA *values,
+			   size_t num_keys)
+{
+	struct dbwrap_fetch_many_state state = {
+		.mem_ctx = mem_ctx, .values = values,
+	};
+	NTSTATUS status;
+	size_t i;
+
+	for (i=0; i<num_keys; i++) {
+		values[i] = (TDB_DATA) { .dptr = NULL, };
+	}
+
+	status = dbwrap_parse_many(db,
+				   keys,
+				   num_keys,
+				   dbwrap_fetch_many_parser,
+				   &state);
+	if (NT_STATUS_IS_OK(status) && state.oom) {
+		status = NT_STATUS_NO_MEMORY;
+	}
+	if (!NT_STATUS_IS_OK(status)) {
+		for (i=0; i<num_keys; i++) {
+			TALLOC_FREE(values[i].dptr);
+			values[i].dsize = 0;
+		}
+		return status;
+	}
+
+	return NT_STATUS_OK;
+}
+
 bool dbwrap_exists(struct db_context *db, TDB_DATA key)
 {
 	int result;
@@ -376,6 +496,39 @@ NTSTATUS dbwrap_store(struct db_context *db, TDB_DATA key,
 	return state.status;
 }
 
+NTSTATUS dbwrap_store_many(struct db_context *db,
+			   const TDB_DATA *keys,
+			   const TDB_DATA *values,
+			   size_t num_keys,
+			   int flags)
+{
+	NTSTATUS status = NT_STATUS_OK;
+	size_t i;
+
+	if (db->store_many != NULL) {
+		if (db->lock_order != DBWRAP_LOCK_ORDER_NONE) {
+			dbwrap_lock_order_lock(db->name, db->lock_order);
+		}
+
+		status = db->store_many(db, keys, values, num_keys, flags);
+
+		if (db->lock_order != DBWRAP_LOCK_ORDER_NONE) {
+			dbwrap_lock_order_unlock(db->name, db->lock_order);
+		}
+
+		return status;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		status = dbwrap_store(db, keys[i], values[i], flags);
+		if (!NT_STATUS_IS_OK(status)) {
+			break;
+		}
+	}
+
+	return status;
+}
+
 struct dbwrap_delete_state {
 	NTSTATUS status;
 };
@@ -39,6 +39,11 @@ enum dbwrap_lock_order {
 
 #define DBWRAP_FLAG_NONE                     0x0000000000000000ULL
 #define DBWRAP_FLAG_OPTIMIZE_READONLY_ACCESS 0x0000000000000001ULL
+/*
+ * Cache records read via dbwrap_parse_record() in-process, see
+ * db_open_cache(). Only honoured for local (non-ctdb) databases.
+ */
+#define DBWRAP_FLAG_CACHE                    0x0000000000000002ULL
 
 enum dbwrap_req_state {
 	/**
@@ -105,6 +110,42 @@ NTSTATUS dbwrap_store(struct db_context *db, TDB_DATA key,
 		      TDB_DATA data, int flags);
 NTSTATUS dbwrap_fetch(struct db_context *db, TALLOC_CTX *mem_ctx,
 		      TDB_DATA key, TDB_DATA *value);
+
+/*
+ * Batched versions of dbwrap_parse_record(), dbwrap_fetch() and
+ * dbwrap_store(). Backends which support it (tdb) lock each hash
+ * chain only once for all keys in it, for the others this is just
+ * a loop over the keys.
+ *
+ * dbwrap_parse_many() calls the parser with the index of the key
+ * in the keys array, keys which are not found are skipped.
+ *
+ * dbwrap_fetch_many() sets values[i].dptr to NULL if keys[i]
+ * was not found.
+ *
+ * dbwrap_store_many() stops at the first failure, without
+ * reverting the records already stored, use a transaction if
+ * that's required. If a key is passed more than once, the last
+ * value wins.
+ */
+NTSTATUS dbwrap_parse_many(struct db_context *db,
+			   const TDB_DATA *keys,
+			   size_t num_keys,
+			   void (*parser)(size_t idx,
+					  TDB_DATA key,
+					  TDB_DATA data,
+					  void *private_data),
+			   void *private_data);
+NTSTATUS dbwrap_fetch_many(struct db_context *db,
+			   TALLOC_CTX *mem_ctx,
+			   const TDB_DATA *keys,
+			   TDB_DATA *values,
+			   size_t num_keys);
+NTSTATUS dbwrap_store_many(struct db_context *db,
+			   const TDB_DATA *keys,
+			   const TDB_DATA *values,
+			   size_t num_keys,
+			   int flags);
 bool dbwrap_exists(struct db_context *db, TDB_DATA key);
 NTSTATUS dbwrap_traverse(struct db_context *db,
 			 int (*f)(struct db_record*, void*),
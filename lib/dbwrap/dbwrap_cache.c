@@ -0,0 +1,368 @@
+/*
+   Unix SMB/CIFS implementation.
+   Cache db contents for parse_record based on seqnum
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "lib/util/debug.h"
+#include "dbwrap/dbwrap.h"
+#include "dbwrap/dbwrap_private.h"
+#include "dbwrap/dbwrap_rbt.h"
+#include "dbwrap/dbwrap_cache.h"
+
+struct db_cache_ctx {
+	struct db_context *backing;
+
+	/*
+	 * positive and negative are only valid as long as
+	 * dbwrap_get_seqnum(backing) returns seqnum.
+	 */
+	int seqnum;
+	struct db_context *positive;
+	struct db_context *negative;
+	size_t size;
+	size_t max_size;
+
+	/*
+	 * Inside a transaction we can't trust the seqnum: a cancel
+	 * rolls it back, so don't cache anything.
+	 */
+	int transaction_depth;
+};
+
+static void dbwrap_cache_flush(struct db_cache_ctx *ctx)
+{
+	TALLOC_FREE(ctx->positive);
+	TALLOC_FREE(ctx->negative);
+	ctx->size = 0;
+}
+
+/*
+ * Make sure the caches belong to the current seqnum of the backing
+ * db. This has to be called before looking at the backing db, so
+ * that a concurrent change between the seqnum check and the lookup
+ * is caught by the next dbwrap_cache_validate() call.
+ */
+static bool dbwrap_cache_validate(struct db_cache_ctx *ctx)
+{
+	int seqnum;
+
+	if (ctx->transaction_depth != 0) {
+		return false;
+	}
+
+	seqnum = dbwrap_get_seqnum(ctx->backing);
+
+	if ((ctx->positive != NULL) && (seqnum == ctx->seqnum)) {
+		return true;
+	}
+
+	dbwrap_cache_flush(ctx);
+
+	ctx->positive = db_open_rbt(ctx);
+	ctx->negative = db_open_rbt(ctx);
+	if ((ctx->positive == NULL) || (ctx->negative == NULL)) {
+		dbwrap_cache_flush(ctx);
+		return false;
+	}
+	ctx->seqnum = seqnum;
+
+	return true;
+}
+
+static void dbwrap_cache_add(struct db_cache_ctx *ctx,
+			     struct db_context *cache,
+			     TDB_DATA key,
+			     TDB_DATA value)
+{
+	size_t size = key.dsize + value.dsize;
+	NTSTATUS status;
+
+	if (size > ctx->max_size) {
+		return;
+	}
+
+	if (ctx->size + size > ctx->max_size) {
+		/*
+		 * Start over, the hot records will show up again
+		 * soon enough.
+		 */
+		int seqnum = ctx->seqnum;
+		bool ok;
+
+		dbwrap_cache_flush(ctx);
+		ok = dbwrap_cache_validate(ctx);
+		if (!ok || (ctx->seqnum != seqnum)) {
+			return;
+		}
+		cache = (value.dptr == NULL) ? ctx->negative : ctx->positive;
+	}
+
+	status = dbwrap_store(cache, key, value, 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_DEBUG("dbwrap_store failed: %s\n", nt_errstr(status));
+		dbwrap_cache_flush(ctx);
+		return;
+	}
+	ctx->size += size;
+}
+
+struct dbwrap_cache_parse_state {
+	struct db_cache_ctx *ctx;
+	void (*parser)(TDB_DATA key, TDB_DATA data, void *private_data);
+	void *private_data;
+};
+
+static void dbwrap_cache_parse_fn(TDB_DATA key,
+				  TDB_DATA data,
+				  void *private_data)
+{
+	struct dbwrap_cache_parse_state *state = private_data;
+
+	/*
+	 * dbwrap_cache_add() relies on dptr != NULL for
+	 * positive entries.
+	 */
+	if (data.dptr == NULL) {
+		data.dptr = (uint8_t *)"";
+	}
+
+	dbwrap_cache_add(state->ctx, state->ctx->positive, key, data);
+	state->parser(key, data, state->private_data);
+}
+
+static NTSTATUS dbwrap_cache_parse_record(
+	struct db_context *db, TDB_DATA key,
+	void (*parser)(TDB_DATA key, TDB_DATA data, void *private_data),
+	void *private_data)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+	struct dbwrap_cache_parse_state state = {
+		.ctx = ctx, .parser = parser, .private_data = private_data,
+	};
+	NTSTATUS status;
+
+	if (!dbwrap_cache_validate(ctx)) {
+		return dbwrap_parse_record(ctx->backing, key,
+					   parser, private_data);
+	}
+
+	status = dbwrap_parse_record(ctx->positive, key,
+				     parser, private_data);
+	if (NT_STATUS_IS_OK(status)) {
+		return NT_STATUS_OK;
+	}
+	if (dbwrap_exists(ctx->negative, key)) {
+		return NT_STATUS_NOT_FOUND;
+	}
+
+	status = dbwrap_parse_record(ctx->backing, key,
+				     dbwrap_cache_parse_fn, &state);
+	if (NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND) &&
+	    (ctx->negative != NULL)) {
+		dbwrap_cache_add(ctx, ctx->negative, key, tdb_null);
+	}
+
+	return status;
+}
+
+static struct db_record *dbwrap_cache_fetch_locked(
+	struct db_context *db, TALLOC_CTX *mem_ctx, TDB_DATA key)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+
+	return dbwrap_fetch_locked(ctx->backing, mem_ctx, key);
+}
+
+static NTSTATUS dbwrap_cache_do_locked(
+	struct db_context *db, TDB_DATA key,
+	void (*fn)(struct db_record *rec, TDB_DATA value, void *private_data),
+	void *private_data)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+
+	return dbwrap_do_locked(ctx->backing, key, fn, private_data);
+}
+
+static int dbwrap_cache_traverse(struct db_context *db,
+				 int (*f)(struct db_record *rec,
+					  void *private_data),
+				 void *private_data)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+	NTSTATUS status;
+	int ret;
+
+	status = dbwrap_traverse(ctx->backing, f, private_data, &ret);
+	if (!NT_STATUS_IS_OK(status)) {
+		return -1;
+	}
+	return ret;
+}
+
+static int dbwrap_cache_traverse_read(struct db_context *db,
+				      int (*f)(struct db_record *rec,
+					       void *private_data),
+				      void *private_data)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+	NTSTATUS status;
+	int ret;
+
+	status = dbwrap_traverse_read(ctx->backing, f, private_data, &ret);
+	if (!NT_STATUS_IS_OK(status)) {
+		return -1;
+	}
+	return ret;
+}
+
+static int dbwrap_cache_get_seqnum(struct db_context *db)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+
+	return dbwrap_get_seqnum(ctx->backing);
+}
+
+static int dbwrap_cache_transaction_start(struct db_context *db)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+	int ret;
+
+	ret = dbwrap_transaction_start(ctx->backing);
+	if (ret == 0) {
+		ctx->transaction_depth += 1;
+		dbwrap_cache_flush(ctx);
+	}
+	return ret;
+}
+
+static NTSTATUS dbwrap_cache_transaction_start_nonblock(
+	struct db_context *db)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+	NTSTATUS status;
+
+	status = dbwrap_transaction_start_nonblock(ctx->backing);
+	if (NT_STATUS_IS_OK(status)) {
+		ctx->transaction_depth += 1;
+		dbwrap_cache_flush(ctx);
+	}
+	return status;
+}
+
+static int dbwrap_cache_transaction_commit(struct db_context *db)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+	int ret;
+
+	ret = dbwrap_transaction_commit(ctx->backing);
+	ctx->transaction_depth -= 1;
+	dbwrap_cache_flush(ctx);
+	return ret;
+}
+
+static int dbwrap_cache_transaction_cancel(struct db_context *db)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+	int ret;
+
+	ret = dbwrap_transaction_cancel(ctx->backing);
+	ctx->transaction_depth -= 1;
+	dbwrap_cache_flush(ctx);
+	return ret;
+}
+
+static int dbwrap_cache_wipe(struct db_context *db)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+
+	int ret;
+
+	ret = dbwrap_wipe(ctx->backing);
+	dbwrap_cache_flush(ctx);
+	return ret;
+}
+
+static int dbwrap_cache_check(struct db_context *db)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+
+	return dbwrap_check(ctx->backing);
+}
+
+static size_t dbwrap_cache_id(struct db_context *db, uint8_t *id,
+			      size_t idlen)
+{
+	struct db_cache_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_cache_ctx);
+
+	return dbwrap_db_id(ctx->backing, id, idlen);
+}
+
+struct db_context *db_open_cache(TALLOC_CTX *mem_ctx,
+				 struct db_context **backing,
+				 size_t max_size)
+{
+	struct db_context *db;
+	struct db_cache_ctx *ctx;
+
+	db = talloc_zero(mem_ctx, struct db_context);
+	if (db == NULL) {
+		return NULL;
+	}
+	ctx = talloc_zero(db, struct db_cache_ctx);
+	if (ctx == NULL) {
+		TALLOC_FREE(db);
+		return NULL;
+	}
+	db->private_data = ctx;
+
+	ctx->max_size = max_size;
+	ctx->backing = talloc_move(ctx, backing);
+	db->lock_order = ctx->backing->lock_order;
+	ctx->backing->lock_order = DBWRAP_LOCK_ORDER_NONE;
+
+	db->fetch_locked = dbwrap_cache_fetch_locked;
+	db->do_locked = dbwrap_cache_do_locked;
+	db->traverse = dbwrap_cache_traverse;
+	db->traverse_read = dbwrap_cache_traverse_read;
+	db->get_seqnum = dbwrap_cache_get_seqnum;
+	db->transaction_start = dbwrap_cache_transaction_start;
+	db->transaction_start_nonblock =
+		dbwrap_cache_transaction_start_nonblock;
+	db->transaction_commit = dbwrap_cache_transaction_commit;
+	db->transaction_cancel = dbwrap_cache_transaction_cancel;
+	db->parse_record = dbwrap_cache_parse_record;
+	db->wipe = dbwrap_cache_wipe;
+	db->check = dbwrap_cache_check;
+	db->id = dbwrap_cache_id;
+	db->name = dbwrap_name(ctx->backing);
+	db->persistent = ctx->backing->persistent;
+
+	return db;
+}
@@ -0,0 +1,41 @@
+/*
+   Unix SMB/CIFS implementation.
+   Cache db contents for parse_record based on seqnum
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __DBWRAP_CACHE_H__
+#define __DBWRAP_CACHE_H__
+
+#include <talloc.h>
+
+struct db_context;
+
+/*
+ * Wrap "backing" with an in-process cache for dbwrap_parse_record()
+ * and everything built on top of it like dbwrap_fetch().
+ *
+ * The cache is flushed whenever dbwrap_get_seqnum() of the backing
+ * db changes, so the backing db has to maintain a sequence number
+ * (e.g. a tdb opened with TDB_SEQNUM). "max_size" is the upper limit
+ * for the number of bytes of keys and values cached.
+ *
+ * Takes over ownership of *backing.
+ */
+struct db_context *db_open_cache(TALLOC_CTX *mem_ctx,
+				 struct db_context **backing,
+				 size_t max_size);
+
+#endif /* __DBWRAP_CACHE_H__ */
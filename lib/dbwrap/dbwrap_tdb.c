@@ -278,6 +278,59 @@ static NTSTATUS db_tdb_parse(struct db_context *db, TDB_DATA key,
 	return NT_STATUS_OK;
 }
 
+struct db_tdb_parse_many_state {
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+};
+
+static int db_tdb_parse_many_parser(size_t idx, TDB_DATA key, TDB_DATA data,
+				    void *private_data)
+{
+	struct db_tdb_parse_many_state *state =
+		(struct db_tdb_parse_many_state *)private_data;
+
+	state->parser(idx, key, data, state->private_data);
+	return 0;
+}
+
+static NTSTATUS db_tdb_parse_many(struct db_context *db,
+				  const TDB_DATA *keys, size_t num_keys,
+				  void (*parser)(size_t idx, TDB_DATA key,
+						 TDB_DATA data,
+						 void *private_data),
+				  void *private_data)
+{
+	struct db_tdb_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_tdb_ctx);
+	struct db_tdb_parse_many_state state = {
+		.parser = parser, .private_data = private_data,
+	};
+	int ret;
+
+	ret = tdb_parse_many(ctx->wtdb->tdb, keys, num_keys,
+			     db_tdb_parse_many_parser, &state);
+	if (ret != 0) {
+		return map_nt_error_from_tdb(tdb_error(ctx->wtdb->tdb));
+	}
+	return NT_STATUS_OK;
+}
+
+static NTSTATUS db_tdb_store_many(struct db_context *db,
+				  const TDB_DATA *keys, const TDB_DATA *values,
+				  size_t num_keys, int flags)
+{
+	struct db_tdb_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_tdb_ctx);
+	int ret;
+
+	ret = tdb_store_many(ctx->wtdb->tdb, keys, values, num_keys, flags);
+	if (ret != 0) {
+		return map_nt_error_from_tdb(tdb_error(ctx->wtdb->tdb));
+	}
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS db_tdb_storev(struct db_record *rec,
 			      const TDB_DATA *dbufs, int num_dbufs, int flag)
 {
@@ -499,6 +552,8 @@ struct db_context *db_open_tdb(TALLOC_CTX *mem_ctx,
 	result->traverse = db_tdb_traverse;
 	result->traverse_read = db_tdb_traverse_read;
 	result->parse_record = db_tdb_parse;
+	result->parse_many = db_tdb_parse_many;
+	result->store_many = db_tdb_store_many;
 	result->get_seqnum = db_tdb_get_seqnum;
 	result->persistent = ((tdb_flags & TDB_CLEAR_IF_FIRST) == 0);
 	result->transaction_start = db_tdb_transaction_start;
@@ -261,6 +261,21 @@ static int ldb_val_equal_exact_ordered(const struct ldb_val v1,
 	return memcmp(v1.data, v2->data, v1.length);
 }
 
+/*
+  same ordering as ldb_val_equal_exact_ordered(), with a fast path
+  for GUID index values. Using a constant length for memcmp() allows
+  the compiler to inline it as a couple of wide compares.
+*/
+static inline int ldb_kv_guid_cmp(const struct ldb_val *v1,
+				  const struct ldb_val *v2)
+{
+	if ((v1->length == LDB_KV_GUID_SIZE) &&
+	    (v2->length == LDB_KV_GUID_SIZE)) {
+		return memcmp(v1->data, v2->data, LDB_KV_GUID_SIZE);
+	}
+	return ldb_val_equal_exact_ordered(*v1, v2);
+}
+
 
 /*
   find a entry in a dn_list, using a ldb_val. Uses a case sensitive
@@ -1390,6 +1405,49 @@ static int ldb_kv_index_dn_leaf(struct ldb_module *module,
 }
 
 
+/*
+  find the first entry at or after "start" in a sorted (GUID index)
+  dn_list that is not smaller than v, returns list->count if there is
+  none.
+
+  This gallops: the step size doubles until we overshoot, then the
+  last step is binary searched. Walking a short list against a long
+  one costs O(short * log(long/short)) instead of O(short * log(long))
+  for independent binary searches.
+*/
+static unsigned int ldb_kv_dn_list_gallop(const struct dn_list *list,
+					  unsigned int start,
+					  const struct ldb_val *v)
+{
+	unsigned int lo = start;
+	unsigned int hi = start;
+	unsigned int step = 1;
+
+	/* everything before lo is known to be smaller than v */
+	while ((hi < list->count) &&
+	       (ldb_kv_guid_cmp(&list->dn[hi], v) < 0)) {
+		lo = hi + 1;
+		if (step > list->count - hi) {
+			hi = list->count;
+			break;
+		}
+		hi += step;
+		step *= 2;
+	}
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (ldb_kv_guid_cmp(&list->dn[mid], v) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
 /*
   list intersection
   list = list & list2
@@ -1460,12 +1518,32 @@ static bool list_intersect(struct ldb_kv_private *ldb_kv,
 	}
 	list3->count = 0;
 
-	for (i=0;i<short_list->count;i++) {
-		/* For the GUID index case, this is a binary search */
-		if (ldb_kv_dn_list_find_val(
-			ldb_kv, long_list, &short_list->dn[i]) != -1) {
-			list3->dn[list3->count] = short_list->dn[i];
-			list3->count++;
+	if (ldb_kv->cache->GUID_index_attribute != NULL) {
+		unsigned int j = 0;
+
+		/*
+		 * Both lists are sorted, so we only ever have to
+		 * look forward in long_list.
+		 */
+		for (i=0; i<short_list->count; i++) {
+			j = ldb_kv_dn_list_gallop(
+				long_list, j, &short_list->dn[i]);
+			if (j == long_list->count) {
+				break;
+			}
+			if (ldb_kv_guid_cmp(&long_list->dn[j],
+					    &short_list->dn[i]) == 0) {
+				list3->dn[list3->count] = short_list->dn[i];
+				list3->count++;
+			}
+		}
+	} else {
+		for (i=0;i<short_list->count;i++) {
+			if (ldb_kv_dn_list_find_val(
+				ldb_kv, long_list, &short_list->dn[i]) != -1) {
+				list3->dn[list3->count] = short_list->dn[i];
+				list3->count++;
+			}
 		}
 	}
 
@@ -1530,8 +1608,7 @@ static bool list_union(struct ldb_context *ldb,
 		} else if (j >= list2->count) {
 			cmp = -1;
 		} else {
-			cmp = ldb_val_equal_exact_ordered(list->dn[i],
-							  &list2->dn[j]);
+			cmp = ldb_kv_guid_cmp(&list->dn[i], &list2->dn[j]);
 		}
 
 		if (cmp < 0) {
@@ -351,6 +351,106 @@ static void test_init_store_set_index_cache_size_range(void **state)
 	TALLOC_FREE(ldb);
 }
 
+/*
+ * Build a GUID index style dn_list containing every "step"th value
+ * in [0, max), encoded big endian so that memcmp() order matches the
+ * numerical order.
+ */
+static struct dn_list *make_guid_list(TALLOC_CTX *mem_ctx,
+				      unsigned int max,
+				      unsigned int step)
+{
+	struct dn_list *list = NULL;
+	unsigned int i;
+
+	list = talloc_zero(mem_ctx, struct dn_list);
+	assert_non_null(list);
+	list->dn = talloc_zero_array(list, struct ldb_val, max / step + 1);
+	assert_non_null(list->dn);
+
+	for (i = 0; i < max; i += step) {
+		uint8_t *guid = talloc_zero_array(list->dn,
+						  uint8_t,
+						  LDB_KV_GUID_SIZE);
+		assert_non_null(guid);
+		guid[12] = (i >> 24) & 0xff;
+		guid[13] = (i >> 16) & 0xff;
+		guid[14] = (i >> 8) & 0xff;
+		guid[15] = i & 0xff;
+		list->dn[list->count].data = guid;
+		list->dn[list->count].length = LDB_KV_GUID_SIZE;
+		list->count++;
+	}
+	return list;
+}
+
+/*
+ * Test the intersection of GUID index lists of very different sizes
+ */
+static void test_list_intersect_guid(void **state)
+{
+	struct test_ctx *test_ctx = talloc_get_type_abort(
+		*state,
+		struct test_ctx);
+	struct ldb_kv_private *ldb_kv = NULL;
+	struct dn_list *list = NULL;
+	struct dn_list *list2 = NULL;
+	const unsigned int steps[][3] = {
+		/* max, step for list, step for list2 */
+		{ 30000, 3, 5 },
+		{ 30000, 5, 3 },
+		{ 30000, 7, 1001 },
+		{ 30000, 1001, 7 },
+		{ 30000, 2, 2 },
+		{ 300, 1, 299 },
+	};
+	unsigned int i, j;
+	bool ok;
+
+	ldb_kv = talloc_zero(test_ctx, struct ldb_kv_private);
+	assert_non_null(ldb_kv);
+	ldb_kv->cache = talloc_zero(ldb_kv, struct ldb_kv_cache);
+	assert_non_null(ldb_kv->cache);
+	ldb_kv->cache->GUID_index_attribute = "objectGUID";
+
+	for (i = 0; i < ARRAY_SIZE(steps); i++) {
+		unsigned int max = steps[i][0];
+		unsigned int s1 = steps[i][1];
+		unsigned int s2 = steps[i][2];
+		unsigned int expected = 0;
+
+		list = make_guid_list(test_ctx, max, s1);
+		list2 = make_guid_list(test_ctx, max, s2);
+
+		ok = list_intersect(ldb_kv, list, list2);
+		assert_true(ok);
+
+		for (j = 0; j < max; j++) {
+			uint8_t *guid = NULL;
+
+			if ((j % s1 != 0) || (j % s2 != 0)) {
+				continue;
+			}
+			assert_true(expected < list->count);
+			guid = list->dn[expected].data;
+			assert_int_equal(LDB_KV_GUID_SIZE,
+					 list->dn[expected].length);
+			assert_int_equal(j,
+					 ((unsigned int)guid[12] << 24) |
+					 ((unsigned int)guid[13] << 16) |
+					 ((unsigned int)guid[14] << 8) |
+					 guid[15]);
+			expected++;
+		}
+		assert_int_equal(expected, list->count);
+
+		TALLOC_FREE(list);
+		TALLOC_FREE(list2);
+	}
+
+	TALLOC_FREE(ldb_kv);
+}
+
 int main(int argc, const char **argv)
 {
 	const struct CMUnitTest tests[] = {
@@ -382,6 +482,10 @@ int main(int argc, const char **argv)
 			test_init_store_set_index_cache_size_range,
 			setup,
 			teardown),
+		cmocka_unit_test_setup_teardown(
+			test_list_intersect_guid,
+			setup,
+			teardown),
 	};
 
 	cmocka_set_message_output(CM_OUTPUT_SUBUNIT);
@@ -23,6 +23,7 @@
 #include "system/filesys.h"
 #include "system/dir.h"
 #include "system/select.h"
+#include "system/shmem.h"
 #include "lib/util/debug.h"
 #include "messages_dgm.h"
 #include "lib/util/genrand.h"
@@ -36,6 +37,90 @@
 
 #define MESSAGING_DGM_FRAGMENT_LENGTH 1024
 
+/*
+ * Rings need SCM_CREDENTIALS: A ring is only accepted from the pid the
+ * kernel tells us, not from what a peer claims to be.
+ */
+#if defined(HAVE_MEMFD_CREATE) && \
+	defined(HAVE___ATOMIC_ADD_FETCH) && defined(HAVE___ATOMIC_ADD_LOAD) && \
+	defined(SO_PASSCRED) && defined(SCM_CREDENTIALS)
+#define MESSAGING_DGM_RINGS 1
+#endif
+
+/*
+ * Control frames between messaging_dgm peers are marked with a cookie
+ * that is never used for fragmented messages.
+ */
+#define MESSAGING_DGM_CTRL_COOKIE UINT64_MAX
+
+enum messaging_dgm_ctrl_type {
+	/*
+	 * Sender to receiver: The attached fd is a ring to read
+	 * further messages from
+	 */
+	MESSAGING_DGM_CTRL_RING_SETUP = 1,
+	/*
+	 * Sender to receiver: The ring is empty and not used anymore
+	 */
+	MESSAGING_DGM_CTRL_RING_DETACH = 2,
+	/*
+	 * Sender to receiver: There's something in the ring
+	 */
+	MESSAGING_DGM_CTRL_RING_DATA = 3,
+	/*
+	 * Receiver to sender: The ring has been drained
+	 */
+	MESSAGING_DGM_CTRL_RING_SPACE = 4,
+	/*
+	 * Receiver to sender: The ring from RING_SETUP is mapped, the
+	 * sender can start using it
+	 */
+	MESSAGING_DGM_CTRL_RING_ACK = 5,
+};
+
+/*
+ * The sender of a control frame is identified by the SCM_CREDENTIALS
+ * the kernel attaches. "ring_id" is set for RING_SETUP, RING_DETACH
+ * and RING_ACK.
+ */
+struct messaging_dgm_ctrl {
+	uint32_t type;
+	uint32_t ring_id;
+};
+
+/*
+ * Shared memory ring for messages from one sender to one
+ * receiver. The sender only writes "head" and the data area, the
+ * receiver only writes "tail". Records are 8-byte aligned: a uint32_t
+ * length, 4 bytes padding and the message. A length of
+ * MESSAGING_DGM_RING_WRAP marks the rest of the data area as unused,
+ * the next record starts at offset 0.
+ *
+ * "consumer_idle" is set by the receiver when it stopped looking at
+ * the ring, the sender then has to send a RING_DATA control frame.
+ * "producer_waiting" is set by the sender when it has messages it can't
+ * put into the ring yet, the receiver then has to send a RING_SPACE
+ * control frame once it made progress.
+ */
+struct messaging_dgm_ring_hdr {
+	uint32_t magic;
+	uint32_t size;
+	uint64_t head;
+	uint64_t tail;
+	uint32_t consumer_idle;
+	uint32_t producer_waiting;
+};
+
+#define MESSAGING_DGM_RING_MAGIC 0x52676d64 /* "dmgR" */
+#define MESSAGING_DGM_RING_HDR_LEN 64
+#define MESSAGING_DGM_RING_SIZE 65536
+#define MESSAGING_DGM_RING_MAX_MSG (MESSAGING_DGM_RING_SIZE / 4)
+#define MESSAGING_DGM_RING_WRAP UINT32_MAX
+
+#ifdef MESSAGING_DGM_RINGS
+static bool messaging_dgm_rings_enabled;
+#endif
+
 struct sun_path_buf {
 	/*
 	 * This will carry enough for a socket path
@@ -73,6 +158,45 @@ struct messaging_dgm_out {
 
 	struct tevent_queue *queue;
 	struct tevent_timer *idle_timer;
+
+	/*
+	 * Our side of the shared memory ring to "pid", see
+	 * messaging_dgm_out_send_direct(). The ring is only used once
+	 * the receiver sent a RING_ACK for "ring_id", until then
+	 * everything goes through the socket.
+	 */
+	struct messaging_dgm_ring_hdr *ring;
+	uint32_t ring_id;
+	bool ring_acked;
+	bool no_ring;
+
+	/*
+	 * Messages that have to wait for the receiver to make
+	 * progress on the ring. Once there is anything in here, all
+	 * further messages have to go here to keep the ordering.
+	 */
+	struct messaging_dgm_out_pending *pending;
+};
+
+struct messaging_dgm_out_pending {
+	struct messaging_dgm_out_pending *prev, *next;
+	int *fds;
+	size_t buflen;
+	uint8_t buf[];
+};
+
+struct messaging_dgm_in_ring {
+	struct messaging_dgm_in_ring *prev, *next;
+	struct messaging_dgm_context *ctx;
+	pid_t pid;
+	uint32_t ring_id;
+	struct messaging_dgm_ring_hdr *hdr;
+	size_t mapsize;
+
+	/*
+	 * Set while messaging_dgm_in_ring_drain() is running
+	 */
+	bool *pfreed;
 };
 
 struct messaging_dgm_in_msg {
@@ -95,6 +219,7 @@ struct messaging_dgm_context {
 
 	int sock;
 	struct messaging_dgm_in_msg *in_msgs;
+	struct messaging_dgm_in_ring *in_rings;
 
 	struct messaging_dgm_fde_ev *fde_evs;
 	void (*recv_cb)(struct tevent_context *ev,
@@ -109,6 +234,8 @@ struct messaging_dgm_context {
 
 	struct pthreadpool_tevent *pool;
 	struct messaging_dgm_out *outsocks;
+
+	uint32_t next_ring_id;
 };
 
 /* Set socket close on exec. */
@@ -148,6 +275,9 @@ static void close_fd_array(int *fds, size_t num_fds)
  * if it's unused (qlen of zero) which closes the socket.
  */
 
+static bool messaging_dgm_out_busy(struct messaging_dgm_out *out);
+static void messaging_dgm_out_rearm_idle_timer(struct messaging_dgm_out *out);
+
 static void messaging_dgm_out_idle_handler(struct tevent_context *ev,
 					   struct tevent_timer *te,
 					   struct timeval current_time,
@@ -155,13 +285,20 @@ static void messaging_dgm_out_idle_handler(struct tevent_context *ev,
 {
 	struct messaging_dgm_out *out = talloc_get_type_abort(
 		private_data, struct messaging_dgm_out);
-	size_t qlen;
 
 	out->idle_timer = NULL;
 
-	qlen = tevent_queue_length(out->queue);
-	if (qlen == 0) {
+	if (!messaging_dgm_out_busy(out)) {
 		TALLOC_FREE(out);
+		return;
+	}
+
+	if (tevent_queue_length(out->queue) == 0) {
+		/*
+		 * Only waiting for the receiver to drain our ring, we
+		 * won't get a fragment callback to rearm the timer.
+		 */
+		messaging_dgm_out_rearm_idle_timer(out);
 	}
 }
 
@@ -278,10 +415,14 @@ fail:
 	return ret;
 }
 
+static void messaging_dgm_out_ring_free(struct messaging_dgm_out *out);
+
 static int messaging_dgm_out_destructor(struct messaging_dgm_out *out)
 {
 	DLIST_REMOVE(out->ctx->outsocks, out);
 
+	messaging_dgm_out_ring_free(out);
+
 	if ((tevent_queue_length(out->queue) != 0) &&
 	    (tevent_cached_getpid() == out->ctx->pid)) {
 		/*
@@ -852,13 +993,410 @@ static int messaging_dgm_out_send_fragmented(struct tevent_context *ev,
 	}
 
 	out->cookie += 1;
-	if (out->cookie == 0) {
-		out->cookie += 1;
+	if ((out->cookie == 0) || (out->cookie == MESSAGING_DGM_CTRL_COOKIE)) {
+		out->cookie = 1;
 	}
 
 	return ret;
 }
 
+#ifdef MESSAGING_DGM_RINGS
+
+static int messaging_dgm_out_send_ctrl(struct messaging_dgm_out *out,
+				       enum messaging_dgm_ctrl_type type,
+				       uint32_t ring_id,
+				       const int *fds, size_t num_fds)
+{
+	uint64_t cookie = MESSAGING_DGM_CTRL_COOKIE;
+	struct messaging_dgm_ctrl ctrl = {
+		.type = type, .ring_id = ring_id,
+	};
+	struct iovec iov[] = {
+		{ .iov_base = &cookie, .iov_len = sizeof(cookie) },
+		{ .iov_base = &ctrl, .iov_len = sizeof(ctrl) },
+	};
+
+	return messaging_dgm_out_send_fragment(
+		out->ctx->ev, out, iov, ARRAY_SIZE(iov), fds, num_fds);
+}
+
+static size_t messaging_dgm_ring_reclen(size_t msglen)
+{
+	return 8 + ((msglen + 7) & ~(size_t)7);
+}
+
+static bool messaging_dgm_ring_empty(struct messaging_dgm_ring_hdr *hdr)
+{
+	uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_SEQ_CST);
+	return (tail == hdr->head);
+}
+
+/*
+ * Create a ring to out->pid and announce it. The receiver starts
+ * reading the ring when it sees the RING_SETUP frame, which is
+ * ordered behind everything we sent via the socket before. We only
+ * put messages into the ring after the receiver acked it: Receivers
+ * without ring support or with rings disabled drop RING_SETUP, and we
+ * just keep using the socket for them.
+ */
+
+static int messaging_dgm_out_ring_setup(struct messaging_dgm_out *out)
+{
+	struct messaging_dgm_ring_hdr *hdr = NULL;
+	size_t mapsize = MESSAGING_DGM_RING_HDR_LEN + MESSAGING_DGM_RING_SIZE;
+	void *ptr = NULL;
+	int fd, ret;
+
+	fd = memfd_create("messaging_dgm_ring", MFD_CLOEXEC);
+	if (fd == -1) {
+		return errno;
+	}
+
+	ret = ftruncate(fd, mapsize);
+	if (ret == -1) {
+		ret = errno;
+		close(fd);
+		return ret;
+	}
+
+	ptr = mmap(NULL, mapsize, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED) {
+		ret = errno;
+		close(fd);
+		return ret;
+	}
+	hdr = ptr;
+
+	*hdr = (struct messaging_dgm_ring_hdr) {
+		.magic = MESSAGING_DGM_RING_MAGIC,
+		.size = MESSAGING_DGM_RING_SIZE,
+	};
+
+	out->ctx->next_ring_id += 1;
+	if (out->ctx->next_ring_id == 0) {
+		out->ctx->next_ring_id = 1;
+	}
+
+	ret = messaging_dgm_out_send_ctrl(
+		out, MESSAGING_DGM_CTRL_RING_SETUP, out->ctx->next_ring_id,
+		&fd, 1);
+	close(fd);
+	if (ret != 0) {
+		munmap(ptr, mapsize);
+		return ret;
+	}
+
+	out->ring = hdr;
+	out->ring_id = out->ctx->next_ring_id;
+	out->ring_acked = false;
+	return 0;
+}
+
+static void messaging_dgm_out_ring_free(struct messaging_dgm_out *out)
+{
+	if (out->ring == NULL) {
+		return;
+	}
+
+	if ((tevent_cached_getpid() == out->ctx->pid) &&
+	    !out->is_blocking &&
+	    (tevent_queue_length(out->queue) == 0) &&
+	    messaging_dgm_ring_empty(out->ring)) {
+		/*
+		 * Best effort, if the receiver does not get this it
+		 * keeps the ring until we're gone or set up a new one.
+		 */
+		uint64_t cookie = MESSAGING_DGM_CTRL_COOKIE;
+		struct messaging_dgm_ctrl ctrl = {
+			.type = MESSAGING_DGM_CTRL_RING_DETACH,
+			.ring_id = out->ring_id,
+		};
+		struct iovec iov[] = {
+			{ .iov_base = &cookie, .iov_len = sizeof(cookie) },
+			{ .iov_base = &ctrl, .iov_len = sizeof(ctrl) },
+		};
+		int err;
+
+		(void)messaging_dgm_sendmsg(out->sock, iov, ARRAY_SIZE(iov),
+					    NULL, 0, &err);
+	}
+
+	munmap(out->ring, MESSAGING_DGM_RING_HDR_LEN + MESSAGING_DGM_RING_SIZE);
+	out->ring = NULL;
+	out->ring_acked = false;
+}
+
+static bool messaging_dgm_ring_put(struct messaging_dgm_ring_hdr *hdr,
+				   const struct iovec *iov, int iovlen,
+				   size_t msglen)
+{
+	uint8_t *data = (uint8_t *)hdr + MESSAGING_DGM_RING_HDR_LEN;
+	uint64_t head = hdr->head;
+	uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_SEQ_CST);
+	size_t reclen = messaging_dgm_ring_reclen(msglen);
+	size_t ofs = head % MESSAGING_DGM_RING_SIZE;
+	size_t to_end = MESSAGING_DGM_RING_SIZE - ofs;
+	size_t needed = reclen;
+	uint32_t len32;
+
+	if (reclen > to_end) {
+		needed += to_end;
+	}
+	if (needed > MESSAGING_DGM_RING_SIZE - (head - tail)) {
+		return false;
+	}
+
+	if (reclen > to_end) {
+		len32 = MESSAGING_DGM_RING_WRAP;
+		memcpy(data + ofs, &len32, sizeof(len32));
+		head += to_end;
+		ofs = 0;
+	}
+
+	len32 = msglen;
+	memcpy(data + ofs, &len32, sizeof(len32));
+	iov_buf(iov, iovlen, data + ofs + 8, msglen);
+
+	__atomic_store_n(&hdr->head, head + reclen, __ATOMIC_SEQ_CST);
+	return true;
+}
+
+/*
+ * Send a message to out->pid right now if the ordering of messages
+ * allows it. EAGAIN means that the message has to wait for the
+ * receiver to make progress on our ring.
+ *
+ * Messages without fds that are small enough go through the
+ * ring. Everything else has to go through the socket, which is only
+ * possible after the receiver has processed everything in the
+ * ring. The receiver only moves the tail after the callback has
+ * seen the message, so an empty ring means everything sent through
+ * it has been delivered. The other way around, as long as messages
+ * wait in out->queue, new ones have to queue up behind them.
+ */
+
+static int messaging_dgm_out_send_direct(struct messaging_dgm_out *out,
+					 const struct iovec *iov, int iovlen,
+					 const int *fds, size_t num_fds)
+{
+	ssize_t msglen;
+	int ret;
+
+	msglen = iov_buflen(iov, iovlen);
+	if (msglen == -1) {
+		return EMSGSIZE;
+	}
+
+	if (messaging_dgm_rings_enabled && !out->no_ring &&
+	    (num_fds == 0) && (msglen <= MESSAGING_DGM_RING_MAX_MSG) &&
+	    (tevent_queue_length(out->queue) == 0)) {
+		bool ok;
+
+		if (out->ring == NULL) {
+			ret = messaging_dgm_out_ring_setup(out);
+			if (ret == ECONNREFUSED) {
+				return ret;
+			}
+			if (ret != 0) {
+				DBG_DEBUG("ring setup to %u failed: %s\n",
+					  (unsigned)out->pid, strerror(ret));
+				out->no_ring = true;
+				goto socket;
+			}
+		}
+
+		if (!out->ring_acked) {
+			/*
+			 * The ring is empty, so the socket keeps
+			 * the ordering
+			 */
+			goto socket;
+		}
+
+		ok = messaging_dgm_ring_put(out->ring, iov, iovlen, msglen);
+		if (!ok) {
+			return EAGAIN;
+		}
+
+		if (__atomic_exchange_n(&out->ring->consumer_idle, 0,
+					__ATOMIC_SEQ_CST) != 0) {
+			ret = messaging_dgm_out_send_ctrl(
+				out, MESSAGING_DGM_CTRL_RING_DATA, 0, NULL, 0);
+			if (ret != 0) {
+				DBG_DEBUG("RING_DATA to %u failed: %s\n",
+					  (unsigned)out->pid, strerror(ret));
+			}
+		}
+		return 0;
+	}
+
+	if ((out->ring != NULL) && !messaging_dgm_ring_empty(out->ring)) {
+		return EAGAIN;
+	}
+
+socket:
+	return messaging_dgm_out_send_fragmented(
+		out->ctx->ev, out, iov, iovlen, fds, num_fds);
+}
+
+#else
+
+static void messaging_dgm_out_ring_free(struct messaging_dgm_out *out)
+{
+	return;
+}
+
+static int messaging_dgm_out_send_direct(struct messaging_dgm_out *out,
+					 const struct iovec *iov, int iovlen,
+					 const int *fds, size_t num_fds)
+{
+	return messaging_dgm_out_send_fragmented(
+		out->ctx->ev, out, iov, iovlen, fds, num_fds);
+}
+
+#endif /* MESSAGING_DGM_RINGS */
+
+static int messaging_dgm_out_pending_destructor(
+	struct messaging_dgm_out_pending *p)
+{
+	close_fd_array(p->fds, talloc_array_length(p->fds));
+	return 0;
+}
+
+static int messaging_dgm_out_queue_pending(struct messaging_dgm_out *out,
+					   const struct iovec *iov,
+					   int iovlen,
+					   const int *fds,
+					   size_t num_fds)
+{
+	struct messaging_dgm_out_pending *p = NULL;
+	ssize_t buflen;
+	size_t i;
+
+	buflen = iov_buflen(iov, iovlen);
+	if (buflen == -1) {
+		return EMSGSIZE;
+	}
+
+	p = talloc_size(out,
+			offsetof(struct messaging_dgm_out_pending, buf) +
+			buflen);
+	if (p == NULL) {
+		return ENOMEM;
+	}
+	talloc_set_name_const(p, "struct messaging_dgm_out_pending");
+
+	*p = (struct messaging_dgm_out_pending) { .buflen = buflen };
+	iov_buf(iov, iovlen, p->buf, buflen);
+
+	p->fds = talloc_array(p, int, num_fds);
+	if (p->fds == NULL) {
+		TALLOC_FREE(p);
+		return ENOMEM;
+	}
+	for (i=0; i<num_fds; i++) {
+		p->fds[i] = -1;
+	}
+	talloc_set_destructor(p, messaging_dgm_out_pending_destructor);
+
+	for (i=0; i<num_fds; i++) {
+		p->fds[i] = dup(fds[i]);
+		if (p->fds[i] == -1) {
+			int ret = errno;
+			TALLOC_FREE(p);
+			return ret;
+		}
+	}
+
+	DLIST_ADD_END(out->pending, p);
+	return 0;
+}
+
+/*
+ * Send as many pending messages as the receiver allows. If we have
+ * to stop, make sure the receiver tells us when to try again.
+ */
+
+static void messaging_dgm_out_flush(struct messaging_dgm_out *out)
+{
+#ifdef MESSAGING_DGM_RINGS
+	bool waiting = false;
+#endif
+
+	while (out->pending != NULL) {
+		struct messaging_dgm_out_pending *p = out->pending;
+		struct iovec iov = {
+			.iov_base = p->buf, .iov_len = p->buflen,
+		};
+		int ret;
+
+		ret = messaging_dgm_out_send_direct(
+			out, &iov, 1, p->fds, talloc_array_length(p->fds));
+		if (ret == EAGAIN) {
+#ifdef MESSAGING_DGM_RINGS
+			if (!waiting) {
+				/*
+				 * Announce that we wait for
+				 * RING_SPACE. Check once more, the
+				 * receiver might have drained the ring
+				 * before it could see the flag.
+				 */
+				__atomic_store_n(&out->ring->producer_waiting,
+						 1, __ATOMIC_SEQ_CST);
+				waiting = true;
+				continue;
+			}
+#endif
+			return;
+		}
+		if (ret != 0) {
+			DBG_WARNING("Dropping message to %u: %s\n",
+				    (unsigned)out->pid, strerror(ret));
+		}
+
+		DLIST_REMOVE(out->pending, p);
+		TALLOC_FREE(p);
+	}
+}
+
+static bool messaging_dgm_out_busy(struct messaging_dgm_out *out)
+{
+	if (tevent_queue_length(out->queue) != 0) {
+		return true;
+	}
+	if (out->pending != NULL) {
+		return true;
+	}
+#ifdef MESSAGING_DGM_RINGS
+	if ((out->ring != NULL) && !messaging_dgm_ring_empty(out->ring)) {
+		return true;
+	}
+#endif
+	return false;
+}
+
+static int messaging_dgm_out_send(struct messaging_dgm_out *out,
+				  const struct iovec *iov, int iovlen,
+				  const int *fds, size_t num_fds)
+{
+	int ret;
+
+	if (out->pending == NULL) {
+		ret = messaging_dgm_out_send_direct(
+			out, iov, iovlen, fds, num_fds);
+		if (ret != EAGAIN) {
+			return ret;
+		}
+	}
+
+	ret = messaging_dgm_out_queue_pending(out, iov, iovlen, fds, num_fds);
+	if (ret != 0) {
+		return ret;
+	}
+	messaging_dgm_out_flush(out);
+	return 0;
+}
+
 static struct messaging_dgm_context *global_dgm_context;
 
 static int messaging_dgm_context_destructor(struct messaging_dgm_context *c);
@@ -1075,6 +1613,19 @@ int messaging_dgm_init(struct tevent_context *ev,
 		return ret;
 	}
 
+#ifdef MESSAGING_DGM_RINGS
+	if (messaging_dgm_rings_enabled) {
+		int one = 1;
+
+		ret = setsockopt(ctx->sock, SOL_SOCKET, SO_PASSCRED,
+				 &one, sizeof(one));
+		if (ret == -1) {
+			DBG_WARNING("SO_PASSCRED failed: %s\n",
+				    strerror(errno));
+		}
+	}
+#endif
+
 	talloc_set_destructor(ctx, messaging_dgm_context_destructor);
 
 	ctx->have_dgm_context = &have_dgm_context;
@@ -1108,6 +1659,10 @@ static int messaging_dgm_context_destructor(struct messaging_dgm_context *c)
 	while (c->in_msgs != NULL) {
 		TALLOC_FREE(c->in_msgs);
 	}
+	while (c->in_rings != NULL) {
+		struct messaging_dgm_in_ring *r = c->in_rings;
+		TALLOC_FREE(r);
+	}
 	while (c->fde_evs != NULL) {
 		tevent_fd_set_flags(c->fde_evs->fde, 0);
 		c->fde_evs->ctx = NULL;
@@ -1235,6 +1790,7 @@ fail:
 
 static void messaging_dgm_recv(struct messaging_dgm_context *ctx,
 			       struct tevent_context *ev,
+			       pid_t sender_pid,
 			       uint8_t *msg, size_t msg_len,
 			       int *fds, size_t num_fds);
 
@@ -1253,9 +1809,16 @@ static void messaging_dgm_read_handler(struct tevent_context *ev,
 	ssize_t received;
 	struct msghdr msg;
 	struct iovec iov;
-	size_t msgbufsize = msghdr_prep_recv_fds(NULL, NULL, 0, INT8_MAX);
+	size_t fdbufsize = msghdr_prep_recv_fds(NULL, NULL, 0, INT8_MAX);
+#ifdef MESSAGING_DGM_RINGS
+	size_t msgbufsize = fdbufsize + CMSG_SPACE(sizeof(struct ucred));
+	struct cmsghdr *cmsg = NULL;
+#else
+	size_t msgbufsize = fdbufsize;
+#endif
 	uint8_t msgbuf[msgbufsize];
 	uint8_t buf[MESSAGING_DGM_FRAGMENT_LENGTH];
+	pid_t sender_pid = -1;
 	size_t num_fds;
 
 	messaging_dgm_validate(ctx);
@@ -1267,7 +1830,14 @@ static void messaging_dgm_read_handler(struct tevent_context *ev,
 	iov = (struct iovec) { .iov_base = buf, .iov_len = sizeof(buf) };
 	msg = (struct msghdr) { .msg_iov = &iov, .msg_iovlen = 1 };
 
-	msghdr_prep_recv_fds(&msg, msgbuf, msgbufsize, INT8_MAX);
+	msghdr_prep_recv_fds(&msg, msgbuf, fdbufsize, INT8_MAX);
+#ifdef MESSAGING_DGM_RINGS
+	/*
+	 * Room for the SCM_CREDENTIALS we get with SO_PASSCRED
+	 */
+	msg.msg_control = msgbuf;
+	msg.msg_controllen = msgbufsize;
+#endif
 
 #ifdef MSG_CMSG_CLOEXEC
 	msg.msg_flags |= MSG_CMSG_CLOEXEC;
@@ -1292,11 +1862,28 @@ static void messaging_dgm_read_handler(struct tevent_context *ev,
 		return;
 	}
 
+#ifdef MESSAGING_DGM_RINGS
+	for (cmsg = CMSG_FIRSTHDR(&msg);
+	     cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		struct ucred cred;
+
+		if ((cmsg->cmsg_level != SOL_SOCKET) ||
+		    (cmsg->cmsg_type != SCM_CREDENTIALS) ||
+		    (cmsg->cmsg_len != CMSG_LEN(sizeof(cred)))) {
+			continue;
+		}
+		memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+		sender_pid = cred.pid;
+		break;
+	}
+#endif
+
 	num_fds = msghdr_extract_fds(&msg, NULL, 0);
 	if (num_fds == 0) {
 		int fds[1];
 
-		messaging_dgm_recv(ctx, ev, buf, received, fds, 0);
+		messaging_dgm_recv(ctx, ev, sender_pid, buf, received, fds, 0);
 	} else {
 		size_t i;
 		int fds[num_fds];
@@ -1313,7 +1900,8 @@ static void messaging_dgm_read_handler(struct tevent_context *ev,
 			}
 		}
 
-		messaging_dgm_recv(ctx, ev, buf, received, fds, num_fds);
+		messaging_dgm_recv(
+			ctx, ev, sender_pid, buf, received, fds, num_fds);
 	}
 }
 
@@ -1335,6 +1923,311 @@ static void messaging_dgm_close_unconsumed(int *fds, size_t num_fds)
 	}
 }
 
+#ifdef MESSAGING_DGM_RINGS
+
+static int messaging_dgm_in_ring_destructor(struct messaging_dgm_in_ring *r)
+{
+	if (r->pfreed != NULL) {
+		*r->pfreed = true;
+	}
+	if (r->ctx != NULL) {
+		DLIST_REMOVE(r->ctx->in_rings, r);
+	}
+	munmap(r->hdr, r->mapsize);
+	return 0;
+}
+
+static struct messaging_dgm_in_ring *messaging_dgm_in_ring_find(
+	struct messaging_dgm_context *ctx, pid_t pid)
+{
+	struct messaging_dgm_in_ring *r;
+
+	for (r = ctx->in_rings; r != NULL; r = r->next) {
+		if (r->pid == pid) {
+			return r;
+		}
+	}
+	return NULL;
+}
+
+static void messaging_dgm_in_ring_space(struct messaging_dgm_context *ctx,
+					pid_t pid)
+{
+	struct messaging_dgm_out *out = NULL;
+	int ret;
+
+	ret = messaging_dgm_out_get(ctx, pid, &out);
+	if (ret == 0) {
+		ret = messaging_dgm_out_send_ctrl(
+			out, MESSAGING_DGM_CTRL_RING_SPACE, 0, NULL, 0);
+	}
+	if (ret != 0) {
+		DBG_DEBUG("RING_SPACE to %u failed: %s\n",
+			  (unsigned)pid, strerror(ret));
+	}
+}
+
+/*
+ * Pass everything in the ring to the recv_cb. The tail is only
+ * advanced after the callback returned, so the sender can rely on an
+ * empty ring meaning that all messages have been processed.
+ */
+
+static void messaging_dgm_in_ring_drain(struct messaging_dgm_in_ring *r,
+					struct tevent_context *ev)
+{
+	struct messaging_dgm_context *ctx = r->ctx;
+	struct messaging_dgm_ring_hdr *hdr = r->hdr;
+	uint8_t *data = (uint8_t *)hdr + MESSAGING_DGM_RING_HDR_LEN;
+	uint32_t size = r->mapsize - MESSAGING_DGM_RING_HDR_LEN;
+	bool freed = false;
+
+	if (r->pfreed != NULL) {
+		/*
+		 * Called from a nested event loop within recv_cb, our
+		 * caller will continue.
+		 */
+		return;
+	}
+	r->pfreed = &freed;
+
+	while (true) {
+		uint64_t tail = hdr->tail;
+		uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_SEQ_CST);
+		size_t ofs = tail % size;
+		size_t to_end = size - ofs;
+		size_t reclen;
+		uint32_t len32;
+		int fds[1];
+
+		if (head == tail) {
+			__atomic_store_n(&hdr->consumer_idle, 1,
+					 __ATOMIC_SEQ_CST);
+			head = __atomic_load_n(&hdr->head, __ATOMIC_SEQ_CST);
+			if (head == tail) {
+				break;
+			}
+			__atomic_store_n(&hdr->consumer_idle, 0,
+					 __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		memcpy(&len32, data + ofs, sizeof(len32));
+
+		if (len32 == MESSAGING_DGM_RING_WRAP) {
+			if (head - tail < to_end) {
+				goto corrupt;
+			}
+			__atomic_store_n(&hdr->tail, tail + to_end,
+					 __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		reclen = messaging_dgm_ring_reclen(len32);
+		if ((len32 > MESSAGING_DGM_RING_MAX_MSG) ||
+		    (reclen > to_end) ||
+		    (reclen > head - tail)) {
+			goto corrupt;
+		}
+
+		ctx->recv_cb(ev, data + ofs + 8, len32, fds, 0,
+			     ctx->recv_cb_private_data);
+		if (freed) {
+			return;
+		}
+
+		__atomic_store_n(&hdr->tail, tail + reclen, __ATOMIC_SEQ_CST);
+
+		if (__atomic_exchange_n(&hdr->producer_waiting, 0,
+					__ATOMIC_SEQ_CST) != 0) {
+			messaging_dgm_in_ring_space(ctx, r->pid);
+		}
+	}
+
+	r->pfreed = NULL;
+
+	/*
+	 * The sender might have set producer_waiting after we looked
+	 * at it the last time, based on a tail value before our last
+	 * update.
+	 */
+	if (__atomic_exchange_n(&hdr->producer_waiting, 0,
+				__ATOMIC_SEQ_CST) != 0) {
+		messaging_dgm_in_ring_space(ctx, r->pid);
+	}
+	return;
+
+corrupt:
+	DBG_WARNING("Invalid ring from %u\n", (unsigned)r->pid);
+	TALLOC_FREE(r);
+}
+
+static void messaging_dgm_in_ring_setup(struct messaging_dgm_context *ctx,
+					struct tevent_context *ev,
+					pid_t pid,
+					uint32_t ring_id,
+					int fd)
+{
+	struct messaging_dgm_in_ring *r = NULL, *next = NULL;
+	struct messaging_dgm_ring_hdr *hdr = NULL;
+	struct messaging_dgm_out *out = NULL;
+	struct stat st;
+	void *ptr = NULL;
+	int ret;
+
+	/*
+	 * A new ring from a pid replaces an old one, the old sender
+	 * is gone. Also clean up behind senders that died without
+	 * detaching.
+	 */
+	for (r = ctx->in_rings; r != NULL; r = next) {
+		next = r->next;
+
+		if (r->pid == pid) {
+			TALLOC_FREE(r);
+			continue;
+		}
+		ret = kill(r->pid, 0);
+		if ((ret == -1) && (errno == ESRCH)) {
+			TALLOC_FREE(r);
+		}
+	}
+
+	ret = fstat(fd, &st);
+	if (ret == -1) {
+		DBG_WARNING("fstat failed: %s\n", strerror(errno));
+		return;
+	}
+	if ((st.st_size <= MESSAGING_DGM_RING_HDR_LEN) ||
+	    (st.st_size > MESSAGING_DGM_RING_HDR_LEN + (off_t)UINT32_MAX)) {
+		DBG_WARNING("Invalid ring size %jd from %u\n",
+			    (intmax_t)st.st_size, (unsigned)pid);
+		return;
+	}
+
+	ptr = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED) {
+		DBG_WARNING("mmap failed: %s\n", strerror(errno));
+		return;
+	}
+	hdr = ptr;
+
+	if ((hdr->magic != MESSAGING_DGM_RING_MAGIC) ||
+	    (hdr->size != st.st_size - MESSAGING_DGM_RING_HDR_LEN) ||
+	    (hdr->size % 8 != 0)) {
+		DBG_WARNING("Invalid ring header from %u\n", (unsigned)pid);
+		munmap(ptr, st.st_size);
+		return;
+	}
+
+	r = talloc(ctx, struct messaging_dgm_in_ring);
+	if (r == NULL) {
+		munmap(ptr, st.st_size);
+		return;
+	}
+	*r = (struct messaging_dgm_in_ring) {
+		.ctx = ctx, .pid = pid, .ring_id = ring_id,
+		.hdr = hdr, .mapsize = st.st_size,
+	};
+	DLIST_ADD(ctx->in_rings, r);
+	talloc_set_destructor(r, messaging_dgm_in_ring_destructor);
+
+	/*
+	 * If the ack gets lost, the sender keeps using the socket
+	 * and will detach an empty ring eventually.
+	 */
+	ret = messaging_dgm_out_get(ctx, pid, &out);
+	if (ret == 0) {
+		ret = messaging_dgm_out_send_ctrl(
+			out, MESSAGING_DGM_CTRL_RING_ACK, ring_id, NULL, 0);
+	}
+	if (ret != 0) {
+		DBG_DEBUG("RING_ACK to %u failed: %s\n",
+			  (unsigned)pid, strerror(ret));
+	}
+
+	messaging_dgm_in_ring_drain(r, ev);
+}
+
+static void messaging_dgm_recv_ctrl(struct messaging_dgm_context *ctx,
+				    struct tevent_context *ev,
+				    pid_t sender_pid,
+				    uint8_t *buf, size_t buflen,
+				    int *fds, size_t num_fds)
+{
+	struct messaging_dgm_ctrl ctrl;
+	struct messaging_dgm_in_ring *r = NULL;
+	struct messaging_dgm_out *out = NULL;
+
+	if (!messaging_dgm_rings_enabled || (sender_pid <= 0)) {
+		goto close_fds;
+	}
+	if (buflen != sizeof(ctrl)) {
+		goto close_fds;
+	}
+	memcpy(&ctrl, buf, sizeof(ctrl));
+
+	switch (ctrl.type) {
+	case MESSAGING_DGM_CTRL_RING_SETUP:
+		if (num_fds != 1) {
+			break;
+		}
+		messaging_dgm_in_ring_setup(
+			ctx, ev, sender_pid, ctrl.ring_id, fds[0]);
+		break;
+	case MESSAGING_DGM_CTRL_RING_DETACH:
+		r = messaging_dgm_in_ring_find(ctx, sender_pid);
+		if ((r != NULL) && (r->ring_id == ctrl.ring_id)) {
+			TALLOC_FREE(r);
+		}
+		break;
+	case MESSAGING_DGM_CTRL_RING_DATA:
+		r = messaging_dgm_in_ring_find(ctx, sender_pid);
+		if (r != NULL) {
+			messaging_dgm_in_ring_drain(r, ev);
+		}
+		break;
+	case MESSAGING_DGM_CTRL_RING_SPACE:
+		for (out = ctx->outsocks; out != NULL; out = out->next) {
+			if (out->pid == sender_pid) {
+				messaging_dgm_out_flush(out);
+				break;
+			}
+		}
+		break;
+	case MESSAGING_DGM_CTRL_RING_ACK:
+		for (out = ctx->outsocks; out != NULL; out = out->next) {
+			if (out->pid != sender_pid) {
+				continue;
+			}
+			if ((out->ring != NULL) &&
+			    (out->ring_id == ctrl.ring_id)) {
+				out->ring_acked = true;
+			}
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+
+close_fds:
+	close_fd_array(fds, num_fds);
+}
+
+#else
+
+static void messaging_dgm_recv_ctrl(struct messaging_dgm_context *ctx,
+				    struct tevent_context *ev,
+				    pid_t sender_pid,
+				    uint8_t *buf, size_t buflen,
+				    int *fds, size_t num_fds)
+{
+	close_fd_array(fds, num_fds);
+}
+
+#endif /* MESSAGING_DGM_RINGS */
+
 /*
  * Deal with identification of fragmented messages and
  * re-assembly into full messages sent, then calls the
@@ -1343,6 +2236,7 @@ static void messaging_dgm_close_unconsumed(int *fds, size_t num_fds)
 
 static void messaging_dgm_recv(struct messaging_dgm_context *ctx,
 			       struct tevent_context *ev,
+			       pid_t sender_pid,
 			       uint8_t *buf, size_t buflen,
 			       int *fds, size_t num_fds)
 {
@@ -1358,6 +2252,12 @@ static void messaging_dgm_recv(struct messaging_dgm_context *ctx,
 	buf += sizeof(cookie);
 	buflen -= sizeof(cookie);
 
+	if (cookie == MESSAGING_DGM_CTRL_COOKIE) {
+		messaging_dgm_recv_ctrl(
+			ctx, ev, sender_pid, buf, buflen, fds, num_fds);
+		return;
+	}
+
 	if (cookie == 0) {
 		ctx->recv_cb(ev, buf, buflen, fds, num_fds,
 			     ctx->recv_cb_private_data);
@@ -1439,6 +2339,32 @@ void messaging_dgm_destroy(void)
 	TALLOC_FREE(global_dgm_context);
 }
 
+void messaging_dgm_enable_rings(bool enable)
+{
+#ifdef MESSAGING_DGM_RINGS
+	struct messaging_dgm_context *ctx = global_dgm_context;
+	int val = enable ? 1 : 0;
+	int ret;
+
+	messaging_dgm_rings_enabled = enable;
+
+	if (ctx == NULL) {
+		return;
+	}
+
+	/*
+	 * Control frames are only accepted with the sender's pid from
+	 * the kernel
+	 */
+	ret = setsockopt(ctx->sock, SOL_SOCKET, SO_PASSCRED,
+			 &val, sizeof(val));
+	if (ret == -1) {
+		DBG_WARNING("SO_PASSCRED failed: %s\n", strerror(errno));
+		messaging_dgm_rings_enabled = false;
+	}
+#endif
+}
+
 int messaging_dgm_send(pid_t pid,
 		       const struct iovec *iov, int iovlen,
 		       const int *fds, size_t num_fds)
@@ -1462,8 +2388,7 @@ again:
 
 	DEBUG(10, ("%s: Sending message to %u\n", __func__, (unsigned)pid));
 
-	ret = messaging_dgm_out_send_fragmented(ctx->ev, out, iov, iovlen,
-						fds, num_fds);
+	ret = messaging_dgm_out_send(out, iov, iovlen, fds, num_fds);
 	if (ret == ECONNREFUSED) {
 		/*
 		 * We cache outgoing sockets. If the receiver has
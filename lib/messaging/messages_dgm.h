@@ -36,6 +36,13 @@ int messaging_dgm_init(struct tevent_context *ev,
 				       void *private_data),
 		       void *recv_cb_private_data);
 void messaging_dgm_destroy(void);
+
+/*
+ * Send small messages without fds through per-receiver shared memory
+ * rings instead of one datagram each. A ring is only used after the
+ * receiver acked it, which it only does with rings enabled as well.
+ */
+void messaging_dgm_enable_rings(bool enable);
 int messaging_dgm_get_unique(pid_t pid, uint64_t *unique);
 int messaging_dgm_send(pid_t pid,
 		       const struct iovec *iov, int iovlen,
@@ -3012,6 +3012,8 @@ struct loadparm_context *loadparm_init(TALLOC_CTX *mem_ctx)
 
 	lpcfg_do_global_parameter_var(lp_ctx, "smb2 max read", "%u", DEFAULT_SMB2_MAX_READ);
 
+	lpcfg_do_global_parameter_var(lp_ctx, "smbd async encryption threshold", "%u", DEFAULT_SMBD_ASYNC_ENCRYPTION_THRESHOLD);
+
 	lpcfg_do_global_parameter(lp_ctx, "durable handles", "yes");
 
 	lpcfg_do_global_parameter(lp_ctx, "max stat cache size", "512");
@@ -3144,6 +3146,11 @@ struct loadparm_context *loadparm_init(TALLOC_CTX *mem_ctx)
 				  "server smb3 encryption algorithms",
 				  DEFAULT_SMB3_ENCRYPTION_ALGORITHMS);
 
+	lpcfg_do_global_parameter(lp_ctx,
+				  "server smb3 compression algorithms",
+				  DEFAULT_SMB3_COMPRESSION_ALGORITHMS);
+	lpcfg_do_global_parameter(lp_ctx, "smb3 compression", "requested");
+
 	lpcfg_do_global_parameter(lp_ctx,
 				  "min domain uid",
 				  "1000");
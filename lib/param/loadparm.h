@@ -286,9 +286,11 @@ enum acl_claims_evaluation {
 #define DEFAULT_SMB2_MAX_WRITE (8*1024*1024)
 #define DEFAULT_SMB2_MAX_TRANSACT (8*1024*1024)
 #define DEFAULT_SMB2_MAX_CREDITS 8192
+#define DEFAULT_SMBD_ASYNC_ENCRYPTION_THRESHOLD (64*1024)
 
 #define DEFAULT_SMB3_SIGNING_ALGORITHMS "AES-128-GMAC AES-128-CMAC HMAC-SHA256"
 #define DEFAULT_SMB3_ENCRYPTION_ALGORITHMS "AES-128-GCM AES-128-CCM AES-256-GCM AES-256-CCM"
+#define DEFAULT_SMB3_COMPRESSION_ALGORITHMS "LZ77+Huffman LZ77 Pattern_V1"
 
 #define LOADPARM_EXTRA_LOCALS						\
 	int usershare;							\
@@ -162,6 +162,22 @@ static const struct enum_list enum_smb_encryption_vals[] = {
 	{-1, NULL}
 };
 
+static const struct enum_list enum_smb3_compression_vals[] = {
+	{SMB3_COMPRESSION_OFF, "No"},
+	{SMB3_COMPRESSION_OFF, "False"},
+	{SMB3_COMPRESSION_OFF, "0"},
+	{SMB3_COMPRESSION_OFF, "Off"},
+	{SMB3_COMPRESSION_OFF, "disabled"},
+	{SMB3_COMPRESSION_REQUESTED, "requested"},
+	{SMB3_COMPRESSION_AUTO, "auto"},
+	{SMB3_COMPRESSION_AUTO, "Yes"},
+	{SMB3_COMPRESSION_AUTO, "True"},
+	{SMB3_COMPRESSION_AUTO, "1"},
+	{SMB3_COMPRESSION_AUTO, "On"},
+	{SMB3_COMPRESSION_AUTO, "enabled"},
+	{-1, NULL}
+};
+
 static const struct enum_list enum_use_kerberos_vals[] = {
 	{CRED_USE_KERBEROS_DESIRED, "desired"},
 	{CRED_USE_KERBEROS_DESIRED, "auto"},
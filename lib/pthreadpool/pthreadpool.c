@@ -37,6 +37,32 @@ struct pthreadpool_job {
 	void *private_data;
 };
 
+/*
+ * Upper limit for the number of job queues. Each worker thread takes
+ * jobs from its own queue first and steals from the other queues
+ * when that is empty.
+ */
+#define PTHREADPOOL_MAX_QUEUES 16
+
+struct pthreadpool_queue {
+	/*
+	 * Control access to the jobs array. Worker threads take jobs
+	 * with only this mutex held, they don't touch pool->mutex
+	 * while there is work to do. If both are needed, pool->mutex
+	 * has to be taken first.
+	 */
+	pthread_mutex_t mutex;
+
+	/*
+	 * Array of jobs
+	 */
+	size_t jobs_array_len;
+	struct pthreadpool_job *jobs;
+
+	size_t head;
+	size_t num_jobs;
+};
+
 struct pthreadpool {
 	/*
 	 * List pthreadpools for fork safety
@@ -54,13 +80,20 @@ struct pthreadpool {
 	pthread_cond_t condvar;
 
 	/*
-	 * Array of jobs
+	 * Job queues, one per worker thread up to
+	 * PTHREADPOOL_MAX_QUEUES. Jobs are only added with
+	 * pool->mutex held, so a thread checking all queues with
+	 * pool->mutex held before going idle can't miss new work.
 	 */
-	size_t jobs_array_len;
-	struct pthreadpool_job *jobs;
+	unsigned num_queues;
+	struct pthreadpool_queue *queues;
 
-	size_t head;
-	size_t num_jobs;
+	/*
+	 * Round-robin positions for adding jobs and for assigning
+	 * home queues to new threads, protected by pool->mutex.
+	 */
+	unsigned next_queue;
+	unsigned next_worker;
 
 	/*
 	 * Indicate job completion
@@ -73,7 +106,8 @@ struct pthreadpool {
 
 	/*
 	 * indicator to worker threads to stop processing further jobs
-	 * and exit.
+	 * and exit. Only changed with pool->mutex and all queue
+	 * mutexes held.
 	 */
 	bool stopped;
 
@@ -121,6 +155,101 @@ static pthread_once_t pthreadpool_atfork_initialized = PTHREAD_ONCE_INIT;
 
 static void pthreadpool_prep_atfork(void);
 
+static void pthreadpool_queues_free(struct pthreadpool_queue *queues,
+				    unsigned num_queues)
+{
+	unsigned i;
+
+	for (i=0; i<num_queues; i++) {
+		pthread_mutex_destroy(&queues[i].mutex);
+		free(queues[i].jobs);
+	}
+	free(queues);
+}
+
+static int pthreadpool_queues_init(struct pthreadpool *pool)
+{
+	unsigned i;
+	int ret;
+
+	pool->num_queues = MIN(pool->max_threads, PTHREADPOOL_MAX_QUEUES);
+	pool->num_queues = MAX(pool->num_queues, 1);
+	pool->next_queue = 0;
+	pool->next_worker = 0;
+
+	pool->queues = calloc(
+		pool->num_queues, sizeof(struct pthreadpool_queue));
+	if (pool->queues == NULL) {
+		return ENOMEM;
+	}
+
+	for (i=0; i<pool->num_queues; i++) {
+		struct pthreadpool_queue *q = &pool->queues[i];
+
+		q->jobs_array_len = 4;
+		q->jobs = calloc(
+			q->jobs_array_len, sizeof(struct pthreadpool_job));
+		if (q->jobs == NULL) {
+			pthreadpool_queues_free(pool->queues, i);
+			return ENOMEM;
+		}
+
+		ret = pthread_mutex_init(&q->mutex, NULL);
+		if (ret != 0) {
+			free(q->jobs);
+			pthreadpool_queues_free(pool->queues, i);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void pthreadpool_lock_queues(struct pthreadpool *pool)
+{
+	unsigned i;
+	int ret;
+
+	for (i=0; i<pool->num_queues; i++) {
+		ret = pthread_mutex_lock(&pool->queues[i].mutex);
+		assert(ret == 0);
+	}
+}
+
+static void pthreadpool_unlock_queues(struct pthreadpool *pool)
+{
+	unsigned i;
+	int ret;
+
+	for (i=pool->num_queues; i>0; i--) {
+		ret = pthread_mutex_unlock(&pool->queues[i-1].mutex);
+		assert(ret == 0);
+	}
+}
+
+/*
+ * Count the jobs in all queues. pool->mutex must be held, so no new
+ * jobs show up while we look.
+ */
+static size_t pthreadpool_count_jobs(struct pthreadpool *pool)
+{
+	size_t num_jobs = 0;
+	unsigned i;
+	int ret;
+
+	for (i=0; i<pool->num_queues; i++) {
+		struct pthreadpool_queue *q = &pool->queues[i];
+
+		ret = pthread_mutex_lock(&q->mutex);
+		assert(ret == 0);
+		num_jobs += q->num_jobs;
+		ret = pthread_mutex_unlock(&q->mutex);
+		assert(ret == 0);
+	}
+
+	return num_jobs;
+}
+
 /*
  * Initialize a thread pool
  */
@@ -141,21 +270,17 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 	}
 	pool->signal_fn = signal_fn;
 	pool->signal_fn_private_data = signal_fn_private_data;
+	pool->max_threads = max_threads;
 
-	pool->jobs_array_len = 4;
-	pool->jobs = calloc(
-		pool->jobs_array_len, sizeof(struct pthreadpool_job));
-
-	if (pool->jobs == NULL) {
+	ret = pthreadpool_queues_init(pool);
+	if (ret != 0) {
 		free(pool);
-		return ENOMEM;
+		return ret;
 	}
 
-	pool->head = pool->num_jobs = 0;
-
 	ret = pthread_mutex_init(&pool->mutex, NULL);
 	if (ret != 0) {
-		free(pool->jobs);
+		pthreadpool_queues_free(pool->queues, pool->num_queues);
 		free(pool);
 		return ret;
 	}
@@ -163,7 +288,7 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 	ret = pthread_cond_init(&pool->condvar, NULL);
 	if (ret != 0) {
 		pthread_mutex_destroy(&pool->mutex);
-		free(pool->jobs);
+		pthreadpool_queues_free(pool->queues, pool->num_queues);
 		free(pool);
 		return ret;
 	}
@@ -172,7 +297,7 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 	if (ret != 0) {
 		pthread_cond_destroy(&pool->condvar);
 		pthread_mutex_destroy(&pool->mutex);
-		free(pool->jobs);
+		pthreadpool_queues_free(pool->queues, pool->num_queues);
 		free(pool);
 		return ret;
 	}
@@ -180,7 +305,6 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 	pool->stopped = false;
 	pool->destroyed = false;
 	pool->num_threads = 0;
-	pool->max_threads = max_threads;
 	pool->num_idle = 0;
 	pool->prefork_cond = NULL;
 
@@ -189,7 +313,7 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 		pthread_mutex_destroy(&pool->fork_mutex);
 		pthread_cond_destroy(&pool->condvar);
 		pthread_mutex_destroy(&pool->mutex);
-		free(pool->jobs);
+		pthreadpool_queues_free(pool->queues, pool->num_queues);
 		free(pool);
 		return ret;
 	}
@@ -235,7 +359,7 @@ size_t pthreadpool_queued_jobs(struct pthreadpool *pool)
 		return 0;
 	}
 
-	ret = pool->num_jobs;
+	ret = pthreadpool_count_jobs(pool);
 
 	unlock_res = pthread_mutex_unlock(&pool->mutex);
 	assert(unlock_res == 0);
@@ -291,6 +415,12 @@ static void pthreadpool_prepare_pool(struct pthreadpool *pool)
 
 	ret = pthread_cond_destroy(&pool->condvar);
 	assert(ret == 0);
+
+	/*
+	 * Busy threads take jobs without holding pool->mutex. Make
+	 * sure none of them holds a queue mutex across the fork.
+	 */
+	pthreadpool_lock_queues(pool);
 }
 
 static void pthreadpool_prepare(void)
@@ -317,6 +447,7 @@ static void pthreadpool_parent(void)
 	for (pool = DLIST_TAIL(pthreadpools);
 	     pool != NULL;
 	     pool = DLIST_PREV(pool)) {
+		pthreadpool_unlock_queues(pool);
 		ret = pthread_cond_init(&pool->condvar, NULL);
 		assert(ret == 0);
 		ret = pthread_mutex_unlock(&pool->mutex);
@@ -338,12 +469,18 @@ static void pthreadpool_child(void)
 	     pool != NULL;
 	     pool = DLIST_PREV(pool)) {
 
+		unsigned i;
+
 		pool->num_threads = 0;
 		pool->num_idle = 0;
-		pool->head = 0;
-		pool->num_jobs = 0;
 		pool->stopped = true;
 
+		for (i=0; i<pool->num_queues; i++) {
+			pool->queues[i].head = 0;
+			pool->queues[i].num_jobs = 0;
+		}
+		pthreadpool_unlock_queues(pool);
+
 		ret = pthread_cond_init(&pool->condvar, NULL);
 		assert(ret == 0);
 
@@ -395,7 +532,7 @@ static int pthreadpool_free(struct pthreadpool *pool)
 		return ret2;
 	}
 
-	free(pool->jobs);
+	pthreadpool_queues_free(pool->queues, pool->num_queues);
 	free(pool);
 
 	return 0;
@@ -409,7 +546,9 @@ static int pthreadpool_stop_locked(struct pthreadpool *pool)
 {
 	int ret;
 
+	pthreadpool_lock_queues(pool);
 	pool->stopped = true;
+	pthreadpool_unlock_queues(pool);
 
 	if (pool->num_threads == 0) {
 		return 0;
@@ -503,39 +642,72 @@ static void pthreadpool_server_exit(struct pthreadpool *pool)
 	}
 }
 
+/*
+ * Take a job from our home queue "idx" or steal one from the other
+ * queues. This does not need pool->mutex.
+ */
 static bool pthreadpool_get_job(struct pthreadpool *p,
+				unsigned idx,
 				struct pthreadpool_job *job)
 {
-	if (p->stopped) {
-		return false;
-	}
+	unsigned i;
+	int res;
+
+	for (i=0; i<p->num_queues; i++) {
+		struct pthreadpool_queue *q =
+			&p->queues[(idx + i) % p->num_queues];
+		bool found = false;
+
+		res = pthread_mutex_lock(&q->mutex);
+		assert(res == 0);
+
+		if (p->stopped) {
+			res = pthread_mutex_unlock(&q->mutex);
+			assert(res == 0);
+			return false;
+		}
+
+		if (q->num_jobs != 0) {
+			*job = q->jobs[q->head];
+			q->head = (q->head+1) % q->jobs_array_len;
+			q->num_jobs -= 1;
+			found = true;
+		}
+
+		res = pthread_mutex_unlock(&q->mutex);
+		assert(res == 0);
 
-	if (p->num_jobs == 0) {
-		return false;
+		if (found) {
+			return true;
+		}
 	}
-	*job = p->jobs[p->head];
-	p->head = (p->head+1) % p->jobs_array_len;
-	p->num_jobs -= 1;
-	return true;
+
+	return false;
 }
 
-static bool pthreadpool_put_job(struct pthreadpool *p,
+static bool pthreadpool_put_job(struct pthreadpool_queue *q,
 				int id,
 				void (*fn)(void *private_data),
 				void *private_data)
 {
 	struct pthreadpool_job *job;
+	int res;
+
+	res = pthread_mutex_lock(&q->mutex);
+	assert(res == 0);
 
-	if (p->num_jobs == p->jobs_array_len) {
+	if (q->num_jobs == q->jobs_array_len) {
 		struct pthreadpool_job *tmp;
-		size_t new_len = p->jobs_array_len * 2;
+		size_t new_len = q->jobs_array_len * 2;
 
 		tmp = realloc(
-			p->jobs, sizeof(struct pthreadpool_job) * new_len);
+			q->jobs, sizeof(struct pthreadpool_job) * new_len);
 		if (tmp == NULL) {
+			res = pthread_mutex_unlock(&q->mutex);
+			assert(res == 0);
 			return false;
 		}
-		p->jobs = tmp;
+		q->jobs = tmp;
 
 		/*
 		 * We just doubled the jobs array. The array implements a FIFO
@@ -546,30 +718,54 @@ static bool pthreadpool_put_job(struct pthreadpool *p,
 		 * copy everything before the current head job into the new
 		 * area.
 		 */
-		memcpy(&p->jobs[p->jobs_array_len], p->jobs,
-		       sizeof(struct pthreadpool_job) * p->head);
+		memcpy(&q->jobs[q->jobs_array_len], q->jobs,
+		       sizeof(struct pthreadpool_job) * q->head);
 
-		p->jobs_array_len = new_len;
+		q->jobs_array_len = new_len;
 	}
 
-	job = &p->jobs[(p->head + p->num_jobs) % p->jobs_array_len];
+	job = &q->jobs[(q->head + q->num_jobs) % q->jobs_array_len];
 	job->id = id;
 	job->fn = fn;
 	job->private_data = private_data;
 
-	p->num_jobs += 1;
+	q->num_jobs += 1;
+
+	res = pthread_mutex_unlock(&q->mutex);
+	assert(res == 0);
 
 	return true;
 }
 
-static void pthreadpool_undo_put_job(struct pthreadpool *p)
+/*
+ * Remove the job we just added to "q" again. Returns false if a busy
+ * thread has already taken it: Jobs are taken from the head of the
+ * queue, and with pool->mutex held nobody else can have added a job
+ * behind ours, so our job is still there if the queue is not empty.
+ */
+static bool pthreadpool_undo_put_job(struct pthreadpool_queue *q)
 {
-	p->num_jobs -= 1;
+	bool found = false;
+	int res;
+
+	res = pthread_mutex_lock(&q->mutex);
+	assert(res == 0);
+
+	if (q->num_jobs != 0) {
+		q->num_jobs -= 1;
+		found = true;
+	}
+
+	res = pthread_mutex_unlock(&q->mutex);
+	assert(res == 0);
+
+	return found;
 }
 
 static void *pthreadpool_server(void *arg)
 {
 	struct pthreadpool *pool = (struct pthreadpool *)arg;
+	unsigned idx;
 	int res;
 
 	res = pthread_mutex_lock(&pool->mutex);
@@ -577,6 +773,12 @@ static void *pthreadpool_server(void *arg)
 		return NULL;
 	}
 
+	/*
+	 * Pick our home queue
+	 */
+	idx = pool->next_worker;
+	pool->next_worker = (pool->next_worker + 1) % pool->num_queues;
+
 	while (1) {
 		struct timespec ts;
 		struct pthreadpool_job job;
@@ -589,7 +791,8 @@ static void *pthreadpool_server(void *arg)
 		clock_gettime(CLOCK_REALTIME, &ts);
 		ts.tv_sec += 1;
 
-		while ((pool->num_jobs == 0) && !pool->stopped) {
+		while ((pthreadpool_count_jobs(pool) == 0) &&
+		       !pool->stopped) {
 
 			pool->num_idle += 1;
 			res = pthread_cond_timedwait(
@@ -628,7 +831,7 @@ static void *pthreadpool_server(void *arg)
 
 			if (res == ETIMEDOUT) {
 
-				if (pool->num_jobs == 0) {
+				if (pthreadpool_count_jobs(pool) == 0) {
 					/*
 					 * we timed out and still no work for
 					 * us. Exit.
@@ -642,31 +845,38 @@ static void *pthreadpool_server(void *arg)
 			assert(res == 0);
 		}
 
-		if (pthreadpool_get_job(pool, &job)) {
-			int ret;
+		if (pool->stopped) {
+			pthreadpool_server_exit(pool);
+			return NULL;
+		}
 
-			/*
-			 * Do the work with the mutex unlocked
-			 */
+		/*
+		 * Do the work with pool->mutex unlocked. We only need
+		 * it again when all queues are empty and we go idle.
+		 */
 
-			res = pthread_mutex_unlock(&pool->mutex);
-			assert(res == 0);
+		res = pthread_mutex_unlock(&pool->mutex);
+		assert(res == 0);
+
+		while (pthreadpool_get_job(pool, idx, &job)) {
+			int ret;
 
 			job.fn(job.private_data);
 
 			ret = pool->signal_fn(job.id,
 					      job.fn, job.private_data,
 					      pool->signal_fn_private_data);
-
-			res = pthread_mutex_lock(&pool->mutex);
-			assert(res == 0);
-
 			if (ret != 0) {
+				res = pthread_mutex_lock(&pool->mutex);
+				assert(res == 0);
 				pthreadpool_server_exit(pool);
 				return NULL;
 			}
 		}
 
+		res = pthread_mutex_lock(&pool->mutex);
+		assert(res == 0);
+
 		if (pool->stopped) {
 			/*
 			 * we're asked to stop processing jobs, so exit
@@ -725,6 +935,7 @@ static int pthreadpool_create_thread(struct pthreadpool *pool)
 int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 			void (*fn)(void *private_data), void *private_data)
 {
+	struct pthreadpool_queue *q;
 	int res;
 	int unlock_res;
 
@@ -759,21 +970,29 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 	}
 
 	/*
-	 * Add job to the end of the queue
+	 * Add job to the end of the next queue, idle threads steal
+	 * it from there if its owner is busy.
 	 */
-	if (!pthreadpool_put_job(pool, job_id, fn, private_data)) {
+	q = &pool->queues[pool->next_queue];
+
+	if (!pthreadpool_put_job(q, job_id, fn, private_data)) {
 		unlock_res = pthread_mutex_unlock(&pool->mutex);
 		assert(unlock_res == 0);
 		return ENOMEM;
 	}
 
+	pool->next_queue = (pool->next_queue + 1) % pool->num_queues;
+
 	if (pool->num_idle > 0) {
 		/*
 		 * We have idle threads, wake one.
 		 */
 		res = pthread_cond_signal(&pool->condvar);
-		if (res != 0) {
-			pthreadpool_undo_put_job(pool);
+		if ((res != 0) && !pthreadpool_undo_put_job(q)) {
+			/*
+			 * A busy thread already took the job
+			 */
+			res = 0;
 		}
 		unlock_res = pthread_mutex_unlock(&pool->mutex);
 		assert(unlock_res == 0);
@@ -806,7 +1025,7 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 		return 0;
 	}
 
-	pthreadpool_undo_put_job(pool);
+	pthreadpool_undo_put_job(q);
 
 	unlock_res = pthread_mutex_unlock(&pool->mutex);
 	assert(unlock_res == 0);
@@ -814,24 +1033,22 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 	return res;
 }
 
-size_t pthreadpool_cancel_job(struct pthreadpool *pool, int job_id,
-			      void (*fn)(void *private_data), void *private_data)
+static size_t pthreadpool_queue_cancel_job(struct pthreadpool_queue *q,
+					   int job_id,
+					   void (*fn)(void *private_data),
+					   void *private_data)
 {
-	int res;
 	size_t i, j;
 	size_t num = 0;
+	int res;
 
-	assert(!pool->destroyed);
-
-	res = pthread_mutex_lock(&pool->mutex);
-	if (res != 0) {
-		return res;
-	}
+	res = pthread_mutex_lock(&q->mutex);
+	assert(res == 0);
 
-	for (i = 0, j = 0; i < pool->num_jobs; i++) {
-		size_t idx = (pool->head + i) % pool->jobs_array_len;
-		size_t new_idx = (pool->head + j) % pool->jobs_array_len;
-		struct pthreadpool_job *job = &pool->jobs[idx];
+	for (i = 0, j = 0; i < q->num_jobs; i++) {
+		size_t idx = (q->head + i) % q->jobs_array_len;
+		size_t new_idx = (q->head + j) % q->jobs_array_len;
+		struct pthreadpool_job *job = &q->jobs[idx];
 
 		if ((job->private_data == private_data) &&
 		    (job->id == job_id) &&
@@ -849,12 +1066,37 @@ size_t pthreadpool_cancel_job(struct pthreadpool *pool, int job_id,
 		 * then i), we need to fill possible gaps in the logical list.
 		 */
 		if (j < i) {
-			pool->jobs[new_idx] = *job;
+			q->jobs[new_idx] = *job;
 		}
 		j++;
 	}
 
-	pool->num_jobs -= num;
+	q->num_jobs -= num;
+
+	res = pthread_mutex_unlock(&q->mutex);
+	assert(res == 0);
+
+	return num;
+}
+
+size_t pthreadpool_cancel_job(struct pthreadpool *pool, int job_id,
+			      void (*fn)(void *private_data), void *private_data)
+{
+	int res;
+	unsigned i;
+	size_t num = 0;
+
+	assert(!pool->destroyed);
+
+	res = pthread_mutex_lock(&pool->mutex);
+	if (res != 0) {
+		return res;
+	}
+
+	for (i = 0; i < pool->num_queues; i++) {
+		num += pthreadpool_queue_cancel_job(
+			&pool->queues[i], job_id, fn, private_data);
+	}
 
 	res = pthread_mutex_unlock(&pool->mutex);
 	assert(res == 0);
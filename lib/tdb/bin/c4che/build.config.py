@@ -0,0 +1,2 @@
+version = 0x2001a00
+tools = [{'tool': 'gnu_dirs', 'tooldir': None, 'funs': None}, {'tool': 'wafsamba', 'tooldir': None, 'funs': None}, {'tool': 'ar', 'tooldir': None, 'funs': None}, {'tool': 'c', 'tooldir': None, 'funs': None}, {'tool': 'gcc', 'tooldir': None, 'funs': None}, {'tool': 'compiler_c', 'tooldir': None, 'funs': None}, {'tool': 'gccdeps', 'tooldir': None, 'funs': None}, {'tool': 'python', 'tooldir': None, 'funs': None}]
@@ -398,6 +398,14 @@ _PUBLIC_ int tdb_check(struct tdb_context *tdb,
 			record_offset(hashes[h], off);
 	}
 
+	/* The heads of the size class freelists are in the header. */
+	for (h = 0; h + 1 < tdb_num_freelists(tdb); h++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, h), &off) == -1)
+			goto free;
+		if (off)
+			record_offset(hashes[0], off);
+	}
+
 	/* For each record, read it in and check it's ok. */
 	for (off = TDB_DATA_START(tdb->hash_size);
 	     off < tdb->map_size;
@@ -58,22 +58,13 @@ static tdb_off_t tdb_dump_record(struct tdb_context *tdb, int hash,
 	return rec.next;
 }
 
-static int tdb_dump_chain(struct tdb_context *tdb, int i)
+static void tdb_dump_list(struct tdb_context *tdb, int i, tdb_off_t top)
 {
 	struct tdb_chainwalk_ctx chainwalk;
-	tdb_off_t rec_ptr, top;
-
-	if (i == -1) {
-		top = FREELIST_TOP;
-	} else {
-		top = TDB_HASH_TOP(i);
-	}
-
-	if (tdb_lock(tdb, i, F_WRLCK) != 0)
-		return -1;
+	tdb_off_t rec_ptr;
 
 	if (tdb_ofs_read(tdb, top, &rec_ptr) == -1)
-		return tdb_unlock(tdb, i, F_WRLCK);
+		return;
 
 	tdb_chainwalk_init(&chainwalk, rec_ptr);
 
@@ -89,6 +80,22 @@ static int tdb_dump_chain(struct tdb_context *tdb, int i)
 			break;
 		}
 	}
+}
+
+static int tdb_dump_chain(struct tdb_context *tdb, int i)
+{
+	unsigned fl;
+
+	if (tdb_lock(tdb, i, F_WRLCK) != 0)
+		return -1;
+
+	if (i != -1) {
+		tdb_dump_list(tdb, i, TDB_HASH_TOP(i));
+	} else {
+		for (fl = 0; fl < tdb_num_freelists(tdb); fl++) {
+			tdb_dump_list(tdb, i, tdb_freelist_top(tdb, fl));
+		}
+	}
 
 	return tdb_unlock(tdb, i, F_WRLCK);
 }
@@ -109,38 +116,47 @@ _PUBLIC_ int tdb_printfreelist(struct tdb_context *tdb)
 	long total_free = 0;
 	tdb_off_t offset, rec_ptr;
 	struct tdb_record rec;
+	unsigned fl;
 
 	if ((ret = tdb_lock(tdb, -1, F_WRLCK)) != 0)
 		return ret;
 
-	offset = FREELIST_TOP;
+	for (fl = 0; fl < tdb_num_freelists(tdb); fl++) {
 
-	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, offset, &rec_ptr) == -1) {
-		tdb_unlock(tdb, -1, F_WRLCK);
-		return 0;
-	}
+		offset = tdb_freelist_top(tdb, fl);
 
-	printf("freelist top=[0x%08x]\n", rec_ptr );
-	while (rec_ptr) {
-		if (tdb->methods->tdb_read(tdb, rec_ptr, (char *)&rec,
-					   sizeof(rec), DOCONV()) == -1) {
+		/* read in the freelist top */
+		if (tdb_ofs_read(tdb, offset, &rec_ptr) == -1) {
 			tdb_unlock(tdb, -1, F_WRLCK);
-			return -1;
+			return 0;
 		}
 
-		if (rec.magic != TDB_FREE_MAGIC) {
-			printf("bad magic 0x%08x in free list\n", rec.magic);
-			tdb_unlock(tdb, -1, F_WRLCK);
-			return -1;
+		if (tdb_num_freelists(tdb) > 1) {
+			printf("freelist %u (rec_len >= %u) top=[0x%08x]\n",
+			       fl, tdb_freelist_min_len(tdb, fl), rec_ptr);
+		} else {
+			printf("freelist top=[0x%08x]\n", rec_ptr );
+		}
+		while (rec_ptr) {
+			if (tdb->methods->tdb_read(tdb, rec_ptr, (char *)&rec,
+						   sizeof(rec), DOCONV()) == -1) {
+				tdb_unlock(tdb, -1, F_WRLCK);
+				return -1;
+			}
+
+			if (rec.magic != TDB_FREE_MAGIC) {
+				printf("bad magic 0x%08x in free list\n", rec.magic);
+				tdb_unlock(tdb, -1, F_WRLCK);
+				return -1;
+			}
+
+			printf("entry offset=[0x%08x], rec.rec_len = [0x%08x (%u)] (end = 0x%08x)\n",
+			       rec_ptr, rec.rec_len, rec.rec_len, rec_ptr + rec.rec_len);
+			total_free += rec.rec_len;
+
+			/* move to the next record */
+			rec_ptr = rec.next;
 		}
-
-		printf("entry offset=[0x%08x], rec.rec_len = [0x%08x (%u)] (end = 0x%08x)\n",
-		       rec_ptr, rec.rec_len, rec.rec_len, rec_ptr + rec.rec_len);
-		total_free += rec.rec_len;
-
-		/* move to the next record */
-		rec_ptr = rec.next;
 	}
 	printf("total rec_len = [0x%08lx (%lu)]\n", total_free, total_free);
 
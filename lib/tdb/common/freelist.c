@@ -27,6 +27,46 @@
 
 #include "tdb_private.h"
 
+/* number of freelists: one per size class, or just the classic one */
+unsigned tdb_num_freelists(struct tdb_context *tdb)
+{
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		return TDB_NUM_FREELIST_CLASSES;
+	}
+	return 1;
+}
+
+/* offset of the pointer to the first record in freelist fl */
+tdb_off_t tdb_freelist_top(struct tdb_context *tdb, unsigned fl)
+{
+	if (fl + 1 >= tdb_num_freelists(tdb)) {
+		return FREELIST_TOP;
+	}
+	return offsetof(struct tdb_header, freelist_classes) +
+		fl * sizeof(tdb_off_t);
+}
+
+/* smallest rec_len of the records on freelist fl */
+tdb_len_t tdb_freelist_min_len(struct tdb_context *tdb, unsigned fl)
+{
+	if (fl == 0 || fl >= tdb_num_freelists(tdb)) {
+		return 0;
+	}
+	return 64U << fl;
+}
+
+/* the freelist a free record of rec_len belongs to */
+unsigned tdb_freelist_for_len(struct tdb_context *tdb, tdb_len_t rec_len)
+{
+	unsigned num_freelists = tdb_num_freelists(tdb);
+	unsigned fl = 0;
+
+	while ((fl + 1 < num_freelists) && (rec_len >= (128U << fl))) {
+		fl++;
+	}
+	return fl;
+}
+
 /* read a freelist record and check for simple errors */
 int tdb_rec_free_read(struct tdb_context *tdb, tdb_off_t off, struct tdb_record *rec)
 {
@@ -225,10 +265,15 @@ static int check_merge_with_left_record(struct tdb_context *tdb,
  * next_ptr will contain the original record's next pointer after
  * successful merging (which will be lost after merging), so that
  * the caller can update the last pointer.
+ *
+ * The left record pointer and its length before merging can be
+ * retrieved as result in lp and old_len.
  */
 static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
 					    tdb_off_t rec_ptr,
-					    tdb_off_t *next_ptr)
+					    tdb_off_t *next_ptr,
+					    tdb_off_t *lp,
+					    tdb_len_t *old_len)
 {
 	tdb_off_t left_ptr;
 	struct tdb_record rec, left_rec;
@@ -251,6 +296,10 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
 		return -1;
 	}
 
+	if (old_len != NULL) {
+		*old_len = left_rec.rec_len;
+	}
+
 	ret = merge_with_left_record(tdb, left_ptr, &left_rec, &rec);
 	if (ret != 0) {
 		return -1;
@@ -260,6 +309,88 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
 		*next_ptr = rec.next;
 	}
 
+	if (lp != NULL) {
+		*lp = left_ptr;
+	}
+
+	return 1;
+}
+
+/**
+ * A free record grew from old_len by merging its right neighbour
+ * into it. If that moved it into a larger size class, unlink it
+ * from the list of its old class and prepend it to the new one.
+ *
+ * The record is read again, the caller may have changed its next
+ * pointer after the merge. Finding the record on its old list
+ * needs a walk of that list, but this only happens when a record
+ * crosses a class boundary.
+ *
+ * Return code:
+ *  -1 upon error
+ *   0 if the record stayed in its class
+ *   1 if it was moved to another list
+ */
+static int tdb_freelist_refile(struct tdb_context *tdb, tdb_off_t rec_ptr,
+			       tdb_len_t old_len)
+{
+	struct tdb_chainwalk_ctx chainwalk;
+	struct tdb_record rec;
+	tdb_off_t last_ptr, ptr, top;
+	unsigned old_fl, new_fl;
+
+	if (tdb_rec_free_read(tdb, rec_ptr, &rec) == -1) {
+		return -1;
+	}
+
+	old_fl = tdb_freelist_for_len(tdb, old_len);
+	new_fl = tdb_freelist_for_len(tdb, rec.rec_len);
+	if (new_fl == old_fl) {
+		return 0;
+	}
+
+	last_ptr = tdb_freelist_top(tdb, old_fl);
+	if (tdb_ofs_read(tdb, last_ptr, &ptr) == -1) {
+		return -1;
+	}
+	tdb_chainwalk_init(&chainwalk, ptr);
+
+	while (ptr != rec_ptr) {
+		bool ok;
+
+		if (ptr == 0) {
+			tdb->ecode = TDB_ERR_CORRUPT;
+			TDB_LOG((tdb, TDB_DEBUG_FATAL,
+				 "tdb_freelist_refile: record %u not on "
+				 "freelist %u\n", rec_ptr, old_fl));
+			return -1;
+		}
+		last_ptr = ptr;
+		if (tdb_ofs_read(tdb, ptr, &ptr) == -1) {
+			return -1;
+		}
+		ok = tdb_chainwalk_check(tdb, &chainwalk, ptr);
+		if (!ok) {
+			return -1;
+		}
+	}
+
+	/* unlink it from the old list */
+	if (tdb_ofs_write(tdb, last_ptr, &rec.next) == -1) {
+		return -1;
+	}
+
+	/* and prepend it to the new one */
+	top = tdb_freelist_top(tdb, new_fl);
+	if (tdb_ofs_read(tdb, top, &rec.next) == -1 ||
+	    tdb_rec_write(tdb, rec_ptr, &rec) == -1 ||
+	    tdb_ofs_write(tdb, top, &rec_ptr) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL,
+			 "tdb_freelist_refile: write failed at %u\n",
+			 rec_ptr));
+		return -1;
+	}
+
 	return 1;
 }
 
@@ -276,6 +407,8 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
  */
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 {
+	tdb_off_t top, left_ptr;
+	struct tdb_record left_rec;
 	int ret;
 
 	/* Allocation and tailer lock */
@@ -288,22 +421,30 @@ int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 		goto fail;
 	}
 
-	ret = check_merge_with_left_record(tdb, offset, rec, NULL, NULL);
+	ret = check_merge_with_left_record(tdb, offset, rec,
+					   &left_ptr, &left_rec);
 	if (ret == -1) {
 		goto fail;
 	}
 	if (ret == 1) {
-		/* merged */
+		/* merged, the left record may have outgrown its class */
+		ret = tdb_freelist_refile(
+			tdb, left_ptr,
+			left_rec.rec_len - sizeof(*rec) - rec->rec_len);
+		if (ret == -1) {
+			goto fail;
+		}
 		goto done;
 	}
 
 	/* Nothing to merge, prepend to free list */
 
 	rec->magic = TDB_FREE_MAGIC;
+	top = tdb_freelist_top(tdb, tdb_freelist_for_len(tdb, rec->rec_len));
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec->next) == -1 ||
+	if (tdb_ofs_read(tdb, top, &rec->next) == -1 ||
 	    tdb_rec_write(tdb, offset, rec) == -1 ||
-	    tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
+	    tdb_ofs_write(tdb, top, &offset) == -1) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free record write failed at offset=%u\n", offset));
 		goto fail;
 	}
@@ -327,11 +468,17 @@ done:
    Note that we try to allocate by grabbing data from the end of an existing record,
    not the beginning. This is so the left merge in a free is more likely to be
    able to free up the record without fragmentation
+
+   fl is the freelist the record is on, if the shortened record becomes
+   too small for that size class it is moved to the right one.
  */
 static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 				  tdb_len_t length, tdb_off_t rec_ptr,
-				  struct tdb_record *rec, tdb_off_t last_ptr)
+				  struct tdb_record *rec, tdb_off_t last_ptr,
+				  unsigned fl)
 {
+	unsigned new_fl;
+	tdb_off_t new_top = 0;
 #define MIN_REC_SIZE (sizeof(struct tdb_record) + sizeof(tdb_off_t) + 8)
 
 	if (rec->rec_len < length + MIN_REC_SIZE) {
@@ -352,12 +499,30 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 
 	/* we're going to just shorten the existing record */
 	rec->rec_len -= (length + sizeof(*rec));
+
+	new_fl = tdb_freelist_for_len(tdb, rec->rec_len);
+	if (new_fl < fl) {
+		/* unlink it, it's prepended to its new list below */
+		if (tdb_ofs_write(tdb, last_ptr, &rec->next) == -1) {
+			return 0;
+		}
+		new_top = tdb_freelist_top(tdb, new_fl);
+		if (tdb_ofs_read(tdb, new_top, &rec->next) == -1) {
+			return 0;
+		}
+	}
+
 	if (tdb_rec_write(tdb, rec_ptr, rec) == -1) {
 		return 0;
 	}
 	if (update_tailer(tdb, rec_ptr, rec) == -1) {
 		return 0;
 	}
+	if (new_top != 0) {
+		if (tdb_ofs_write(tdb, new_top, &rec_ptr) == -1) {
+			return 0;
+		}
+	}
 
 	/* and setup the new record */
 	rec_ptr += sizeof(*rec) + rec->rec_len;
@@ -377,46 +542,43 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 	return rec_ptr;
 }
 
-/* allocate some space from the free list. The offset returned points
-   to a unconnected tdb_record within the database with room for at
-   least length bytes of total data
+struct tdb_bestfit {
+	tdb_off_t rec_ptr, last_ptr;
+	tdb_len_t rec_len;
+};
 
-   0 is returned if the space could not be allocated
+/*
+   walk freelist fl looking for the best fitting record with room for at
+   least length bytes. With first_fit the first record big enough is
+   taken.
+
+   -1 is returned on error, bestfit->rec_ptr is 0 if nothing was found
  */
-static tdb_off_t tdb_allocate_from_freelist(
-	struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+static int tdb_freelist_bestfit(struct tdb_context *tdb, unsigned fl,
+				tdb_len_t length, bool first_fit,
+				struct tdb_record *rec,
+				struct tdb_bestfit *bestfit,
+				bool *merge_created_candidate)
 {
-	tdb_off_t rec_ptr, last_ptr, newrec_ptr;
+	tdb_off_t rec_ptr, last_ptr;
 	struct tdb_chainwalk_ctx chainwalk;
 	bool modified;
-	struct {
-		tdb_off_t rec_ptr, last_ptr;
-		tdb_len_t rec_len;
-	} bestfit;
-	float multiplier = 1.0;
-	bool merge_created_candidate;
-
-	/* over-allocate to reduce fragmentation */
-	length *= 1.25;
-
-	/* Extra bytes required for tailer */
-	length += sizeof(tdb_off_t);
-	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+	float multiplier;
 
- again:
-	merge_created_candidate = false;
-	last_ptr = FREELIST_TOP;
+restart:
+	last_ptr = tdb_freelist_top(tdb, fl);
 
 	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec_ptr) == -1)
-		return 0;
+	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1)
+		return -1;
 
 	modified = false;
 	tdb_chainwalk_init(&chainwalk, rec_ptr);
+	multiplier = 1.0;
 
-	bestfit.rec_ptr = 0;
-	bestfit.last_ptr = 0;
-	bestfit.rec_len = 0;
+	bestfit->rec_ptr = 0;
+	bestfit->last_ptr = 0;
+	bestfit->rec_len = 0;
 
 	/*
 	   this is a best fit allocation strategy. Originally we used
@@ -429,20 +591,40 @@ static tdb_off_t tdb_allocate_from_freelist(
 		struct tdb_record left_rec;
 
 		if (tdb_rec_free_read(tdb, rec_ptr, rec) == -1) {
-			return 0;
+			return -1;
 		}
 
 		ret = check_merge_with_left_record(tdb, rec_ptr, rec,
 						   &left_ptr, &left_rec);
 		if (ret == -1) {
-			return 0;
+			return -1;
 		}
 		if (ret == 1) {
 			/* merged */
 			rec_ptr = rec->next;
 			ret = tdb_ofs_write(tdb, last_ptr, &rec->next);
 			if (ret == -1) {
-				return 0;
+				return -1;
+			}
+
+			/*
+			 * If the left neighbour outgrew its size class
+			 * it is moved to another list. It might have been
+			 * on this one, even right before the current
+			 * record, so neither last_ptr nor the best fit
+			 * so far can be trusted anymore: start over.
+			 */
+			ret = tdb_freelist_refile(
+				tdb, left_ptr,
+				left_rec.rec_len - sizeof(*rec) - rec->rec_len);
+			if (ret == -1) {
+				return -1;
+			}
+			if (ret == 1) {
+				if (left_rec.rec_len > length) {
+					*merge_created_candidate = true;
+				}
+				goto restart;
 			}
 
 			/*
@@ -466,12 +648,12 @@ static tdb_off_t tdb_allocate_from_freelist(
 			 * This way we can avoid expanding the database.
 			 */
 
-			if (bestfit.rec_ptr == left_ptr) {
-				bestfit.rec_len = left_rec.rec_len;
+			if (bestfit->rec_ptr == left_ptr) {
+				bestfit->rec_len = left_rec.rec_len;
 			}
 
 			if (left_rec.rec_len > length) {
-				merge_created_candidate = true;
+				*merge_created_candidate = true;
 			}
 
 			modified = true;
@@ -480,11 +662,11 @@ static tdb_off_t tdb_allocate_from_freelist(
 		}
 
 		if (rec->rec_len >= length) {
-			if (bestfit.rec_ptr == 0 ||
-			    rec->rec_len < bestfit.rec_len) {
-				bestfit.rec_len = rec->rec_len;
-				bestfit.rec_ptr = rec_ptr;
-				bestfit.last_ptr = last_ptr;
+			if (bestfit->rec_ptr == 0 ||
+			    rec->rec_len < bestfit->rec_len) {
+				bestfit->rec_len = rec->rec_len;
+				bestfit->rec_ptr = rec_ptr;
+				bestfit->last_ptr = last_ptr;
 			}
 		}
 
@@ -496,16 +678,20 @@ static tdb_off_t tdb_allocate_from_freelist(
 			bool ok;
 			ok = tdb_chainwalk_check(tdb, &chainwalk, rec_ptr);
 			if (!ok) {
-				return 0;
+				return -1;
 			}
 		}
 
+		if (first_fit && bestfit->rec_len > 0) {
+			break;
+		}
+
 		/* if we've found a record that is big enough, then
 		   stop searching if its also not too big. The
 		   definition of 'too big' changes as we scan
 		   through */
-		if (bestfit.rec_len > 0 &&
-		    bestfit.rec_len < length * multiplier) {
+		if (bestfit->rec_len > 0 &&
+		    bestfit->rec_len < length * multiplier) {
 			break;
 		}
 
@@ -516,14 +702,58 @@ static tdb_off_t tdb_allocate_from_freelist(
 		multiplier *= 1.05;
 	}
 
-	if (bestfit.rec_ptr != 0) {
+	return 0;
+}
+
+/* allocate some space from the free list. The offset returned points
+   to a unconnected tdb_record within the database with room for at
+   least length bytes of total data
+
+   0 is returned if the space could not be allocated
+ */
+static tdb_off_t tdb_allocate_from_freelist(
+	struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+{
+	unsigned num_freelists = tdb_num_freelists(tdb);
+	unsigned first_fl, fl;
+	struct tdb_bestfit bestfit;
+	bool merge_created_candidate;
+	int ret;
+
+	/* over-allocate to reduce fragmentation */
+	length *= 1.25;
+
+	/* Extra bytes required for tailer */
+	length += sizeof(tdb_off_t);
+	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+
+	first_fl = tdb_freelist_for_len(tdb, length);
+
+ again:
+	merge_created_candidate = false;
+
+	/*
+	 * Only the size class of length needs a best fit search, all
+	 * records in the larger classes are big enough, so just take
+	 * the first one from the smallest non-empty class.
+	 */
+	for (fl = first_fl; fl < num_freelists; fl++) {
+		ret = tdb_freelist_bestfit(tdb, fl, length, fl > first_fl,
+					   rec, &bestfit,
+					   &merge_created_candidate);
+		if (ret == -1) {
+			return 0;
+		}
+		if (bestfit.rec_ptr == 0) {
+			continue;
+		}
+
 		if (tdb_rec_free_read(tdb, bestfit.rec_ptr, rec) == -1) {
 			return 0;
 		}
 
-		newrec_ptr = tdb_allocate_ofs(tdb, length, bestfit.rec_ptr,
-					      rec, bestfit.last_ptr);
-		return newrec_ptr;
+		return tdb_allocate_ofs(tdb, length, bestfit.rec_ptr,
+					rec, bestfit.last_ptr, fl);
 	}
 
 	if (merge_created_candidate) {
@@ -647,6 +877,8 @@ blocking_freelist_allocate:
 static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 				       int *count_records, int *count_merged)
 {
+	unsigned num_freelists = tdb_num_freelists(tdb);
+	unsigned fl;
 	tdb_off_t cur, next;
 	int count = 0;
 	int merged = 0;
@@ -657,32 +889,61 @@ static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 		return -1;
 	}
 
-	cur = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
-		tdb_off_t next2;
+	for (fl = 0; fl < num_freelists; fl++) {
+		int fl_count = count;
+		int fl_merged = 0;
 
-		count++;
+	restart:
+		/* records merged away were counted before */
+		count = fl_count + fl_merged;
 
-		ret = check_merge_ptr_with_left_record(tdb, next, &next2);
-		if (ret == -1) {
-			goto done;
-		}
-		if (ret == 1) {
-			/*
-			 * merged:
-			 * now let cur->next point to next2 instead of next
-			 */
+		cur = tdb_freelist_top(tdb, fl);
+		while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
+			tdb_off_t next2, left_ptr;
+			tdb_len_t left_len;
+
+			count++;
 
-			ret = tdb_ofs_write(tdb, cur, &next2);
-			if (ret != 0) {
+			ret = check_merge_ptr_with_left_record(tdb, next,
+							       &next2,
+							       &left_ptr,
+							       &left_len);
+			if (ret == -1) {
 				goto done;
 			}
+			if (ret == 1) {
+				/*
+				 * merged:
+				 * now let cur->next point to next2
+				 * instead of next
+				 */
+
+				ret = tdb_ofs_write(tdb, cur, &next2);
+				if (ret != 0) {
+					goto done;
+				}
+
+				next = next2;
+				merged++;
+				fl_merged++;
+
+				/*
+				 * If the left record moved to another
+				 * size class, cur might have been it:
+				 * walk this list again.
+				 */
+				ret = tdb_freelist_refile(tdb, left_ptr,
+							  left_len);
+				if (ret == -1) {
+					goto done;
+				}
+				if (ret == 1) {
+					goto restart;
+				}
+			}
 
-			next = next2;
-			merged++;
+			cur = next;
 		}
-
-		cur = next;
 	}
 
 	if (count_records != NULL) {
@@ -705,6 +966,8 @@ done:
  */
 static int tdb_freelist_size_no_merge(struct tdb_context *tdb)
 {
+	unsigned num_freelists = tdb_num_freelists(tdb);
+	unsigned fl;
 	tdb_off_t ptr;
 	int count=0;
 
@@ -712,9 +975,11 @@ static int tdb_freelist_size_no_merge(struct tdb_context *tdb)
 		return -1;
 	}
 
-	ptr = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
-		count++;
+	for (fl = 0; fl < num_freelists; fl++) {
+		ptr = tdb_freelist_top(tdb, fl);
+		while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
+			count++;
+		}
 	}
 
 	tdb_unlock(tdb, -1, F_RDLCK);
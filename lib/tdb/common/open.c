@@ -84,6 +84,9 @@ static int tdb_new_database(struct tdb_context *tdb, struct tdb_header *header,
 	if (tdb->flags & TDB_MUTEX_LOCKING) {
 		newdb->feature_flags |= TDB_FEATURE_FLAG_MUTEX;
 	}
+	if (tdb->flags & TDB_FREELIST_CLASSES) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_FREELIST_CLASSES;
+	}
 
 	/*
 	 * If we have any features we add the FEATURE_FLAG_MAGIC, overwriting the
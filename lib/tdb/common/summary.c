@@ -24,6 +24,7 @@
 	"Incompatible hash: %s\n" \
 	"Active/supported feature flags: 0x%08x/0x%08x\n" \
 	"Robust mutexes locking: %s\n" \
+	"Size class freelists: %s\n" \
 	"Smallest/average/largest keys: %zu/%zu/%zu\n" \
 	"Smallest/average/largest data: %zu/%zu/%zu\n" \
 	"Smallest/average/largest padding: %zu/%zu/%zu\n" \
@@ -186,6 +187,7 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 (tdb->hash_fn == tdb_jenkins_hash)?"yes":"no",
 		 (unsigned)tdb->feature_flags, TDB_SUPPORTED_FEATURE_FLAGS,
 		 (tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX)?"yes":"no",
+		 (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)?"yes":"no",
 		 keys.min, tally_mean(&keys), keys.max,
 		 data.min, tally_mean(&data), data.max,
 		 extra.min, tally_mean(&extra), extra.max,
@@ -780,6 +780,259 @@ _PUBLIC_ int tdb_storev(struct tdb_context *tdb, TDB_DATA key,
 	return ret;
 }
 
+/*
+ * Support for the tdb_*_many() functions: sort the keys by hash chain,
+ * so that every chain is locked only once, and call fn for every key
+ * with the chain lock held. Within a chain the keys are processed in
+ * the order they were passed in.
+ */
+
+struct tdb_many_entry {
+	uint32_t bucket;
+	uint32_t hash;
+	size_t idx;
+};
+
+static int tdb_many_entry_cmp(const void *p1, const void *p2)
+{
+	const struct tdb_many_entry *e1 = p1;
+	const struct tdb_many_entry *e2 = p2;
+
+	if (e1->bucket != e2->bucket) {
+		return (e1->bucket < e2->bucket) ? -1 : 1;
+	}
+	if (e1->idx != e2->idx) {
+		return (e1->idx < e2->idx) ? -1 : 1;
+	}
+	return 0;
+}
+
+static int tdb_many_walk(struct tdb_context *tdb,
+			 const TDB_DATA *keys,
+			 size_t num_keys,
+			 int ltype,
+			 int (*fn)(struct tdb_context *tdb,
+				   TDB_DATA key,
+				   uint32_t hash,
+				   size_t idx,
+				   void *private_data),
+			 void *private_data)
+{
+	struct tdb_many_entry *entries;
+	size_t i;
+	int ret = 0;
+
+	if (num_keys == 0) {
+		return 0;
+	}
+	if (num_keys > SIZE_MAX / sizeof(struct tdb_many_entry)) {
+		tdb->ecode = TDB_ERR_OOM;
+		return -1;
+	}
+
+	entries = malloc(num_keys * sizeof(struct tdb_many_entry));
+	if (entries == NULL) {
+		tdb->ecode = TDB_ERR_OOM;
+		return -1;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		TDB_DATA key = keys[i];
+
+		entries[i].hash = tdb->hash_fn(&key);
+		entries[i].bucket = BUCKET(entries[i].hash);
+		entries[i].idx = i;
+	}
+
+	qsort(entries, num_keys, sizeof(struct tdb_many_entry),
+	      tdb_many_entry_cmp);
+
+	i = 0;
+	while (i < num_keys) {
+		uint32_t bucket = entries[i].bucket;
+
+		if (tdb_lock(tdb, bucket, ltype) == -1) {
+			ret = -1;
+			break;
+		}
+
+		while ((i < num_keys) && (entries[i].bucket == bucket)) {
+			struct tdb_many_entry *e = &entries[i++];
+
+			ret = fn(tdb, keys[e->idx], e->hash, e->idx,
+				 private_data);
+			if (ret != 0) {
+				break;
+			}
+		}
+
+		tdb_unlock(tdb, bucket, ltype);
+
+		if (ret != 0) {
+			break;
+		}
+	}
+
+	free(entries);
+	return ret;
+}
+
+struct tdb_parse_many_state {
+	size_t idx;
+	int (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		      void *private_data);
+	void *private_data;
+};
+
+static int tdb_parse_many_parser(TDB_DATA key, TDB_DATA data,
+				 void *private_data)
+{
+	struct tdb_parse_many_state *state = private_data;
+
+	return state->parser(state->idx, key, data, state->private_data);
+}
+
+static int tdb_parse_many_fn(struct tdb_context *tdb, TDB_DATA key,
+			     uint32_t hash, size_t idx, void *private_data)
+{
+	struct tdb_parse_many_state *state = private_data;
+	struct tdb_record rec;
+	tdb_off_t rec_ptr;
+	int ret;
+
+	rec_ptr = tdb_find(tdb, key, hash, &rec);
+	if (rec_ptr == 0) {
+		/* record not found */
+		tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, -1);
+		return 0;
+	}
+	tdb_trace_1rec_ret(tdb, "tdb_parse_record", key, 0);
+
+	state->idx = idx;
+
+	ret = tdb_parse_data(tdb, key, rec_ptr + sizeof(rec) + rec.key_len,
+			     rec.data_len, tdb_parse_many_parser, state);
+	return ret;
+}
+
+/*
+ * Parse many records, taking every hash chain lock only once.
+ * See tdb_parse_record() for the restrictions of the parser.
+ *
+ * Keys which are not found are skipped. If the parser returns
+ * something else than 0, we stop and pass that up to the caller.
+ */
+_PUBLIC_ int tdb_parse_many(struct tdb_context *tdb,
+			    const TDB_DATA *keys, size_t num_keys,
+			    int (*parser)(size_t idx, TDB_DATA key,
+					  TDB_DATA data, void *private_data),
+			    void *private_data)
+{
+	struct tdb_parse_many_state state = {
+		.parser = parser, .private_data = private_data,
+	};
+
+	return tdb_many_walk(tdb, keys, num_keys, F_RDLCK,
+			     tdb_parse_many_fn, &state);
+}
+
+static int tdb_fetch_many_fn(struct tdb_context *tdb, TDB_DATA key,
+			     uint32_t hash, size_t idx, void *private_data)
+{
+	TDB_DATA *values = private_data;
+	struct tdb_record rec;
+	tdb_off_t rec_ptr;
+
+	rec_ptr = tdb_find(tdb, key, hash, &rec);
+	if (rec_ptr == 0) {
+		values[idx] = tdb_null;
+		tdb_trace_1rec_retrec(tdb, "tdb_fetch", key, values[idx]);
+		return 0;
+	}
+
+	values[idx].dptr = tdb_alloc_read(
+		tdb, rec_ptr + sizeof(rec) + rec.key_len, rec.data_len);
+	values[idx].dsize = rec.data_len;
+	tdb_trace_1rec_retrec(tdb, "tdb_fetch", key, values[idx]);
+
+	if (values[idx].dptr == NULL) {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Fetch many records, taking every hash chain lock only once.
+ *
+ * values[i] is the result of tdb_fetch(keys[i]), the caller
+ * has to free all of them. On failure all values are tdb_null.
+ */
+_PUBLIC_ int tdb_fetch_many(struct tdb_context *tdb,
+			    const TDB_DATA *keys, TDB_DATA *values,
+			    size_t num_keys)
+{
+	size_t i;
+	int ret;
+
+	for (i=0; i<num_keys; i++) {
+		values[i] = tdb_null;
+	}
+
+	ret = tdb_many_walk(tdb, keys, num_keys, F_RDLCK,
+			    tdb_fetch_many_fn, values);
+	if (ret != 0) {
+		for (i=0; i<num_keys; i++) {
+			SAFE_FREE(values[i].dptr);
+			values[i].dsize = 0;
+		}
+		return -1;
+	}
+
+	return 0;
+}
+
+struct tdb_store_many_state {
+	const TDB_DATA *values;
+	int flag;
+};
+
+static int tdb_store_many_fn(struct tdb_context *tdb, TDB_DATA key,
+			     uint32_t hash, size_t idx, void *private_data)
+{
+	struct tdb_store_many_state *state = private_data;
+	TDB_DATA dbuf = state->values[idx];
+	int ret;
+
+	ret = _tdb_store(tdb, key, dbuf, state->flag, hash);
+	tdb_trace_2rec_flag_ret(tdb, "tdb_store", key, dbuf, state->flag,
+				ret);
+	return ret;
+}
+
+/*
+ * Store many records, taking every hash chain lock only once.
+ *
+ * This is not atomic: If a store fails, we stop and return -1,
+ * but the records stored before are not reverted. Wrap the call
+ * into a transaction if that's needed.
+ */
+_PUBLIC_ int tdb_store_many(struct tdb_context *tdb,
+			    const TDB_DATA *keys, const TDB_DATA *values,
+			    size_t num_keys, int flag)
+{
+	struct tdb_store_many_state state = {
+		.values = values, .flag = flag,
+	};
+
+	if (tdb->read_only || tdb->traverse_read) {
+		tdb->ecode = TDB_ERR_RDONLY;
+		return -1;
+	}
+
+	return tdb_many_walk(tdb, keys, num_keys, F_WRLCK,
+			     tdb_store_many_fn, &state);
+}
+
 /* Append to an entry. Create if not exist. */
 _PUBLIC_ int tdb_append(struct tdb_context *tdb, TDB_DATA key, TDB_DATA new_dbuf)
 {
@@ -1011,10 +1264,12 @@ _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb)
 		}
 	}
 
-	/* wipe the freelist */
-	if (tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
-		TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist\n"));
-		goto failed;
+	/* wipe the freelists */
+	for (i=0;i<tdb_num_freelists(tdb);i++) {
+		if (tdb_ofs_write(tdb, tdb_freelist_top(tdb, i), &offset) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist %d\n", i));
+			goto failed;
+		}
 	}
 
 	/* add all the rest of the file to the freelist, possibly leaving a gap
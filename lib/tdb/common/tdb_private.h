@@ -70,11 +70,24 @@ typedef uint32_t tdb_off_t;
 #define TDB_PAD_U32  0x42424242
 
 #define TDB_FEATURE_FLAG_MUTEX 0x00000001
+#define TDB_FEATURE_FLAG_FREELIST_CLASSES 0x00000002
 
 #define TDB_SUPPORTED_FEATURE_FLAGS ( \
 	TDB_FEATURE_FLAG_MUTEX | \
+	TDB_FEATURE_FLAG_FREELIST_CLASSES | \
 	0)
 
+/*
+ * With TDB_FEATURE_FLAG_FREELIST_CLASSES free records are kept in
+ * TDB_NUM_FREELIST_CLASSES lists segregated by size. Class 0 holds records
+ * with rec_len < 128, class n records with rec_len < (128 << n), the
+ * last class everything larger. The heads of the small classes are
+ * stored in tdb_header.freelist_classes[], the last class is the
+ * classic freelist at FREELIST_TOP. All lists are protected by the
+ * freelist lock.
+ */
+#define TDB_NUM_FREELIST_CLASSES 8
+
 /* NB assumes there is a local variable called "tdb" that is the
  * current context, also takes doubly-parenthesized print-style
  * argument. */
@@ -182,7 +195,9 @@ struct tdb_header {
 	uint32_t magic2_hash; /* hash of TDB_MAGIC. */
 	uint32_t feature_flags;
 	tdb_len_t mutex_size; /* set if TDB_FEATURE_FLAG_MUTEX is set */
-	tdb_off_t reserved[25];
+	/* set if TDB_FEATURE_FLAG_FREELIST_CLASSES is set */
+	tdb_off_t freelist_classes[TDB_NUM_FREELIST_CLASSES-1];
+	tdb_off_t reserved[18];
 };
 
 struct tdb_lock_type {
@@ -301,6 +316,10 @@ int tdb_write_unlock_record(struct tdb_context *tdb, tdb_off_t off);
 int tdb_ofs_read(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 int tdb_ofs_write(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 void *tdb_convert(void *buf, uint32_t size);
+unsigned tdb_num_freelists(struct tdb_context *tdb);
+tdb_off_t tdb_freelist_top(struct tdb_context *tdb, unsigned fl);
+tdb_len_t tdb_freelist_min_len(struct tdb_context *tdb, unsigned fl);
+unsigned tdb_freelist_for_len(struct tdb_context *tdb, tdb_len_t rec_len);
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec);
 tdb_off_t tdb_allocate(struct tdb_context *tdb, int hash, tdb_len_t length,
 		       struct tdb_record *rec);
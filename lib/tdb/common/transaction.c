@@ -1091,17 +1091,20 @@ static bool repack_worthwhile(struct tdb_context *tdb)
 	tdb_off_t ptr;
 	struct tdb_record rec;
 	tdb_len_t total = 0, largest = 0;
+	unsigned fl;
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &ptr) == -1) {
-		return false;
-	}
+	for (fl = 0; fl < tdb_num_freelists(tdb); fl++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, fl), &ptr) == -1) {
+			return false;
+		}
 
-	while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
-		total += rec.rec_len;
-		if (rec.rec_len > largest) {
-			largest = rec.rec_len;
+		while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
+			total += rec.rec_len;
+			if (rec.rec_len > largest) {
+				largest = rec.rec_len;
+			}
+			ptr = rec.next;
 		}
-		ptr = rec.next;
 	}
 
 	return total > largest * 2;
@@ -97,6 +97,8 @@ extern "C" {
 #define TDB_MUTEX_LOCKING 4096 /** optimized locking using robust mutexes if supported,
                                    only with tdb >= 1.3.0 and TDB_CLEAR_IF_FIRST
                                    after checking tdb_runtime_check_for_robust_mutexes() */
+#define TDB_FREELIST_CLASSES 8192 /** Create the database with size class segregated
+                                      freelists, can't be opened by tdb < 1.4.11 */
 
 /** The tdb error codes */
 enum TDB_ERROR {TDB_SUCCESS=0, TDB_ERR_CORRUPT, TDB_ERR_IO, TDB_ERR_LOCK, 
@@ -337,6 +339,69 @@ _PUBLIC_ int tdb_parse_record(struct tdb_context *tdb, TDB_DATA key,
 					    void *private_data),
 			      void *private_data);
 
+/**
+ * @brief Hand many records to a parser function, locking every chain once.
+ *
+ * This is the batched version of tdb_parse_record(). The keys are sorted by
+ * hash chain, so that every hash chain is locked only once, no matter how
+ * many of the keys are in it. The parser is called with the index of the
+ * key in the keys array. Keys which are not found are skipped.
+ *
+ * @warning The same restrictions as for tdb_parse_record() apply, the
+ * parser is called while tdb holds a lock on the hash chain.
+ *
+ * @param[in]  tdb      The tdb to parse the records.
+ *
+ * @param[in]  keys     The keys to parse.
+ *
+ * @param[in]  num_keys The number of keys.
+ *
+ * @param[in]  parser   The parser to use to parse the data.
+ *
+ * @param[in]  private_data A private data pointer which is passed to the parser
+ *                          function.
+ *
+ * @return              0 on success, -1 on error with error code set. If the
+ *                      parser returns something else than 0, no further
+ *                      records are parsed and the value is passed up to the
+ *                      caller.
+ *
+ * @see tdb_parse_record()
+ */
+_PUBLIC_ int tdb_parse_many(struct tdb_context *tdb,
+			    const TDB_DATA *keys, size_t num_keys,
+			    int (*parser)(size_t idx, TDB_DATA key,
+					  TDB_DATA data, void *private_data),
+			    void *private_data);
+
+/**
+ * @brief Fetch many entries, locking every chain once.
+ *
+ * This is the batched version of tdb_fetch(). The keys are sorted by
+ * hash chain, so that every hash chain is locked only once, no matter how
+ * many of the keys are in it.
+ *
+ * The caller must free the resulting data.
+ *
+ * @param[in]  tdb      The tdb to fetch the keys.
+ *
+ * @param[in]  keys     The keys to fetch.
+ *
+ * @param[out] values   An array of num_keys entries, values[i] is set to the
+ *                      data of keys[i] or to tdb_null if keys[i] was not
+ *                      found.
+ *
+ * @param[in]  num_keys The number of keys.
+ *
+ * @return              0 on success, -1 on error with error code set. On
+ *                      error all values are set to tdb_null.
+ *
+ * @see tdb_fetch()
+ */
+_PUBLIC_ int tdb_fetch_many(struct tdb_context *tdb,
+			    const TDB_DATA *keys, TDB_DATA *values,
+			    size_t num_keys);
+
 /**
  * @brief Delete an entry in the database given a key.
  *
@@ -396,6 +461,38 @@ _PUBLIC_ int tdb_store(struct tdb_context *tdb, TDB_DATA key, TDB_DATA dbuf, int
 _PUBLIC_ int tdb_storev(struct tdb_context *tdb, TDB_DATA key,
 	       const TDB_DATA *dbufs, int num_dbufs, int flag);
 
+/**
+ * @brief Store many elements, locking every chain once.
+ *
+ * This is the batched version of tdb_store(). The keys are sorted by
+ * hash chain, so that every hash chain is locked only once, no matter how
+ * many of the keys are in it. If a key is passed more than once, the last
+ * value wins.
+ *
+ * The operation is not atomic: If a store fails, no further entries are
+ * stored, but the ones already stored are not reverted. Use a transaction
+ * if this is required.
+ *
+ * @param[in]  tdb      The tdb to store the entries.
+ *
+ * @param[in]  keys     The keys to use to store the entries.
+ *
+ * @param[in]  values   The data to store, values[i] is stored under keys[i].
+ *
+ * @param[in]  num_keys The number of keys.
+ *
+ * @param[in]  flag     The flags to store the keys:\n\n
+ *                      TDB_INSERT: Don't overwrite an existing entry.\n
+ *                      TDB_MODIFY: Don't create a new entry\n
+ *
+ * @return              0 on success, -1 on error with error code set.
+ *
+ * @see tdb_store()
+ */
+_PUBLIC_ int tdb_store_many(struct tdb_context *tdb,
+			    const TDB_DATA *keys, const TDB_DATA *values,
+			    size_t num_keys, int flag);
+
 /**
  * @brief Append data to an entry.
  *
@@ -0,0 +1,283 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/freelistcheck.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_RECORDS 500
+
+static size_t record_size(unsigned i, unsigned gen)
+{
+	/* Spread the records over all size classes */
+	return ((i * 37 + gen * 101) % 12000) + 1;
+}
+
+static bool store_records(struct tdb_context *tdb, unsigned gen)
+{
+	unsigned char *buf;
+	unsigned i;
+	bool ok = true;
+
+	buf = malloc(12000);
+	if (buf == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		TDB_DATA key = { .dptr = (unsigned char *)&i,
+				 .dsize = sizeof(i) };
+		TDB_DATA data = { .dptr = buf,
+				  .dsize = record_size(i, gen) };
+
+		memset(buf, i + gen, data.dsize);
+		if (tdb_store(tdb, key, data, TDB_REPLACE) != 0) {
+			ok = false;
+			break;
+		}
+	}
+
+	free(buf);
+	return ok;
+}
+
+static bool check_records(struct tdb_context *tdb, unsigned gen)
+{
+	unsigned i;
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		TDB_DATA key = { .dptr = (unsigned char *)&i,
+				 .dsize = sizeof(i) };
+		TDB_DATA data;
+		size_t j;
+
+		data = tdb_fetch(tdb, key);
+		if (data.dptr == NULL) {
+			continue;
+		}
+		if (data.dsize != record_size(i, gen)) {
+			free(data.dptr);
+			return false;
+		}
+		for (j = 0; j < data.dsize; j++) {
+			if (data.dptr[j] != (unsigned char)(i + gen)) {
+				free(data.dptr);
+				return false;
+			}
+		}
+		free(data.dptr);
+	}
+	return true;
+}
+
+static bool delete_odd_records(struct tdb_context *tdb)
+{
+	unsigned i;
+
+	for (i = 1; i < NUM_RECORDS; i += 2) {
+		TDB_DATA key = { .dptr = (unsigned char *)&i,
+				 .dsize = sizeof(i) };
+		if (tdb_delete(tdb, key) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool small_classes_used(struct tdb_context *tdb)
+{
+	unsigned fl;
+
+	for (fl = 0; fl + 1 < tdb_num_freelists(tdb); fl++) {
+		tdb_off_t top;
+
+		if (tdb_ofs_read(tdb, tdb_freelist_top(tdb, fl), &top) != 0) {
+			return false;
+		}
+		if (top != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+#define NUM_MERGE 30
+
+/* 76 bytes of data and the key give rec_len 104, size class 0 */
+static bool store_small_records(struct tdb_context *tdb)
+{
+	unsigned char buf[76];
+	unsigned i;
+
+	memset(buf, 0x55, sizeof(buf));
+
+	for (i = 0; i <= NUM_MERGE; i++) {
+		TDB_DATA key = { .dptr = (unsigned char *)&i,
+				 .dsize = sizeof(i) };
+		TDB_DATA data = { .dptr = buf, .dsize = sizeof(buf) };
+
+		if (tdb_store(tdb, key, data, TDB_INSERT) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static tdb_off_t key_offset(struct tdb_context *tdb, unsigned i)
+{
+	TDB_DATA key = { .dptr = (unsigned char *)&i, .dsize = sizeof(i) };
+	struct tdb_record rec;
+	tdb_off_t rec_ptr;
+
+	rec_ptr = tdb_find_lock_hash(tdb, key, tdb->hash_fn(&key),
+				     F_RDLCK, &rec);
+	if (rec_ptr == 0) {
+		return 0;
+	}
+	tdb_unlock(tdb, BUCKET(rec.full_hash), F_RDLCK);
+	return rec_ptr;
+}
+
+/* Is the free record at rec_ptr on the list of its size class? */
+static bool on_class_list(struct tdb_context *tdb, tdb_off_t rec_ptr)
+{
+	struct tdb_record rec;
+	tdb_off_t ptr;
+
+	if (tdb_rec_free_read(tdb, rec_ptr, &rec) != 0) {
+		return false;
+	}
+
+	ptr = tdb_freelist_top(tdb, tdb_freelist_for_len(tdb, rec.rec_len));
+	while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
+		if (ptr == rec_ptr) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * The records are allocated from the end of the free space, so record
+ * i + 1 is the left neighbour of record i. Delete them from left to
+ * right, each one is merged into the hole left of it, which grows
+ * through all size classes up to class 5. Record NUM_MERGE stays and
+ * keeps the hole apart from the free space in front.
+ */
+static bool merge_records(struct tdb_context *tdb, tdb_off_t hole)
+{
+	unsigned i = NUM_MERGE;
+	int num_free;
+
+	while (i-- > 0) {
+		TDB_DATA key = { .dptr = (unsigned char *)&i,
+				 .dsize = sizeof(i) };
+
+		if (tdb_delete(tdb, key) != 0) {
+			return false;
+		}
+		if (!on_class_list(tdb, hole)) {
+			return false;
+		}
+		if (tdb_validate_freelist(tdb, &num_free) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	struct tdb_record rec;
+	tdb_off_t hole;
+	tdb_len_t hole_len;
+	size_t map_size;
+	int num_free;
+
+	plan_tests(32);
+
+	tdb = tdb_open_ex("run-freelist-classes.tdb", 7,
+			  TDB_CLEAR_IF_FIRST|TDB_FREELIST_CLASSES,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb);
+	ok1(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES);
+	ok1(tdb_num_freelists(tdb) == TDB_NUM_FREELIST_CLASSES);
+
+	ok1(store_records(tdb, 0));
+	ok1(check_records(tdb, 0));
+	ok1(delete_odd_records(tdb));
+	ok1(small_classes_used(tdb));
+	ok1(tdb_check(tdb, NULL, NULL) == 0);
+	ok1(tdb_validate_freelist(tdb, &num_free) == 0 && num_free > 0);
+
+	/* Reallocate from the segregated lists */
+	ok1(store_records(tdb, 1));
+	ok1(check_records(tdb, 1));
+	ok1(tdb_check(tdb, NULL, NULL) == 0);
+	ok1(tdb_validate_freelist(tdb, &num_free) == 0);
+
+	ok1(tdb_transaction_start(tdb) == 0);
+	ok1(delete_odd_records(tdb) && store_records(tdb, 2));
+	ok1(tdb_transaction_commit(tdb) == 0);
+	ok1(check_records(tdb, 2));
+	tdb_close(tdb);
+
+	/* The feature is stored in the header, no need to pass the flag */
+	tdb = tdb_open_ex("run-freelist-classes.tdb", 0, 0,
+			  O_RDWR, 0, &taplogctx, NULL);
+	ok1(tdb);
+	ok1(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES);
+	ok1(tdb_check(tdb, NULL, NULL) == 0);
+
+	ok1(tdb_wipe_all(tdb) == 0);
+	ok1(tdb_validate_freelist(tdb, &num_free) == 0 && num_free == 1);
+	tdb_close(tdb);
+
+	/* Merges move the record to its new size class */
+	tdb = tdb_open_ex("run-freelist-classes.tdb", 7,
+			  TDB_CLEAR_IF_FIRST|TDB_FREELIST_CLASSES,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb);
+	ok1(store_small_records(tdb));
+	hole = key_offset(tdb, NUM_MERGE - 1);
+	ok1(hole != 0 && hole < key_offset(tdb, 0));
+	ok1(merge_records(tdb, hole));
+	ok1(tdb_rec_free_read(tdb, hole, &rec) == 0);
+	ok1(rec.rec_len == NUM_MERGE * 128 - sizeof(rec));
+	ok1(tdb_freelist_for_len(tdb, rec.rec_len) == 5);
+	hole_len = rec.rec_len;
+
+	/*
+	 * Only the hole and the free space in front of the records fit,
+	 * the smallest class with a fitting record has to be taken.
+	 */
+	map_size = tdb->map_size;
+	{
+		unsigned i = NUM_MERGE + 1;
+		unsigned char buf[1500];
+		TDB_DATA key = { .dptr = (unsigned char *)&i,
+				 .dsize = sizeof(i) };
+		TDB_DATA data = { .dptr = buf, .dsize = sizeof(buf) };
+
+		memset(buf, 0xaa, sizeof(buf));
+		ok1(tdb_store(tdb, key, data, TDB_INSERT) == 0);
+	}
+	ok1(tdb->map_size == map_size);
+	ok1(tdb_rec_free_read(tdb, hole, &rec) == 0 &&
+	    rec.rec_len < hole_len &&
+	    tdb_validate_freelist(tdb, &num_free) == 0);
+	tdb_close(tdb);
+
+	return exit_status();
+}
@@ -0,0 +1,160 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_KEYS 20
+
+static char keystrs[NUM_KEYS][16];
+static char valuestrs[NUM_KEYS][16];
+static TDB_DATA keys[NUM_KEYS];
+static TDB_DATA values[NUM_KEYS];
+
+static bool tdb_data_same(TDB_DATA d1, TDB_DATA d2)
+{
+	if (d1.dsize != d2.dsize) {
+		return false;
+	}
+	return (memcmp(d1.dptr, d2.dptr, d1.dsize) == 0);
+}
+
+struct parse_many_state {
+	unsigned count;
+	bool ok;
+};
+
+static int parse_many_fn(size_t idx, TDB_DATA key, TDB_DATA data,
+			 void *private_data)
+{
+	struct parse_many_state *state = private_data;
+
+	state->ok &= (idx < NUM_KEYS);
+	state->ok &= tdb_data_same(key, keys[idx]);
+	state->ok &= tdb_data_same(data, values[idx]);
+	state->count += 1;
+
+	return 0;
+}
+
+static int parse_many_stop_fn(size_t idx, TDB_DATA key, TDB_DATA data,
+			      void *private_data)
+{
+	unsigned *count = private_data;
+
+	*count += 1;
+	return 42;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	struct parse_many_state state = { .ok = true };
+	TDB_DATA fetched[NUM_KEYS + 1];
+	TDB_DATA fetch_keys[NUM_KEYS + 1];
+	TDB_DATA dup_keys[2];
+	TDB_DATA dup_values[2];
+	TDB_DATA data;
+	unsigned count = 0;
+	bool same = true;
+	int i;
+	int ret;
+
+	plan_tests(16);
+
+	/* a small hash size, so that chains hold more than one key */
+	tdb = tdb_open_ex(
+		"run-many.tdb",
+		3,
+		TDB_CLEAR_IF_FIRST,
+		O_RDWR|O_CREAT,
+		0600,
+		&taplogctx,
+		NULL);
+	ok1(tdb);
+
+	for (i=0; i<NUM_KEYS; i++) {
+		snprintf(keystrs[i], sizeof(keystrs[i]), "key%d", i);
+		snprintf(valuestrs[i], sizeof(valuestrs[i]), "value%d", i * 7);
+		keys[i] = (TDB_DATA) {
+			.dptr = (uint8_t *)keystrs[i],
+			.dsize = strlen(keystrs[i]),
+		};
+		values[i] = (TDB_DATA) {
+			.dptr = (uint8_t *)valuestrs[i],
+			.dsize = strlen(valuestrs[i]),
+		};
+	}
+
+	ret = tdb_store_many(tdb, keys, values, NUM_KEYS, TDB_INSERT);
+	ok1(ret == 0);
+
+	for (i=0; i<NUM_KEYS; i++) {
+		data = tdb_fetch(tdb, keys[i]);
+		same &= tdb_data_same(data, values[i]);
+		free(data.dptr);
+	}
+	ok1(same);
+
+	/* fetch all keys plus one that does not exist */
+	memcpy(fetch_keys, keys, sizeof(keys));
+	fetch_keys[NUM_KEYS] = (TDB_DATA) {
+		.dptr = discard_const_p(uint8_t, "nokey"), .dsize = 5
+	};
+	ret = tdb_fetch_many(tdb, fetch_keys, fetched, NUM_KEYS + 1);
+	ok1(ret == 0);
+
+	same = true;
+	for (i=0; i<NUM_KEYS; i++) {
+		same &= tdb_data_same(fetched[i], values[i]);
+		free(fetched[i].dptr);
+	}
+	ok1(same);
+	ok1(fetched[NUM_KEYS].dptr == NULL);
+
+	ret = tdb_parse_many(tdb, fetch_keys, NUM_KEYS + 1,
+			     parse_many_fn, &state);
+	ok1(ret == 0);
+	ok1(state.ok);
+	ok1(state.count == NUM_KEYS);
+
+	/* a non-zero parser return stops the walk */
+	ret = tdb_parse_many(tdb, keys, NUM_KEYS, parse_many_stop_fn, &count);
+	ok1(ret == 42);
+	ok1(count == 1);
+
+	/* TDB_INSERT fails on existing keys */
+	ret = tdb_store_many(tdb, keys, values, NUM_KEYS, TDB_INSERT);
+	ok1(ret == -1);
+	ok1(tdb_error(tdb) == TDB_ERR_EXISTS);
+
+	/* the last value wins for duplicate keys */
+	dup_keys[0] = keys[0];
+	dup_keys[1] = keys[0];
+	dup_values[0] = values[1];
+	dup_values[1] = values[2];
+	ret = tdb_store_many(tdb, dup_keys, dup_values, 2, TDB_REPLACE);
+	ok1(ret == 0);
+	data = tdb_fetch(tdb, keys[0]);
+	ok1(tdb_data_same(data, values[2]));
+	free(data.dptr);
+
+	ret = tdb_store_many(tdb, NULL, NULL, 0, TDB_REPLACE);
+	ok1(ret == 0);
+
+	unlink(tdb_name(tdb));
+
+	tdb_close(tdb);
+
+	return exit_status();
+}
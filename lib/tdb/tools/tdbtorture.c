@@ -34,6 +34,7 @@ static int hash_size = 2;
 static unsigned loopnum;
 static int count_pipe;
 static bool mutex = false;
+static bool freelist_classes = false;
 static struct tdb_logging_context log_ctx;
 
 #ifdef PRINTF_ATTRIBUTE
@@ -228,7 +229,7 @@ static int traverse_fn(struct tdb_context *tdb, TDB_DATA key, TDB_DATA dbuf,
 
 static void usage(void)
 {
-	printf("Usage: tdbtorture [-t] [-k] [-m] [-n NUM_PROCS] [-l NUM_LOOPS] [-s SEED] [-H HASH_SIZE]\n");
+	printf("Usage: tdbtorture [-t] [-k] [-m] [-f] [-n NUM_PROCS] [-l NUM_LOOPS] [-s SEED] [-H HASH_SIZE]\n");
 	exit(0);
 }
 
@@ -251,6 +252,9 @@ static int run_child(const char *filename, int i, int seed, unsigned num_loops,
 	if (mutex) {
 		tdb_flags |= TDB_MUTEX_LOCKING;
 	}
+	if (freelist_classes) {
+		tdb_flags |= TDB_FREELIST_CLASSES;
+	}
 
 	db = tdb_open_ex(filename, hash_size, tdb_flags,
 			 O_RDWR | O_CREAT, 0600, &log_ctx, NULL);
@@ -324,7 +328,7 @@ int main(int argc, char * const *argv)
 
 	log_ctx.log_fn = tdb_log;
 
-	while ((c = getopt(argc, argv, "n:l:s:H:thkm")) != -1) {
+	while ((c = getopt(argc, argv, "n:l:s:H:thkmf")) != -1) {
 		switch (c) {
 		case 'n':
 			num_procs = strtol(optarg, NULL, 0);
@@ -351,6 +355,9 @@ int main(int argc, char * const *argv)
 				exit(1);
 			}
 			break;
+		case 'f':
+			freelist_classes = true;
+			break;
 		default:
 			usage();
 		}
@@ -1947,6 +1947,179 @@ done:
 	return ok;
 }
 
+static bool test_event_msg(struct torture_context *tctx,
+			   const void *test_data)
+{
+	const char *backend = (const char *)test_data;
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct tevent_context *ev = NULL;
+	struct tevent_req *sreq = NULL;
+	struct tevent_req *rreq = NULL;
+	int sock[2] = { -1, -1 };
+	uint8_t sbuf[] = "message";
+	uint8_t rbuf[32] = { 0, };
+	struct iovec siov = { .iov_base = sbuf, .iov_len = sizeof(sbuf) };
+	struct iovec riov = { .iov_base = rbuf, .iov_len = sizeof(rbuf) };
+	struct msghdr smsg = { .msg_iov = &siov, .msg_iovlen = 1 };
+	struct msghdr rmsg = { .msg_iov = &riov, .msg_iovlen = 1 };
+	ssize_t nread, nwritten;
+	int err = 0;
+	int ret;
+	bool ok = false;
+
+	ev = test_tevent_context_init_byname(frame, backend);
+	if (ev == NULL) {
+		torture_skip(tctx, talloc_asprintf(tctx,
+			     "event backend '%s' not supported\n",
+			     backend));
+		return true;
+	}
+
+	torture_comment(tctx, "tevent backend '%s'\n", backend);
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sock);
+	torture_assert_goto(tctx, ret == 0, ok, done, "socketpair failed\n");
+
+	/*
+	 * The receive is pending before there is anything to read
+	 */
+	rreq = tevent_recvmsg_send(frame, ev, sock[0], &rmsg, 0);
+	torture_assert_not_null_goto(tctx, rreq, ok, done,
+				     "tevent_recvmsg_send failed\n");
+	sreq = tevent_sendmsg_send(frame, ev, sock[1], &smsg, 0);
+	torture_assert_not_null_goto(tctx, sreq, ok, done,
+				     "tevent_sendmsg_send failed\n");
+
+	ok = tevent_req_poll(sreq, ev);
+	torture_assert_goto(tctx, ok, ok, done, "tevent_req_poll failed\n");
+	nwritten = tevent_sendmsg_recv(sreq, &err);
+	torture_assert_int_equal_goto(tctx, nwritten, sizeof(sbuf), ok, done,
+				      "tevent_sendmsg_recv\n");
+	TALLOC_FREE(sreq);
+
+	ok = tevent_req_poll(rreq, ev);
+	torture_assert_goto(tctx, ok, ok, done, "tevent_req_poll failed\n");
+	nread = tevent_recvmsg_recv(rreq, &err);
+	torture_assert_int_equal_goto(tctx, nread, sizeof(sbuf), ok, done,
+				      "tevent_recvmsg_recv\n");
+	torture_assert_mem_equal_goto(tctx, rbuf, sbuf, sizeof(sbuf), ok, done,
+				      "data mismatch\n");
+	TALLOC_FREE(rreq);
+
+	/*
+	 * A receive pending in the parent fails in the child, it
+	 * must not be submitted again and steal the parent's data.
+	 */
+	rreq = tevent_recvmsg_send(frame, ev, sock[0], &rmsg, 0);
+	torture_assert_not_null_goto(tctx, rreq, ok, done,
+				     "tevent_recvmsg_send failed\n");
+
+	if (strcmp(backend, "uring") == 0) {
+		pid_t child_pid, finished_pid;
+		int child_status;
+
+		child_pid = fork();
+		if (child_pid == 0) {
+			struct tevent_req *req2 = NULL;
+
+			/*
+			 * Reopens the ring, but the callback is
+			 * deferred to the event loop
+			 */
+			req2 = tevent_recvmsg_send(frame, ev, sock[0],
+						   &rmsg, 0);
+			if (req2 == NULL) {
+				exit(1);
+			}
+			if (!tevent_req_is_in_progress(rreq)) {
+				exit(2);
+			}
+			TALLOC_FREE(req2);
+
+			if (!tevent_req_poll(rreq, ev)) {
+				exit(3);
+			}
+			nread = tevent_recvmsg_recv(rreq, &err);
+			if ((nread != -1) || (err != ECANCELED)) {
+				exit(4);
+			}
+			exit(0);
+		}
+		torture_assert_goto(tctx, child_pid > 0, ok, done,
+				    "fork failed\n");
+
+		finished_pid = waitpid(child_pid, &child_status, 0);
+		torture_assert_goto(tctx, finished_pid == child_pid, ok, done,
+				    "wrong child\n");
+		torture_assert_int_equal_goto(tctx, child_status, 0, ok, done,
+					      "child_status\n");
+	}
+
+	memset(rbuf, 0, sizeof(rbuf));
+	nwritten = write(sock[1], sbuf, sizeof(sbuf));
+	torture_assert_int_equal_goto(tctx, nwritten, sizeof(sbuf), ok, done,
+				      "write failed\n");
+	ok = tevent_req_poll(rreq, ev);
+	torture_assert_goto(tctx, ok, ok, done, "tevent_req_poll failed\n");
+	nread = tevent_recvmsg_recv(rreq, &err);
+	torture_assert_int_equal_goto(tctx, nread, sizeof(sbuf), ok, done,
+				      "tevent_recvmsg_recv\n");
+	torture_assert_mem_equal_goto(tctx, rbuf, sbuf, sizeof(sbuf), ok, done,
+				      "data mismatch\n");
+	TALLOC_FREE(rreq);
+
+	/*
+	 * A pending receive can be cancelled
+	 */
+	rreq = tevent_recvmsg_send(frame, ev, sock[0], &rmsg, 0);
+	torture_assert_not_null_goto(tctx, rreq, ok, done,
+				     "tevent_recvmsg_send failed\n");
+	ok = tevent_req_cancel(rreq);
+	torture_assert_goto(tctx, ok, ok, done, "tevent_req_cancel failed\n");
+	ok = tevent_req_poll(rreq, ev);
+	torture_assert_goto(tctx, ok, ok, done, "tevent_req_poll failed\n");
+	nread = tevent_recvmsg_recv(rreq, &err);
+	torture_assert_int_equal_goto(tctx, nread, -1, ok, done,
+				      "tevent_recvmsg_recv\n");
+	torture_assert_int_equal_goto(tctx, err, ECANCELED, ok, done,
+				      "tevent_recvmsg_recv\n");
+	TALLOC_FREE(rreq);
+
+	/*
+	 * Freeing a pending receive must not leave the kernel
+	 * writing into rbuf, closing the peer gives EOF.
+	 */
+	rreq = tevent_recvmsg_send(frame, ev, sock[0], &rmsg, 0);
+	torture_assert_not_null_goto(tctx, rreq, ok, done,
+				     "tevent_recvmsg_send failed\n");
+	TALLOC_FREE(rreq);
+
+	rreq = tevent_recvmsg_send(frame, ev, sock[0], &rmsg, 0);
+	torture_assert_not_null_goto(tctx, rreq, ok, done,
+				     "tevent_recvmsg_send failed\n");
+	close(sock[1]);
+	sock[1] = -1;
+	ok = tevent_req_poll(rreq, ev);
+	torture_assert_goto(tctx, ok, ok, done, "tevent_req_poll failed\n");
+	nread = tevent_recvmsg_recv(rreq, &err);
+	torture_assert_int_equal_goto(tctx, nread, 0, ok, done,
+				      "tevent_recvmsg_recv\n");
+	TALLOC_FREE(rreq);
+
+	ok = true;
+
+done:
+	TALLOC_FREE(frame);
+
+	if (sock[0] != -1) {
+		close(sock[0]);
+	}
+	if (sock[1] != -1) {
+		close(sock[1]);
+	}
+	return ok;
+}
+
 #ifdef HAVE_PTHREAD
 
 static pthread_mutex_t threaded_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -2620,6 +2793,10 @@ struct torture_suite *torture_local_event(TALLOC_CTX *mem_ctx)
 					       "free_wrapper",
 					       test_free_wrapper,
 					       (const void *)list[i]);
+		torture_suite_add_simple_tcase_const(backend_suite,
+					       "msg",
+					       test_event_msg,
+					       (const void *)list[i]);
 
 		torture_suite_add_suite(suite, backend_suite);
 	}
@@ -131,6 +131,9 @@ static void tevent_backend_init(void)
 #if defined(HAVE_EPOLL)
 	tevent_epoll_init();
 #endif
+#if defined(HAVE_IO_URING)
+	tevent_uring_init();
+#endif
 
 	tevent_standard_init();
 }
@@ -1903,6 +1903,90 @@ struct tevent_req *tevent_wakeup_send(TALLOC_CTX *mem_ctx,
  */
 bool tevent_wakeup_recv(struct tevent_req *req);
 
+struct msghdr;
+
+/**
+ * @brief Send a message on a socket.
+ *
+ * With the "uring" backend the sendmsg is handed to the kernel
+ * directly and completes without waiting for the socket to become
+ * writable first. Other backends wait for the fd to become writable
+ * and then do a nonblocking sendmsg().
+ *
+ * @param[in]  mem_ctx  The talloc memory context to use.
+ *
+ * @param[in]  ev       The event handle to setup the request.
+ *
+ * @param[in]  fd       The socket to send on.
+ *
+ * @param[in]  msg      The message to send. It and all buffers it
+ *                      references have to stay valid until the
+ *                      request is finished or freed.
+ *
+ * @param[in]  flags    Flags for sendmsg(), don't pass MSG_DONTWAIT.
+ *
+ * @return              The new request, NULL on error.
+ *
+ * @see tevent_sendmsg_recv()
+ */
+struct tevent_req *tevent_sendmsg_send(TALLOC_CTX *mem_ctx,
+				       struct tevent_context *ev,
+				       int fd,
+				       const struct msghdr *msg,
+				       int flags);
+
+/**
+ * @brief Get the result of tevent_sendmsg_send().
+ *
+ * @param[in]  req      The finished request.
+ *
+ * @param[out] perrno   The error number on failure.
+ *
+ * @return              The number of bytes sent, -1 on error.
+ */
+ssize_t tevent_sendmsg_recv(struct tevent_req *req, int *perrno);
+
+/**
+ * @brief Receive a message from a socket.
+ *
+ * With the "uring" backend the recvmsg is handed to the kernel
+ * directly and completes as soon as data arrived, without a
+ * separate readiness notification. Other backends wait for the fd to
+ * become readable and then do a nonblocking recvmsg().
+ *
+ * @param[in]  mem_ctx  The talloc memory context to use.
+ *
+ * @param[in]  ev       The event handle to setup the request.
+ *
+ * @param[in]  fd       The socket to receive from.
+ *
+ * @param[in]  msg      The message header to fill. It and all buffers it
+ *                      references have to stay valid until the
+ *                      request is finished or freed.
+ *
+ * @param[in]  flags    Flags for recvmsg(), don't pass MSG_DONTWAIT.
+ *
+ * @return              The new request, NULL on error.
+ *
+ * @see tevent_recvmsg_recv()
+ */
+struct tevent_req *tevent_recvmsg_send(TALLOC_CTX *mem_ctx,
+				       struct tevent_context *ev,
+				       int fd,
+				       struct msghdr *msg,
+				       int flags);
+
+/**
+ * @brief Get the result of tevent_recvmsg_send().
+ *
+ * @param[in]  req      The finished request.
+ *
+ * @param[out] perrno   The error number on failure.
+ *
+ * @return              The number of bytes received, -1 on error.
+ */
+ssize_t tevent_recvmsg_recv(struct tevent_req *req, int *perrno);
+
 /* @} */
 
 /**
@@ -530,6 +530,26 @@ void tevent_epoll_set_panic_fallback(struct tevent_context *ev,
 			bool (*panic_fallback)(struct tevent_context *ev,
 					       bool replay));
 #endif
+#ifdef HAVE_IO_URING
+bool tevent_uring_init(void);
+struct msghdr;
+struct tevent_uring_io;
+/*
+ * Start a sendmsg/recvmsg on a context using the "uring" backend,
+ * fails with ENOSYS for other backends. "fn" gets the result of the
+ * syscall or -errno.
+ */
+struct tevent_uring_io *tevent_uring_io_start(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	bool send,
+	int fd,
+	const struct msghdr *msg,
+	int flags,
+	void (*fn)(int res, void *private_data),
+	void *private_data);
+bool tevent_uring_io_cancel(struct tevent_uring_io *io);
+#endif
 
 static inline void tevent_thread_call_depth_notify(
 			enum tevent_thread_call_depth_cmd cmd,
@@ -0,0 +1,273 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   sendmsg/recvmsg as tevent requests
+
+     ** NOTE! The following LGPL license applies to the tevent
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "system/network.h"
+#include "tevent.h"
+#include "tevent_internal.h"
+#include "tevent_util.h"
+
+struct tevent_msg_state {
+	bool send;
+	int fd;
+	const struct msghdr *msg;
+	int flags;
+	struct tevent_fd *fde;
+#ifdef HAVE_IO_URING
+	struct tevent_uring_io *io;
+#endif
+	ssize_t ret;
+};
+
+static void tevent_msg_cleanup(struct tevent_req *req,
+			       enum tevent_req_state req_state);
+static bool tevent_msg_cancel(struct tevent_req *req);
+static void tevent_msg_handler(struct tevent_context *ev,
+			       struct tevent_fd *fde,
+			       uint16_t flags,
+			       void *private_data);
+#ifdef HAVE_IO_URING
+static void tevent_msg_uring_done(int res, void *private_data);
+#endif
+
+static struct tevent_req *tevent_msg_send(TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  bool send,
+					  int fd,
+					  const struct msghdr *msg,
+					  int flags)
+{
+	struct tevent_req *req = NULL;
+	struct tevent_msg_state *state = NULL;
+	uint16_t fd_flags;
+
+	req = tevent_req_create(mem_ctx, &state, struct tevent_msg_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	*state = (struct tevent_msg_state) {
+		.send = send, .fd = fd, .msg = msg, .flags = flags, .ret = -1,
+	};
+
+	tevent_req_set_cleanup_fn(req, tevent_msg_cleanup);
+
+#ifdef HAVE_IO_URING
+	state->io = tevent_uring_io_start(state,
+					  ev,
+					  send,
+					  fd,
+					  msg,
+					  flags,
+					  tevent_msg_uring_done,
+					  req);
+	if (state->io != NULL) {
+		if (tevent_wrapper_main_ev(ev) != ev) {
+			/*
+			 * The completion is not run through the
+			 * wrapper hooks, let an immediate on the
+			 * wrapper call our caller.
+			 */
+			tevent_req_defer_callback(req, ev);
+		}
+		tevent_req_set_cancel_fn(req, tevent_msg_cancel);
+		return req;
+	}
+	if (errno != ENOSYS) {
+		tevent_req_error(req, errno);
+		return tevent_req_post(req, ev);
+	}
+#endif
+
+	/*
+	 * Without a completion based backend we wait for the fd to
+	 * become ready and do a nonblocking call.
+	 */
+	fd_flags = send ? (TEVENT_FD_WRITE|TEVENT_FD_ERROR) : TEVENT_FD_READ;
+
+	state->fde = tevent_add_fd(ev, state, fd, fd_flags,
+				   tevent_msg_handler, req);
+	if (tevent_req_nomem(state->fde, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_cancel_fn(req, tevent_msg_cancel);
+	return req;
+}
+
+static void tevent_msg_cleanup(struct tevent_req *req,
+			       enum tevent_req_state req_state)
+{
+	struct tevent_msg_state *state = tevent_req_data(
+		req, struct tevent_msg_state);
+
+	TALLOC_FREE(state->fde);
+#ifdef HAVE_IO_URING
+	/*
+	 * This waits for the kernel to give up the caller's
+	 * buffers.
+	 */
+	TALLOC_FREE(state->io);
+#endif
+}
+
+static bool tevent_msg_cancel(struct tevent_req *req)
+{
+	struct tevent_msg_state *state = tevent_req_data(
+		req, struct tevent_msg_state);
+
+#ifdef HAVE_IO_URING
+	if (state->io != NULL) {
+		/*
+		 * tevent_msg_uring_done() reports ECANCELED unless
+		 * the request won the race.
+		 */
+		return tevent_uring_io_cancel(state->io);
+	}
+#endif
+
+	if (state->fde == NULL) {
+		return false;
+	}
+	TALLOC_FREE(state->fde);
+	tevent_req_error(req, ECANCELED);
+	return true;
+}
+
+static void tevent_msg_handler(struct tevent_context *ev,
+			       struct tevent_fd *fde,
+			       uint16_t flags,
+			       void *private_data)
+{
+	struct tevent_req *req = talloc_get_type_abort(
+		private_data, struct tevent_req);
+	struct tevent_msg_state *state = tevent_req_data(
+		req, struct tevent_msg_state);
+	ssize_t ret;
+
+	if (flags & TEVENT_FD_ERROR) {
+		/*
+		 * Like writev_send(), report EPIPE rather than
+		 * looking for a more detailed error.
+		 */
+		TALLOC_FREE(state->fde);
+		tevent_req_error(req, EPIPE);
+		return;
+	}
+
+	if (state->send) {
+		ret = sendmsg(state->fd, state->msg,
+			      state->flags|MSG_DONTWAIT);
+	} else {
+		ret = recvmsg(state->fd, discard_const_p(struct msghdr, state->msg),
+			      state->flags|MSG_DONTWAIT);
+	}
+	if ((ret == -1) &&
+	    ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+		return;
+	}
+	TALLOC_FREE(state->fde);
+
+	if (ret == -1) {
+		tevent_req_error(req, errno);
+		return;
+	}
+	state->ret = ret;
+	tevent_req_done(req);
+}
+
+#ifdef HAVE_IO_URING
+static void tevent_msg_uring_done(int res, void *private_data)
+{
+	struct tevent_req *req = talloc_get_type_abort(
+		private_data, struct tevent_req);
+	struct tevent_msg_state *state = tevent_req_data(
+		req, struct tevent_msg_state);
+
+	TALLOC_FREE(state->io);
+
+	if (res < 0) {
+		tevent_req_error(req, -res);
+		return;
+	}
+	state->ret = res;
+	tevent_req_done(req);
+}
+#endif
+
+static ssize_t tevent_msg_recv(struct tevent_req *req, int *perrno)
+{
+	struct tevent_msg_state *state = tevent_req_data(
+		req, struct tevent_msg_state);
+	enum tevent_req_state req_state;
+	uint64_t error;
+	ssize_t ret = -1;
+
+	if (tevent_req_is_error(req, &req_state, &error)) {
+		switch (req_state) {
+		case TEVENT_REQ_USER_ERROR:
+			*perrno = error;
+			break;
+		case TEVENT_REQ_TIMED_OUT:
+			*perrno = ETIMEDOUT;
+			break;
+		case TEVENT_REQ_NO_MEMORY:
+			*perrno = ENOMEM;
+			break;
+		default:
+			*perrno = EINVAL;
+			break;
+		}
+	} else {
+		ret = state->ret;
+	}
+
+	tevent_req_received(req);
+	return ret;
+}
+
+struct tevent_req *tevent_sendmsg_send(TALLOC_CTX *mem_ctx,
+				       struct tevent_context *ev,
+				       int fd,
+				       const struct msghdr *msg,
+				       int flags)
+{
+	return tevent_msg_send(mem_ctx, ev, true, fd, msg, flags);
+}
+
+ssize_t tevent_sendmsg_recv(struct tevent_req *req, int *perrno)
+{
+	return tevent_msg_recv(req, perrno);
+}
+
+struct tevent_req *tevent_recvmsg_send(TALLOC_CTX *mem_ctx,
+				       struct tevent_context *ev,
+				       int fd,
+				       struct msghdr *msg,
+				       int flags)
+{
+	return tevent_msg_send(mem_ctx, ev, false, fd, msg, flags);
+}
+
+ssize_t tevent_recvmsg_recv(struct tevent_req *req, int *perrno)
+{
+	return tevent_msg_recv(req, perrno);
+}
@@ -0,0 +1,1164 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   main select loop and event handling - io_uring implementation
+
+     ** NOTE! The following LGPL license applies to the tevent
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The "uring" backend watches fds with IORING_OP_POLL_ADD requests
+ * instead of epoll_ctl() calls. Changes to fd events are collected
+ * in a list of dirty fdes and turned into submission queue entries
+ * right before we wait, so a whole loop iteration worth of changes
+ * goes to the kernel with the same io_uring_enter() call that waits
+ * for the next events.
+ *
+ * The poll requests are one-shot. tevent fd handlers are allowed to
+ * consume only part of the data available, so we need level
+ * triggered semantics, while multishot polls only report new wakeups
+ * of the file. The poll is re-armed after the handler ran, when the
+ * kernel sees the request it checks the current state of the file.
+ *
+ * Completion queue entries are collected into a list of completed
+ * operations, handlers are called one at a time from there. As long
+ * as there is something in that list, tevent_loop_once() does not
+ * need to enter the kernel at all.
+ *
+ * Besides polls the ring is used for sendmsg/recvmsg requests from
+ * tevent_sendmsg_send() and tevent_recvmsg_send().
+ */
+
+#include "replace.h"
+#include "system/filesys.h"
+#include "system/select.h"
+#include "system/network.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "tevent.h"
+#include "tevent_internal.h"
+#include "tevent_util.h"
+
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+
+enum uring_op_list {
+	URING_OP_LIST_NONE = 0,
+	/* uring_ev->dirty: a poll that needs to be (re-)armed */
+	URING_OP_LIST_DIRTY,
+	/* uring_ev->completed: waiting for dispatch */
+	URING_OP_LIST_COMPLETED,
+	/* uring_ev->orphans: poll for a freed fde, still in the kernel */
+	URING_OP_LIST_ORPHAN,
+};
+
+struct uring_event_context;
+
+/*
+ * One request in the ring, the address is the user_data of the
+ * sqe. Entries with user_data 0 (cancellations) are ignored when
+ * they complete.
+ */
+struct uring_op {
+	struct uring_op *prev, *next;
+	struct uring_event_context *uring_ev;
+	enum uring_op_list list;
+
+	/* The kernel owns a request for this op */
+	bool in_flight;
+	/* A cancel for the current request has been queued */
+	bool cancel_queued;
+	/* Result of the last completion */
+	int32_t res;
+
+	/* For polls, NULL for orphans */
+	struct tevent_fd *fde;
+	uint32_t armed_mask;
+
+	/* For sendmsg/recvmsg */
+	struct tevent_uring_io *io;
+};
+
+struct tevent_uring_io {
+	struct tevent_uring_io *prev, *next;
+	struct uring_event_context *uring_ev;
+	struct uring_op op;
+
+	uint8_t opcode;
+	int fd;
+	const struct msghdr *msg;
+	unsigned msg_flags;
+
+	void (*fn)(int res, void *private_data);
+	void *private_data;
+};
+
+struct uring_event_context {
+	/* a pointer back to the generic event_context */
+	struct tevent_context *ev;
+
+	int ring_fd;
+	pid_t pid;
+
+	void *ring_ptr;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	struct {
+		uint32_t *khead;
+		uint32_t *ktail;
+		uint32_t mask;
+		uint32_t entries;
+		uint32_t tail;
+	} sq;
+
+	struct {
+		uint32_t *khead;
+		uint32_t *ktail;
+		uint32_t mask;
+		struct io_uring_cqe *cqes;
+	} cq;
+
+	struct uring_op *dirty;
+	struct uring_op *completed;
+	struct uring_op *orphans;
+	struct tevent_uring_io *ios;
+};
+
+static const struct tevent_ops uring_event_ops;
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd,
+			  unsigned to_submit,
+			  unsigned min_complete,
+			  unsigned flags,
+			  void *arg,
+			  size_t argsz)
+{
+	return syscall(__NR_io_uring_enter,
+		       fd,
+		       to_submit,
+		       min_complete,
+		       flags,
+		       arg,
+		       argsz);
+}
+
+/*
+  called when the ring can't be used anymore
+*/
+static void uring_panic(struct uring_event_context *uring_ev,
+			const char *reason)
+{
+	tevent_debug(uring_ev->ev, TEVENT_DEBUG_FATAL,
+		     "%s (%s) - calling abort()\n",
+		     reason, strerror(errno));
+	abort();
+}
+
+static void uring_op_list_add(struct uring_event_context *uring_ev,
+			      struct uring_op *op,
+			      enum uring_op_list list)
+{
+	switch (list) {
+	case URING_OP_LIST_NONE:
+		return;
+	case URING_OP_LIST_DIRTY:
+		DLIST_ADD_END(uring_ev->dirty, op);
+		break;
+	case URING_OP_LIST_COMPLETED:
+		DLIST_ADD_END(uring_ev->completed, op);
+		break;
+	case URING_OP_LIST_ORPHAN:
+		DLIST_ADD(uring_ev->orphans, op);
+		break;
+	}
+	op->list = list;
+}
+
+static void uring_op_list_remove(struct uring_event_context *uring_ev,
+				 struct uring_op *op)
+{
+	switch (op->list) {
+	case URING_OP_LIST_NONE:
+		return;
+	case URING_OP_LIST_DIRTY:
+		DLIST_REMOVE(uring_ev->dirty, op);
+		break;
+	case URING_OP_LIST_COMPLETED:
+		DLIST_REMOVE(uring_ev->completed, op);
+		break;
+	case URING_OP_LIST_ORPHAN:
+		DLIST_REMOVE(uring_ev->orphans, op);
+		break;
+	}
+	op->list = URING_OP_LIST_NONE;
+}
+
+static void uring_ring_fini(struct uring_event_context *uring_ev)
+{
+	if (uring_ev->sqes != NULL) {
+		munmap(uring_ev->sqes, uring_ev->sqes_size);
+		uring_ev->sqes = NULL;
+	}
+	if (uring_ev->ring_ptr != NULL) {
+		munmap(uring_ev->ring_ptr, uring_ev->ring_size);
+		uring_ev->ring_ptr = NULL;
+	}
+	if (uring_ev->ring_fd != -1) {
+		close(uring_ev->ring_fd);
+		uring_ev->ring_fd = -1;
+	}
+}
+
+static int uring_ring_init(struct uring_event_context *uring_ev)
+{
+	struct io_uring_params p = {
+		.flags = IORING_SETUP_CQSIZE,
+		.cq_entries = URING_CQ_ENTRIES,
+	};
+	uint32_t required = IORING_FEAT_SINGLE_MMAP |
+			    IORING_FEAT_NODROP |
+			    IORING_FEAT_EXT_ARG;
+	size_t sq_size, cq_size;
+	uint8_t *ptr = NULL;
+	uint32_t *array = NULL;
+	uint32_t i;
+	int fd;
+
+#if defined(IORING_SETUP_SUBMIT_ALL) && defined(IORING_SETUP_COOP_TASKRUN)
+	p.flags |= IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+#endif
+
+	fd = io_uring_setup(URING_SQ_ENTRIES, &p);
+	if ((fd == -1) && (errno == EINVAL)) {
+		/*
+		 * Kernels before 5.19 don't know SUBMIT_ALL and
+		 * COOP_TASKRUN, they are only optimizations.
+		 */
+		p = (struct io_uring_params) {
+			.flags = IORING_SETUP_CQSIZE,
+			.cq_entries = URING_CQ_ENTRIES,
+		};
+		fd = io_uring_setup(URING_SQ_ENTRIES, &p);
+	}
+	if (fd == -1) {
+		tevent_debug(uring_ev->ev, TEVENT_DEBUG_FATAL,
+			     "Failed to create io_uring (%s).\n",
+			     strerror(errno));
+		return -1;
+	}
+	uring_ev->ring_fd = fd;
+
+	if ((p.features & required) != required) {
+		tevent_debug(uring_ev->ev, TEVENT_DEBUG_FATAL,
+			     "io_uring features 0x%"PRIx32" missing\n",
+			     required & ~p.features);
+		uring_ring_fini(uring_ev);
+		errno = ENOSYS;
+		return -1;
+	}
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	uring_ev->ring_size = MAX(sq_size, cq_size);
+
+	ptr = mmap(NULL,
+		   uring_ev->ring_size,
+		   PROT_READ|PROT_WRITE,
+		   MAP_SHARED|MAP_POPULATE,
+		   fd,
+		   IORING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED) {
+		tevent_debug(uring_ev->ev, TEVENT_DEBUG_FATAL,
+			     "Failed to map io_uring (%s).\n",
+			     strerror(errno));
+		uring_ring_fini(uring_ev);
+		return -1;
+	}
+	uring_ev->ring_ptr = ptr;
+
+	uring_ev->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	uring_ev->sqes = mmap(NULL,
+			      uring_ev->sqes_size,
+			      PROT_READ|PROT_WRITE,
+			      MAP_SHARED|MAP_POPULATE,
+			      fd,
+			      IORING_OFF_SQES);
+	if (uring_ev->sqes == MAP_FAILED) {
+		uring_ev->sqes = NULL;
+		tevent_debug(uring_ev->ev, TEVENT_DEBUG_FATAL,
+			     "Failed to map io_uring sqes (%s).\n",
+			     strerror(errno));
+		uring_ring_fini(uring_ev);
+		return -1;
+	}
+
+	uring_ev->sq.khead = (uint32_t *)(ptr + p.sq_off.head);
+	uring_ev->sq.ktail = (uint32_t *)(ptr + p.sq_off.tail);
+	uring_ev->sq.mask = *(uint32_t *)(ptr + p.sq_off.ring_mask);
+	uring_ev->sq.entries = *(uint32_t *)(ptr + p.sq_off.ring_entries);
+	uring_ev->sq.tail = *uring_ev->sq.ktail;
+
+	/*
+	 * We use the sqes in order, so the index array never
+	 * changes.
+	 */
+	array = (uint32_t *)(ptr + p.sq_off.array);
+	for (i = 0; i < uring_ev->sq.entries; i++) {
+		array[i] = i;
+	}
+
+	uring_ev->cq.khead = (uint32_t *)(ptr + p.cq_off.head);
+	uring_ev->cq.ktail = (uint32_t *)(ptr + p.cq_off.tail);
+	uring_ev->cq.mask = *(uint32_t *)(ptr + p.cq_off.ring_mask);
+	uring_ev->cq.cqes = (struct io_uring_cqe *)(ptr + p.cq_off.cqes);
+
+	uring_ev->pid = tevent_cached_getpid();
+
+	return 0;
+}
+
+/*
+  move all entries from the completion queue to uring_ev->completed
+*/
+static void uring_reap(struct uring_event_context *uring_ev)
+{
+	uint32_t head = *uring_ev->cq.khead;
+	uint32_t tail = __atomic_load_n(uring_ev->cq.ktail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		struct io_uring_cqe *cqe =
+			&uring_ev->cq.cqes[head & uring_ev->cq.mask];
+		struct uring_op *op = (struct uring_op *)(uintptr_t)
+			cqe->user_data;
+
+		head += 1;
+
+		if (op == NULL) {
+			/* Result of a cancel request */
+			continue;
+		}
+
+		op->in_flight = false;
+		op->cancel_queued = false;
+		op->res = cqe->res;
+
+		if (op->list == URING_OP_LIST_ORPHAN) {
+			uring_op_list_remove(uring_ev, op);
+			TALLOC_FREE(op);
+			continue;
+		}
+
+		uring_op_list_remove(uring_ev, op);
+		uring_op_list_add(uring_ev, op, URING_OP_LIST_COMPLETED);
+	}
+
+	__atomic_store_n(uring_ev->cq.khead, head, __ATOMIC_RELEASE);
+}
+
+/*
+  hand everything queued so far to the kernel, optionally waiting
+  for completions
+*/
+static int uring_submit(struct uring_event_context *uring_ev,
+			unsigned min_complete,
+			struct timespec *ts)
+{
+	struct __kernel_timespec kts;
+	struct io_uring_getevents_arg arg = {};
+	unsigned flags = 0;
+	uint32_t to_submit;
+	int ret;
+
+	to_submit = uring_ev->sq.tail -
+		__atomic_load_n(uring_ev->sq.khead, __ATOMIC_ACQUIRE);
+
+	if (min_complete > 0) {
+		flags |= IORING_ENTER_GETEVENTS;
+	}
+	if (ts != NULL) {
+		kts = (struct __kernel_timespec) {
+			.tv_sec = ts->tv_sec, .tv_nsec = ts->tv_nsec,
+		};
+		arg.ts = (uint64_t)(uintptr_t)&kts;
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+
+	if ((to_submit == 0) && (min_complete == 0)) {
+		return 0;
+	}
+
+	ret = io_uring_enter(uring_ev->ring_fd,
+			     to_submit,
+			     min_complete,
+			     flags,
+			     (ts != NULL) ? &arg : NULL,
+			     (ts != NULL) ? sizeof(arg) : 0);
+	return ret;
+}
+
+/*
+  copy an sqe into the submission queue
+*/
+static void uring_push_sqe(struct uring_event_context *uring_ev,
+			   const struct io_uring_sqe *sqe)
+{
+	uint32_t tail = uring_ev->sq.tail;
+	uint32_t head = __atomic_load_n(uring_ev->sq.khead, __ATOMIC_ACQUIRE);
+	unsigned retries = 0;
+
+	while ((tail - head) >= uring_ev->sq.entries) {
+		int ret;
+
+		/*
+		 * The submission queue is full, make room. With a
+		 * full completion queue the kernel might refuse new
+		 * submissions, so reap first.
+		 */
+		uring_reap(uring_ev);
+
+		ret = uring_submit(uring_ev, 0, NULL);
+		if ((ret == -1) &&
+		    (errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+			uring_panic(uring_ev, "io_uring_enter() failed");
+			return;
+		}
+
+		head = __atomic_load_n(uring_ev->sq.khead, __ATOMIC_ACQUIRE);
+
+		if (retries++ > 1000) {
+			uring_panic(uring_ev, "submission queue stuck");
+			return;
+		}
+	}
+
+	uring_ev->sqes[tail & uring_ev->sq.mask] = *sqe;
+	uring_ev->sq.tail = tail + 1;
+	__atomic_store_n(uring_ev->sq.ktail, uring_ev->sq.tail, __ATOMIC_RELEASE);
+}
+
+static void uring_push_cancel(struct uring_event_context *uring_ev,
+			      struct uring_op *op)
+{
+	struct io_uring_sqe sqe = {
+		.opcode = (op->io != NULL) ?
+			IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE,
+		.fd = -1,
+		.addr = (uint64_t)(uintptr_t)op,
+		.user_data = 0,
+	};
+
+	uring_push_sqe(uring_ev, &sqe);
+	op->cancel_queued = true;
+}
+
+/*
+  map from TEVENT_FD_* to POLLIN/POLLOUT
+*/
+static uint32_t uring_map_flags(uint16_t flags)
+{
+	uint32_t ret = 0;
+
+	/*
+	 * POLLERR and POLLHUP are always reported.
+	 */
+	if (flags & TEVENT_FD_READ) {
+		ret |= POLLIN;
+#ifdef POLLRDHUP
+		ret |= POLLRDHUP;
+#endif
+	}
+	if (flags & TEVENT_FD_WRITE) {
+		ret |= POLLOUT;
+	}
+#ifdef POLLRDHUP
+	if (flags & TEVENT_FD_ERROR) {
+		ret |= POLLRDHUP;
+	}
+#endif
+	return ret;
+}
+
+static void uring_push_poll(struct uring_event_context *uring_ev,
+			    struct uring_op *op,
+			    uint32_t mask)
+{
+	struct io_uring_sqe sqe = {
+		.opcode = IORING_OP_POLL_ADD,
+		.fd = op->fde->fd,
+		.user_data = (uint64_t)(uintptr_t)op,
+	};
+
+#ifdef WORDS_BIGENDIAN
+	sqe.poll32_events = (mask << 16) | (mask >> 16);
+#else
+	sqe.poll32_events = mask;
+#endif
+
+	uring_push_sqe(uring_ev, &sqe);
+	op->in_flight = true;
+	op->armed_mask = mask;
+}
+
+/*
+  turn the dirty fdes into poll requests
+*/
+static void uring_flush_dirty(struct uring_event_context *uring_ev)
+{
+	struct uring_op *op = NULL;
+
+	while ((op = uring_ev->dirty) != NULL) {
+		uint32_t want = uring_map_flags(op->fde->flags);
+
+		uring_op_list_remove(uring_ev, op);
+
+		if (op->in_flight) {
+			if ((op->armed_mask != want) && !op->cancel_queued) {
+				/*
+				 * Re-armed with the new mask once the
+				 * cancelled poll shows up in
+				 * uring_dispatch().
+				 */
+				uring_push_cancel(uring_ev, op);
+			}
+			continue;
+		}
+
+		if (want == 0) {
+			continue;
+		}
+
+		uring_push_poll(uring_ev, op, want);
+	}
+}
+
+static void uring_fde_dirty(struct uring_event_context *uring_ev,
+			    struct tevent_fd *fde)
+{
+	struct uring_op *op = talloc_get_type_abort(
+		fde->additional_data, struct uring_op);
+
+	if (op->list != URING_OP_LIST_NONE) {
+		/*
+		 * Already dirty, or completed: uring_dispatch() will
+		 * mark it dirty once the handler ran.
+		 */
+		return;
+	}
+	uring_op_list_add(uring_ev, op, URING_OP_LIST_DIRTY);
+}
+
+/*
+  reopen the ring when our pid changes. The ring memory is shared
+  with the parent, so we must not touch anything in there.
+
+  sendmsg/recvmsg requests in flight belong to the parent's ring,
+  which might complete them after the fork. Submitting them again
+  could send or consume data twice, so they fail with ECANCELED from
+  the next uring_dispatch().
+ */
+static void uring_check_reopen(struct uring_event_context *uring_ev)
+{
+	struct tevent_fd *fde = NULL;
+	struct tevent_uring_io *io = NULL;
+	struct uring_op *op = NULL;
+	int ret;
+
+	if (uring_ev->pid == tevent_cached_getpid()) {
+		return;
+	}
+
+	/*
+	 * Don't munmap(), it would just drop our reference, but
+	 * uring_ring_fini() is the simplest way to forget the
+	 * pointers.
+	 */
+	uring_ring_fini(uring_ev);
+
+	while ((op = uring_ev->orphans) != NULL) {
+		uring_op_list_remove(uring_ev, op);
+		TALLOC_FREE(op);
+	}
+
+	ret = uring_ring_init(uring_ev);
+	if (ret != 0) {
+		uring_panic(uring_ev, "uring_ring_init() failed");
+		return;
+	}
+
+	for (fde = uring_ev->ev->fd_events; fde != NULL; fde = fde->next) {
+		op = talloc_get_type_abort(fde->additional_data,
+					   struct uring_op);
+		op->in_flight = false;
+		op->cancel_queued = false;
+		uring_fde_dirty(uring_ev, fde);
+	}
+
+	for (io = uring_ev->ios; io != NULL; io = io->next) {
+		if (!io->op.in_flight) {
+			continue;
+		}
+		io->op.in_flight = false;
+		io->op.cancel_queued = false;
+		io->op.res = -ECANCELED;
+		uring_op_list_remove(uring_ev, &io->op);
+		uring_op_list_add(uring_ev, &io->op, URING_OP_LIST_COMPLETED);
+	}
+}
+
+/*
+  free the ring
+*/
+static int uring_ctx_destructor(struct uring_event_context *uring_ev)
+{
+	struct tevent_uring_io *io = NULL;
+
+	if (uring_ev->pid == tevent_cached_getpid()) {
+		/*
+		 * Closing the ring cancels requests in the
+		 * background, but sendmsg/recvmsg requests still
+		 * reference memory of our callers. Wait for them.
+		 */
+		for (io = uring_ev->ios; io != NULL; io = io->next) {
+			if (io->op.in_flight && !io->op.cancel_queued) {
+				uring_push_cancel(uring_ev, &io->op);
+			}
+		}
+		for (io = uring_ev->ios; io != NULL; io = io->next) {
+			while (io->op.in_flight) {
+				int ret = uring_submit(uring_ev, 1, NULL);
+				if ((ret == -1) && (errno != EINTR) &&
+				    (errno != EAGAIN) && (errno != EBUSY)) {
+					uring_panic(uring_ev,
+						    "io_uring_enter() failed");
+					break;
+				}
+				uring_reap(uring_ev);
+			}
+		}
+	}
+
+	while ((io = uring_ev->ios) != NULL) {
+		DLIST_REMOVE(uring_ev->ios, io);
+		io->uring_ev = NULL;
+	}
+
+	uring_ring_fini(uring_ev);
+	return 0;
+}
+
+/*
+  create a uring_event_context structure.
+*/
+static int uring_event_context_init(struct tevent_context *ev)
+{
+	struct uring_event_context *uring_ev = NULL;
+	int ret;
+
+	/*
+	 * We might be called during tevent_re_initialise()
+	 * which means we need to free our old additional_data.
+	 */
+	TALLOC_FREE(ev->additional_data);
+
+	uring_ev = talloc_zero(ev, struct uring_event_context);
+	if (uring_ev == NULL) {
+		return -1;
+	}
+	uring_ev->ev = ev;
+	uring_ev->ring_fd = -1;
+
+	ret = uring_ring_init(uring_ev);
+	if (ret != 0) {
+		talloc_free(uring_ev);
+		return ret;
+	}
+	talloc_set_destructor(uring_ev, uring_ctx_destructor);
+
+	ev->additional_data = uring_ev;
+	return 0;
+}
+
+/*
+  destroy an fd_event
+*/
+static int uring_event_fd_destructor(struct tevent_fd *fde)
+{
+	struct tevent_context *ev = fde->event_ctx;
+	struct uring_event_context *uring_ev = NULL;
+	struct uring_op *op = NULL;
+
+	if (ev == NULL) {
+		/*
+		 * The context is gone, and with it our uring_op.
+		 */
+		fde->additional_data = NULL;
+		return tevent_common_fd_destructor(fde);
+	}
+
+	uring_ev = talloc_get_type_abort(ev->additional_data,
+					 struct uring_event_context);
+
+	/*
+	 * After a fork this forgets about the poll requests of the
+	 * parent, so do it before we look at op->in_flight.
+	 */
+	uring_check_reopen(uring_ev);
+	DLIST_REMOVE(ev->fd_events, fde);
+
+	op = talloc_get_type_abort(fde->additional_data, struct uring_op);
+	fde->additional_data = NULL;
+
+	uring_op_list_remove(uring_ev, op);
+	op->fde = NULL;
+
+	if (op->in_flight) {
+		/*
+		 * The kernel still knows about the op, it's freed
+		 * when the poll comes back.
+		 */
+		if (!op->cancel_queued) {
+			uring_push_cancel(uring_ev, op);
+		}
+		uring_op_list_add(uring_ev, op, URING_OP_LIST_ORPHAN);
+	} else {
+		TALLOC_FREE(op);
+	}
+
+	return tevent_common_fd_destructor(fde);
+}
+
+/*
+  add a fd based event
+  return NULL on failure (memory allocation error)
+*/
+static struct tevent_fd *uring_event_add_fd(struct tevent_context *ev,
+					    TALLOC_CTX *mem_ctx,
+					    int fd, uint16_t flags,
+					    tevent_fd_handler_t handler,
+					    void *private_data,
+					    const char *handler_name,
+					    const char *location)
+{
+	struct uring_event_context *uring_ev =
+		talloc_get_type_abort(ev->additional_data,
+		struct uring_event_context);
+	struct tevent_fd *fde = NULL;
+	struct uring_op *op = NULL;
+
+	uring_check_reopen(uring_ev);
+
+	op = talloc_zero(uring_ev, struct uring_op);
+	if (op == NULL) {
+		return NULL;
+	}
+	op->uring_ev = uring_ev;
+
+	fde = tevent_common_add_fd(ev, mem_ctx, fd, flags,
+				   handler, private_data,
+				   handler_name, location);
+	if (fde == NULL) {
+		TALLOC_FREE(op);
+		return NULL;
+	}
+
+	op->fde = fde;
+	fde->additional_data = op;
+	talloc_set_destructor(fde, uring_event_fd_destructor);
+
+	uring_fde_dirty(uring_ev, fde);
+
+	return fde;
+}
+
+/*
+  set the fd event flags
+*/
+static void uring_event_set_fd_flags(struct tevent_fd *fde, uint16_t flags)
+{
+	struct tevent_context *ev = fde->event_ctx;
+	struct uring_event_context *uring_ev = NULL;
+
+	if (fde->flags == flags) {
+		return;
+	}
+	fde->flags = flags;
+
+	if (ev == NULL) {
+		return;
+	}
+
+	uring_ev = talloc_get_type_abort(ev->additional_data,
+					 struct uring_event_context);
+	uring_check_reopen(uring_ev);
+	uring_fde_dirty(uring_ev, fde);
+}
+
+/*
+  give up on an fde the kernel can't poll
+*/
+static void uring_fde_disarm(struct uring_event_context *uring_ev,
+			     struct tevent_fd *fde,
+			     int32_t res)
+{
+	struct uring_op *op = talloc_get_type_abort(
+		fde->additional_data, struct uring_op);
+
+	tevent_debug(uring_ev->ev, TEVENT_DEBUG_ERROR,
+		     "poll on fde[%p] fd[%d] failed: %s - disabling\n",
+		     fde, fde->fd,
+		     (res < 0) ? strerror(-res) : "POLLNVAL");
+
+	fde->additional_data = NULL;
+	TALLOC_FREE(op);
+	tevent_common_fd_disarm(fde);
+}
+
+/*
+  call the handler for one completed operation
+
+  Returns true if a handler was called.
+*/
+static bool uring_dispatch(struct uring_event_context *uring_ev)
+{
+	struct uring_op *op = NULL;
+
+	while ((op = uring_ev->completed) != NULL) {
+		struct tevent_fd *fde = op->fde;
+		int32_t res = op->res;
+		uint16_t flags = 0;
+		bool removed = false;
+
+		uring_op_list_remove(uring_ev, op);
+
+		if (op->io != NULL) {
+			struct tevent_uring_io *io = op->io;
+
+			DLIST_REMOVE(uring_ev->ios, io);
+			io->uring_ev = NULL;
+			io->fn(res, io->private_data);
+			return true;
+		}
+
+		if (res == -ECANCELED) {
+			/* see uring_flush_dirty() */
+			uring_fde_dirty(uring_ev, fde);
+			continue;
+		}
+
+		if ((res < 0) || (res & POLLNVAL)) {
+			uring_fde_disarm(uring_ev, fde, res);
+			continue;
+		}
+
+#ifdef POLLRDHUP
+#define __URING_RETURN_ERROR_FLAGS (POLLHUP|POLLERR|POLLRDHUP)
+#else
+#define __URING_RETURN_ERROR_FLAGS (POLLHUP|POLLERR)
+#endif
+
+		if (res & __URING_RETURN_ERROR_FLAGS) {
+			/*
+			 * If we only wait for TEVENT_FD_WRITE, we
+			 * should not tell the event handler about it,
+			 * and remove the writable flag, as we only
+			 * report errors when waiting for read events
+			 * or explicit for errors.
+			 */
+			if (!(fde->flags & (TEVENT_FD_READ|TEVENT_FD_ERROR)))
+			{
+				uring_fde_dirty(uring_ev, fde);
+				TEVENT_FD_NOT_WRITEABLE(fde);
+				continue;
+			}
+			if (fde->flags & TEVENT_FD_ERROR) {
+				flags |= TEVENT_FD_ERROR;
+			}
+			if (fde->flags & TEVENT_FD_READ) {
+				flags |= TEVENT_FD_READ;
+			}
+		}
+		if (res & POLLIN) {
+			flags |= TEVENT_FD_READ;
+		}
+		if (res & POLLOUT) {
+			flags |= TEVENT_FD_WRITE;
+		}
+
+		/*
+		 * make sure we only pass the flags
+		 * the handler is expecting.
+		 */
+		flags &= fde->flags;
+
+		uring_fde_dirty(uring_ev, fde);
+
+		if (flags == 0) {
+			continue;
+		}
+
+		tevent_common_invoke_fd_handler(fde, flags, &removed);
+		return true;
+	}
+
+	return false;
+}
+
+/*
+  event loop handling using io_uring
+*/
+static int uring_event_loop(struct uring_event_context *uring_ev,
+			    struct timeval *tvalp)
+{
+	struct tevent_context *ev = uring_ev->ev;
+	struct timespec ts;
+	bool handled;
+	int ret;
+	int wait_errno;
+
+	/*
+	 * First hand out what we already have, this does not need
+	 * a syscall.
+	 */
+	uring_reap(uring_ev);
+	handled = uring_dispatch(uring_ev);
+	if (handled) {
+		return 0;
+	}
+
+	uring_flush_dirty(uring_ev);
+
+	if (ev->signal_events &&
+	    tevent_common_check_signal(ev)) {
+		return 0;
+	}
+
+	if (tvalp != NULL) {
+		ts = (struct timespec) {
+			.tv_sec = tvalp->tv_sec,
+			.tv_nsec = tvalp->tv_usec * 1000,
+		};
+	}
+
+	tevent_trace_point_callback(ev, TEVENT_TRACE_BEFORE_WAIT);
+	ret = uring_submit(uring_ev, 1, (tvalp != NULL) ? &ts : NULL);
+	wait_errno = errno;
+	tevent_trace_point_callback(ev, TEVENT_TRACE_AFTER_WAIT);
+
+	if (ret == -1 && wait_errno == EINTR && ev->signal_events) {
+		if (tevent_common_check_signal(ev)) {
+			return 0;
+		}
+	}
+
+	if ((ret == -1) &&
+	    (wait_errno != EINTR) &&
+	    (wait_errno != ETIME) &&
+	    (wait_errno != EAGAIN) &&
+	    (wait_errno != EBUSY)) {
+		errno = wait_errno;
+		uring_panic(uring_ev, "io_uring_enter() failed");
+		return -1;
+	}
+
+	uring_reap(uring_ev);
+
+	if ((uring_ev->completed == NULL) && (tvalp != NULL)) {
+		/* we don't care about a possible delay here */
+		tevent_common_loop_timer_delay(ev);
+		return 0;
+	}
+
+	uring_dispatch(uring_ev);
+	return 0;
+}
+
+/*
+  do a single event loop using the events defined in ev
+*/
+static int uring_event_loop_once(struct tevent_context *ev,
+				 const char *location)
+{
+	struct uring_event_context *uring_ev =
+		talloc_get_type_abort(ev->additional_data,
+		struct uring_event_context);
+	struct timeval tval;
+
+	if (ev->signal_events &&
+	    tevent_common_check_signal(ev)) {
+		return 0;
+	}
+
+	if (ev->threaded_contexts != NULL) {
+		tevent_common_threaded_activate_immediate(ev);
+	}
+
+	if (ev->immediate_events &&
+	    tevent_common_loop_immediate(ev)) {
+		return 0;
+	}
+
+	tval = tevent_common_loop_timer_delay(ev);
+	if (tevent_timeval_is_zero(&tval)) {
+		return 0;
+	}
+
+	uring_check_reopen(uring_ev);
+
+	return uring_event_loop(uring_ev, &tval);
+}
+
+static int uring_io_destructor(struct tevent_uring_io *io)
+{
+	struct uring_event_context *uring_ev = io->uring_ev;
+
+	if (uring_ev == NULL) {
+		return 0;
+	}
+
+	uring_check_reopen(uring_ev);
+
+	if (io->op.in_flight && !io->op.cancel_queued) {
+		uring_push_cancel(uring_ev, &io->op);
+	}
+
+	/*
+	 * The kernel might still access the caller's buffers until
+	 * the request comes back.
+	 */
+	while (io->op.in_flight) {
+		int ret = uring_submit(uring_ev, 1, NULL);
+		if ((ret == -1) &&
+		    (errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+			uring_panic(uring_ev, "io_uring_enter() failed");
+			break;
+		}
+		uring_reap(uring_ev);
+	}
+
+	uring_op_list_remove(uring_ev, &io->op);
+	DLIST_REMOVE(uring_ev->ios, io);
+
+	return 0;
+}
+
+/*
+  start a sendmsg or recvmsg request on a context using the uring
+  backend
+*/
+_PRIVATE_ struct tevent_uring_io *tevent_uring_io_start(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	bool send,
+	int fd,
+	const struct msghdr *msg,
+	int flags,
+	void (*fn)(int res, void *private_data),
+	void *private_data)
+{
+	struct tevent_context *main_ev = tevent_wrapper_main_ev(ev);
+	struct uring_event_context *uring_ev = NULL;
+	struct tevent_uring_io *io = NULL;
+	struct io_uring_sqe sqe = {};
+
+	if ((main_ev == NULL) || (main_ev->ops != &uring_event_ops)) {
+		errno = ENOSYS;
+		return NULL;
+	}
+	uring_ev = talloc_get_type_abort(main_ev->additional_data,
+					 struct uring_event_context);
+
+	uring_check_reopen(uring_ev);
+
+	io = talloc_zero(mem_ctx, struct tevent_uring_io);
+	if (io == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	*io = (struct tevent_uring_io) {
+		.uring_ev = uring_ev,
+		.op.uring_ev = uring_ev,
+		.op.io = io,
+		.opcode = send ? IORING_OP_SENDMSG : IORING_OP_RECVMSG,
+		.fd = fd,
+		.msg = msg,
+		.msg_flags = flags,
+		.fn = fn,
+		.private_data = private_data,
+	};
+
+	sqe = (struct io_uring_sqe) {
+		.opcode = io->opcode,
+		.fd = io->fd,
+		.addr = (uint64_t)(uintptr_t)io->msg,
+		.msg_flags = io->msg_flags,
+		.user_data = (uint64_t)(uintptr_t)&io->op,
+	};
+	uring_push_sqe(uring_ev, &sqe);
+	io->op.in_flight = true;
+
+	DLIST_ADD(uring_ev->ios, io);
+	talloc_set_destructor(io, uring_io_destructor);
+
+	return io;
+}
+
+/*
+  ask the kernel to cancel a request, it completes with -ECANCELED
+  unless it finished already
+*/
+_PRIVATE_ bool tevent_uring_io_cancel(struct tevent_uring_io *io)
+{
+	struct uring_event_context *uring_ev = io->uring_ev;
+
+	if ((uring_ev == NULL) || !io->op.in_flight) {
+		return false;
+	}
+
+	uring_check_reopen(uring_ev);
+
+	if (!io->op.cancel_queued) {
+		uring_push_cancel(uring_ev, &io->op);
+	}
+	return true;
+}
+
+static const struct tevent_ops uring_event_ops = {
+	.context_init		= uring_event_context_init,
+	.add_fd			= uring_event_add_fd,
+	.set_fd_close_fn	= tevent_common_fd_set_close_fn,
+	.get_fd_flags		= tevent_common_fd_get_flags,
+	.set_fd_flags		= uring_event_set_fd_flags,
+	.add_timer		= tevent_common_add_timer_v2,
+	.schedule_immediate	= tevent_common_schedule_immediate,
+	.add_signal		= tevent_common_add_signal,
+	.loop_once		= uring_event_loop_once,
+	.loop_wait		= tevent_common_loop_wait,
+};
+
+_PRIVATE_ bool tevent_uring_init(void)
+{
+	return tevent_register_backend("uring", &uring_event_ops);
+}
@@ -0,0 +1,781 @@
+/*
+   Unix SMB/CIFS implementation.
+   SMB2 compression
+
+   Copyright (C) Samba Team 2024
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "../libcli/smb/smb_common.h"
+#include "lib/compression/lzxpress.h"
+#include "lib/compression/lzxpress_huffman.h"
+
+/*
+ * Runs of identical bytes shorter than this
+ * are left to the LZ77 based algorithms.
+ */
+#define SMB2_COMPRESSION_PATTERN_MIN 64
+
+/*
+ * The size of each of the 3 slices
+ * smb2_compression_worthwhile() looks at.
+ */
+#define SMB2_COMPRESSION_SAMPLE_SIZE 1024
+
+static bool smb2_compression_algo_known(uint16_t algo)
+{
+	switch (algo) {
+	case SMB2_COMPRESSION_LZ77:
+	case SMB2_COMPRESSION_LZ77_HUFFMAN:
+	case SMB2_COMPRESSION_PATTERN_V1:
+		return true;
+	}
+
+	return false;
+}
+
+static bool smb2_compression_has_algo(
+	const struct smb3_compression_capabilities *c,
+	uint16_t algo)
+{
+	uint16_t i;
+
+	for (i = 0; i < c->num_algos; i++) {
+		if (c->algos[i] == algo) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+NTSTATUS smb2_compression_capabilities_pull(const DATA_BLOB blob,
+					    struct smb3_compression_capabilities *c)
+{
+	size_t needed = 8;
+	uint16_t count;
+	uint16_t i;
+	const uint8_t *p = NULL;
+
+	*c = (struct smb3_compression_capabilities) { .num_algos = 0, };
+
+	if (blob.length < needed) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	count = SVAL(blob.data, 0);
+	/* 2 bytes padding */
+	c->flags = IVAL(blob.data, 4);
+
+	if (count == 0) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	needed += count * 2;
+	if (blob.length < needed) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	p = blob.data + 8;
+	for (i = 0; i < count; i++) {
+		uint16_t algo = SVAL(p, i * 2);
+
+		if (!smb2_compression_algo_known(algo)) {
+			continue;
+		}
+		if (smb2_compression_has_algo(c, algo)) {
+			continue;
+		}
+		if (c->num_algos >= SMB3_COMPRESSION_CAPABILITIES_MAX_ALGOS) {
+			break;
+		}
+
+		c->algos[c->num_algos] = algo;
+		c->num_algos += 1;
+	}
+
+	return NT_STATUS_OK;
+}
+
+NTSTATUS smb2_compression_capabilities_push(TALLOC_CTX *mem_ctx,
+					    const struct smb3_compression_capabilities *c,
+					    DATA_BLOB *blob)
+{
+	uint16_t i;
+
+	if (c->num_algos == 0) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	*blob = data_blob_talloc_zero(mem_ctx, 8 + c->num_algos * 2);
+	if (blob->data == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	SSVAL(blob->data, 0, c->num_algos);
+	SSVAL(blob->data, 2, 0); /* Padding */
+	SIVAL(blob->data, 4, c->flags);
+
+	for (i = 0; i < c->num_algos; i++) {
+		SSVAL(blob->data, 8 + i * 2, c->algos[i]);
+	}
+
+	return NT_STATUS_OK;
+}
+
+void smb2_compression_capabilities_select(
+	const struct smb3_compression_capabilities *ours,
+	const struct smb3_compression_capabilities *peer,
+	struct smb3_compression_capabilities *result)
+{
+	uint32_t flags = ours->flags & peer->flags;
+	bool lz_found = false;
+	uint16_t i;
+
+	*result = (struct smb3_compression_capabilities) {
+		.flags = flags & SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED,
+	};
+
+	for (i = 0; i < ours->num_algos; i++) {
+		uint16_t algo = ours->algos[i];
+
+		if (!smb2_compression_has_algo(peer, algo)) {
+			continue;
+		}
+
+		if (algo == SMB2_COMPRESSION_PATTERN_V1) {
+			/*
+			 * Pattern_V1 can only be used
+			 * in chained messages.
+			 */
+			if (!(result->flags &
+			      SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED))
+			{
+				continue;
+			}
+		} else {
+			lz_found = true;
+		}
+
+		result->algos[result->num_algos] = algo;
+		result->num_algos += 1;
+	}
+
+	if (!lz_found && !(result->flags &
+			   SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED))
+	{
+		*result = (struct smb3_compression_capabilities) {
+			.num_algos = 0,
+		};
+	}
+}
+
+static uint16_t smb2_compression_lz_algo(
+	const struct smb3_compression_capabilities *c)
+{
+	uint16_t i;
+
+	for (i = 0; i < c->num_algos; i++) {
+		switch (c->algos[i]) {
+		case SMB2_COMPRESSION_LZ77:
+		case SMB2_COMPRESSION_LZ77_HUFFMAN:
+			return c->algos[i];
+		}
+	}
+
+	return SMB2_COMPRESSION_NONE;
+}
+
+bool smb2_compression_worthwhile(const uint8_t *buf, size_t len)
+{
+	uint8_t sample[3 * SMB2_COMPRESSION_SAMPLE_SIZE];
+	uint8_t compressed[3 * SMB2_COMPRESSION_SAMPLE_SIZE];
+	size_t sample_len;
+	ssize_t ret;
+
+	if (len < SMB2_COMPRESSION_PATTERN_MIN) {
+		return false;
+	}
+
+	/*
+	 * We look at the start, the middle and the end
+	 * of the buffer and try to compress that
+	 * with plain LZ77, which is cheap.
+	 *
+	 * Data that doesn't shrink by at least 1/8
+	 * is typically already compressed or encrypted
+	 * and it's not worth spending more cpu cycles
+	 * on it.
+	 */
+	if (len <= sizeof(sample)) {
+		memcpy(sample, buf, len);
+		sample_len = len;
+	} else {
+		size_t mid = (len - SMB2_COMPRESSION_SAMPLE_SIZE) / 2;
+		size_t end = len - SMB2_COMPRESSION_SAMPLE_SIZE;
+
+		memcpy(sample, buf, SMB2_COMPRESSION_SAMPLE_SIZE);
+		memcpy(sample + SMB2_COMPRESSION_SAMPLE_SIZE,
+		       buf + mid,
+		       SMB2_COMPRESSION_SAMPLE_SIZE);
+		memcpy(sample + 2 * SMB2_COMPRESSION_SAMPLE_SIZE,
+		       buf + end,
+		       SMB2_COMPRESSION_SAMPLE_SIZE);
+		sample_len = sizeof(sample);
+	}
+
+	ret = lzxpress_compress(sample, sample_len,
+				compressed, sizeof(compressed));
+	if (ret < 0) {
+		return false;
+	}
+
+	return (size_t)ret <= (sample_len - sample_len / 8);
+}
+
+/*
+ * Returns the compressed size or 0 if the data is not compressible.
+ */
+static size_t smb2_compression_lz_compress(TALLOC_CTX *mem_ctx,
+					   uint16_t algo,
+					   const uint8_t *buf,
+					   size_t len,
+					   uint8_t **_out)
+{
+	uint8_t *out = NULL;
+	ssize_t ret;
+
+	if (len > UINT32_MAX) {
+		return 0;
+	}
+
+	switch (algo) {
+	case SMB2_COMPRESSION_LZ77:
+		out = talloc_array(mem_ctx, uint8_t, len);
+		if (out == NULL) {
+			return 0;
+		}
+		ret = lzxpress_compress(buf, len, out, len);
+		break;
+	case SMB2_COMPRESSION_LZ77_HUFFMAN:
+		ret = lzxpress_huffman_compress_talloc(mem_ctx, buf, len, &out);
+		break;
+	default:
+		return 0;
+	}
+
+	if (ret <= 0 || (size_t)ret >= len) {
+		TALLOC_FREE(out);
+		return 0;
+	}
+
+	*_out = out;
+	return ret;
+}
+
+static ssize_t smb2_compression_lz_decompress(uint16_t algo,
+					      const uint8_t *in,
+					      size_t in_len,
+					      uint8_t *out,
+					      size_t out_len)
+{
+	if (in_len > UINT32_MAX || out_len > UINT32_MAX) {
+		return -1;
+	}
+
+	switch (algo) {
+	case SMB2_COMPRESSION_LZ77:
+		return lzxpress_decompress(in, in_len, out, out_len);
+	case SMB2_COMPRESSION_LZ77_HUFFMAN:
+		return lzxpress_huffman_decompress(in, in_len, out, out_len);
+	}
+
+	return -1;
+}
+
+static size_t smb2_compression_pattern_len(const uint8_t *buf,
+					   size_t len,
+					   bool backwards)
+{
+	uint8_t c;
+	size_t i;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	if (backwards) {
+		c = buf[len - 1];
+		for (i = 1; i < len; i++) {
+			if (buf[len - 1 - i] != c) {
+				break;
+			}
+		}
+	} else {
+		c = buf[0];
+		for (i = 1; i < len; i++) {
+			if (buf[i] != c) {
+				break;
+			}
+		}
+	}
+
+	if (i < SMB2_COMPRESSION_PATTERN_MIN) {
+		return 0;
+	}
+
+	return i;
+}
+
+static bool smb2_compression_chained_append(TALLOC_CTX *mem_ctx,
+					    DATA_BLOB *out,
+					    uint16_t algo,
+					    uint32_t orig_size,
+					    const uint8_t *payload,
+					    size_t payload_len)
+{
+	uint8_t hdr[SMB2_COMP_CHAINED_HDR_SIZE + 4];
+	size_t hdr_len = SMB2_COMP_CHAINED_HDR_SIZE;
+	size_t length = payload_len;
+	bool ok;
+
+	if (algo == SMB2_COMPRESSION_LZ77 ||
+	    algo == SMB2_COMPRESSION_LZ77_HUFFMAN)
+	{
+		/*
+		 * The OriginalPayloadSize is part of the payload
+		 */
+		SIVAL(hdr, SMB2_COMP_CHAINED_HDR_SIZE, orig_size);
+		hdr_len += 4;
+		length += 4;
+	}
+
+	if (length > UINT32_MAX) {
+		return false;
+	}
+
+	SSVAL(hdr, SMB2_COMP_CHAINED_ALGORITHM, algo);
+	SSVAL(hdr, SMB2_COMP_CHAINED_FLAGS, SMB2_COMPRESSION_FLAG_CHAINED);
+	SIVAL(hdr, SMB2_COMP_CHAINED_LENGTH, length);
+
+	ok = data_blob_append(mem_ctx, out, hdr, hdr_len);
+	if (!ok) {
+		return false;
+	}
+
+	return data_blob_append(mem_ctx, out, payload, payload_len);
+}
+
+static NTSTATUS smb2_compression_compress_chained(
+	TALLOC_CTX *mem_ctx,
+	const struct smb3_compression_capabilities *c,
+	const uint8_t *prefix,
+	size_t prefix_len,
+	const uint8_t *data,
+	size_t data_len,
+	DATA_BLOB *out)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	uint16_t lz_algo = smb2_compression_lz_algo(c);
+	bool use_pattern = smb2_compression_has_algo(c,
+					SMB2_COMPRESSION_PATTERN_V1);
+	DATA_BLOB blob = data_blob_null;
+	size_t len = prefix_len + data_len;
+	size_t leading = 0;
+	size_t trailing = 0;
+	uint8_t tf[8];
+	bool ok;
+
+	SIVAL(tf, SMB2_COMP_TF_PROTOCOL_ID, SMB2_COMP_TF_MAGIC);
+	SIVAL(tf, SMB2_COMP_TF_ORIG_SIZE, len);
+
+	ok = data_blob_append(frame, &blob, tf, sizeof(tf));
+	if (!ok) {
+		goto nomem;
+	}
+
+	if (prefix_len > 0) {
+		ok = smb2_compression_chained_append(frame, &blob,
+						     SMB2_COMPRESSION_NONE,
+						     prefix_len,
+						     prefix, prefix_len);
+		if (!ok) {
+			goto nomem;
+		}
+	}
+
+	if (use_pattern) {
+		leading = smb2_compression_pattern_len(data, data_len, false);
+		trailing = smb2_compression_pattern_len(data + leading,
+							data_len - leading,
+							true);
+	}
+
+	if (leading > 0) {
+		uint8_t p[SMB2_COMP_PATTERN_V1_SIZE] = { 0, };
+
+		SCVAL(p, SMB2_COMP_PATTERN_V1_PATTERN, data[0]);
+		SIVAL(p, SMB2_COMP_PATTERN_V1_REPETITIONS, leading);
+
+		ok = smb2_compression_chained_append(frame, &blob,
+						     SMB2_COMPRESSION_PATTERN_V1,
+						     leading, p, sizeof(p));
+		if (!ok) {
+			goto nomem;
+		}
+	}
+
+	if (data_len > leading + trailing) {
+		const uint8_t *mid = data + leading;
+		size_t mid_len = data_len - leading - trailing;
+		uint8_t *cbuf = NULL;
+		size_t clen = 0;
+
+		if (lz_algo != SMB2_COMPRESSION_NONE &&
+		    smb2_compression_worthwhile(mid, mid_len))
+		{
+			clen = smb2_compression_lz_compress(frame, lz_algo,
+							    mid, mid_len,
+							    &cbuf);
+		}
+
+		if (clen > 0 && clen + 4 < mid_len) {
+			ok = smb2_compression_chained_append(frame, &blob,
+							     lz_algo,
+							     mid_len,
+							     cbuf, clen);
+		} else {
+			ok = smb2_compression_chained_append(frame, &blob,
+							     SMB2_COMPRESSION_NONE,
+							     mid_len,
+							     mid, mid_len);
+		}
+		if (!ok) {
+			goto nomem;
+		}
+	}
+
+	if (trailing > 0) {
+		uint8_t p[SMB2_COMP_PATTERN_V1_SIZE] = { 0, };
+
+		SCVAL(p, SMB2_COMP_PATTERN_V1_PATTERN, data[data_len - 1]);
+		SIVAL(p, SMB2_COMP_PATTERN_V1_REPETITIONS, trailing);
+
+		ok = smb2_compression_chained_append(frame, &blob,
+						     SMB2_COMPRESSION_PATTERN_V1,
+						     trailing, p, sizeof(p));
+		if (!ok) {
+			goto nomem;
+		}
+	}
+
+	if (blob.length >= len) {
+		*out = data_blob_null;
+		TALLOC_FREE(frame);
+		return NT_STATUS_OK;
+	}
+
+	*out = data_blob_talloc(mem_ctx, blob.data, blob.length);
+	TALLOC_FREE(frame);
+	if (out->data == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	return NT_STATUS_OK;
+
+nomem:
+	TALLOC_FREE(frame);
+	return NT_STATUS_NO_MEMORY;
+}
+
+static NTSTATUS smb2_compression_compress_unchained(
+	TALLOC_CTX *mem_ctx,
+	const struct smb3_compression_capabilities *c,
+	const uint8_t *prefix,
+	size_t prefix_len,
+	const uint8_t *data,
+	size_t data_len,
+	DATA_BLOB *out)
+{
+	TALLOC_CTX *frame = NULL;
+	uint16_t lz_algo = smb2_compression_lz_algo(c);
+	size_t len = prefix_len + data_len;
+	uint8_t *cbuf = NULL;
+	size_t clen;
+	uint8_t *p = NULL;
+
+	*out = data_blob_null;
+
+	if (lz_algo == SMB2_COMPRESSION_NONE) {
+		return NT_STATUS_OK;
+	}
+
+	if (!smb2_compression_worthwhile(data, data_len)) {
+		return NT_STATUS_OK;
+	}
+
+	frame = talloc_stackframe();
+
+	clen = smb2_compression_lz_compress(frame, lz_algo,
+					    data, data_len, &cbuf);
+	if (clen == 0 || SMB2_COMP_TF_HDR_SIZE + prefix_len + clen >= len) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_OK;
+	}
+
+	*out = data_blob_talloc(mem_ctx, NULL,
+				SMB2_COMP_TF_HDR_SIZE + prefix_len + clen);
+	if (out->data == NULL) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+	p = out->data;
+
+	SIVAL(p, SMB2_COMP_TF_PROTOCOL_ID, SMB2_COMP_TF_MAGIC);
+	SIVAL(p, SMB2_COMP_TF_ORIG_SIZE, data_len);
+	SSVAL(p, SMB2_COMP_TF_ALGORITHM, lz_algo);
+	SSVAL(p, SMB2_COMP_TF_FLAGS, SMB2_COMPRESSION_FLAG_NONE);
+	SIVAL(p, SMB2_COMP_TF_OFFSET, prefix_len);
+	p += SMB2_COMP_TF_HDR_SIZE;
+
+	memcpy(p, prefix, prefix_len);
+	p += prefix_len;
+	memcpy(p, cbuf, clen);
+
+	TALLOC_FREE(frame);
+	return NT_STATUS_OK;
+}
+
+NTSTATUS smb2_compression_compress(TALLOC_CTX *mem_ctx,
+				   const struct smb3_compression_capabilities *c,
+				   const uint8_t *prefix,
+				   size_t prefix_len,
+				   const uint8_t *data,
+				   size_t data_len,
+				   DATA_BLOB *out)
+{
+	*out = data_blob_null;
+
+	if (c->num_algos == 0) {
+		return NT_STATUS_OK;
+	}
+
+	if (prefix_len > UINT32_MAX ||
+	    data_len > UINT32_MAX - prefix_len)
+	{
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	if (data_len < SMB2_COMPRESSION_PATTERN_MIN) {
+		return NT_STATUS_OK;
+	}
+
+	if (c->flags & SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED) {
+		return smb2_compression_compress_chained(mem_ctx, c,
+							 prefix, prefix_len,
+							 data, data_len,
+							 out);
+	}
+
+	return smb2_compression_compress_unchained(mem_ctx, c,
+						   prefix, prefix_len,
+						   data, data_len,
+						   out);
+}
+
+static NTSTATUS smb2_compression_decompress_chained(TALLOC_CTX *mem_ctx,
+						    const uint8_t *buf,
+						    size_t len,
+						    size_t max_size,
+						    DATA_BLOB *out)
+{
+	size_t orig_size = IVAL(buf, SMB2_COMP_TF_ORIG_SIZE);
+	size_t ofs = 8;
+	size_t out_ofs = 0;
+	uint8_t *p = NULL;
+
+	if (orig_size > max_size) {
+		DBG_NOTICE("Chained message too large: %zu > %zu\n",
+			   orig_size, max_size);
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	p = talloc_array(mem_ctx, uint8_t, orig_size);
+	if (p == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	while (ofs < len) {
+		const uint8_t *payload = NULL;
+		uint16_t algo;
+		size_t length;
+		size_t remaining = orig_size - out_ofs;
+		size_t osize;
+		ssize_t ret;
+
+		if (len - ofs < SMB2_COMP_CHAINED_HDR_SIZE) {
+			goto inval;
+		}
+
+		algo = SVAL(buf, ofs + SMB2_COMP_CHAINED_ALGORITHM);
+		length = IVAL(buf, ofs + SMB2_COMP_CHAINED_LENGTH);
+		ofs += SMB2_COMP_CHAINED_HDR_SIZE;
+
+		if (length > len - ofs) {
+			goto inval;
+		}
+		payload = buf + ofs;
+		ofs += length;
+
+		switch (algo) {
+		case SMB2_COMPRESSION_NONE:
+			if (length > remaining) {
+				goto inval;
+			}
+			memcpy(p + out_ofs, payload, length);
+			out_ofs += length;
+			break;
+
+		case SMB2_COMPRESSION_PATTERN_V1:
+			if (length != SMB2_COMP_PATTERN_V1_SIZE) {
+				goto inval;
+			}
+			osize = IVAL(payload, SMB2_COMP_PATTERN_V1_REPETITIONS);
+			if (osize > remaining) {
+				goto inval;
+			}
+			memset(p + out_ofs,
+			       CVAL(payload, SMB2_COMP_PATTERN_V1_PATTERN),
+			       osize);
+			out_ofs += osize;
+			break;
+
+		case SMB2_COMPRESSION_LZ77:
+		case SMB2_COMPRESSION_LZ77_HUFFMAN:
+			if (length < 4) {
+				goto inval;
+			}
+			osize = IVAL(payload, 0);
+			if (osize > remaining) {
+				goto inval;
+			}
+			ret = smb2_compression_lz_decompress(algo,
+							     payload + 4,
+							     length - 4,
+							     p + out_ofs,
+							     osize);
+			if (ret < 0 || (size_t)ret != osize) {
+				goto inval;
+			}
+			out_ofs += osize;
+			break;
+
+		default:
+			DBG_NOTICE("Unsupported algorithm 0x%04x\n", algo);
+			goto inval;
+		}
+	}
+
+	if (out_ofs != orig_size) {
+		goto inval;
+	}
+
+	*out = data_blob_const(p, orig_size);
+	return NT_STATUS_OK;
+
+inval:
+	TALLOC_FREE(p);
+	return NT_STATUS_INVALID_PARAMETER;
+}
+
+static NTSTATUS smb2_compression_decompress_unchained(TALLOC_CTX *mem_ctx,
+						      const uint8_t *buf,
+						      size_t len,
+						      size_t max_size,
+						      DATA_BLOB *out)
+{
+	size_t orig_size = IVAL(buf, SMB2_COMP_TF_ORIG_SIZE);
+	uint16_t algo = SVAL(buf, SMB2_COMP_TF_ALGORITHM);
+	size_t offset = IVAL(buf, SMB2_COMP_TF_OFFSET);
+	size_t total;
+	uint8_t *p = NULL;
+	ssize_t ret;
+
+	buf += SMB2_COMP_TF_HDR_SIZE;
+	len -= SMB2_COMP_TF_HDR_SIZE;
+
+	if (offset > len) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	total = offset + orig_size;
+	if (total < offset || total > max_size) {
+		DBG_NOTICE("Unchained message too large: %zu > %zu\n",
+			   total, max_size);
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	p = talloc_array(mem_ctx, uint8_t, total);
+	if (p == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	memcpy(p, buf, offset);
+
+	ret = smb2_compression_lz_decompress(algo,
+					     buf + offset,
+					     len - offset,
+					     p + offset,
+					     orig_size);
+	if (ret < 0 || (size_t)ret != orig_size) {
+		TALLOC_FREE(p);
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	*out = data_blob_const(p, total);
+	return NT_STATUS_OK;
+}
+
+NTSTATUS smb2_compression_decompress(TALLOC_CTX *mem_ctx,
+				     const uint8_t *buf,
+				     size_t len,
+				     size_t max_size,
+				     DATA_BLOB *out)
+{
+	uint16_t flags;
+
+	*out = data_blob_null;
+
+	if (len < SMB2_COMP_TF_HDR_SIZE) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	if (IVAL(buf, SMB2_COMP_TF_PROTOCOL_ID) != SMB2_COMP_TF_MAGIC) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	flags = SVAL(buf, SMB2_COMP_TF_FLAGS);
+	if (flags & SMB2_COMPRESSION_FLAG_CHAINED) {
+		return smb2_compression_decompress_chained(mem_ctx,
+							   buf, len,
+							   max_size,
+							   out);
+	}
+
+	return smb2_compression_decompress_unchained(mem_ctx,
+						     buf, len,
+						     max_size,
+						     out);
+}
@@ -0,0 +1,88 @@
+/*
+   Unix SMB/CIFS implementation.
+   SMB2 compression
+
+   Copyright (C) Samba Team 2024
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LIBCLI_SMB_SMB2_COMPRESSION_H_
+#define _LIBCLI_SMB_SMB2_COMPRESSION_H_
+
+#include "lib/util/data_blob.h"
+#include "libcli/util/ntstatus.h"
+
+struct smb3_compression_capabilities {
+#define SMB3_COMPRESSION_CAPABILITIES_MAX_ALGOS 3
+	uint16_t num_algos;
+	uint16_t algos[SMB3_COMPRESSION_CAPABILITIES_MAX_ALGOS];
+	uint32_t flags;
+};
+
+/*
+ * Parse/Build the payload of a SMB2_COMPRESSION_CAPABILITIES
+ * negotiate context, unknown algorithms are silently ignored.
+ */
+NTSTATUS smb2_compression_capabilities_pull(const DATA_BLOB blob,
+					    struct smb3_compression_capabilities *c);
+NTSTATUS smb2_compression_capabilities_push(TALLOC_CTX *mem_ctx,
+					    const struct smb3_compression_capabilities *c,
+					    DATA_BLOB *blob);
+
+/*
+ * Calculate the negotiated capabilities, the result
+ * is in the order of our own preference.
+ */
+void smb2_compression_capabilities_select(
+	const struct smb3_compression_capabilities *ours,
+	const struct smb3_compression_capabilities *peer,
+	struct smb3_compression_capabilities *result);
+
+/*
+ * Returns true if a (cheap) sample based estimation
+ * shows that it's worth trying to compress the buffer.
+ */
+bool smb2_compression_worthwhile(const uint8_t *buf, size_t len);
+
+/*
+ * Build a SMB2_COMPRESSION_TRANSFORM message for the given
+ * SMB2 message, using the negotiated capabilities.
+ *
+ * The prefix (typically the SMB2 header and the fixed
+ * body) is never compressed, only the data is.
+ *
+ * If compression doesn't reduce the size of the message
+ * NT_STATUS_OK is returned with out->length == 0 and the
+ * caller should send the message uncompressed.
+ */
+NTSTATUS smb2_compression_compress(TALLOC_CTX *mem_ctx,
+				   const struct smb3_compression_capabilities *c,
+				   const uint8_t *prefix,
+				   size_t prefix_len,
+				   const uint8_t *data,
+				   size_t data_len,
+				   DATA_BLOB *out);
+
+/*
+ * Decompress a chained or unchained SMB2_COMPRESSION_TRANSFORM
+ * message, the result is limited to max_size bytes.
+ */
+NTSTATUS smb2_compression_decompress(TALLOC_CTX *mem_ctx,
+				     const uint8_t *buf,
+				     size_t len,
+				     size_t max_size,
+				     DATA_BLOB *out);
+
+#endif /* _LIBCLI_SMB_SMB2_COMPRESSION_H_ */
@@ -37,6 +37,36 @@
 
 #define SMB2_TF_FLAGS_ENCRYPTED     0x0001
 
+/* offsets into SMB2_COMPRESSION_TRANSFORM header elements */
+#define SMB2_COMP_TF_PROTOCOL_ID	0x00 /*  4 bytes */
+#define SMB2_COMP_TF_ORIG_SIZE		0x04 /*  4 bytes */
+#define SMB2_COMP_TF_ALGORITHM		0x08 /*  2 bytes */
+#define SMB2_COMP_TF_FLAGS		0x0A /*  2 bytes */
+#define SMB2_COMP_TF_OFFSET		0x0C /*  4 bytes (unchained) */
+#define SMB2_COMP_TF_LENGTH		0x0C /*  4 bytes (chained) */
+
+#define SMB2_COMP_TF_HDR_SIZE		0x10 /* 16 bytes */
+
+#define SMB2_COMP_TF_MAGIC 0x424D53FC /* 0xFC 'S' 'M' 'B' */
+
+/* offsets into SMB2_COMPRESSION_CHAINED_PAYLOAD header elements */
+#define SMB2_COMP_CHAINED_ALGORITHM	0x00 /*  2 bytes */
+#define SMB2_COMP_CHAINED_FLAGS		0x02 /*  2 bytes */
+#define SMB2_COMP_CHAINED_LENGTH	0x04 /*  4 bytes */
+
+#define SMB2_COMP_CHAINED_HDR_SIZE	0x08 /*  8 bytes */
+
+/* offsets into SMB2_COMPRESSION_PATTERN_PAYLOAD_V1 elements */
+#define SMB2_COMP_PATTERN_V1_PATTERN	0x00 /*  1 byte  */
+#define SMB2_COMP_PATTERN_V1_RESERVED1	0x01 /*  1 byte  */
+#define SMB2_COMP_PATTERN_V1_RESERVED2	0x02 /*  2 bytes */
+#define SMB2_COMP_PATTERN_V1_REPETITIONS 0x04 /*  4 bytes */
+
+#define SMB2_COMP_PATTERN_V1_SIZE	0x08 /*  8 bytes */
+
+#define SMB2_COMPRESSION_FLAG_NONE	0x0000
+#define SMB2_COMPRESSION_FLAG_CHAINED	0x0001
+
 /* offsets into header elements for a sync SMB2 request */
 #define SMB2_HDR_PROTOCOL_ID    0x00
 #define SMB2_HDR_LENGTH		0x04
@@ -161,6 +191,17 @@
 	(((uint64_t)1 << (((nonce_len_bytes) - 8)*8)) - 1) \
 	))
 
+/* Values for the SMB2_COMPRESSION_CAPABILITIES Context (>= 0x311) */
+#define SMB2_COMPRESSION_INVALID_ALGO      0xffff /* only used internally */
+#define SMB2_COMPRESSION_NONE              0x0000
+#define SMB2_COMPRESSION_LZNT1             0x0001
+#define SMB2_COMPRESSION_LZ77              0x0002
+#define SMB2_COMPRESSION_LZ77_HUFFMAN      0x0003
+#define SMB2_COMPRESSION_PATTERN_V1        0x0004 /* only with chaining */
+
+#define SMB2_COMPRESSION_CAPABILITIES_FLAG_NONE    0x00000000
+#define SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED 0x00000001
+
 /* Values for the SMB2_TRANSPORT_CAPABILITIES Context (>= 0x311) */
 #define SMB2_ACCEPT_TRANSPORT_LEVEL_SECURITY           0x0001
 
@@ -299,6 +340,7 @@
 #define SMB2_CLOSE_FLAGS_FULL_INFORMATION (0x01)
 
 #define SMB2_READFLAG_READ_UNBUFFERED	0x01
+#define SMB2_READFLAG_REQUEST_COMPRESSED	0x02 /* only in dialect >= 0x311 */
 
 #define SMB2_WRITEFLAG_WRITE_THROUGH	0x00000001
 #define SMB2_WRITEFLAG_WRITE_UNBUFFERED	0x00000002
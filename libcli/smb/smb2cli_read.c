@@ -60,6 +60,9 @@ struct tevent_req *smb2cli_read_send(TALLOC_CTX *mem_ctx,
 	fixed = state->fixed;
 
 	SSVAL(fixed, 0, 49);
+	if (smb2cli_conn_compression_negotiated(conn)) {
+		SCVAL(fixed, 3, SMB2_READFLAG_REQUEST_COMPRESSED);
+	}
 	SIVAL(fixed, 4, length);
 	SBVAL(fixed, 8, offset);
 	SBVAL(fixed, 16, fid_persistent);
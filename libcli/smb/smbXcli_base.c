@@ -130,6 +130,7 @@ struct smbXcli_conn {
 			DATA_BLOB gss_blob;
 			uint16_t sign_algo;
 			uint16_t cipher;
+			struct smb3_compression_capabilities compression;
 			bool smb311_posix;
 		} server;
 
@@ -549,6 +550,11 @@ const char *smbXcli_conn_remote_name(struct smbXcli_conn *conn)
 	return conn->remote_name;
 }
 
+const struct GUID *smbXcli_conn_client_guid(struct smbXcli_conn *conn)
+{
+	return &conn->smb2.client.guid;
+}
+
 uint16_t smbXcli_conn_max_requests(struct smbXcli_conn *conn)
 {
 	if (conn->protocol >= PROTOCOL_SMB2_02) {
@@ -2833,6 +2839,11 @@ uint16_t smb2cli_conn_server_encryption_algo(struct smbXcli_conn *conn)
 	return conn->smb2.server.cipher;
 }
 
+bool smb2cli_conn_compression_negotiated(struct smbXcli_conn *conn)
+{
+	return conn->smb2.server.compression.num_algos > 0;
+}
+
 uint32_t smb2cli_conn_max_trans_size(struct smbXcli_conn *conn)
 {
 	return conn->smb2.server.max_trans_size;
@@ -3561,7 +3572,12 @@ static struct smbXcli_session* smbXcli_session_by_uid(struct smbXcli_conn *conn,
 	return s;
 }
 
+/*
+ * A decompressed message is allocated as a child of
+ * inbuf_ctx, so that references on it keep it alive.
+ */
 static NTSTATUS smb2cli_inbuf_parse_compound(struct smbXcli_conn *conn,
+					     TALLOC_CTX *inbuf_ctx,
 					     uint8_t *buf,
 					     size_t buflen,
 					     TALLOC_CTX *mem_ctx,
@@ -3652,6 +3668,46 @@ static NTSTATUS smb2cli_inbuf_parse_compound(struct smbXcli_conn *conn,
 			len = enc_len;
 		}
 
+		if (IVAL(hdr, 0) == SMB2_COMP_TF_MAGIC) {
+			DATA_BLOB decompressed = data_blob_null;
+			NTSTATUS status;
+
+			if (conn->smb2.server.compression.num_algos == 0) {
+				DEBUG(10, ("Got SMB2_COMPRESSION_TRANSFORM "
+					   "header, but not negotiated\n"));
+				goto inval;
+			}
+
+			/*
+			 * The compression transform has to cover
+			 * the whole (decrypted) message.
+			 */
+			if (num_iov != 0 || taken + len != buflen) {
+				DEBUG(10, ("SMB2_COMPRESSION_TRANSFORM "
+					   "within a compound response\n"));
+				goto inval;
+			}
+
+			status = smb2_compression_decompress(inbuf_ctx,
+							     hdr,
+							     len,
+							     0x00FFFFFF,
+							     &decompressed);
+			if (!NT_STATUS_IS_OK(status)) {
+				TALLOC_FREE(iov);
+				return status;
+			}
+
+			first_hdr = decompressed.data;
+			buflen = decompressed.length;
+			taken = 0;
+			hdr = first_hdr;
+			len = buflen;
+			if (tf != NULL) {
+				verified_buflen = buflen;
+			}
+		}
+
 		/*
 		 * We need the header plus the body length field
 		 */
@@ -3758,6 +3814,7 @@ static NTSTATUS smb2cli_conn_dispatch_incoming(struct smbXcli_conn *conn,
 	size_t inbuf_len = smb_len_tcp(inbuf);
 
 	status = smb2cli_inbuf_parse_compound(conn,
+					      inbuf,
 					      inbuf + NBT_HDR_SIZE,
 					      inbuf_len,
 					      tmp_mem,
@@ -4871,6 +4928,8 @@ static struct tevent_req *smbXcli_negprot_smb2_subreq(struct smbXcli_negprot_sta
 			&state->conn->smb2.client.smb3_capabilities.signing;
 		const struct smb3_encryption_capabilities *client_ciphers =
 			&state->conn->smb2.client.smb3_capabilities.encryption;
+		const struct smb3_compression_capabilities *client_compression =
+			&state->conn->smb2.client.smb3_capabilities.compression;
 		NTSTATUS status;
 		struct smb2_negotiate_contexts c = { .num_contexts = 0, };
 		uint8_t *netname_utf16 = NULL;
@@ -4931,6 +4990,22 @@ static struct tevent_req *smbXcli_negprot_smb2_subreq(struct smbXcli_negprot_sta
 			}
 		}
 
+		if (client_compression->num_algos > 0) {
+			status = smb2_compression_capabilities_push(
+				state, client_compression, &b);
+			if (!NT_STATUS_IS_OK(status)) {
+				return NULL;
+			}
+
+			status = smb2_negotiate_context_add(
+				state, &c, SMB2_COMPRESSION_CAPABILITIES,
+				b.data, b.length);
+			data_blob_free(&b);
+			if (!NT_STATUS_IS_OK(status)) {
+				return NULL;
+			}
+		}
+
 		ok = convert_string_talloc(state, CH_UNIX, CH_UTF16,
 					   state->conn->remote_name,
 					   strlen(state->conn->remote_name),
@@ -5032,6 +5107,7 @@ static void smbXcli_negprot_smb2_done(struct tevent_req *subreq)
 	gnutls_hash_hd_t hash_hnd = NULL;
 	struct smb2_negotiate_context *sign_algo = NULL;
 	struct smb2_negotiate_context *cipher = NULL;
+	struct smb2_negotiate_context *compression = NULL;
 	struct smb2_negotiate_context *posix = NULL;
 	struct iovec sent_iov[3] = {{0}, {0}, {0}};
 	static const struct smb2cli_req_expected_response expected[] = {
@@ -5400,6 +5476,37 @@ static void smbXcli_negprot_smb2_done(struct tevent_req *subreq)
 		conn->smb2.server.cipher = cipher_selected;
 	}
 
+	compression = smb2_negotiate_context_find(
+		state->out_ctx, SMB2_COMPRESSION_CAPABILITIES);
+	if (compression != NULL) {
+		const struct smb3_compression_capabilities *client_compression =
+			&state->conn->smb2.client.smb3_capabilities.compression;
+		struct smb3_compression_capabilities server_compression;
+
+		if (client_compression->num_algos == 0) {
+			/*
+			 * We didn't ask for SMB2_COMPRESSION_CAPABILITIES
+			 */
+			tevent_req_nterror(req,
+					NT_STATUS_INVALID_NETWORK_RESPONSE);
+			return;
+		}
+
+		status = smb2_compression_capabilities_pull(compression->data,
+							    &server_compression);
+		if (tevent_req_nterror(req, status)) {
+			return;
+		}
+
+		/*
+		 * The result only contains algorithms we offered,
+		 * anything else the server selected is ignored.
+		 */
+		smb2_compression_capabilities_select(client_compression,
+						     &server_compression,
+						     &conn->smb2.server.compression);
+	}
+
 	posix = smb2_negotiate_context_find(
 		state->out_ctx, SMB2_POSIX_EXTENSIONS_AVAILABLE);
 	if (posix != NULL) {
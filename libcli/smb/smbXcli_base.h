@@ -67,6 +67,7 @@ void smbXcli_conn_set_sockopt(struct smbXcli_conn *conn, const char *options);
 const struct sockaddr_storage *smbXcli_conn_local_sockaddr(struct smbXcli_conn *conn);
 const struct sockaddr_storage *smbXcli_conn_remote_sockaddr(struct smbXcli_conn *conn);
 const char *smbXcli_conn_remote_name(struct smbXcli_conn *conn);
+const struct GUID *smbXcli_conn_client_guid(struct smbXcli_conn *conn);
 
 uint16_t smbXcli_conn_max_requests(struct smbXcli_conn *conn);
 NTTIME smbXcli_conn_server_system_time(struct smbXcli_conn *conn);
@@ -385,6 +386,7 @@ uint32_t smb2cli_conn_server_capabilities(struct smbXcli_conn *conn);
 uint16_t smb2cli_conn_server_security_mode(struct smbXcli_conn *conn);
 uint16_t smb2cli_conn_server_signing_algo(struct smbXcli_conn *conn);
 uint16_t smb2cli_conn_server_encryption_algo(struct smbXcli_conn *conn);
+bool smb2cli_conn_compression_negotiated(struct smbXcli_conn *conn);
 uint32_t smb2cli_conn_max_trans_size(struct smbXcli_conn *conn);
 uint32_t smb2cli_conn_max_read_size(struct smbXcli_conn *conn);
 uint32_t smb2cli_conn_max_write_size(struct smbXcli_conn *conn);
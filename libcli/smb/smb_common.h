@@ -28,6 +28,7 @@
 #include "libcli/smb/smb2_lease.h"
 #include "libcli/smb/smb2_lock.h"
 #include "libcli/smb/smb2_signing.h"
+#include "libcli/smb/smb2_compression.h"
 #include "libcli/smb/smb_util.h"
 #include "libcli/smb/smb_unix_ext.h"
 
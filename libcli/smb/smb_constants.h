@@ -112,6 +112,12 @@ enum smb_encryption_setting {
 	SMB_ENCRYPTION_REQUIRED = SMB_SIGNING_REQUIRED,
 };
 
+enum smb3_compression_setting {
+	SMB3_COMPRESSION_OFF = 0,
+	SMB3_COMPRESSION_REQUESTED = 1,
+	SMB3_COMPRESSION_AUTO = 2,
+};
+
 /* types of buffers in core SMB protocol */
 #define SMB_DATA_BLOCK 0x1
 #define SMB_ASCII4     0x4
@@ -602,6 +608,8 @@ enum csc_policy {
 	(FSCTL_SMBTORTURE | FSCTL_ACCESS_WRITE | 0x0020 | FSCTL_METHOD_NEITHER)
 #define FSCTL_SMBTORTURE_FSP_ASYNC_SLEEP \
 	(FSCTL_SMBTORTURE | FSCTL_ACCESS_WRITE | 0x0040 | FSCTL_METHOD_NEITHER)
+#define FSCTL_SMBTORTURE_FILES_HASH_CHECK \
+	(FSCTL_SMBTORTURE | FSCTL_ACCESS_WRITE | 0x0080 | FSCTL_METHOD_NEITHER)
 
 /*
  * A few values from [MS-FSCC] 2.1.2.1 Reparse Tags
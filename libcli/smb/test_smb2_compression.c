@@ -0,0 +1,228 @@
+/*
+ * Unix SMB/CIFS implementation.
+ *
+ * Copyright (C) Samba Team 2024
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "replace.h"
+#include <talloc.h>
+#include "libcli/util/ntstatus.h"
+#include "lib/util/data_blob.h"
+#include "smb2_constants.h"
+#include "smb2_compression.h"
+
+#define TEST_DATA_SIZE (1024 * 1024)
+
+static const struct smb3_compression_capabilities caps_chained = {
+	.num_algos = 3,
+	.algos = {
+		SMB2_COMPRESSION_LZ77_HUFFMAN,
+		SMB2_COMPRESSION_LZ77,
+		SMB2_COMPRESSION_PATTERN_V1,
+	},
+	.flags = SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED,
+};
+
+static const struct smb3_compression_capabilities caps_lz77 = {
+	.num_algos = 1,
+	.algos = { SMB2_COMPRESSION_LZ77, },
+	.flags = SMB2_COMPRESSION_CAPABILITIES_FLAG_NONE,
+};
+
+static const struct smb3_compression_capabilities caps_huffman = {
+	.num_algos = 1,
+	.algos = { SMB2_COMPRESSION_LZ77_HUFFMAN, },
+	.flags = SMB2_COMPRESSION_CAPABILITIES_FLAG_NONE,
+};
+
+static void round_trip(const struct smb3_compression_capabilities *c,
+		       const uint8_t *data,
+		       size_t data_len,
+		       bool expect_compressed)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(NULL);
+	uint8_t prefix[SMB2_HDR_BODY + 0x10];
+	DATA_BLOB compressed = data_blob_null;
+	DATA_BLOB decompressed = data_blob_null;
+	size_t i;
+	NTSTATUS status;
+
+	for (i = 0; i < sizeof(prefix); i++) {
+		prefix[i] = i;
+	}
+
+	status = smb2_compression_compress(mem_ctx, c,
+					   prefix, sizeof(prefix),
+					   data, data_len,
+					   &compressed);
+	assert_true(NT_STATUS_IS_OK(status));
+
+	if (!expect_compressed) {
+		assert_int_equal(compressed.length, 0);
+		TALLOC_FREE(mem_ctx);
+		return;
+	}
+
+	assert_true(compressed.length > 0);
+	assert_true(compressed.length < sizeof(prefix) + data_len);
+
+	status = smb2_compression_decompress(mem_ctx,
+					     compressed.data,
+					     compressed.length,
+					     sizeof(prefix) + data_len,
+					     &decompressed);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_int_equal(decompressed.length, sizeof(prefix) + data_len);
+	assert_memory_equal(decompressed.data, prefix, sizeof(prefix));
+	assert_memory_equal(decompressed.data + sizeof(prefix),
+			    data, data_len);
+
+	/*
+	 * The size limit has to be enforced
+	 */
+	status = smb2_compression_decompress(mem_ctx,
+					     compressed.data,
+					     compressed.length,
+					     sizeof(prefix) + data_len - 1,
+					     &decompressed);
+	assert_false(NT_STATUS_IS_OK(status));
+
+	TALLOC_FREE(mem_ctx);
+}
+
+static void test_smb2_compression_text(void **state)
+{
+	const char *text = "The quick brown fox jumps over the lazy dog. ";
+	size_t text_len = strlen(text);
+	uint8_t *data = talloc_array(NULL, uint8_t, TEST_DATA_SIZE);
+	size_t i;
+
+	assert_non_null(data);
+	for (i = 0; i < TEST_DATA_SIZE; i++) {
+		data[i] = text[i % text_len];
+	}
+
+	round_trip(&caps_chained, data, TEST_DATA_SIZE, true);
+	round_trip(&caps_lz77, data, TEST_DATA_SIZE, true);
+	round_trip(&caps_huffman, data, TEST_DATA_SIZE, true);
+
+	TALLOC_FREE(data);
+}
+
+static void test_smb2_compression_random(void **state)
+{
+	uint8_t *data = talloc_array(NULL, uint8_t, TEST_DATA_SIZE);
+	uint32_t x = 0x12345678;
+	size_t i;
+
+	assert_non_null(data);
+	for (i = 0; i < TEST_DATA_SIZE; i++) {
+		x = x * 1103515245 + 12345;
+		data[i] = x >> 24;
+	}
+
+	round_trip(&caps_chained, data, TEST_DATA_SIZE, false);
+	round_trip(&caps_lz77, data, TEST_DATA_SIZE, false);
+	round_trip(&caps_huffman, data, TEST_DATA_SIZE, false);
+
+	/*
+	 * Leading and trailing runs are sent as Pattern_V1
+	 * even if the rest is not compressible
+	 */
+	memset(data, 'a', 4096);
+	memset(data + TEST_DATA_SIZE - 4096, 0, 4096);
+	round_trip(&caps_chained, data, TEST_DATA_SIZE, true);
+
+	TALLOC_FREE(data);
+}
+
+static void test_smb2_compression_pattern(void **state)
+{
+	uint8_t *data = talloc_zero_array(NULL, uint8_t, TEST_DATA_SIZE);
+
+	assert_non_null(data);
+
+	round_trip(&caps_chained, data, TEST_DATA_SIZE, true);
+	round_trip(&caps_lz77, data, TEST_DATA_SIZE, true);
+	round_trip(&caps_huffman, data, TEST_DATA_SIZE, true);
+
+	TALLOC_FREE(data);
+}
+
+static void test_smb2_compression_capabilities(void **state)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(NULL);
+	struct smb3_compression_capabilities peer = {
+		.num_algos = 2,
+		.algos = {
+			SMB2_COMPRESSION_PATTERN_V1,
+			SMB2_COMPRESSION_LZ77,
+		},
+		.flags = SMB2_COMPRESSION_CAPABILITIES_FLAG_NONE,
+	};
+	struct smb3_compression_capabilities pulled;
+	struct smb3_compression_capabilities result;
+	DATA_BLOB blob = data_blob_null;
+	NTSTATUS status;
+
+	status = smb2_compression_capabilities_push(mem_ctx, &peer, &blob);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_int_equal(blob.length, 8 + 2 * 2);
+
+	status = smb2_compression_capabilities_pull(blob, &pulled);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_int_equal(pulled.num_algos, 2);
+	assert_int_equal(pulled.algos[0], SMB2_COMPRESSION_PATTERN_V1);
+	assert_int_equal(pulled.algos[1], SMB2_COMPRESSION_LZ77);
+
+	/*
+	 * Pattern_V1 requires chaining
+	 */
+	smb2_compression_capabilities_select(&caps_chained, &pulled, &result);
+	assert_int_equal(result.num_algos, 1);
+	assert_int_equal(result.algos[0], SMB2_COMPRESSION_LZ77);
+	assert_int_equal(result.flags, SMB2_COMPRESSION_CAPABILITIES_FLAG_NONE);
+
+	pulled.flags = SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED;
+	smb2_compression_capabilities_select(&caps_chained, &pulled, &result);
+	assert_int_equal(result.num_algos, 2);
+	assert_int_equal(result.algos[0], SMB2_COMPRESSION_LZ77);
+	assert_int_equal(result.algos[1], SMB2_COMPRESSION_PATTERN_V1);
+
+	smb2_compression_capabilities_select(&caps_huffman, &pulled, &result);
+	assert_int_equal(result.num_algos, 0);
+
+	TALLOC_FREE(mem_ctx);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_smb2_compression_text),
+		cmocka_unit_test(test_smb2_compression_random),
+		cmocka_unit_test(test_smb2_compression_pattern),
+		cmocka_unit_test(test_smb2_compression_capabilities),
+	};
+
+	cmocka_set_message_output(CM_OUTPUT_SUBUNIT);
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
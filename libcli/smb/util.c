@@ -510,6 +510,28 @@ const char *smb3_encryption_algorithm_name(uint16_t algo)
 	return NULL;
 }
 
+static const struct enum_list enum_smb3_compression_algorithms[] = {
+	{SMB2_COMPRESSION_LZ77_HUFFMAN, "LZ77+Huffman"},
+	{SMB2_COMPRESSION_LZ77, "LZ77"},
+	{SMB2_COMPRESSION_PATTERN_V1, "Pattern_V1"},
+	{-1, NULL}
+};
+
+const char *smb3_compression_algorithm_name(uint16_t algo)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(enum_smb3_compression_algorithms); i++) {
+		if (enum_smb3_compression_algorithms[i].value != algo) {
+			continue;
+		}
+
+		return enum_smb3_compression_algorithms[i].name;
+	}
+
+	return NULL;
+}
+
 static int32_t parse_enum_val(const struct enum_list *e,
 			      const char *param_name,
 			      const char *param_value)
@@ -533,7 +555,8 @@ static int32_t parse_enum_val(const struct enum_list *e,
 
 struct smb311_capabilities smb311_capabilities_parse(const char *role,
 				const char * const *signing_algos,
-				const char * const *encryption_algos)
+				const char * const *encryption_algos,
+				const char * const *compression_algos)
 {
 	struct smb311_capabilities c = {
 		.signing = {
@@ -542,15 +565,21 @@ struct smb311_capabilities smb311_capabilities_parse(const char *role,
 		.encryption = {
 			.num_algos = 0,
 		},
+		.compression = {
+			.num_algos = 0,
+		},
 	};
 	char sign_param[64] = { 0, };
 	char enc_param[64] = { 0, };
+	char comp_param[64] = { 0, };
 	size_t ai;
 
 	snprintf(sign_param, sizeof(sign_param),
 		 "%s smb3 signing algorithms", role);
 	snprintf(enc_param, sizeof(enc_param),
 		 "%s smb3 encryption algorithms", role);
+	snprintf(comp_param, sizeof(comp_param),
+		 "%s smb3 compression algorithms", role);
 
 	for (ai = 0; signing_algos != NULL && signing_algos[ai] != NULL; ai++) {
 		const char *algoname = signing_algos[ai];
@@ -630,6 +659,53 @@ struct smb311_capabilities smb311_capabilities_parse(const char *role,
 		c.encryption.num_algos += 1;
 	}
 
+	for (ai = 0; compression_algos != NULL && compression_algos[ai] != NULL; ai++) {
+		const char *algoname = compression_algos[ai];
+		int32_t v32;
+		uint16_t algo;
+		size_t di;
+		bool ignore = false;
+
+		if (c.compression.num_algos >= SMB3_COMPRESSION_CAPABILITIES_MAX_ALGOS) {
+			DBG_ERR("WARNING: Ignoring trailing value '%s' for parameter '%s'\n",
+				  algoname, comp_param);
+			continue;
+		}
+
+		v32 = parse_enum_val(enum_smb3_compression_algorithms,
+				     comp_param, algoname);
+		if (v32 == INT32_MAX) {
+			continue;
+		}
+		algo = v32;
+
+		for (di = 0; di < c.compression.num_algos; di++) {
+			if (algo != c.compression.algos[di]) {
+				continue;
+			}
+
+			ignore = true;
+			break;
+		}
+
+		if (ignore) {
+			DBG_ERR("WARNING: Ignoring duplicate value '%s' for parameter '%s'\n",
+				  algoname, comp_param);
+			continue;
+		}
+
+		c.compression.algos[c.compression.num_algos] = algo;
+		c.compression.num_algos += 1;
+	}
+
+	if (c.compression.num_algos > 0) {
+		/*
+		 * We always support chained messages,
+		 * which are required for Pattern_V1.
+		 */
+		c.compression.flags = SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED;
+	}
+
 	return c;
 }
 
@@ -0,0 +1,75 @@
+# Unix SMB/CIFS implementation.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Tests for SMB3 multichannel in samba.samba3.libsmb."""
+
+from samba.samba3 import libsmb_samba_internal as libsmb
+import samba.tests.libsmb
+import os
+import random
+
+
+class LibsmbMultichannelTestCase(samba.tests.libsmb.LibsmbTests):
+
+    def multichannel_conn(self, max_channels):
+        c = libsmb.Conn(
+            self.server_ip,
+            "tmp",
+            self.lp,
+            self.creds,
+            max_channels=max_channels)
+        self.assertGreaterEqual(c.protocol(), libsmb.PROTOCOL_SMB3_00)
+        return c
+
+    def test_single_channel(self):
+        c = self.multichannel_conn(1)
+        self.assertEqual(c.num_channels(), 1)
+
+    def test_channels(self):
+        # The server has an IPv4 and an IPv6 address
+        c = self.multichannel_conn(2)
+        self.assertEqual(c.num_channels(), 2)
+
+        c = self.multichannel_conn(8)
+        self.assertGreater(c.num_channels(), 1)
+        self.assertLessEqual(c.num_channels(), 8)
+
+    def test_loadfile_savefile(self):
+        c = self.multichannel_conn(4)
+        self.assertGreater(c.num_channels(), 1)
+
+        filename = "multichannel_%d.dat" % random.randint(0, 0xFFFF)
+        self.addCleanup(self.clean_file, c, filename)
+
+        # Large enough for many chunks on every channel, not a
+        # multiple of the chunk size
+        data = os.urandom(8 * 1024 * 1024 + 4321)
+
+        c.savefile(filename, data)
+        self.assertEqual(c.loadfile(filename), data)
+
+        # Read back through a single channel connection as well
+        c1 = self.multichannel_conn(1)
+        self.assertEqual(c1.loadfile(filename), data)
+
+        data = os.urandom(3 * 1024 * 1024)
+        c1.savefile(filename, data)
+        self.assertEqual(c.loadfile(filename), data)
+
+
+if __name__ == "__main__":
+    import unittest
+    unittest.main()
@@ -341,6 +341,8 @@ tasks = {
             "fileserver",
             "fileserver_smb1",
             "fileserver_smb1_done",
+            "fileserver_zerocopy",
+            "fileserver_async_encryption",
             "maptoguest",
             "simpleserver",
             "backupfromdc",
@@ -411,6 +413,8 @@ tasks = {
             "fileserver",
             "fileserver_smb1",
             "fileserver_smb1_done",
+            "fileserver_zerocopy",
+            "fileserver_async_encryption",
             "maptoguest",
             "simpleserver",
             "backupfromdc",
@@ -465,6 +469,8 @@ tasks = {
             "fileserver",
             "fileserver_smb1",
             "fileserver_smb1_done",
+            "fileserver_zerocopy",
+            "fileserver_async_encryption",
             "maptoguest",
             "ktest", # ktest is also tested in samba-ktest-mit samba
                      # and samba-mitkrb5 but is tested here against
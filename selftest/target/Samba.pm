@@ -600,7 +600,7 @@ sub get_interface($)
 		localktest6       => 7,
 		maptoguest        => 8,
 		localnt4dc9       => 9,
-		# 10 is spare
+		fileserverenc     => 10,
 
 		# 11-16 are used by selftest.pl for the client.conf. Most tests only
 		# use the first .11 IP. However, some tests (like winsreplication) rely
@@ -653,6 +653,7 @@ sub get_interface($)
 		admemidmapnss     => 60,
 		localadmember2    => 61,
 		admemautorid      => 62,
+		fileserverzc      => 63,
 
 		rootdnsforwarder  => 64,
 
@@ -239,6 +239,8 @@ sub check_env($$)
 	fileserver          => [],
 	fileserver_smb1     => [],
 	fileserver_smb1_done => ["fileserver_smb1"],
+	fileserver_zerocopy => [],
+	fileserver_async_encryption => [],
 	maptoguest          => [],
 	ktest               => [],
 
@@ -1883,6 +1885,15 @@ sub setup_fileserver
 	my $volume_serial_number_sharedir="$share_dir/volume_serial_number";
 	push(@dirs, $volume_serial_number_sharedir);
 
+	my $pathref_dircache_sharedir="$share_dir/pathref_dircache";
+	push(@dirs, $pathref_dircache_sharedir);
+
+	my $dirlist_cache_sharedir="$share_dir/dirlist_cache";
+	push(@dirs, $dirlist_cache_sharedir);
+
+	my $casefold_index_sharedir="$share_dir/casefold_index";
+	push(@dirs, $casefold_index_sharedir);
+
 	my $ip4 = Samba::get_ipv4_addr("FILESERVER");
 	my $fileserver_options = "
         smb3 unix extensions = yes
@@ -2033,6 +2044,7 @@ sub setup_fileserver
 	virusfilter:infected file action = rename
 	virusfilter:scan on close = yes
 	vfs_default:VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS = no
+	smbd:dirlist cache size = 65536
 
 [volumeserialnumber]
 	path = $volume_serial_number_sharedir
@@ -2044,11 +2056,35 @@ sub setup_fileserver
 	acl_xattr:security_acl_name = user.hackme
 	read only = no
 
+[pathref_dircache]
+	path = $pathref_dircache_sharedir
+	read only = no
+	wide links = no
+	smbd:pathref dircache size = 16
+
+[dirlist_cache]
+	path = $dirlist_cache_sharedir
+	read only = no
+	smbd:dirlist cache = yes
+	smbd:dirlist cache min entries = 100
+
+[casefold_index]
+	path = $casefold_index_sharedir
+	read only = no
+	smbd:casefold index = yes
+	smbd:casefold index min entries = 1000
+
 [io_uring]
 	path = $share_dir
 	vfs objects = acl_xattr fake_acls xattr_tdb streams_depot time_audit full_audit io_uring
 	read only = no
 
+[io_uring_options]
+	path = $share_dir
+	vfs objects = acl_xattr fake_acls xattr_tdb streams_depot time_audit full_audit io_uring
+	read only = no
+	io_uring:registered_files = 4
+
 [homes]
 	comment = Home directories
 	browseable = No
@@ -2146,6 +2182,7 @@ sub setup_fileserver_smb1
 	client min protocol = CORE
 	server min protocol = LANMAN1
 	check parent directory delete on close = yes
+	smbd:prefork children = 3
 
 [hidenewfiles]
 	path = $prefix_abs/share
@@ -2188,6 +2225,26 @@ sub setup_fileserver_smb1_done
 	return $self->return_alias_env($path, $dep_env);
 }
 
+sub setup_fileserver_zerocopy
+{
+	my ($self, $path) = @_;
+	my $conf = "
+[global]
+	smbd zerocopy send threshold = 4096
+";
+	return $self->setup_fileserver($path, $conf, "FILESERVERZC");
+}
+
+sub setup_fileserver_async_encryption
+{
+	my ($self, $path) = @_;
+	my $conf = "
+[global]
+	smbd async encryption threshold = 1024
+";
+	return $self->setup_fileserver($path, $conf, "FILESERVERENC");
+}
+
 sub setup_ktest
 {
 	my ($self, $prefix) = @_;
@@ -92,6 +92,15 @@ struct cli_state {
 		struct smbXcli_tcon *tcon;
 		struct idr_context *open_handles;
 		bool client_smb311_posix;
+
+		/*
+		 * Additional channels bound to session, see
+		 * libsmb/climultichannel.c. They share tcon
+		 * and the open handles with us.
+		 */
+		struct cli_state **channels;
+		size_t num_channels;
+		size_t next_channel;
 	} smb2;
 };
 
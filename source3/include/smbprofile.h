@@ -112,6 +112,13 @@ struct tevent_context;
 	SMBPROFILE_STATS_COUNT(statcache_hits) \
 	SMBPROFILE_STATS_SECTION_END \
 	\
+	SMBPROFILE_STATS_SECTION_START(dircache, "Pathref Directory Cache") \
+	SMBPROFILE_STATS_COUNT(dircache_lookups) \
+	SMBPROFILE_STATS_COUNT(dircache_misses) \
+	SMBPROFILE_STATS_COUNT(dircache_stale) \
+	SMBPROFILE_STATS_COUNT(dircache_hits) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
 	SMBPROFILE_STATS_SECTION_START(SMB, "SMB Calls") \
 	SMBPROFILE_STATS_BASIC(SMBmkdir) \
 	SMBPROFILE_STATS_BASIC(SMBrmdir) \
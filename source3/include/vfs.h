@@ -381,6 +381,8 @@
  * Change to Version 49 - will ship with 4.19
  * Version 49 - remove seekdir and telldir
  * Version 49 - remove "sbuf" argument from readdir_fn()
+ * Version 49 - add file_id_link and fd_link to files_struct
+ * Version 49 - add pathref_dircache to connection_struct
  */
 
 #define SMB_VFS_INTERFACE_VERSION 49
@@ -410,6 +412,7 @@ typedef union unid_t {
 } unid_t;
 
 struct fd_handle;
+struct pathref_dircache;
 
 struct fsp_lease {
 	size_t ref_count;
@@ -418,8 +421,20 @@ struct fsp_lease {
 	struct smb2_lease lease;
 };
 
+/*
+ * Entry in one of the smbd_server_connection hash tables indexing
+ * the open files. Only to be touched by smbd/files.c.
+ */
+struct files_struct_link {
+	struct files_struct_link *prev, *next;
+	struct files_struct *fsp;
+	uint64_t hash;
+};
+
 typedef struct files_struct {
 	struct files_struct *next, *prev;
+	struct files_struct_link file_id_link;
+	struct files_struct_link fd_link;
 	uint64_t fnum;
 	struct smbXsrv_open *op;
 	struct connection_struct *conn;
@@ -731,6 +746,7 @@ typedef struct connection_struct {
 	enum timestamp_set_resolution ts_res;
 	char *connectpath;
 	struct files_struct *cwd_fsp; /* Working directory. */
+	struct pathref_dircache *pathref_dircache; /* See smbd/files.c */
 	bool tcon_done;
 
 	struct vfs_handle_struct *vfs_handles;		/* for the new plugins */
@@ -24,6 +24,7 @@
 #include "dbwrap/dbwrap_open.h"
 #include "dbwrap/dbwrap_tdb.h"
 #include "dbwrap/dbwrap_ctdb.h"
+#include "dbwrap/dbwrap_cache.h"
 #include "lib/param/param.h"
 #include "lib/cluster_support.h"
 #include "lib/messages_ctdb.h"
@@ -66,6 +67,8 @@ struct db_context *db_open(TALLOC_CTX *mem_ctx,
 	struct db_context *result = NULL;
 	const char *base;
 	struct loadparm_context *lp_ctx = NULL;
+	bool try_cache;
+	unsigned long cache_size;
 
 	if ((lock_order != DBWRAP_LOCK_ORDER_NONE) &&
 	    !DBWRAP_LOCK_ORDER_VALID(lock_order)) {
@@ -127,6 +130,29 @@ struct db_context *db_open(TALLOC_CTX *mem_ctx,
 		}
 	}
 
+	if (tdb_flags & TDB_CLEAR_IF_FIRST) {
+		bool freelist_classes = false;
+
+		/*
+		 * The database is recreated on first open, so we can
+		 * choose the on-disk format without caring for older
+		 * tdb versions in smbd. External tools like tdbtool or
+		 * ctdb might still be older, so this is opt-in.
+		 */
+		freelist_classes = lp_parm_bool(-1,
+						"dbwrap_tdb_freelist_classes",
+						"*",
+						freelist_classes);
+		freelist_classes = lp_parm_bool(-1,
+						"dbwrap_tdb_freelist_classes",
+						base,
+						freelist_classes);
+
+		if (freelist_classes) {
+			tdb_flags |= TDB_FREELIST_CLASSES;
+		}
+	}
+
 	if (lp_clustering()) {
 		const char *sockname;
 
@@ -183,6 +209,27 @@ struct db_context *db_open(TALLOC_CTX *mem_ctx,
 		hash_size = lpcfg_tdb_hash_size(lp_ctx, name);
 	}
 	tdb_flags = lpcfg_tdb_flags(lp_ctx, tdb_flags);
+	talloc_unlink(mem_ctx, lp_ctx);
+
+	try_cache = (dbwrap_flags & DBWRAP_FLAG_CACHE);
+	try_cache = lp_parm_bool(-1, "dbwrap_cache", "*", try_cache);
+	try_cache = lp_parm_bool(-1, "dbwrap_cache", base, try_cache);
+
+	cache_size = lp_parm_ulong(-1, "dbwrap_cache_size", "*", 1024*1024);
+	cache_size = lp_parm_ulong(-1, "dbwrap_cache_size", base, cache_size);
+	if (cache_size == 0) {
+		try_cache = false;
+	}
+
+	if (try_cache) {
+		/*
+		 * The cache is invalidated by the seqnum. This relies
+		 * on every process writing to this database using the
+		 * same smb.conf settings and DBWRAP_FLAG_CACHE, so
+		 * that all of them bump it.
+		 */
+		tdb_flags |= TDB_SEQNUM;
+	}
 
 	result = dbwrap_local_open(mem_ctx,
 				   name,
@@ -192,6 +239,17 @@ struct db_context *db_open(TALLOC_CTX *mem_ctx,
 				   mode,
 				   lock_order,
 				   dbwrap_flags);
-	talloc_unlink(mem_ctx, lp_ctx);
+	if ((result != NULL) && try_cache) {
+		struct db_context *cached = NULL;
+
+		cached = db_open_cache(mem_ctx, &result, cache_size);
+		if (cached == NULL) {
+			TALLOC_FREE(result);
+			errno = ENOMEM;
+			return NULL;
+		}
+		result = cached;
+	}
+
 	return result;
 }
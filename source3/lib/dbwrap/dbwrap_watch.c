@@ -182,7 +182,13 @@ struct db_watched_record {
 		bool alerted;
 	} watchers;
 	struct {
-		struct dbwrap_watcher watcher;
+		/*
+		 * How many watchers to alert, taken in
+		 * the order they were added to the record.
+		 */
+		size_t max;
+		size_t num;
+		struct dbwrap_watcher watchers[DBWRAP_WATCH_MAX_ALERTS];
 	} wakeup;
 };
 
@@ -210,8 +216,10 @@ static NTSTATUS dbwrap_watched_storev(struct db_record *rec,
 				      const TDB_DATA *dbufs, int num_dbufs,
 				      int flags);
 static NTSTATUS dbwrap_watched_delete(struct db_record *rec);
-static void dbwrap_watched_trigger_wakeup(struct messaging_context *msg_ctx,
-					  struct dbwrap_watcher *watcher);
+static void dbwrap_watched_trigger_wakeup(
+	struct messaging_context *msg_ctx,
+	const struct dbwrap_watcher *watchers,
+	size_t num_watchers);
 static int db_watched_record_destructor(struct db_watched_record *wrec);
 
 static void db_watched_record_init(struct db_context *db,
@@ -239,6 +247,7 @@ static void db_watched_record_init(struct db_context *db,
 			.initial_value = backend_value,
 			.initial_valid = true,
 		},
+		.wakeup.max = 1,
 	};
 
 	ok = dbwrap_watch_rec_parse(backend_value,
@@ -428,7 +437,9 @@ static int db_watched_record_destructor(struct db_watched_record *wrec)
 
 	db_watched_record_fini(wrec);
 	TALLOC_FREE(wrec->backend.rec);
-	dbwrap_watched_trigger_wakeup(ctx->msg, &wrec->wakeup.watcher);
+	dbwrap_watched_trigger_wakeup(ctx->msg,
+				      wrec->wakeup.watchers,
+				      wrec->wakeup.num);
 	return 0;
 }
 
@@ -486,7 +497,9 @@ static NTSTATUS dbwrap_watched_do_locked(struct db_context *db, TDB_DATA key,
 
 	DBG_DEBUG("dbwrap_watched_do_locked_fn returned\n");
 
-	dbwrap_watched_trigger_wakeup(state.msg_ctx, &wrec.wakeup.watcher);
+	dbwrap_watched_trigger_wakeup(state.msg_ctx,
+				      wrec.wakeup.watchers,
+				      wrec.wakeup.num);
 
 	return NT_STATUS_OK;
 }
@@ -494,6 +507,8 @@ static NTSTATUS dbwrap_watched_do_locked(struct db_context *db, TDB_DATA key,
 static void dbwrap_watched_record_prepare_wakeup(
 	struct db_watched_record *wrec)
 {
+	size_t i;
+
 	/*
 	 * Wakeup only needs to happen once (if at all)
 	 */
@@ -502,6 +517,7 @@ static void dbwrap_watched_record_prepare_wakeup(
 		return;
 	}
 	wrec->watchers.alerted = true;
+	wrec->wakeup.num = 0;
 
 	if (wrec->watchers.count == 0) {
 		DBG_DEBUG("No watchers\n");
@@ -509,22 +525,23 @@ static void dbwrap_watched_record_prepare_wakeup(
 	}
 
 	while (wrec->watchers.count != 0) {
+		struct dbwrap_watcher *w = &wrec->wakeup.watchers[0];
 		struct server_id_buf tmp;
 		bool exists;
 
-		dbwrap_watcher_get(&wrec->wakeup.watcher, wrec->watchers.first);
-		exists = serverid_exists(&wrec->wakeup.watcher.pid);
+		dbwrap_watcher_get(w, wrec->watchers.first);
+		exists = serverid_exists(&w->pid);
 		if (!exists) {
 			DBG_DEBUG("Discard non-existing waiter %s:%"PRIu64"\n",
-				  server_id_str_buf(wrec->wakeup.watcher.pid, &tmp),
-				  wrec->wakeup.watcher.instance);
+				  server_id_str_buf(w->pid, &tmp),
+				  w->instance);
 			wrec->watchers.first += DBWRAP_WATCHER_BUF_LENGTH;
 			wrec->watchers.count -= 1;
 			continue;
 		}
 
 		/*
-		 * We will only wakeup the first waiter, via
+		 * We will only wakeup the first waiter(s), via
 		 * dbwrap_watched_trigger_wakeup(), but keep
 		 * all (including the first one) in the list that
 		 * will be flushed back to the backend record
@@ -533,40 +550,120 @@ static void dbwrap_watched_record_prepare_wakeup(
 		 * when they no longer want to monitor the record.
 		 */
 		DBG_DEBUG("Will alert first waiter %s:%"PRIu64"\n",
-			  server_id_str_buf(wrec->wakeup.watcher.pid, &tmp),
-			  wrec->wakeup.watcher.instance);
+			  server_id_str_buf(w->pid, &tmp),
+			  w->instance);
+		wrec->wakeup.num = 1;
 		break;
 	}
+
+	/*
+	 * If the caller asked for more, take the next ones in
+	 * the order they started to wait. Dead ones are left in
+	 * place, they get discarded once they made it to the
+	 * front.
+	 */
+	for (i = 1;
+	     (i < wrec->watchers.count) &&
+	     (wrec->wakeup.num < wrec->wakeup.max);
+	     i++) {
+		struct dbwrap_watcher *w =
+			&wrec->wakeup.watchers[wrec->wakeup.num];
+		struct server_id_buf tmp;
+
+		dbwrap_watcher_get(
+			w, wrec->watchers.first + i*DBWRAP_WATCHER_BUF_LENGTH);
+		if (!serverid_exists(&w->pid)) {
+			continue;
+		}
+
+		DBG_DEBUG("Will alert waiter %s:%"PRIu64" at position %zu\n",
+			  server_id_str_buf(w->pid, &tmp),
+			  w->instance,
+			  i+1);
+		wrec->wakeup.num += 1;
+	}
 }
 
-static void dbwrap_watched_trigger_wakeup(struct messaging_context *msg_ctx,
-					  struct dbwrap_watcher *watcher)
+static void dbwrap_watched_trigger_wakeup(
+	struct messaging_context *msg_ctx,
+	const struct dbwrap_watcher *watchers,
+	size_t num_watchers)
 {
-	struct server_id_buf tmp;
-	uint8_t instance_buf[8];
-	NTSTATUS status;
+	bool sent[DBWRAP_WATCH_MAX_ALERTS] = { false, };
+	uint32_t my_vnn = messaging_server_id(msg_ctx).vnn;
+	bool batch = true;
+	size_t i, j;
+
+	SMB_ASSERT(num_watchers <= ARRAY_SIZE(sent));
 
-	if (watcher->instance == 0) {
+	if (num_watchers == 0) {
 		DBG_DEBUG("No one to wakeup\n");
 		return;
 	}
 
-	DBG_DEBUG("Alerting %s:%"PRIu64"\n",
-		  server_id_str_buf(watcher->pid, &tmp),
-		  watcher->instance);
+	/*
+	 * Receivers without multi-instance support only look at
+	 * messages of exactly one instance and drop the others. We
+	 * can't know the version of processes on other ctdb nodes,
+	 * so only batch when every watcher to be alerted is local:
+	 * Local processes run the same binaries, mixed versions
+	 * during an upgrade aside.
+	 */
+	for (i=0; i<num_watchers; i++) {
+		if (watchers[i].pid.vnn != my_vnn) {
+			batch = false;
+			break;
+		}
+	}
+
+	/*
+	 * Send one message per process, carrying all instances
+	 * to be alerted there.
+	 */
+	for (i=0; i<num_watchers; i++) {
+		uint8_t instance_bufs[DBWRAP_WATCH_MAX_ALERTS * sizeof(uint64_t)];
+		size_t num_instances = 0;
+		struct server_id_buf tmp;
+		NTSTATUS status;
 
-	SBVAL(instance_buf, 0, watcher->instance);
+		if (sent[i]) {
+			continue;
+		}
 
-	status = messaging_send_buf(
-		msg_ctx,
-		watcher->pid,
-		MSG_DBWRAP_MODIFIED,
-		instance_buf,
-		sizeof(instance_buf));
-	if (!NT_STATUS_IS_OK(status)) {
-		DBG_WARNING("messaging_send_buf to %s failed: %s - ignoring...\n",
-			    server_id_str_buf(watcher->pid, &tmp),
-			    nt_errstr(status));
+		for (j=i; j<num_watchers; j++) {
+			if (sent[j]) {
+				continue;
+			}
+			if (!server_id_equal(&watchers[i].pid,
+					     &watchers[j].pid)) {
+				continue;
+			}
+			if (!batch && (num_instances != 0)) {
+				break;
+			}
+
+			DBG_DEBUG("Alerting %s:%"PRIu64"\n",
+				  server_id_str_buf(watchers[j].pid, &tmp),
+				  watchers[j].instance);
+
+			SBVAL(instance_bufs,
+			      num_instances * sizeof(uint64_t),
+			      watchers[j].instance);
+			num_instances += 1;
+			sent[j] = true;
+		}
+
+		status = messaging_send_buf(
+			msg_ctx,
+			watchers[i].pid,
+			MSG_DBWRAP_MODIFIED,
+			instance_bufs,
+			num_instances * sizeof(uint64_t));
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_WARNING("messaging_send_buf to %s failed: %s - ignoring...\n",
+				    server_id_str_buf(watchers[i].pid, &tmp),
+				    nt_errstr(status));
+		}
 	}
 }
 
@@ -1034,7 +1131,7 @@ void dbwrap_watched_watch_skip_alerting(struct db_record *rec)
 {
 	struct db_watched_record *wrec = db_record_get_watched_record(rec);
 
-	wrec->wakeup.watcher = (struct dbwrap_watcher) { .instance = 0, };
+	wrec->wakeup.num = 0;
 	wrec->watchers.alerted = true;
 }
 
@@ -1042,10 +1139,20 @@ void dbwrap_watched_watch_reset_alerting(struct db_record *rec)
 {
 	struct db_watched_record *wrec = db_record_get_watched_record(rec);
 
-	wrec->wakeup.watcher = (struct dbwrap_watcher) { .instance = 0, };
+	wrec->wakeup.num = 0;
 	wrec->watchers.alerted = false;
 }
 
+void dbwrap_watched_watch_set_alert_count(struct db_record *rec,
+					  size_t num_watchers)
+{
+	struct db_watched_record *wrec = db_record_get_watched_record(rec);
+
+	SMB_ASSERT(num_watchers != 0);
+
+	wrec->wakeup.max = MIN(num_watchers, DBWRAP_WATCH_MAX_ALERTS);
+}
+
 void dbwrap_watched_watch_force_alerting(struct db_record *rec)
 {
 	struct db_watched_record *wrec = db_record_get_watched_record(rec);
@@ -1054,17 +1161,31 @@ void dbwrap_watched_watch_force_alerting(struct db_record *rec)
 }
 
 struct dbwrap_watched_watch_state {
+	struct dbwrap_watched_watch_state *prev, *next;
+	struct tevent_req *req;
+	struct tevent_context *ev;
 	struct db_context *db;
 	TDB_DATA key;
 	struct dbwrap_watcher watcher;
+	struct tevent_req *msg_req;
+	bool listed;
 	struct server_id blocker;
 	bool blockerdead;
 };
 
+/*
+ * All pending watchers of this process, used to alert
+ * the ones that came in the same MSG_DBWRAP_MODIFIED
+ * message.
+ */
+static struct dbwrap_watched_watch_state *dbwrap_watched_watch_states;
+
 static bool dbwrap_watched_msg_filter(struct messaging_rec *rec,
 				      void *private_data);
 static void dbwrap_watched_watch_done(struct tevent_req *subreq);
 static void dbwrap_watched_watch_blocker_died(struct tevent_req *subreq);
+static void dbwrap_watched_watch_cleanup(struct tevent_req *req,
+					 enum tevent_req_state req_state);
 static int dbwrap_watched_watch_state_destructor(
 	struct dbwrap_watched_watch_state *state);
 
@@ -1087,6 +1208,8 @@ struct tevent_req *dbwrap_watched_watch_send(TALLOC_CTX *mem_ctx,
 	if (req == NULL) {
 		return NULL;
 	}
+	state->req = req;
+	state->ev = ev;
 	state->db = db;
 	state->blocker = blocker;
 
@@ -1127,12 +1250,16 @@ struct tevent_req *dbwrap_watched_watch_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
-	subreq = messaging_filtered_read_send(
+	state->msg_req = messaging_filtered_read_send(
 		state, ev, ctx->msg, dbwrap_watched_msg_filter, state);
-	if (tevent_req_nomem(subreq, req)) {
+	if (tevent_req_nomem(state->msg_req, req)) {
 		return tevent_req_post(req, ev);
 	}
-	tevent_req_set_callback(subreq, dbwrap_watched_watch_done, req);
+	tevent_req_set_callback(state->msg_req, dbwrap_watched_watch_done, req);
+
+	DLIST_ADD_END(dbwrap_watched_watch_states, state);
+	state->listed = true;
+	tevent_req_set_cleanup_fn(req, dbwrap_watched_watch_cleanup);
 
 	talloc_set_destructor(state, dbwrap_watched_watch_state_destructor);
 
@@ -1166,6 +1293,18 @@ static void dbwrap_watched_watch_blocker_died(struct tevent_req *subreq)
 	tevent_req_done(req);
 }
 
+static void dbwrap_watched_watch_cleanup(struct tevent_req *req,
+					 enum tevent_req_state req_state)
+{
+	struct dbwrap_watched_watch_state *state = tevent_req_data(
+		req, struct dbwrap_watched_watch_state);
+
+	if (state->listed) {
+		DLIST_REMOVE(dbwrap_watched_watch_states, state);
+		state->listed = false;
+	}
+}
+
 static void dbwrap_watched_watch_state_destructor_fn(
 	struct db_record *rec,
 	TDB_DATA value,
@@ -1206,7 +1345,7 @@ static bool dbwrap_watched_msg_filter(struct messaging_rec *rec,
 {
 	struct dbwrap_watched_watch_state *state = talloc_get_type_abort(
 		private_data, struct dbwrap_watched_watch_state);
-	uint64_t instance;
+	size_t ofs;
 
 	if (rec->msg_type != MSG_DBWRAP_MODIFIED) {
 		return false;
@@ -1215,23 +1354,64 @@ static bool dbwrap_watched_msg_filter(struct messaging_rec *rec,
 		return false;
 	}
 
-	if (rec->buf.length != sizeof(instance)) {
-		DBG_DEBUG("Got size %zu, expected %zu\n",
+	if ((rec->buf.length == 0) ||
+	    ((rec->buf.length % sizeof(uint64_t)) != 0)) {
+		DBG_DEBUG("Got size %zu, expected a multiple of %zu\n",
 			  rec->buf.length,
-			  sizeof(instance));
+			  sizeof(uint64_t));
 		return false;
 	}
 
-	instance = BVAL(rec->buf.data, 0);
+	for (ofs = 0; ofs < rec->buf.length; ofs += sizeof(uint64_t)) {
+		uint64_t instance = BVAL(rec->buf.data, ofs);
 
-	if (instance != state->watcher.instance) {
-		DBG_DEBUG("Got instance %"PRIu64", expected %"PRIu64"\n",
-			  instance,
-			  state->watcher.instance);
-		return false;
+		if (instance == state->watcher.instance) {
+			return true;
+		}
 	}
 
-	return true;
+	DBG_DEBUG("Instance %"PRIu64" not among %zu alerted\n",
+		  state->watcher.instance,
+		  rec->buf.length / sizeof(uint64_t));
+	return false;
+}
+
+/*
+ * A message only gets delivered to one messaging_filtered_read
+ * request. Alert the other watchers it was meant for directly.
+ */
+static void dbwrap_watched_watch_alert_others(
+	struct dbwrap_watched_watch_state *state,
+	const struct messaging_rec *rec)
+{
+	size_t ofs;
+
+	for (ofs = 0; ofs < rec->buf.length; ofs += sizeof(uint64_t)) {
+		uint64_t instance = BVAL(rec->buf.data, ofs);
+		struct dbwrap_watched_watch_state *s = NULL;
+
+		if (instance == state->watcher.instance) {
+			continue;
+		}
+
+		for (s = dbwrap_watched_watch_states; s != NULL; s = s->next) {
+			if ((s->watcher.instance == instance) &&
+			    (s->msg_req != NULL) &&
+			    server_id_equal(&s->watcher.pid,
+					    &state->watcher.pid)) {
+				break;
+			}
+		}
+		if (s == NULL) {
+			DBG_DEBUG("Instance %"PRIu64" no longer waiting\n",
+				  instance);
+			continue;
+		}
+
+		TALLOC_FREE(s->msg_req);
+		tevent_req_defer_callback(s->req, s->ev);
+		tevent_req_done(s->req);
+	}
 }
 
 static void dbwrap_watched_watch_done(struct tevent_req *subreq)
@@ -1243,12 +1423,17 @@ static void dbwrap_watched_watch_done(struct tevent_req *subreq)
 	struct messaging_rec *rec;
 	int ret;
 
+	SMB_ASSERT(subreq == state->msg_req);
+
 	ret = messaging_filtered_read_recv(subreq, state, &rec);
 	TALLOC_FREE(subreq);
+	state->msg_req = NULL;
 	if (ret != 0) {
 		tevent_req_nterror(req, map_nt_error_from_unix(ret));
 		return;
 	}
+	dbwrap_watched_watch_alert_others(state, rec);
+	TALLOC_FREE(rec);
 	tevent_req_done(req);
 }
 
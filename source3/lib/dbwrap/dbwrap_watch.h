@@ -24,6 +24,17 @@
 #include "dbwrap/dbwrap.h"
 #include "messages.h"
 
+/*
+ * Upper limit for dbwrap_watched_watch_set_alert_count()
+ *
+ * Watchers alerted in the same process get one MSG_DBWRAP_MODIFIED
+ * message listing all their instances, but only if all alerted
+ * watchers are on the local node. Older Samba versions drop messages
+ * with more than one instance, so remote (ctdb) watchers get one
+ * message per instance.
+ */
+#define DBWRAP_WATCH_MAX_ALERTS 16
+
 struct db_context *db_open_watched(TALLOC_CTX *mem_ctx,
 				   struct db_context **backend,
 				   struct messaging_context *msg);
@@ -32,6 +43,8 @@ void dbwrap_watched_watch_remove_instance(struct db_record *rec, uint64_t instan
 void dbwrap_watched_watch_skip_alerting(struct db_record *rec);
 void dbwrap_watched_watch_reset_alerting(struct db_record *rec);
 void dbwrap_watched_watch_force_alerting(struct db_record *rec);
+void dbwrap_watched_watch_set_alert_count(struct db_record *rec,
+					  size_t num_watchers);
 struct tevent_req *dbwrap_watched_watch_send(TALLOC_CTX *mem_ctx,
 					     struct tevent_context *ev,
 					     struct db_record *rec,
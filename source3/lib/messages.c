@@ -556,6 +556,9 @@ static NTSTATUS messaging_init_internal(TALLOC_CTX *mem_ctx,
 		status = map_nt_error_from_unix(ret);
 		goto done;
 	}
+
+	messaging_dgm_enable_rings(
+		lp_parm_bool(-1, "messaging", "shm rings", false));
 	talloc_set_destructor(ctx, messaging_context_destructor);
 
 #ifdef CLUSTER_SUPPORT
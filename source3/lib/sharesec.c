@@ -156,7 +156,7 @@ NTSTATUS share_info_db_init(void)
 
 	share_db = db_open(NULL, db_path, 0,
 			   TDB_DEFAULT, O_RDWR|O_CREAT, 0600,
-			   DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_NONE);
+			   DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_CACHE);
 	if (share_db == NULL) {
 		DEBUG(0,("Failed to open share info database %s (%s)\n",
 			 db_path, strerror(errno)));
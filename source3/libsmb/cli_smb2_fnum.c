@@ -3851,6 +3851,30 @@ struct tevent_req *cli_smb2_read_send(TALLOC_CTX *mem_ctx,
 				uint16_t fnum,
 				off_t offset,
 				size_t size)
+{
+	return cli_smb2_channel_read_send(mem_ctx,
+					  ev,
+					  cli,
+					  cli->conn,
+					  cli->smb2.session,
+					  fnum,
+					  offset,
+					  size);
+}
+
+/*
+ * Like cli_smb2_read_send(), but send the request over one of the
+ * channels of cli->smb2.session, see cli_smb2_channel_select().
+ */
+
+struct tevent_req *cli_smb2_channel_read_send(TALLOC_CTX *mem_ctx,
+				struct tevent_context *ev,
+				struct cli_state *cli,
+				struct smbXcli_conn *conn,
+				struct smbXcli_session *session,
+				uint16_t fnum,
+				off_t offset,
+				size_t size)
 {
 	NTSTATUS status;
 	struct tevent_req *req, *subreq;
@@ -3876,9 +3900,9 @@ struct tevent_req *cli_smb2_read_send(TALLOC_CTX *mem_ctx,
 
 	subreq = smb2cli_read_send(state,
 				state->ev,
-				state->cli->conn,
+				conn,
 				state->cli->timeout,
-				state->cli->smb2.session,
+				session,
 				state->cli->smb2.tcon,
 				state->size,
 				state->start_offset,
@@ -3960,6 +3984,34 @@ struct tevent_req *cli_smb2_write_send(TALLOC_CTX *mem_ctx,
 					const uint8_t *buf,
 					off_t offset,
 					size_t size)
+{
+	return cli_smb2_channel_write_send(mem_ctx,
+					   ev,
+					   cli,
+					   cli->conn,
+					   cli->smb2.session,
+					   fnum,
+					   mode,
+					   buf,
+					   offset,
+					   size);
+}
+
+/*
+ * Like cli_smb2_write_send(), but send the request over one of the
+ * channels of cli->smb2.session, see cli_smb2_channel_select().
+ */
+
+struct tevent_req *cli_smb2_channel_write_send(TALLOC_CTX *mem_ctx,
+					struct tevent_context *ev,
+					struct cli_state *cli,
+					struct smbXcli_conn *conn,
+					struct smbXcli_session *session,
+					uint16_t fnum,
+					uint16_t mode,
+					const uint8_t *buf,
+					off_t offset,
+					size_t size)
 {
 	NTSTATUS status;
 	struct tevent_req *req, *subreq = NULL;
@@ -3987,9 +4039,9 @@ struct tevent_req *cli_smb2_write_send(TALLOC_CTX *mem_ctx,
 
 	subreq = smb2cli_write_send(state,
 				state->ev,
-				state->cli->conn,
+				conn,
 				state->cli->timeout,
-				state->cli->smb2.session,
+				session,
 				state->cli->smb2.tcon,
 				state->size,
 				state->offset,
@@ -253,6 +253,14 @@ struct tevent_req *cli_smb2_read_send(TALLOC_CTX *mem_ctx,
 				uint16_t fnum,
 				off_t offset,
 				size_t size);
+struct tevent_req *cli_smb2_channel_read_send(TALLOC_CTX *mem_ctx,
+				struct tevent_context *ev,
+				struct cli_state *cli,
+				struct smbXcli_conn *conn,
+				struct smbXcli_session *session,
+				uint16_t fnum,
+				off_t offset,
+				size_t size);
 NTSTATUS cli_smb2_read_recv(struct tevent_req *req,
 				ssize_t *received,
 				uint8_t **rcvbuf);
@@ -264,6 +272,16 @@ struct tevent_req *cli_smb2_write_send(TALLOC_CTX *mem_ctx,
 					const uint8_t *buf,
 					off_t offset,
 					size_t size);
+struct tevent_req *cli_smb2_channel_write_send(TALLOC_CTX *mem_ctx,
+					struct tevent_context *ev,
+					struct cli_state *cli,
+					struct smbXcli_conn *conn,
+					struct smbXcli_session *session,
+					uint16_t fnum,
+					uint16_t mode,
+					const uint8_t *buf,
+					off_t offset,
+					size_t size);
 NTSTATUS cli_smb2_write_recv(struct tevent_req *req,
 			     size_t *pwritten);
 struct tevent_req *cli_smb2_writeall_send(TALLOC_CTX *mem_ctx,
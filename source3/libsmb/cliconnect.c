@@ -656,6 +656,7 @@ struct cli_sesssetup_blob_state {
 	struct cli_state *cli;
 	DATA_BLOB blob;
 	uint16_t max_blob_size;
+	uint8_t smb2_flags;
 
 	DATA_BLOB this_blob;
 	struct iovec *recv_iov;
@@ -675,6 +676,7 @@ static void cli_sesssetup_blob_done(struct tevent_req *subreq);
 static struct tevent_req *cli_sesssetup_blob_send(TALLOC_CTX *mem_ctx,
 						  struct tevent_context *ev,
 						  struct cli_state *cli,
+						  uint8_t smb2_flags,
 						  DATA_BLOB blob)
 {
 	struct tevent_req *req, *subreq;
@@ -689,6 +691,7 @@ static struct tevent_req *cli_sesssetup_blob_send(TALLOC_CTX *mem_ctx,
 	state->ev = ev;
 	state->blob = blob;
 	state->cli = cli;
+	state->smb2_flags = smb2_flags;
 
 	if (smbXcli_conn_protocol(cli->conn) >= PROTOCOL_SMB2_02) {
 		usable_space = UINT16_MAX;
@@ -733,7 +736,7 @@ static bool cli_sesssetup_blob_next(struct cli_sesssetup_blob_state *state,
 						    state->cli->conn,
 						    state->cli->timeout,
 						    state->cli->smb2.session,
-						    0, /* in_flags */
+						    state->smb2_flags, /* in_flags */
 						    SMB2_CAP_DFS, /* in_capabilities */
 						    0, /* in_channel */
 						    0, /* in_previous_session_id */
@@ -880,6 +883,8 @@ static NTSTATUS cli_sesssetup_blob_recv(struct tevent_req *req,
 struct cli_session_setup_gensec_state {
 	struct tevent_context *ev;
 	struct cli_state *cli;
+	/* The session we add a channel to, NULL for a new session */
+	struct smbXcli_session *bind_session;
 	struct auth_generic_state *auth_generic;
 	bool is_anonymous;
 	DATA_BLOB blob_in;
@@ -909,7 +914,8 @@ static struct tevent_req *cli_session_setup_gensec_send(
 	TALLOC_CTX *mem_ctx, struct tevent_context *ev, struct cli_state *cli,
 	struct cli_credentials *creds,
 	const char *target_service,
-	const char *target_hostname)
+	const char *target_hostname,
+	struct smbXcli_session *bind_session)
 {
 	struct tevent_req *req;
 	struct cli_session_setup_gensec_state *state;
@@ -923,6 +929,7 @@ static struct tevent_req *cli_session_setup_gensec_send(
 	}
 	state->ev = ev;
 	state->cli = cli;
+	state->bind_session = bind_session;
 
 	talloc_set_destructor(
 		state, cli_session_setup_gensec_state_destructor);
@@ -971,7 +978,15 @@ static struct tevent_req *cli_session_setup_gensec_send(
 		return tevent_req_post(req, ev);
 	}
 
-	if (smbXcli_conn_protocol(cli->conn) >= PROTOCOL_SMB2_02) {
+	if (state->bind_session != NULL) {
+		status = smb2cli_session_create_channel(cli,
+							state->bind_session,
+							cli->conn,
+							&state->cli->smb2.session);
+		if (tevent_req_nterror(req, status)) {
+			return tevent_req_post(req, ev);
+		}
+	} else if (smbXcli_conn_protocol(cli->conn) >= PROTOCOL_SMB2_02) {
 		state->cli->smb2.session = smbXcli_session_create(cli,
 								  cli->conn);
 		if (tevent_req_nomem(state->cli->smb2.session, req)) {
@@ -1052,8 +1067,12 @@ static void cli_session_setup_gensec_remote_next(struct tevent_req *req)
 		return;
 	}
 
-	subreq = cli_sesssetup_blob_send(state, state->ev,
-					 state->cli, state->blob_out);
+	subreq = cli_sesssetup_blob_send(state,
+					 state->ev,
+					 state->cli,
+					 (state->bind_session != NULL) ?
+					 SMB2_SESSION_FLAG_BINDING : 0,
+					 state->blob_out);
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
@@ -1235,7 +1254,15 @@ static void cli_session_setup_gensec_ready(struct tevent_req *req)
 		return;
 	}
 
-	if (smbXcli_conn_protocol(state->cli->conn) >= PROTOCOL_SMB2_02) {
+	if (state->bind_session != NULL) {
+		status = smb2cli_session_set_channel_key(
+			state->cli->smb2.session,
+			state->session_key,
+			state->recv_iov);
+		if (tevent_req_nterror(req, status)) {
+			return;
+		}
+	} else if (smbXcli_conn_protocol(state->cli->conn) >= PROTOCOL_SMB2_02) {
 		struct smbXcli_session *session = state->cli->smb2.session;
 
 		status = smb2cli_session_set_session_key(session,
@@ -1349,7 +1376,8 @@ static struct tevent_req *cli_session_setup_spnego_send(
 		 cli_credentials_get_principal(creds, talloc_tos()));
 
 	subreq = cli_session_setup_gensec_send(state, ev, cli, creds,
-					       target_service, target_hostname);
+					       target_service, target_hostname,
+					       NULL);
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
 	}
@@ -1386,6 +1414,93 @@ static ADS_STATUS cli_session_setup_spnego_recv(struct tevent_req *req)
 	return state->result;
 }
 
+/****************************************************************************
+ Bind the SMB3 session of "cli" to the connection of "channel".
+
+ channel must have negotiated the same dialect with the same client guid,
+ after success channel->smb2.session is an additional channel of
+ cli->smb2.session.
+****************************************************************************/
+
+struct cli_session_bind_state {
+	uint8_t dummy;
+};
+
+static void cli_session_bind_done(struct tevent_req *subreq);
+
+struct tevent_req *cli_session_bind_send(TALLOC_CTX *mem_ctx,
+					 struct tevent_context *ev,
+					 struct cli_state *channel,
+					 struct cli_state *cli,
+					 struct cli_credentials *creds)
+{
+	struct tevent_req *req, *subreq;
+	struct cli_session_bind_state *state;
+	const char *target_hostname = NULL;
+	NTSTATUS status;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct cli_session_bind_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	if (smbXcli_conn_protocol(cli->conn) < PROTOCOL_SMB3_00 ||
+	    smbXcli_conn_protocol(channel->conn) !=
+	    smbXcli_conn_protocol(cli->conn)) {
+		tevent_req_nterror(req, NT_STATUS_NOT_SUPPORTED);
+		return tevent_req_post(req, ev);
+	}
+
+	if (cli_credentials_is_anonymous(creds)) {
+		/*
+		 * Anonymous and guest sessions don't have
+		 * signing keys, they can't be bound.
+		 */
+		tevent_req_nterror(req, NT_STATUS_NOT_SUPPORTED);
+		return tevent_req_post(req, ev);
+	}
+
+	target_hostname = smbXcli_conn_remote_name(cli->conn);
+
+	status = cli_session_creds_prepare_krb5(channel, creds);
+	if (tevent_req_nterror(req, status)) {
+		return tevent_req_post(req, ev);
+	}
+
+	DBG_INFO("Bind channel to %s as %s\n",
+		 target_hostname,
+		 cli_credentials_get_principal(creds, talloc_tos()));
+
+	subreq = cli_session_setup_gensec_send(state, ev, channel, creds,
+					       "cifs", target_hostname,
+					       cli->smb2.session);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, cli_session_bind_done, req);
+	return req;
+}
+
+static void cli_session_bind_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	NTSTATUS status;
+
+	status = cli_session_setup_gensec_recv(subreq);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+	tevent_req_done(req);
+}
+
+NTSTATUS cli_session_bind_recv(struct tevent_req *req)
+{
+	return tevent_req_simple_recv_ntstatus(req);
+}
+
 struct cli_session_setup_creds_state {
 	struct cli_state *cli;
 	DATA_BLOB apassword_blob;
@@ -151,6 +151,7 @@ static NTSTATUS do_connect(TALLOC_CTX *ctx,
 		cli_credentials_get_smb_encryption(creds);
 	struct smb2_negotiate_contexts *in_contexts = NULL;
 	struct smb2_negotiate_contexts *out_contexts = NULL;
+	int max_channels;
 
 	if (encryption_state >= SMB_ENCRYPTION_DESIRED) {
 		signing_state = SMB_SIGNING_REQUIRED;
@@ -315,6 +316,22 @@ static NTSTATUS do_connect(TALLOC_CTX *ctx,
 	}
 
 	DEBUG(4,(" tconx ok\n"));
+
+	max_channels = lp_parm_int(-1, "libsmb", "max channels", 1);
+	if (max_channels > 1 &&
+	    smbXcli_conn_protocol(c->conn) >= PROTOCOL_SMB3_00) {
+		/*
+		 * More channels are just an optimization for
+		 * cli_pull() and cli_push(), go on without them.
+		 */
+		status = cli_smb2_multichannel_connect(c, creds, max_channels);
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_NOTICE("cli_smb2_multichannel_connect failed: "
+				   "%s\n", nt_errstr(status));
+		}
+		DBG_INFO("using %zu channels\n", c->smb2.num_channels + 1);
+	}
+
 	*pcli = c;
 	return NT_STATUS_OK;
 }
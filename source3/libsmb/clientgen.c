@@ -68,6 +68,27 @@ struct cli_state *cli_state_create(TALLOC_CTX *mem_ctx,
 				   const char *remote_name,
 				   enum smb_signing_setting signing_state,
 				   int flags)
+{
+	return cli_state_create_guid(mem_ctx,
+				     fd,
+				     remote_name,
+				     signing_state,
+				     flags,
+				     NULL);
+}
+
+/****************************************************************************
+ Like cli_state_create(), but with a given client guid. Additional
+ channels of a session have to use the client guid of the first one.
+ With client_guid == NULL the guid is chosen as in cli_state_create().
+****************************************************************************/
+
+struct cli_state *cli_state_create_guid(TALLOC_CTX *mem_ctx,
+					int fd,
+					const char *remote_name,
+					enum smb_signing_setting signing_state,
+					int flags,
+					const struct GUID *_client_guid)
 {
 	struct cli_state *cli = NULL;
 	bool use_spnego = lp_client_use_spnego();
@@ -79,10 +100,13 @@ struct cli_state *cli_state_create(TALLOC_CTX *mem_ctx,
 	struct smb311_capabilities smb3_capabilities =
 		smb311_capabilities_parse("client",
 			lp_client_smb3_signing_algorithms(),
-			lp_client_smb3_encryption_algorithms());
+			lp_client_smb3_encryption_algorithms(),
+			lp_client_smb3_compression_algorithms());
 	struct GUID client_guid;
 
-	if (!GUID_all_zero(&cli_state_client_guid)) {
+	if (_client_guid != NULL) {
+		client_guid = *_client_guid;
+	} else if (!GUID_all_zero(&cli_state_client_guid)) {
 		client_guid = cli_state_client_guid;
 	} else {
 		const char *str = NULL;
@@ -255,6 +279,7 @@ static void _cli_shutdown(struct cli_state *cli)
 		cli_tdis(cli);
 	}
 
+	cli_smb2_multichannel_disconnect(cli);
 	smbXcli_conn_disconnect(cli->conn, NT_STATUS_OK);
 
 	TALLOC_FREE(cli);
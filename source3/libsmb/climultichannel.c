@@ -0,0 +1,519 @@
+/*
+   Unix SMB/CIFS implementation.
+   SMB3 multichannel client support
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/network.h"
+#include "libsmb/libsmb.h"
+#include "../lib/util/tevent_ntstatus.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "../libcli/smb/smb2_negotiate_context.h"
+#include "auth/credentials/credentials.h"
+#include "librpc/gen_ndr/ndr_ioctl.h"
+#include "ntioctl.h"
+#include "lib/util/util_net.h"
+
+/*
+ * Additional channels for cli->smb2.session.
+ *
+ * We ask the server for its interfaces with
+ * FSCTL_QUERY_NETWORK_INTERFACE_INFO, connect to the fastest ones
+ * with the same dialect and client guid and bind the session to
+ * them. The channels share the tree connect and the open handles of
+ * cli, only reads and writes are spread over them, see
+ * cli_smb2_channel_select().
+ */
+
+struct cli_smb2_multichannel_addr {
+	struct sockaddr_storage ss;
+	uint64_t linkspeed;
+	bool rss;
+};
+
+struct cli_smb2_multichannel_connect_state {
+	struct tevent_context *ev;
+	struct cli_state *cli;
+	struct cli_credentials *creds;
+	size_t max_channels;
+	uint16_t port;
+
+	struct cli_smb2_multichannel_addr *addrs;
+	size_t num_addrs;
+	size_t next_addr;
+
+	struct cli_state *channel;
+};
+
+static void cli_smb2_multichannel_connect_ifaces(struct tevent_req *subreq);
+static void cli_smb2_multichannel_connect_next(struct tevent_req *req);
+static void cli_smb2_multichannel_connect_connected(
+	struct tevent_req *subreq);
+static void cli_smb2_multichannel_connect_negprot_done(
+	struct tevent_req *subreq);
+static void cli_smb2_multichannel_connect_bound(struct tevent_req *subreq);
+
+struct tevent_req *cli_smb2_multichannel_connect_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct cli_state *cli,
+	struct cli_credentials *creds,
+	size_t max_channels)
+{
+	struct tevent_req *req = NULL, *subreq = NULL;
+	struct cli_smb2_multichannel_connect_state *state = NULL;
+	uint32_t caps;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct cli_smb2_multichannel_connect_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->cli = cli;
+	state->creds = creds;
+	state->max_channels = max_channels;
+
+	if (smbXcli_conn_protocol(cli->conn) < PROTOCOL_SMB3_00) {
+		tevent_req_nterror(req, NT_STATUS_NOT_SUPPORTED);
+		return tevent_req_post(req, ev);
+	}
+
+	caps = smb2cli_conn_server_capabilities(cli->conn);
+	if (!(caps & SMB2_CAP_MULTI_CHANNEL)) {
+		tevent_req_nterror(req, NT_STATUS_NOT_SUPPORTED);
+		return tevent_req_post(req, ev);
+	}
+
+	if (!cli_state_has_tcon(cli)) {
+		tevent_req_nterror(req, NT_STATUS_INVALID_PARAMETER_MIX);
+		return tevent_req_post(req, ev);
+	}
+
+	if (cli->smb2.num_channels + 1 >= max_channels) {
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
+	state->port = get_sockaddr_port(
+		smbXcli_conn_remote_sockaddr(cli->conn));
+
+	subreq = smb2cli_ioctl_send(state,
+				    state->ev,
+				    cli->conn,
+				    cli->timeout,
+				    cli->smb2.session,
+				    cli->smb2.tcon,
+				    UINT64_MAX, /* in_fid_persistent */
+				    UINT64_MAX, /* in_fid_volatile */
+				    FSCTL_QUERY_NETWORK_INTERFACE_INFO,
+				    0, /* in_max_input_length */
+				    NULL, /* in_input_buffer */
+				    0x10000, /* in_max_output_length */
+				    NULL, /* in_output_buffer */
+				    SMB2_IOCTL_FLAG_IS_FSCTL);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq,
+				cli_smb2_multichannel_connect_ifaces,
+				req);
+	return req;
+}
+
+static int cli_smb2_multichannel_addr_cmp(
+	const struct cli_smb2_multichannel_addr *a1,
+	const struct cli_smb2_multichannel_addr *a2)
+{
+	/* fastest first */
+	if (a1->linkspeed > a2->linkspeed) {
+		return -1;
+	}
+	if (a1->linkspeed < a2->linkspeed) {
+		return 1;
+	}
+	return 0;
+}
+
+static void cli_smb2_multichannel_connect_ifaces(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct cli_smb2_multichannel_connect_state *state = tevent_req_data(
+		req, struct cli_smb2_multichannel_connect_state);
+	const struct sockaddr_storage *remote_ss =
+		smbXcli_conn_remote_sockaddr(state->cli->conn);
+	struct fsctl_net_iface_info *ifaces = NULL;
+	struct fsctl_net_iface_info *iface = NULL;
+	DATA_BLOB out = data_blob_null;
+	enum ndr_err_code ndr_err;
+	size_t num_ifaces = 0;
+	NTSTATUS status;
+
+	status = smb2cli_ioctl_recv(subreq, state, NULL, &out);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	ifaces = talloc_zero(state, struct fsctl_net_iface_info);
+	if (tevent_req_nomem(ifaces, req)) {
+		return;
+	}
+
+	ndr_err = ndr_pull_struct_blob(
+		&out, ifaces, ifaces,
+		(ndr_pull_flags_fn_t)ndr_pull_fsctl_net_iface_info);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DBG_NOTICE("ndr_pull_fsctl_net_iface_info failed: %s\n",
+			   ndr_errstr(ndr_err));
+		tevent_req_nterror(req, NT_STATUS_INVALID_NETWORK_RESPONSE);
+		return;
+	}
+
+	for (iface = ifaces; iface != NULL; iface = iface->next) {
+		num_ifaces += 1;
+	}
+
+	state->addrs = talloc_array(state,
+				    struct cli_smb2_multichannel_addr,
+				    num_ifaces);
+	if (tevent_req_nomem(state->addrs, req)) {
+		return;
+	}
+
+	for (iface = ifaces; iface != NULL; iface = iface->next) {
+		struct cli_smb2_multichannel_addr *a =
+			&state->addrs[state->num_addrs];
+		const char *str = NULL;
+		bool ok;
+
+		switch (iface->sockaddr.family) {
+		case FSCTL_NET_IFACE_AF_INET:
+			str = iface->sockaddr.saddr.saddr_in.ipv4;
+			break;
+		case FSCTL_NET_IFACE_AF_INET6:
+			str = iface->sockaddr.saddr.saddr_in6.ipv6;
+			break;
+		}
+		if (str == NULL) {
+			continue;
+		}
+
+		ok = interpret_string_addr(&a->ss, str, AI_NUMERICHOST);
+		if (!ok) {
+			continue;
+		}
+		a->linkspeed = iface->linkspeed;
+		a->rss = (iface->capability & FSCTL_NET_IFACE_RSS_CAPABLE);
+
+		/*
+		 * Another connection to the address we already use
+		 * only helps if the server spreads it over cpus.
+		 */
+		if (!a->rss &&
+		    sockaddr_equal((const struct sockaddr *)&a->ss,
+				   (const struct sockaddr *)remote_ss)) {
+			continue;
+		}
+
+		DBG_DEBUG("candidate %s linkspeed %"PRIu64"%s\n",
+			  str, a->linkspeed, a->rss ? " rss" : "");
+
+		state->num_addrs += 1;
+	}
+
+	TALLOC_FREE(ifaces);
+
+	TYPESAFE_QSORT(state->addrs,
+		       state->num_addrs,
+		       cli_smb2_multichannel_addr_cmp);
+
+	cli_smb2_multichannel_connect_next(req);
+}
+
+static void cli_smb2_multichannel_connect_next(struct tevent_req *req)
+{
+	struct cli_smb2_multichannel_connect_state *state = tevent_req_data(
+		req, struct cli_smb2_multichannel_connect_state);
+	struct tevent_req *subreq = NULL;
+
+	TALLOC_FREE(state->channel);
+
+	if ((state->cli->smb2.num_channels + 1 >= state->max_channels) ||
+	    (state->next_addr >= state->num_addrs)) {
+		tevent_req_done(req);
+		return;
+	}
+
+	subreq = open_socket_out_send(state,
+				      state->ev,
+				      &state->addrs[state->next_addr].ss,
+				      state->port,
+				      state->cli->timeout);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq,
+				cli_smb2_multichannel_connect_connected,
+				req);
+}
+
+static void cli_smb2_multichannel_connect_failed(struct tevent_req *req,
+						 const char *what,
+						 NTSTATUS status)
+{
+	struct cli_smb2_multichannel_connect_state *state = tevent_req_data(
+		req, struct cli_smb2_multichannel_connect_state);
+	struct sockaddr_storage *ss = &state->addrs[state->next_addr].ss;
+	char addr[INET6_ADDRSTRLEN];
+
+	print_sockaddr(addr, sizeof(addr), ss);
+	DBG_NOTICE("%s for channel to %s failed: %s\n",
+		   what, addr, nt_errstr(status));
+
+	/*
+	 * One failing interface is not fatal, we just use the
+	 * channels we get.
+	 */
+	state->next_addr += 1;
+	cli_smb2_multichannel_connect_next(req);
+}
+
+static void cli_smb2_multichannel_connect_connected(
+	struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct cli_smb2_multichannel_connect_state *state = tevent_req_data(
+		req, struct cli_smb2_multichannel_connect_state);
+	struct cli_state *cli = state->cli;
+	NTSTATUS status;
+	int fd = -1;
+
+	status = open_socket_out_recv(subreq, &fd);
+	TALLOC_FREE(subreq);
+	if (!NT_STATUS_IS_OK(status)) {
+		cli_smb2_multichannel_connect_failed(req, "connect", status);
+		return;
+	}
+
+	/*
+	 * All channels of a session need the client guid of the
+	 * first one.
+	 */
+	state->channel = cli_state_create_guid(
+		state,
+		fd,
+		smbXcli_conn_remote_name(cli->conn),
+		SMB_SIGNING_REQUIRED,
+		0,
+		smbXcli_conn_client_guid(cli->conn));
+	if (tevent_req_nomem(state->channel, req)) {
+		close(fd);
+		return;
+	}
+	state->channel->timeout = cli->timeout;
+
+	subreq = smbXcli_negprot_send(
+		state,
+		state->ev,
+		state->channel->conn,
+		cli->timeout,
+		smbXcli_conn_protocol(cli->conn),
+		smbXcli_conn_protocol(cli->conn),
+		WINDOWS_CLIENT_PURE_SMB2_NEGPROT_INITIAL_CREDIT_ASK,
+		NULL);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq,
+				cli_smb2_multichannel_connect_negprot_done,
+				req);
+}
+
+static void cli_smb2_multichannel_connect_negprot_done(
+	struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct cli_smb2_multichannel_connect_state *state = tevent_req_data(
+		req, struct cli_smb2_multichannel_connect_state);
+	struct smbXcli_conn *conn = state->channel->conn;
+	NTSTATUS status;
+
+	status = smbXcli_negprot_recv(subreq, NULL, NULL);
+	TALLOC_FREE(subreq);
+	if (!NT_STATUS_IS_OK(status)) {
+		cli_smb2_multichannel_connect_failed(req, "negprot", status);
+		return;
+	}
+
+	if (!(smb2cli_conn_server_capabilities(conn) &
+	      SMB2_CAP_MULTI_CHANNEL)) {
+		cli_smb2_multichannel_connect_failed(
+			req, "negprot", NT_STATUS_NOT_SUPPORTED);
+		return;
+	}
+
+	smb2cli_conn_set_max_credits(conn, DEFAULT_SMB2_MAX_CREDITS);
+
+	subreq = cli_session_bind_send(state,
+				       state->ev,
+				       state->channel,
+				       state->cli,
+				       state->creds);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq,
+				cli_smb2_multichannel_connect_bound,
+				req);
+}
+
+static void cli_smb2_multichannel_connect_bound(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct cli_smb2_multichannel_connect_state *state = tevent_req_data(
+		req, struct cli_smb2_multichannel_connect_state);
+	struct cli_state *cli = state->cli;
+	struct cli_state **channels = NULL;
+	NTSTATUS status;
+
+	status = cli_session_bind_recv(subreq);
+	TALLOC_FREE(subreq);
+	if (!NT_STATUS_IS_OK(status)) {
+		cli_smb2_multichannel_connect_failed(req, "bind", status);
+		return;
+	}
+
+	channels = talloc_realloc(cli,
+				  cli->smb2.channels,
+				  struct cli_state *,
+				  cli->smb2.num_channels + 1);
+	if (tevent_req_nomem(channels, req)) {
+		return;
+	}
+	cli->smb2.channels = channels;
+	cli->smb2.channels[cli->smb2.num_channels] =
+		talloc_move(cli->smb2.channels, &state->channel);
+	cli->smb2.num_channels += 1;
+
+	state->next_addr += 1;
+	cli_smb2_multichannel_connect_next(req);
+}
+
+NTSTATUS cli_smb2_multichannel_connect_recv(struct tevent_req *req)
+{
+	return tevent_req_simple_recv_ntstatus(req);
+}
+
+NTSTATUS cli_smb2_multichannel_connect(struct cli_state *cli,
+				       struct cli_credentials *creds,
+				       size_t max_channels)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct tevent_context *ev = NULL;
+	struct tevent_req *req = NULL;
+	NTSTATUS status = NT_STATUS_NO_MEMORY;
+
+	if (smbXcli_conn_has_async_calls(cli->conn)) {
+		/*
+		 * Can't use sync call while an async call is in flight
+		 */
+		status = NT_STATUS_INVALID_PARAMETER;
+		goto fail;
+	}
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		goto fail;
+	}
+	req = cli_smb2_multichannel_connect_send(frame,
+						 ev,
+						 cli,
+						 creds,
+						 max_channels);
+	if (req == NULL) {
+		goto fail;
+	}
+	if (!tevent_req_poll_ntstatus(req, ev, &status)) {
+		goto fail;
+	}
+	status = cli_smb2_multichannel_connect_recv(req);
+fail:
+	TALLOC_FREE(frame);
+	return status;
+}
+
+/*
+ * Pick the channel for the next request, round robin over the
+ * channels that have credits left. Without additional channels
+ * this is cli->conn as long as smb2cli_conn_req_possible() says so.
+ */
+
+bool cli_smb2_channel_select(struct cli_state *cli,
+			     struct smbXcli_conn **pconn,
+			     struct smbXcli_session **psession,
+			     uint32_t *pmax_dyn_len)
+{
+	size_t num = cli->smb2.num_channels + 1;
+	size_t i;
+
+	for (i = 0; i < num; i++) {
+		size_t idx = (cli->smb2.next_channel + i) % num;
+		struct smbXcli_conn *conn = cli->conn;
+		struct smbXcli_session *session = cli->smb2.session;
+		bool ok;
+
+		if (idx > 0) {
+			struct cli_state *c = cli->smb2.channels[idx - 1];
+
+			if (!smbXcli_conn_is_connected(c->conn)) {
+				continue;
+			}
+			conn = c->conn;
+			session = c->smb2.session;
+		}
+
+		ok = smb2cli_conn_req_possible(conn, pmax_dyn_len);
+		if (!ok) {
+			continue;
+		}
+
+		cli->smb2.next_channel = (idx + 1) % num;
+		*pconn = conn;
+		*psession = session;
+		return true;
+	}
+
+	return false;
+}
+
+void cli_smb2_multichannel_disconnect(struct cli_state *cli)
+{
+	size_t i;
+
+	for (i = 0; i < cli->smb2.num_channels; i++) {
+		struct cli_state *c = cli->smb2.channels[i];
+
+		smbXcli_conn_disconnect(c->conn, NT_STATUS_OK);
+	}
+
+	TALLOC_FREE(cli->smb2.channels);
+	cli->smb2.num_channels = 0;
+	cli->smb2.next_channel = 0;
+}
@@ -371,9 +371,10 @@ struct tevent_req *cli_pull_send(TALLOC_CTX *mem_ctx,
 
 	if (window_size == 0) {
 		/*
-		 * We use 16 MByte as default window size.
+		 * We use 16 MByte per channel as default window size.
 		 */
 		window_size = 16 * 1024 * 1024;
+		window_size *= cli->smb2.num_channels + 1;
 	}
 
 	tmp64 = window_size/state->chunk_size;
@@ -524,9 +525,18 @@ static void cli_pull_chunk_ship(struct cli_pull_chunk *chunk)
 	size = chunk->total_size - chunk->tmp_size;
 
 	if (smbXcli_conn_protocol(state->cli->conn) >= PROTOCOL_SMB2_02) {
+		struct smbXcli_conn *conn = NULL;
+		struct smbXcli_session *session = NULL;
 		uint32_t max_size;
 
-		ok = smb2cli_conn_req_possible(state->cli->conn, &max_size);
+		/*
+		 * With multichannel the chunks are spread over
+		 * the channels
+		 */
+		ok = cli_smb2_channel_select(state->cli,
+					     &conn,
+					     &session,
+					     &max_size);
 		if (!ok) {
 			return;
 		}
@@ -536,12 +546,14 @@ static void cli_pull_chunk_ship(struct cli_pull_chunk *chunk)
 		 */
 		size = MIN(max_size, size);
 
-		chunk->subreq = cli_smb2_read_send(chunk,
-						   state->ev,
-						   state->cli,
-						   state->fnum,
-						   ofs,
-						   size);
+		chunk->subreq = cli_smb2_channel_read_send(chunk,
+							   state->ev,
+							   state->cli,
+							   conn,
+							   session,
+							   state->fnum,
+							   ofs,
+							   size);
 		if (tevent_req_nomem(chunk->subreq, req)) {
 			return;
 		}
@@ -1514,9 +1526,10 @@ struct tevent_req *cli_push_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 
 	if (window_size == 0) {
 		/*
-		 * We use 16 MByte as default window size.
+		 * We use 16 MByte per channel as default window size.
 		 */
 		window_size = 16 * 1024 * 1024;
+		window_size *= cli->smb2.num_channels + 1;
 	}
 
 	tmp64 = window_size/state->chunk_size;
@@ -1645,9 +1658,18 @@ static void cli_push_chunk_ship(struct cli_push_chunk *chunk)
 	size = chunk->total_size - chunk->tmp_size;
 
 	if (smbXcli_conn_protocol(state->cli->conn) >= PROTOCOL_SMB2_02) {
+		struct smbXcli_conn *conn = NULL;
+		struct smbXcli_session *session = NULL;
 		uint32_t max_size;
 
-		ok = smb2cli_conn_req_possible(state->cli->conn, &max_size);
+		/*
+		 * With multichannel the chunks are spread over
+		 * the channels
+		 */
+		ok = cli_smb2_channel_select(state->cli,
+					     &conn,
+					     &session,
+					     &max_size);
 		if (!ok) {
 			return;
 		}
@@ -1657,14 +1679,16 @@ static void cli_push_chunk_ship(struct cli_push_chunk *chunk)
 		 */
 		size = MIN(max_size, size);
 
-		chunk->subreq = cli_smb2_write_send(chunk,
-						    state->ev,
-						    state->cli,
-						    state->fnum,
-						    state->mode,
-						    buf,
-						    ofs,
-						    size);
+		chunk->subreq = cli_smb2_channel_write_send(chunk,
+							    state->ev,
+							    state->cli,
+							    conn,
+							    session,
+							    state->fnum,
+							    state->mode,
+							    buf,
+							    ofs,
+							    size);
 		if (tevent_req_nomem(chunk->subreq, req)) {
 			return;
 		}
@@ -52,6 +52,12 @@ struct tevent_req *cli_session_setup_creds_send(TALLOC_CTX *mem_ctx,
 NTSTATUS cli_session_setup_creds_recv(struct tevent_req *req);
 NTSTATUS cli_session_setup_creds(struct cli_state *cli,
 				 struct cli_credentials *creds);
+struct tevent_req *cli_session_bind_send(TALLOC_CTX *mem_ctx,
+					 struct tevent_context *ev,
+					 struct cli_state *channel,
+					 struct cli_state *cli,
+					 struct cli_credentials *creds);
+NTSTATUS cli_session_bind_recv(struct tevent_req *req);
 NTSTATUS cli_session_setup_anon(struct cli_state *cli);
 struct tevent_req *cli_session_setup_guest_create(TALLOC_CTX *mem_ctx,
 						  struct tevent_context *ev,
@@ -182,6 +188,12 @@ struct cli_state *cli_state_create(TALLOC_CTX *mem_ctx,
 				   const char *remote_name,
 				   enum smb_signing_setting signing_state,
 				   int flags);
+struct cli_state *cli_state_create_guid(TALLOC_CTX *mem_ctx,
+					int fd,
+					const char *remote_name,
+					enum smb_signing_setting signing_state,
+					int flags,
+					const struct GUID *client_guid);
 void cli_shutdown(struct cli_state *cli);
 uint16_t cli_state_get_vc_num(struct cli_state *cli);
 uint32_t cli_setpid(struct cli_state *cli, uint32_t pid);
@@ -796,6 +808,24 @@ NTSTATUS cli_message_recv(struct tevent_req *req);
 NTSTATUS cli_message(struct cli_state *cli, const char *host,
 		     const char *username, const char *message);
 
+/* The following definitions come from libsmb/climultichannel.c  */
+
+struct tevent_req *cli_smb2_multichannel_connect_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct cli_state *cli,
+	struct cli_credentials *creds,
+	size_t max_channels);
+NTSTATUS cli_smb2_multichannel_connect_recv(struct tevent_req *req);
+NTSTATUS cli_smb2_multichannel_connect(struct cli_state *cli,
+				       struct cli_credentials *creds,
+				       size_t max_channels);
+bool cli_smb2_channel_select(struct cli_state *cli,
+			     struct smbXcli_conn **pconn,
+			     struct smbXcli_session **psession,
+			     uint32_t *pmax_dyn_len);
+void cli_smb2_multichannel_disconnect(struct cli_state *cli);
+
 /* The following definitions come from libsmb/clioplock.c  */
 
 struct tevent_req *cli_smb_oplock_break_waiter_send(TALLOC_CTX *mem_ctx,
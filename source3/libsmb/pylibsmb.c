@@ -42,6 +42,9 @@ c = libsmb.Conn("127.0.0.1",
                 lp,
                 creds,
                 multi_threaded=True)
+
+max_channels=<n> binds up to n-1 additional SMB3 channels, loadfile and
+savefile spread their reads and writes over them.
 -------------------------
 */
 
@@ -549,6 +552,7 @@ static int py_cli_state_init(struct py_cli_state *self, PyObject *args,
 	struct smb2_negotiate_contexts *negotiate_contexts = NULL;
 	bool use_ipc = false;
 	bool request_posix = false;
+	int max_channels = 1;
 	struct tevent_req *req;
 	bool ret;
 	int flags = 0;
@@ -559,6 +563,7 @@ static int py_cli_state_init(struct py_cli_state *self, PyObject *args,
 		"ipc",
 		"posix",
 		"negotiate_contexts",
+		"max_channels",
 		NULL
 	};
 
@@ -569,14 +574,15 @@ static int py_cli_state_init(struct py_cli_state *self, PyObject *args,
 	}
 
 	ret = ParseTupleAndKeywords(
-		args, kwds, "ssO|O!OOOOO", kwlist,
+		args, kwds, "ssO|O!OOOOOi", kwlist,
 		&host, &share, &py_lp,
 		py_type_Credentials, &creds,
 		&py_multi_threaded,
 		&py_force_smb1,
 		&py_ipc,
 		&py_posix,
-		&py_negotiate_contexts);
+		&py_negotiate_contexts,
+		&max_channels);
 
 	Py_DECREF(py_type_Credentials);
 
@@ -654,6 +660,24 @@ static int py_cli_state_init(struct py_cli_state *self, PyObject *args,
 		return -1;
 	}
 
+	if (max_channels > 1) {
+		/*
+		 * Additional SMB3 channels for loadfile/savefile
+		 */
+		req = cli_smb2_multichannel_connect_send(
+			NULL, self->ev, self->cli, cli_creds, max_channels);
+		if (!py_tevent_req_wait_exc(self, req)) {
+			return -1;
+		}
+		status = cli_smb2_multichannel_connect_recv(req);
+		TALLOC_FREE(req);
+
+		if (!NT_STATUS_IS_OK(status)) {
+			PyErr_SetNTSTATUS(status);
+			return -1;
+		}
+	}
+
 	/*
 	 * Oplocks require a multi threaded connection
 	 */
@@ -2347,6 +2371,17 @@ static PyObject *py_smb_protocol(struct py_cli_state *self,
 	return result;
 }
 
+static PyObject *py_smb_num_channels(struct py_cli_state *self,
+				     PyObject *Py_UNUSED(ignored))
+{
+	size_t num = 1;
+
+	if (smbXcli_conn_protocol(self->cli->conn) >= PROTOCOL_SMB2_02) {
+		num += self->cli->smb2.num_channels;
+	}
+	return PyLong_FromSize_t(num);
+}
+
 static PyObject *py_smb_get_sd(struct py_cli_state *self, PyObject *args)
 {
 	int fnum;
@@ -2742,6 +2777,12 @@ static PyMethodDef py_cli_state_methods[] = {
 	  METH_NOARGS,
 	  "protocol() -> Number"
 	},
+	{ "num_channels",
+	  (PyCFunction)py_smb_num_channels,
+	  METH_NOARGS,
+	  "num_channels() -> Number\n\n"
+	  "\t\tReturn the number of channels, including the first one"
+	},
 	{ "have_posix",
 	  (PyCFunction)py_smb_have_posix,
 	  METH_NOARGS,
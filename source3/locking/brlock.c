@@ -52,8 +52,29 @@ struct byte_range_lock {
 	bool modified;
 	struct lock_struct *lock_data;
 	struct db_record *record;
+
+	/*
+	 * lock_data is sorted by start offset, locks with the same
+	 * start are kept in the order they were added. Records written
+	 * by older versions might not be sorted, then we fall back to
+	 * looking at all locks.
+	 */
+	bool sorted;
+
+	/*
+	 * max_last[i] is the highest last byte covered by any of
+	 * lock_data[0..i]. Built on demand for finding the locks that
+	 * can overlap a range, freed whenever lock_data changes.
+	 */
+	br_off *max_last;
 };
 
+/*
+ * Below this number of locks just looking at all of them is cheaper
+ * than maintaining max_last.
+ */
+#define BRL_INDEX_MIN_LOCKS 8
+
 /****************************************************************************
  Debug info at level 10 for lock struct.
 ****************************************************************************/
@@ -203,6 +224,221 @@ bool byte_range_overlap(uint64_t ofs1,
 	return true;
 }
 
+/****************************************************************************
+ The last byte covered by a range as seen by byte_range_overlap(). A
+ zero length range ends one byte before its start, the {0, 0} range
+ never overlaps anything.
+****************************************************************************/
+
+static br_off brl_last(br_off start, br_off size)
+{
+	if (start == 0 && size == 0) {
+		return 0;
+	}
+	if (!byte_range_valid(start, size)) {
+		return UINT64_MAX;
+	}
+	return start + size - 1;
+}
+
+/****************************************************************************
+ Helpers to keep lock_data sorted by start offset.
+****************************************************************************/
+
+static bool brl_locks_sorted(const struct lock_struct *locks,
+			     unsigned int num_locks)
+{
+	unsigned int i;
+
+	for (i=1; i < num_locks; i++) {
+		if (locks[i-1].start > locks[i].start) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Stable insertion sort, we only ever have a few locks out of place.
+ */
+static void brl_sort_locks(struct lock_struct *locks, unsigned int num_locks)
+{
+	unsigned int i;
+
+	for (i=1; i < num_locks; i++) {
+		struct lock_struct tmp;
+		unsigned int j = i;
+
+		if (locks[i-1].start <= locks[i].start) {
+			continue;
+		}
+
+		tmp = locks[i];
+		while ((j > 0) && (locks[j-1].start > tmp.start)) {
+			locks[j] = locks[j-1];
+			j -= 1;
+		}
+		locks[j] = tmp;
+	}
+}
+
+/*
+ * Index of the first lock with a start offset > start
+ */
+static unsigned int brl_upper_bound(const struct lock_struct *locks,
+				    unsigned int num_locks,
+				    br_off start)
+{
+	unsigned int lo = 0;
+	unsigned int hi = num_locks;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (locks[mid].start <= start) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/*
+ * Index of the first lock with a start offset >= start
+ */
+static unsigned int brl_lower_bound(const struct lock_struct *locks,
+				    unsigned int num_locks,
+				    br_off start)
+{
+	unsigned int lo = 0;
+	unsigned int hi = num_locks;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (locks[mid].start < start) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static void brl_locks_changed(struct byte_range_lock *br_lck)
+{
+	TALLOC_FREE(br_lck->max_last);
+}
+
+/****************************************************************************
+ Build the overlap index for a lock array sorted by start offset:
+ max_last[i] is the highest last byte covered by any of locks[0..i].
+****************************************************************************/
+
+br_off *brl_index_build(TALLOC_CTX *mem_ctx,
+			const struct lock_struct *locks,
+			unsigned int num_locks)
+{
+	br_off *max_last = NULL;
+	unsigned int i;
+
+	max_last = talloc_array(mem_ctx, br_off, num_locks);
+	if (max_last == NULL) {
+		return NULL;
+	}
+
+	for (i=0; i < num_locks; i++) {
+		br_off last = brl_last(locks[i].start, locks[i].size);
+
+		if ((i > 0) && (max_last[i-1] > last)) {
+			last = max_last[i-1];
+		}
+		max_last[i] = last;
+	}
+
+	return max_last;
+}
+
+/****************************************************************************
+ Find the slice [*pbegin, *pend) of a sorted lock array that contains
+ all locks that can overlap [start, start+size). Locks outside of it
+ can't conflict with this range.
+****************************************************************************/
+
+void brl_index_range(const struct lock_struct *locks,
+		     unsigned int num_locks,
+		     const br_off *max_last,
+		     br_off start,
+		     br_off size,
+		     unsigned int *pbegin,
+		     unsigned int *pend)
+{
+	unsigned int lo, hi;
+
+	if (start == 0 && size == 0) {
+		/* The {0, 0} range doesn't conflict with any lock */
+		*pbegin = 0;
+		*pend = 0;
+		return;
+	}
+
+	/*
+	 * Locks starting behind our last byte can't overlap
+	 */
+	*pend = brl_upper_bound(locks, num_locks, brl_last(start, size));
+
+	/*
+	 * max_last is monotonic, find the first lock that could
+	 * reach up to our start.
+	 */
+	lo = 0;
+	hi = *pend;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (max_last[mid] < start) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*pbegin = lo;
+}
+
+static void brl_overlap_range(struct byte_range_lock *br_lck,
+			      br_off start,
+			      br_off size,
+			      unsigned int *pbegin,
+			      unsigned int *pend)
+{
+	*pbegin = 0;
+	*pend = br_lck->num_locks;
+
+	if (!br_lck->sorted || (br_lck->num_locks < BRL_INDEX_MIN_LOCKS)) {
+		return;
+	}
+
+	if (br_lck->max_last == NULL) {
+		br_lck->max_last = brl_index_build(br_lck,
+						   br_lck->lock_data,
+						   br_lck->num_locks);
+		if (br_lck->max_last == NULL) {
+			/* Look at all of them */
+			return;
+		}
+	}
+
+	brl_index_range(br_lck->lock_data,
+			br_lck->num_locks,
+			br_lck->max_last,
+			start,
+			size,
+			pbegin,
+			pend);
+}
+
 /****************************************************************************
  See if lck1 and lck2 overlap.
 ****************************************************************************/
@@ -424,7 +660,7 @@ static int lock_compare(const struct lock_struct *lck1,
 NTSTATUS brl_lock_windows_default(struct byte_range_lock *br_lck,
 				  struct lock_struct *plock)
 {
-	unsigned int i;
+	unsigned int i, begin, end;
 	files_struct *fsp = br_lck->fsp;
 	struct lock_struct *locks = br_lck->lock_data;
 	NTSTATUS status;
@@ -437,7 +673,9 @@ NTSTATUS brl_lock_windows_default(struct byte_range_lock *br_lck,
 		return NT_STATUS_INVALID_LOCK_RANGE;
 	}
 
-	for (i=0; i < br_lck->num_locks; i++) {
+	brl_overlap_range(br_lck, plock->start, plock->size, &begin, &end);
+
+	for (i=begin; i < end; i++) {
 		/* Do any Windows or POSIX locks conflict ? */
 		if (brl_conflict(&locks[i], plock)) {
 			if (!serverid_exists(&locks[i].context.pid)) {
@@ -495,10 +733,19 @@ NTSTATUS brl_lock_windows_default(struct byte_range_lock *br_lck,
 		goto fail;
 	}
 
-	memcpy(&locks[br_lck->num_locks], plock, sizeof(struct lock_struct));
+	i = br_lck->num_locks;
+	if (br_lck->sorted) {
+		/* Behind all locks with the same start */
+		i = brl_upper_bound(locks, br_lck->num_locks, plock->start);
+		memmove(&locks[i+1], &locks[i],
+			(br_lck->num_locks - i) * sizeof(struct lock_struct));
+	}
+
+	memcpy(&locks[i], plock, sizeof(struct lock_struct));
 	br_lck->num_locks += 1;
 	br_lck->lock_data = locks;
 	br_lck->modified = True;
+	brl_locks_changed(br_lck);
 
 	return NT_STATUS_OK;
  fail:
@@ -889,21 +1136,16 @@ static NTSTATUS brl_lock_posix(struct byte_range_lock *br_lck,
 					     LEVEL2_CONTEND_POSIX_BRL);
 	}
 
-	/* Try and add the lock in order, sorted by lock start. */
-	for (i=0; i < count; i++) {
-		struct lock_struct *curr_lock = &tp[i];
-
-		if (curr_lock->start <= plock->start) {
-			continue;
-		}
-	}
+	/*
+	 * Add the lock, keeping the array sorted by lock start. Split
+	 * and merged ranges can also have moved.
+	 */
+	memcpy(&tp[count], plock, sizeof(struct lock_struct));
+	count++;
 
-	if (i < count) {
-		memmove(&tp[i+1], &tp[i],
-			(count - i)*sizeof(struct lock_struct));
+	if (br_lck->sorted) {
+		brl_sort_locks(tp, count);
 	}
-	memcpy(&tp[i], plock, sizeof(struct lock_struct));
-	count++;
 
 	/* We can get the POSIX lock, now see if it needs to
 	   be mapped into a lower level POSIX one, and if so can
@@ -953,6 +1195,7 @@ static NTSTATUS brl_lock_posix(struct byte_range_lock *br_lck,
 	br_lck->lock_data = tp;
 	locks = tp;
 	br_lck->modified = True;
+	brl_locks_changed(br_lck);
 
 	/* A successful downgrade from write to read lock can trigger a lock
 	   re-evalutation where waiting readers can now proceed. */
@@ -1029,7 +1272,7 @@ NTSTATUS brl_lock(
 bool brl_unlock_windows_default(struct byte_range_lock *br_lck,
 				const struct lock_struct *plock)
 {
-	unsigned int i;
+	unsigned int i, begin, end;
 	struct lock_struct *locks = br_lck->lock_data;
 	enum brl_type deleted_lock_type = READ_LOCK; /* shut the compiler up.... */
 
@@ -1061,7 +1304,16 @@ bool brl_unlock_windows_default(struct byte_range_lock *br_lck,
 	}
 #endif
 
-	for (i = 0; i < br_lck->num_locks; i++) {
+	begin = 0;
+	end = br_lck->num_locks;
+
+	if (br_lck->sorted) {
+		/* Only locks with the same start can match */
+		begin = brl_lower_bound(locks, end, plock->start);
+		end = brl_upper_bound(locks, end, plock->start);
+	}
+
+	for (i = begin; i < end; i++) {
 		struct lock_struct *lock = &locks[i];
 
 		/* Only remove our own locks that match in start, size, and flavour. */
@@ -1075,7 +1327,7 @@ bool brl_unlock_windows_default(struct byte_range_lock *br_lck,
 		}
 	}
 
-	if (i == br_lck->num_locks) {
+	if (i == end) {
 		/* we didn't find it */
 		return False;
 	}
@@ -1087,6 +1339,7 @@ bool brl_unlock_windows_default(struct byte_range_lock *br_lck,
 	ARRAY_DEL_ELEMENT(locks, i, br_lck->num_locks);
 	br_lck->num_locks -= 1;
 	br_lck->modified = True;
+	brl_locks_changed(br_lck);
 
 	/* Unlock the underlying POSIX regions. */
 	if(lp_posix_locking(br_lck->fsp->conn->params)) {
@@ -1202,6 +1455,11 @@ static bool brl_unlock_posix(struct byte_range_lock *br_lck,
 		return True;
 	}
 
+	if (br_lck->sorted) {
+		/* The upper half of a split lock might have moved */
+		brl_sort_locks(tp, count);
+	}
+
 	/* Unlock any POSIX regions. */
 	if(lp_posix_locking(br_lck->fsp->conn->params)) {
 		release_posix_lock_posix_flavour(br_lck->fsp,
@@ -1233,6 +1491,7 @@ static bool brl_unlock_posix(struct byte_range_lock *br_lck,
 	locks = tp;
 	br_lck->lock_data = tp;
 	br_lck->modified = True;
+	brl_locks_changed(br_lck);
 
 	return True;
 }
@@ -1276,12 +1535,15 @@ bool brl_locktest(struct byte_range_lock *br_lck,
 		  const struct lock_struct *rw_probe)
 {
 	bool ret = True;
-	unsigned int i;
+	unsigned int i, begin, end;
 	struct lock_struct *locks = br_lck->lock_data;
 	files_struct *fsp = br_lck->fsp;
 
+	brl_overlap_range(br_lck, rw_probe->start, rw_probe->size,
+			  &begin, &end);
+
 	/* Make sure existing locks don't conflict */
-	for (i=0; i < br_lck->num_locks; i++) {
+	for (i=begin; i < end; i++) {
 		/*
 		 * Our own locks don't conflict.
 		 */
@@ -1344,7 +1606,7 @@ NTSTATUS brl_lockquery(struct byte_range_lock *br_lck,
 		enum brl_type *plock_type,
 		enum brl_flavour lock_flav)
 {
-	unsigned int i;
+	unsigned int i, begin, end;
 	struct lock_struct lock;
 	const struct lock_struct *locks = br_lck->lock_data;
 	files_struct *fsp = br_lck->fsp;
@@ -1358,8 +1620,10 @@ NTSTATUS brl_lockquery(struct byte_range_lock *br_lck,
 	lock.lock_type = *plock_type;
 	lock.lock_flav = lock_flav;
 
+	brl_overlap_range(br_lck, lock.start, lock.size, &begin, &end);
+
 	/* Make sure existing locks don't conflict */
-	for (i=0; i < br_lck->num_locks; i++) {
+	for (i=begin; i < end; i++) {
 		const struct lock_struct *exlock = &locks[i];
 		bool conflict = False;
 
@@ -1680,7 +1944,7 @@ int brl_forall(void (*fn)(struct file_id id, struct server_id pid,
 
 static void byte_range_lock_flush(struct byte_range_lock *br_lck)
 {
-	unsigned i;
+	unsigned i, num_locks;
 	struct lock_struct *locks = br_lck->lock_data;
 
 	if (!br_lck->modified) {
@@ -1688,20 +1952,23 @@ static void byte_range_lock_flush(struct byte_range_lock *br_lck)
 		goto done;
 	}
 
-	i = 0;
+	num_locks = 0;
 
-	while (i < br_lck->num_locks) {
+	for (i = 0; i < br_lck->num_locks; i++) {
 		if (locks[i].context.pid.pid == 0) {
 			/*
 			 * Autocleanup, the process conflicted and does not
 			 * exist anymore.
 			 */
-			locks[i] = locks[br_lck->num_locks-1];
-			br_lck->num_locks -= 1;
-		} else {
-			i += 1;
+			continue;
+		}
+		/* Keep the order */
+		if (num_locks < i) {
+			locks[num_locks] = locks[i];
 		}
+		num_locks += 1;
 	}
+	br_lck->num_locks = num_locks;
 
 	if (br_lck->num_locks == 0) {
 		/* No locks - delete this entry. */
@@ -1742,6 +2009,8 @@ static bool brl_parse_data(struct byte_range_lock *br_lck, TDB_DATA data)
 {
 	size_t data_len;
 
+	br_lck->sorted = true;
+
 	if (data.dsize == 0) {
 		return true;
 	}
@@ -1758,6 +2027,9 @@ static bool brl_parse_data(struct byte_range_lock *br_lck, TDB_DATA data)
 		DEBUG(1, ("talloc_memdup failed\n"));
 		return false;
 	}
+
+	br_lck->sorted = brl_locks_sorted(br_lck->lock_data,
+					  br_lck->num_locks);
 	return true;
 }
 
@@ -1797,6 +2069,15 @@ struct byte_range_lock *brl_get_locks(TALLOC_CTX *mem_ctx, files_struct *fsp)
 		return NULL;
 	}
 
+	if (!br_lck->sorted) {
+		/*
+		 * Written by an older version. Sort it, we'll store
+		 * it in order with the next change.
+		 */
+		brl_sort_locks(br_lck->lock_data, br_lck->num_locks);
+		br_lck->sorted = true;
+	}
+
 	talloc_set_destructor(br_lck, byte_range_lock_destructor);
 
 	if (DEBUGLEVEL >= 10) {
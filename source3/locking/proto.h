@@ -40,6 +40,16 @@ bool byte_range_overlap(uint64_t ofs1,
 			uint64_t len1,
 			uint64_t ofs2,
 			uint64_t len2);
+br_off *brl_index_build(TALLOC_CTX *mem_ctx,
+			const struct lock_struct *locks,
+			unsigned int num_locks);
+void brl_index_range(const struct lock_struct *locks,
+		     unsigned int num_locks,
+		     const br_off *max_last,
+		     br_off start,
+		     br_off size,
+		     unsigned int *pbegin,
+		     unsigned int *pend);
 
 NTSTATUS brl_lock_windows_default(struct byte_range_lock *br_lck,
 				  struct lock_struct *plock);
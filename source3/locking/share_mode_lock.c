@@ -1501,6 +1501,39 @@ NTSTATUS share_mode_watch_recv(
 	return NT_STATUS_OK;
 }
 
+/*
+ * Read-only share_mode_locks are not refcounted and never written
+ * back. The database only changes unique_content_epoch when the
+ * share_mode_data blob changes, so when the caller is done with it we
+ * can give the parsed data to the memcache. The next unlocked (or
+ * locked) fetch of the same record peeks at the epoch in the blob
+ * header and skips the NDR parse if nothing has changed in between.
+ */
+static int share_mode_lock_unlocked_destructor(struct share_mode_lock *lck)
+{
+	struct share_mode_data *d = lck->cached_data;
+	void *ptr = NULL;
+
+	if ((d == NULL) || d->modified || d->not_stored) {
+		return 0;
+	}
+
+	/*
+	 * Don't replace an entry someone else has put there, it's
+	 * at least as recent as ours.
+	 */
+	ptr = memcache_lookup_talloc(NULL,
+				     SHARE_MODE_LOCK_CACHE,
+				     memcache_key(&d->id));
+	if (ptr != NULL) {
+		return 0;
+	}
+
+	share_mode_memcache_store(d);
+	lck->cached_data = NULL;
+	return 0;
+}
+
 struct fetch_share_mode_unlocked_state {
 	TALLOC_CTX *mem_ctx;
 	struct file_id id;
@@ -1546,7 +1579,10 @@ static void fetch_share_mode_unlocked_parser(
 	if (state->lck->cached_data == NULL) {
 		DBG_DEBUG("parse_share_modes failed\n");
 		TALLOC_FREE(state->lck);
+		return;
 	}
+	state->lck->cached_data->id = state->id;
+	talloc_set_destructor(state->lck, share_mode_lock_unlocked_destructor);
 }
 
 /*******************************************************************
@@ -1688,6 +1724,8 @@ static void fetch_share_mode_fn(
 		TALLOC_FREE(state->lck);
 		return;
 	}
+	state->lck->cached_data->id = state->id;
+	talloc_set_destructor(state->lck, share_mode_lock_unlocked_destructor);
 }
 
 static void fetch_share_mode_done(struct tevent_req *subreq)
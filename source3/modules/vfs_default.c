@@ -3545,17 +3545,85 @@ struct vfswrap_getxattrat_state {
 	ssize_t xattr_size;
 	struct vfs_aio_state vfs_aio_state;
 	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes);
+
+	struct vfswrap_getxattrat_batch *batch;
+	size_t batch_idx;
+};
+
+/*
+ * Async getxattrat requests typically come in bursts, e.g. from
+ * smbd_smb2_query_directory() fetching the DOS attributes of all
+ * entries it's about to return. Instead of one threadpool job per
+ * request, requests with the same credentials issued within one
+ * event loop iteration are collected and run as a single job. This
+ * saves a thread wakeup and a completion signal per xattr.
+ */
+#define VFSWRAP_GETXATTRAT_BATCH_MAX 64
+
+struct vfswrap_getxattrat_queue {
+	struct vfswrap_getxattrat_batch *pending;
+};
+
+struct vfswrap_getxattrat_batch {
+	struct vfswrap_getxattrat_queue *queue;
+	struct tevent_context *ev;
+	struct tevent_immediate *im;
+	struct pthreadpool_tevent *pool;
+	struct security_unix_token *token;
+	struct tevent_req *reqs[VFSWRAP_GETXATTRAT_BATCH_MAX];
+	size_t num_reqs;
+	bool in_thread;
 };
 
 static int vfswrap_getxattrat_state_destructor(
 		struct vfswrap_getxattrat_state *state)
 {
-	return -1;
+	struct vfswrap_getxattrat_batch *batch = state->batch;
+
+	if (batch == NULL) {
+		return 0;
+	}
+	if (batch->in_thread) {
+		return -1;
+	}
+	batch->reqs[state->batch_idx] = NULL;
+	state->batch = NULL;
+	return 0;
+}
+
+static int vfswrap_getxattrat_batch_destructor(
+		struct vfswrap_getxattrat_batch *batch)
+{
+	size_t i;
+
+	if (batch->in_thread) {
+		return -1;
+	}
+	if ((batch->queue != NULL) && (batch->queue->pending == batch)) {
+		batch->queue->pending = NULL;
+	}
+	for (i=0; i<batch->num_reqs; i++) {
+		struct vfswrap_getxattrat_state *state = NULL;
+
+		if (batch->reqs[i] == NULL) {
+			continue;
+		}
+		state = tevent_req_data(batch->reqs[i],
+					struct vfswrap_getxattrat_state);
+		state->batch = NULL;
+	}
+	return 0;
 }
 
 static void vfswrap_getxattrat_do_sync(struct tevent_req *req);
+static bool vfswrap_getxattrat_batch_add(struct tevent_req *req);
+static void vfswrap_getxattrat_batch_dispatch(
+	struct tevent_context *ev,
+	struct tevent_immediate *im,
+	void *private_data);
 static void vfswrap_getxattrat_do_async(void *private_data);
 static void vfswrap_getxattrat_done(struct tevent_req *subreq);
+static void vfswrap_getxattrat_finish(struct tevent_req *req, int ret);
 
 static struct tevent_req *vfswrap_getxattrat_send(
 			TALLOC_CTX *mem_ctx,
@@ -3567,12 +3635,12 @@ static struct tevent_req *vfswrap_getxattrat_send(
 			size_t alloc_hint)
 {
 	struct tevent_req *req = NULL;
-	struct tevent_req *subreq = NULL;
 	struct vfswrap_getxattrat_state *state = NULL;
 	size_t max_threads = 0;
 	bool have_per_thread_cwd = false;
 	bool have_per_thread_creds = false;
 	bool do_async = false;
+	bool ok;
 
 	SMB_ASSERT(!is_named_stream(smb_fname));
 
@@ -3662,20 +3730,162 @@ static struct tevent_req *vfswrap_getxattrat_send(
 
 	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile_bytes);
 
-	subreq = pthreadpool_tevent_job_send(
-			state,
-			ev,
-			dir_fsp->conn->sconn->pool,
-			vfswrap_getxattrat_do_async,
-			state);
-	if (tevent_req_nomem(subreq, req)) {
+	ok = vfswrap_getxattrat_batch_add(req);
+	if (!ok) {
+		tevent_req_oom(req);
 		return tevent_req_post(req, ev);
 	}
-	tevent_req_set_callback(subreq, vfswrap_getxattrat_done, req);
 
+	return req;
+}
+
+static bool vfswrap_getxattrat_same_token(
+	const struct security_unix_token *t1,
+	const struct security_unix_token *t2)
+{
+	if ((t1->uid != t2->uid) || (t1->gid != t2->gid)) {
+		return false;
+	}
+	if (t1->ngroups != t2->ngroups) {
+		return false;
+	}
+	if (t1->ngroups == 0) {
+		return true;
+	}
+	return (memcmp(t1->groups,
+		       t2->groups,
+		       sizeof(gid_t) * t1->ngroups) == 0);
+}
+
+static bool vfswrap_getxattrat_batch_add(struct tevent_req *req)
+{
+	struct vfswrap_getxattrat_state *state = tevent_req_data(
+		req, struct vfswrap_getxattrat_state);
+	struct vfs_handle_struct *handle = state->handle;
+	struct vfswrap_getxattrat_queue *queue = NULL;
+	struct vfswrap_getxattrat_batch *batch = NULL;
+
+	if (SMB_VFS_HANDLE_TEST_DATA(handle)) {
+		SMB_VFS_HANDLE_GET_DATA(handle,
+					queue,
+					struct vfswrap_getxattrat_queue,
+					return false);
+	} else {
+		queue = talloc_zero(handle, struct vfswrap_getxattrat_queue);
+		if (queue == NULL) {
+			return false;
+		}
+		SMB_VFS_HANDLE_SET_DATA(handle,
+					queue,
+					NULL,
+					struct vfswrap_getxattrat_queue,
+					return false);
+	}
+
+	batch = queue->pending;
+	if ((batch != NULL) &&
+	    ((batch->ev != state->ev) ||
+	     !vfswrap_getxattrat_same_token(batch->token, state->token)))
+	{
+		/*
+		 * Don't mix requests with different credentials,
+		 * send off what we have.
+		 */
+		vfswrap_getxattrat_batch_dispatch(batch->ev, batch->im, batch);
+		batch = NULL;
+	}
+
+	if (batch == NULL) {
+		batch = talloc_zero(queue, struct vfswrap_getxattrat_batch);
+		if (batch == NULL) {
+			return false;
+		}
+		batch->queue = queue;
+		batch->ev = state->ev;
+		batch->pool = state->dir_fsp->conn->sconn->pool;
+
+		batch->token = copy_unix_token(batch, state->token);
+		if (batch->token == NULL) {
+			TALLOC_FREE(batch);
+			return false;
+		}
+		batch->im = tevent_create_immediate(batch);
+		if (batch->im == NULL) {
+			TALLOC_FREE(batch);
+			return false;
+		}
+		talloc_set_destructor(batch,
+				      vfswrap_getxattrat_batch_destructor);
+
+		tevent_schedule_immediate(batch->im,
+					  batch->ev,
+					  vfswrap_getxattrat_batch_dispatch,
+					  batch);
+		queue->pending = batch;
+	}
+
+	state->batch = batch;
+	state->batch_idx = batch->num_reqs;
+	batch->reqs[batch->num_reqs++] = req;
 	talloc_set_destructor(state, vfswrap_getxattrat_state_destructor);
 
-	return req;
+	if (batch->num_reqs == ARRAY_SIZE(batch->reqs)) {
+		vfswrap_getxattrat_batch_dispatch(batch->ev, batch->im, batch);
+	}
+
+	return true;
+}
+
+static void vfswrap_getxattrat_batch_dispatch(
+	struct tevent_context *ev,
+	struct tevent_immediate *im,
+	void *private_data)
+{
+	struct vfswrap_getxattrat_batch *batch = talloc_get_type_abort(
+		private_data, struct vfswrap_getxattrat_batch);
+	struct vfswrap_getxattrat_queue *queue = batch->queue;
+	struct tevent_req *subreq = NULL;
+	size_t i;
+
+	tevent_schedule_immediate(im, NULL, NULL, NULL);
+
+	queue->pending = NULL;
+	batch->queue = NULL;
+
+	/*
+	 * From now on the batch and its requests are referenced by a
+	 * worker thread, see vfswrap_getxattrat_state_destructor().
+	 * The batch must survive a disconnect of the share, so don't
+	 * hang it off the vfs handle anymore.
+	 */
+	talloc_steal(ev, batch);
+
+	subreq = pthreadpool_tevent_job_send(batch,
+					     ev,
+					     batch->pool,
+					     vfswrap_getxattrat_do_async,
+					     batch);
+	if (subreq == NULL) {
+		for (i=0; i<batch->num_reqs; i++) {
+			struct tevent_req *req = batch->reqs[i];
+			struct vfswrap_getxattrat_state *state = NULL;
+
+			if (req == NULL) {
+				continue;
+			}
+			state = tevent_req_data(
+				req, struct vfswrap_getxattrat_state);
+			state->batch = NULL;
+			batch->reqs[i] = NULL;
+			SMBPROFILE_BYTES_ASYNC_END(state->profile_bytes);
+			tevent_req_oom(req);
+		}
+		TALLOC_FREE(batch);
+		return;
+	}
+	tevent_req_set_callback(subreq, vfswrap_getxattrat_done, batch);
+
+	batch->in_thread = true;
 }
 
 static void vfswrap_getxattrat_do_sync(struct tevent_req *req)
@@ -3699,15 +3909,12 @@ static void vfswrap_getxattrat_do_sync(struct tevent_req *req)
 
 static void vfswrap_getxattrat_do_async(void *private_data)
 {
-	struct vfswrap_getxattrat_state *state = talloc_get_type_abort(
-		private_data, struct vfswrap_getxattrat_state);
-	struct timespec start_time;
-	struct timespec end_time;
+	struct vfswrap_getxattrat_batch *batch = talloc_get_type_abort(
+		private_data, struct vfswrap_getxattrat_batch);
+	int cred_error = 0;
+	size_t i;
 	int ret;
 
-	PROFILE_TIMESTAMP(&start_time);
-	SMBPROFILE_BYTES_ASYNC_SET_BUSY(state->profile_bytes);
-
 	/*
 	 * Here we simulate a getxattrat()
 	 * call using fchdir();getxattr()
@@ -3716,38 +3923,91 @@ static void vfswrap_getxattrat_do_async(void *private_data)
 	per_thread_cwd_activate();
 
 	/* Become the correct credential on this thread. */
-	ret = set_thread_credentials(state->token->uid,
-				     state->token->gid,
-				     (size_t)state->token->ngroups,
-				     state->token->groups);
+	ret = set_thread_credentials(batch->token->uid,
+				     batch->token->gid,
+				     (size_t)batch->token->ngroups,
+				     batch->token->groups);
 	if (ret != 0) {
-		state->xattr_size = -1;
-		state->vfs_aio_state.error = errno;
-		goto end_profile;
+		cred_error = errno;
 	}
 
-	state->xattr_size = vfswrap_fgetxattr(state->handle,
-					      state->smb_fname->fsp,
-					      state->xattr_name,
-					      state->xattr_value,
-					      talloc_array_length(state->xattr_value));
-	if (state->xattr_size == -1) {
-		state->vfs_aio_state.error = errno;
-	}
+	for (i=0; i<batch->num_reqs; i++) {
+		struct vfswrap_getxattrat_state *state = NULL;
+		struct timespec start_time;
+		struct timespec end_time;
+
+		if (batch->reqs[i] == NULL) {
+			continue;
+		}
+		state = tevent_req_data(batch->reqs[i],
+					struct vfswrap_getxattrat_state);
+
+		PROFILE_TIMESTAMP(&start_time);
+		SMBPROFILE_BYTES_ASYNC_SET_BUSY(state->profile_bytes);
+
+		if (cred_error != 0) {
+			state->xattr_size = -1;
+			state->vfs_aio_state.error = cred_error;
+			goto end_profile;
+		}
+
+		state->xattr_size = vfswrap_fgetxattr(
+			state->handle,
+			state->smb_fname->fsp,
+			state->xattr_name,
+			state->xattr_value,
+			talloc_array_length(state->xattr_value));
+		if (state->xattr_size == -1) {
+			state->vfs_aio_state.error = errno;
+		}
 
 end_profile:
-	PROFILE_TIMESTAMP(&end_time);
-	state->vfs_aio_state.duration = nsec_time_diff(&end_time, &start_time);
-	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile_bytes);
+		PROFILE_TIMESTAMP(&end_time);
+		state->vfs_aio_state.duration = nsec_time_diff(&end_time,
+							       &start_time);
+		SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile_bytes);
+	}
 }
 
 static void vfswrap_getxattrat_done(struct tevent_req *subreq)
 {
-	struct tevent_req *req = tevent_req_callback_data(
-		subreq, struct tevent_req);
+	struct vfswrap_getxattrat_batch *batch = tevent_req_callback_data(
+		subreq, struct vfswrap_getxattrat_batch);
+	size_t i;
+	int ret;
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+
+	batch->in_thread = false;
+
+	/*
+	 * Finishing a request runs its callers' callbacks, which may
+	 * free other requests of this batch. Their destructors take
+	 * them out of batch->reqs.
+	 */
+	for (i=0; i<batch->num_reqs; i++) {
+		struct tevent_req *req = batch->reqs[i];
+		struct vfswrap_getxattrat_state *state = NULL;
+
+		if (req == NULL) {
+			continue;
+		}
+		state = tevent_req_data(req, struct vfswrap_getxattrat_state);
+		batch->reqs[i] = NULL;
+		state->batch = NULL;
+		talloc_set_destructor(state, NULL);
+
+		vfswrap_getxattrat_finish(req, ret);
+	}
+
+	TALLOC_FREE(batch);
+}
+
+static void vfswrap_getxattrat_finish(struct tevent_req *req, int ret)
+{
 	struct vfswrap_getxattrat_state *state = tevent_req_data(
 		req, struct vfswrap_getxattrat_state);
-	int ret;
 	bool ok;
 
 	/*
@@ -3756,10 +4016,7 @@ static void vfswrap_getxattrat_done(struct tevent_req *subreq)
 	ok = change_to_user_and_service_by_fsp(state->dir_fsp);
 	SMB_ASSERT(ok);
 
-	ret = pthreadpool_tevent_job_recv(subreq);
-	TALLOC_FREE(subreq);
 	SMBPROFILE_BYTES_ASYNC_END(state->profile_bytes);
-	talloc_set_destructor(state, NULL);
 	if (ret != 0) {
 		if (ret != EAGAIN) {
 			tevent_req_error(req, ret);
@@ -45,6 +45,7 @@ struct open_how;
 #include "lib/util/tevent_unix.h"
 #include "lib/util/sys_rw.h"
 #include "lib/util/iov_buf.h"
+#include "lib/util/bitmap.h"
 #include "smbprofile.h"
 #include <liburing.h>
 
@@ -59,6 +60,16 @@ struct vfs_io_uring_config {
 	bool need_retry;
 	struct vfs_io_uring_request *queue;
 	struct vfs_io_uring_request *pending;
+	/* used slots of the registered file table, NULL if not in use */
+	struct bitmap *fixed_files;
+};
+
+/*
+ * fsp extension for files in the registered file table
+ */
+struct vfs_io_uring_fsp {
+	struct vfs_io_uring_config *config;
+	int slot;
 };
 
 struct vfs_io_uring_request {
@@ -68,6 +79,8 @@ struct vfs_io_uring_request {
 	struct tevent_req *req;
 	void (*completion_fn)(struct vfs_io_uring_request *cur,
 			      const char *location);
+	/* slot in the registered file table, or -1 */
+	int fixed_fd;
 	struct timespec start_time;
 	struct timespec end_time;
 	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes);
@@ -179,6 +192,7 @@ static int vfs_io_uring_connect(vfs_handle_struct *handle, const char *service,
 	int ret;
 	struct vfs_io_uring_config *config;
 	unsigned num_entries;
+	unsigned num_fixed_files;
 	bool sqpoll;
 	unsigned flags = 0;
 
@@ -229,6 +243,49 @@ static int vfs_io_uring_connect(vfs_handle_struct *handle, const char *service,
 	}
 #endif /* HAVE_IO_URING_RING_DONTFORK */
 
+	num_fixed_files = lp_parm_ulong(SNUM(handle->conn),
+					"io_uring",
+					"registered_files",
+					0);
+	num_fixed_files = MIN(num_fixed_files, INT_MAX / sizeof(int));
+	if (num_fixed_files > 0) {
+		int *fds = NULL;
+		unsigned i;
+
+		fds = talloc_array(config, int, num_fixed_files);
+		if (fds == NULL) {
+			SMB_VFS_NEXT_DISCONNECT(handle);
+			errno = ENOMEM;
+			return -1;
+		}
+		for (i = 0; i < num_fixed_files; i++) {
+			fds[i] = -1;
+		}
+
+		ret = io_uring_register_files(&config->uring,
+					      fds,
+					      num_fixed_files);
+		TALLOC_FREE(fds);
+		if (ret < 0) {
+			/*
+			 * Older kernels don't support sparse file
+			 * tables, we just don't use them then.
+			 */
+			DBG_WARNING("io_uring_register_files(%u) failed: %s, "
+				    "not using registered files\n",
+				    num_fixed_files,
+				    strerror(-ret));
+		} else {
+			config->fixed_files = bitmap_talloc(config,
+							    num_fixed_files);
+			if (config->fixed_files == NULL) {
+				SMB_VFS_NEXT_DISCONNECT(handle);
+				errno = ENOMEM;
+				return -1;
+			}
+		}
+	}
+
 	config->fde = tevent_add_fd(handle->conn->sconn->ev_ctx,
 				    config,
 				    config->uring.ring_fd,
@@ -394,6 +451,9 @@ static void vfs_io_uring_request_submit(struct vfs_io_uring_request *cur)
 {
 	struct vfs_io_uring_config *config = cur->config;
 
+	if (cur->fixed_fd != -1) {
+		cur->sqe.flags |= IOSQE_FIXED_FILE;
+	}
 	io_uring_sqe_set_data(&cur->sqe, cur);
 	DLIST_ADD_END(config->queue, cur);
 	cur->list_head = &config->queue;
@@ -416,6 +476,100 @@ static void vfs_io_uring_fd_handler(struct tevent_context *ev,
 	vfs_io_uring_queue_run(config);
 }
 
+static void vfs_io_uring_fsp_destroy(void *p_data)
+{
+	struct vfs_io_uring_fsp *ext = (struct vfs_io_uring_fsp *)p_data;
+	struct vfs_io_uring_config *config = ext->config;
+	int fd = -1;
+	int ret;
+
+	if (config->uring.ring_fd != -1) {
+		ret = io_uring_register_files_update(&config->uring,
+						     ext->slot,
+						     &fd,
+						     1);
+		if (ret != 1) {
+			DBG_WARNING("Removing slot %d failed: %s\n",
+				    ext->slot,
+				    strerror(-ret));
+		}
+	}
+	bitmap_clear(config->fixed_files, ext->slot);
+}
+
+/*
+ * Return the slot of fsp in the registered file table, registering
+ * it on first use. As every registration costs a syscall this is
+ * only done for files we actually do io on. If the table is full,
+ * or registered files are not in use, we return -1 and the caller
+ * uses the plain fd.
+ */
+static int vfs_io_uring_fixed_fd(struct vfs_handle_struct *handle,
+				 struct vfs_io_uring_config *config,
+				 struct files_struct *fsp)
+{
+	struct vfs_io_uring_fsp *ext = NULL;
+	int fd;
+	int slot;
+	int ret;
+
+	if (config->fixed_files == NULL) {
+		return -1;
+	}
+
+	ext = (struct vfs_io_uring_fsp *)VFS_FETCH_FSP_EXTENSION(handle, fsp);
+	if (ext != NULL) {
+		return ext->slot;
+	}
+
+	fd = fsp_get_io_fd(fsp);
+	if (fd == -1) {
+		return -1;
+	}
+
+	slot = bitmap_find(config->fixed_files, 0);
+	if (slot == -1) {
+		return -1;
+	}
+
+	ret = io_uring_register_files_update(&config->uring, slot, &fd, 1);
+	if (ret != 1) {
+		DBG_DEBUG("Registering fd %d in slot %d failed: %s\n",
+			  fd,
+			  slot,
+			  strerror(-ret));
+		return -1;
+	}
+
+	ext = VFS_ADD_FSP_EXTENSION(handle,
+				    fsp,
+				    struct vfs_io_uring_fsp,
+				    vfs_io_uring_fsp_destroy);
+	if (ext == NULL) {
+		fd = -1;
+		io_uring_register_files_update(&config->uring, slot, &fd, 1);
+		return -1;
+	}
+	ext->config = config;
+	ext->slot = slot;
+	bitmap_set(config->fixed_files, slot);
+
+	return slot;
+}
+
+static int vfs_io_uring_close(struct vfs_handle_struct *handle,
+			      struct files_struct *fsp)
+{
+	/*
+	 * The registered file table holds a reference on the file,
+	 * so we have to remove it from there before the close
+	 * can really close it.
+	 */
+	VFS_REMOVE_FSP_EXTENSION(handle, fsp);
+
+	return SMB_VFS_NEXT_CLOSE(handle, fsp);
+}
+
 struct vfs_io_uring_pread_state {
 	struct files_struct *fsp;
 	off_t offset;
@@ -452,6 +606,7 @@ static struct tevent_req *vfs_io_uring_pread_send(struct vfs_handle_struct *hand
 	state->ur.config = config;
 	state->ur.req = req;
 	state->ur.completion_fn = vfs_io_uring_pread_completion;
+	state->ur.fixed_fd = vfs_io_uring_fixed_fd(handle, config, fsp);
 
 	SMBPROFILE_BYTES_ASYNC_START(syscall_asys_pread, profile_p,
 				     state->ur.profile_bytes, n);
@@ -479,8 +634,14 @@ static struct tevent_req *vfs_io_uring_pread_send(struct vfs_handle_struct *hand
 
 static void vfs_io_uring_pread_submit(struct vfs_io_uring_pread_state *state)
 {
+	int fd = state->ur.fixed_fd;
+
+	if (fd == -1) {
+		fd = fsp_get_io_fd(state->fsp);
+	}
+
 	io_uring_prep_readv(&state->ur.sqe,
-			    fsp_get_io_fd(state->fsp),
+			    fd,
 			    &state->iov, 1,
 			    state->offset);
 	vfs_io_uring_request_submit(&state->ur);
@@ -600,6 +761,7 @@ static struct tevent_req *vfs_io_uring_pwrite_send(struct vfs_handle_struct *han
 	state->ur.config = config;
 	state->ur.req = req;
 	state->ur.completion_fn = vfs_io_uring_pwrite_completion;
+	state->ur.fixed_fd = vfs_io_uring_fixed_fd(handle, config, fsp);
 
 	SMBPROFILE_BYTES_ASYNC_START(syscall_asys_pwrite, profile_p,
 				     state->ur.profile_bytes, n);
@@ -627,8 +789,14 @@ static struct tevent_req *vfs_io_uring_pwrite_send(struct vfs_handle_struct *han
 
 static void vfs_io_uring_pwrite_submit(struct vfs_io_uring_pwrite_state *state)
 {
+	int fd = state->ur.fixed_fd;
+
+	if (fd == -1) {
+		fd = fsp_get_io_fd(state->fsp);
+	}
+
 	io_uring_prep_writev(&state->ur.sqe,
-			     fsp_get_io_fd(state->fsp),
+			     fd,
 			     &state->iov, 1,
 			     state->offset);
 	vfs_io_uring_request_submit(&state->ur);
@@ -727,6 +895,7 @@ static struct tevent_req *vfs_io_uring_fsync_send(struct vfs_handle_struct *hand
 	struct tevent_req *req = NULL;
 	struct vfs_io_uring_fsync_state *state = NULL;
 	struct vfs_io_uring_config *config = NULL;
+	int fd;
 
 	SMB_VFS_HANDLE_GET_DATA(handle, config,
 				struct vfs_io_uring_config,
@@ -740,13 +909,19 @@ static struct tevent_req *vfs_io_uring_fsync_send(struct vfs_handle_struct *hand
 	state->ur.config = config;
 	state->ur.req = req;
 	state->ur.completion_fn = vfs_io_uring_fsync_completion;
+	state->ur.fixed_fd = vfs_io_uring_fixed_fd(handle, config, fsp);
 
 	SMBPROFILE_BYTES_ASYNC_START(syscall_asys_fsync, profile_p,
 				     state->ur.profile_bytes, 0);
 	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->ur.profile_bytes);
 
+	fd = state->ur.fixed_fd;
+	if (fd == -1) {
+		fd = fsp_get_io_fd(fsp);
+	}
+
 	io_uring_prep_fsync(&state->ur.sqe,
-			    fsp_get_io_fd(fsp),
+			    fd,
 			    0); /* fsync_flags */
 	vfs_io_uring_request_submit(&state->ur);
 
@@ -806,6 +981,7 @@ static int vfs_io_uring_fsync_recv(struct tevent_req *req,
 
 static struct vfs_fn_pointers vfs_io_uring_fns = {
 	.connect_fn = vfs_io_uring_connect,
+	.close_fn = vfs_io_uring_close,
 	.pread_send_fn = vfs_io_uring_pread_send,
 	.pread_recv_fn = vfs_io_uring_pread_recv,
 	.pwrite_send_fn = vfs_io_uring_pwrite_send,
@@ -248,6 +248,7 @@ static const struct loadparm_service _sDefault =
 	.aio_write_size = 1,
 	.map_readonly = MAP_READONLY_NO,
 	.server_smb_encrypt = SMB_ENCRYPTION_DEFAULT,
+	.smb3_compression = SMB3_COMPRESSION_REQUESTED,
 	.kernel_share_modes = false,
 	.durable_handles = true,
 	.check_parent_directory_delete_on_close = false,
@@ -876,6 +877,8 @@ void loadparm_s3_init_globals(struct loadparm_context *lp_ctx,
 	Globals.smb2_max_write = DEFAULT_SMB2_MAX_WRITE;
 	Globals.smb2_max_trans = DEFAULT_SMB2_MAX_TRANSACT;
 	Globals.smb2_max_credits = DEFAULT_SMB2_MAX_CREDITS;
+	Globals.smbd_async_encryption_threshold =
+		DEFAULT_SMBD_ASYNC_ENCRYPTION_THRESHOLD;
 	Globals.smb2_leases = true;
 	Globals.server_multi_channel_support = true;
 
@@ -988,6 +991,9 @@ void loadparm_s3_init_globals(struct loadparm_context *lp_ctx,
 	Globals.server_smb3_encryption_algorithms =
 		str_list_make_v3_const(NULL, DEFAULT_SMB3_ENCRYPTION_ALGORITHMS, NULL);
 
+	Globals.server_smb3_compression_algorithms =
+		str_list_make_v3_const(NULL, DEFAULT_SMB3_COMPRESSION_ALGORITHMS, NULL);
+
 	Globals.min_domain_uid = 1000;
 
 	/*
@@ -21,7 +21,7 @@
 #define _REG_DB_H
 
 #define REG_TDB_FLAGS   TDB_SEQNUM
-#define REG_DBWRAP_FLAGS DBWRAP_FLAG_NONE
+#define REG_DBWRAP_FLAGS DBWRAP_FLAG_CACHE
 
 #define REGDB_VERSION_V1    1  /* first db version with write support */
 #define REGDB_VERSION_V2    2  /* version 2 with normalized keys */
@@ -0,0 +1,136 @@
+#!/bin/sh
+#
+# "smbd async dosmode": a directory listing starts one async
+# getxattrat per entry, vfs_default runs them in batches of up to
+# 64. List a directory with more entries than that and check the
+# attributes of every file, also of files without a DOS attribute
+# xattr, whose getxattrat fails. The result has to match a listing
+# without async dosmode.
+#
+
+if [ $# -lt 5 ]; then
+	cat <<EOF
+Usage: test_async_dosmode_batch.sh SERVER USERNAME PASSWORD SMBCLIENT SHAREPATH
+EOF
+	exit 1
+fi
+
+SERVER=${1}
+USERNAME=${2}
+PASSWORD=${3}
+SMBCLIENT=${4}
+SHAREPATH=${5}
+shift 5
+ADDARGS="$*"
+
+incdir=$(dirname "$0")/../../../testprogs/blackbox
+. "$incdir"/subunit.sh
+
+failed=0
+
+ASYNC_SHARE=vfs_aio_pthread_async_dosmode_default1
+SYNC_SHARE=vfs_aio_pthread
+DIR=async_dosmode_batch
+NUM_FILES=200
+
+cleanup()
+{
+	rm -rf "${SHAREPATH:?}/${DIR}"
+}
+
+# Files ending in 9 keep no xattr, the others get one of +h, +s, +r
+file_mode()
+{
+	case $1 in
+	*[012]) echo "+h" ;;
+	*[345]) echo "+s" ;;
+	*[678]) echo "+r" ;;
+	*) ;;
+	esac
+}
+
+setup()
+{
+	cleanup
+	mkdir "${SHAREPATH}/${DIR}" || return 1
+	(cd "${SHAREPATH}/${DIR}" &&
+		seq -f "file_%04g" 1 ${NUM_FILES} | xargs touch) || return 1
+
+	cmds=""
+	for f in $(seq -f "file_%04g" 1 ${NUM_FILES}); do
+		mode=$(file_mode "$f")
+		if [ -n "$mode" ]; then
+			cmds="${cmds}setmode ${DIR}/${f} ${mode};"
+		fi
+	done
+
+	${SMBCLIENT} //"${SERVER}"/${SYNC_SHARE} \
+		-U"${USERNAME}"%"${PASSWORD}" ${ADDARGS} -c "$cmds" ||
+		return 1
+	return 0
+}
+
+list_modes()
+{
+	${SMBCLIENT} //"${SERVER}"/"$1" \
+		-U"${USERNAME}"%"${PASSWORD}" ${ADDARGS} -mSMB3 \
+		-c "ls ${DIR}/*" 2>&1 |
+		awk '$1 ~ /^file_[0-9]+$/ { print $1, $2 }' | sort
+}
+
+test_async_modes()
+{
+	out=$(list_modes ${ASYNC_SHARE})
+	num=$(echo "$out" | grep -c "^file_")
+	if [ "$num" != "${NUM_FILES}" ]; then
+		echo "$out"
+		echo "listed $num files, expected ${NUM_FILES}"
+		return 1
+	fi
+
+	echo "$out" | while read -r f attrs; do
+		case $(file_mode "$f") in
+		+h) want=H ;;
+		+s) want=S ;;
+		+r) want=R ;;
+		*) want="" ;;
+		esac
+		for a in H S R; do
+			has=no
+			case $attrs in
+			*$a*) has=yes ;;
+			esac
+			if [ "$a" = "$want" ] && [ $has = no ]; then
+				echo "$f: $attrs, expected $a"
+				return 1
+			fi
+			if [ "$a" != "$want" ] && [ $has = yes ]; then
+				echo "$f: $attrs, did not expect $a"
+				return 1
+			fi
+		done
+	done || return 1
+
+	return 0
+}
+
+test_same_as_sync()
+{
+	async=$(list_modes ${ASYNC_SHARE})
+	sync=$(list_modes ${SYNC_SHARE})
+	if [ "$async" != "$sync" ]; then
+		echo "async: $async"
+		echo "sync: $sync"
+		return 1
+	fi
+	return 0
+}
+
+testit "setup" setup || failed=$((failed + 1))
+testit "async dosmode listing" test_async_modes || failed=$((failed + 1))
+testit "async equals sync listing" test_same_as_sync ||
+	failed=$((failed + 1))
+
+cleanup
+
+testok "$0" "$failed"
@@ -0,0 +1,130 @@
+#!/bin/sh
+#
+# "smbd:dirlist cache": listings have to be right across processes and
+# after changes, the tdb must not be world readable and has to stay
+# below "smbd:dirlist cache size".
+#
+
+if [ $# -lt 5 ]; then
+	cat <<EOF
+Usage: test_dirlist_cache.sh SERVER USERNAME PASSWORD SMBCLIENT SHAREPATH
+EOF
+	exit 1
+fi
+
+SERVER=${1}
+USERNAME=${2}
+PASSWORD=${3}
+SMBCLIENT=${4}
+SHAREPATH=${5}
+shift 5
+ADDARGS="$*"
+
+samba_tdbdump=tdbdump
+if test -x "$BINDIR"/tdbdump; then
+	samba_tdbdump="$BINDIR"/tdbdump
+fi
+TDBDUMP="${TDBDUMP:-$samba_tdbdump}"
+
+incdir=$(dirname "$0")/../../../testprogs/blackbox
+. "$incdir"/subunit.sh
+
+failed=0
+
+cache="${LOCK_DIR}/dirlist_cache.tdb"
+
+# Each list is about 30k, the share has "smbd:dirlist cache size = 65536"
+NUM_FILES=3000
+
+cleanup()
+{
+	rm -rf "${SHAREPATH}/big1" "${SHAREPATH}/big2" "${SHAREPATH}/big3"
+}
+
+cleanup
+for d in big1 big2 big3; do
+	mkdir "${SHAREPATH}/${d}" || exit 1
+	(cd "${SHAREPATH}/${d}" &&
+		seq -f "file_%04g" 1 ${NUM_FILES} | xargs touch) || exit 1
+done
+
+# Only directories that did not change for a second are cached
+sleep 2
+
+count_files()
+{
+	${SMBCLIENT} //"${SERVER}"/dirlist_cache \
+		-U"${USERNAME}"%"${PASSWORD}" ${ADDARGS} \
+		-c "ls $1/*" 2>&1 | grep -c " file_[0-9]* "
+}
+
+test_count()
+{
+	dir=$1
+	expected=$2
+
+	count=$(count_files "$dir")
+	if [ "$count" != "$expected" ]; then
+		echo "$dir: listed $count files, expected $expected"
+		return 1
+	fi
+	return 0
+}
+
+test_mode()
+{
+	mode=$(stat -c %a "$cache") || return 1
+	if [ "$mode" != "600" ]; then
+		echo "$cache has mode $mode"
+		return 1
+	fi
+	return 0
+}
+
+test_num_records()
+{
+	expected=$1
+
+	num=$("$TDBDUMP" "$cache" | grep -c "^key(")
+	if [ "$num" != "$expected" ]; then
+		"$TDBDUMP" "$cache" | grep "^key("
+		echo "$num records, expected $expected"
+		return 1
+	fi
+	return 0
+}
+
+testit "fill cache" test_count big1 ${NUM_FILES} || failed=$((failed + 1))
+testit "cache not world readable" test_mode || failed=$((failed + 1))
+testit "list from cache" test_count big1 ${NUM_FILES} ||
+	failed=$((failed + 1))
+
+touch "${SHAREPATH}/big1/newfile_0000" "${SHAREPATH}/big1/file_9999"
+
+testit "list after create" test_count big1 $((NUM_FILES + 1)) ||
+	failed=$((failed + 1))
+
+rm "${SHAREPATH}/big1/file_0001"
+
+testit "list after delete" test_count big1 ${NUM_FILES} ||
+	failed=$((failed + 1))
+
+sleep 2
+
+#
+# big1 is cached again, big2 fits in as well, big3 pushes both of them
+# out: 3/4 of the limit only leaves room for one list. That leaves
+# big3 and the size counter.
+#
+testit "fill cache 1" test_count big1 ${NUM_FILES} || failed=$((failed + 1))
+sleep 1
+testit "fill cache 2" test_count big2 ${NUM_FILES} || failed=$((failed + 1))
+sleep 1
+testit "fill cache 3" test_count big3 ${NUM_FILES} || failed=$((failed + 1))
+testit "size limit" test_num_records 2 || failed=$((failed + 1))
+testit "list after eviction" test_count big3 ${NUM_FILES} ||
+	failed=$((failed + 1))
+
+cleanup
+
+testok "$0" "$failed"
@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# "smbd:pathref dircache size" must not let a cached directory
+# handle escape the share when a path component is replaced by a
+# symlink.
+#
+
+if [ $# -lt 6 ]; then
+	cat <<EOF
+Usage: test_pathref_dircache.sh SERVER USERNAME PASSWORD SMBCLIENT SHAREPATH PREFIX
+EOF
+	exit 1
+fi
+
+SERVER=${1}
+USERNAME=${2}
+PASSWORD=${3}
+SMBCLIENT=${4}
+SHAREPATH=${5}
+PREFIX=${6}
+shift 6
+ADDARGS="$*"
+
+incdir=$(dirname "$0")/../../../testprogs/blackbox
+. "$incdir"/subunit.sh
+
+failed=0
+
+outside="${PREFIX}/pathref_dircache_outside"
+
+cleanup()
+{
+	rm -rf "${SHAREPATH}/a" "${outside}"
+}
+
+cleanup
+mkdir -p "${SHAREPATH}/a/c" "${outside}" || exit 1
+touch "${SHAREPATH}/a/c/inside_marker" || exit 1
+
+#
+# One smbclient session, so the cache of the connection is used:
+# list a/c twice to fill the cache, then move "a" out of the share
+# and leave a symlink pointing to it behind.
+#
+test_symlink_swap()
+{
+	out=$(
+		cat <<EOF | ${SMBCLIENT} //"${SERVER}"/pathref_dircache \
+			-U"${USERNAME}"%"${PASSWORD}" ${ADDARGS} 2>&1
+ls a/c/*
+ls a/c/*
+!mv "${SHAREPATH}/a" "${outside}/a" && ln -s "${outside}/a" "${SHAREPATH}/a"
+ls a/c/*
+EOF
+	)
+	echo "$out"
+
+	count=$(echo "$out" | grep -c inside_marker)
+	if [ "$count" != "2" ]; then
+		echo "inside_marker listed $count times, expected 2"
+		return 1
+	fi
+	return 0
+}
+
+testit "symlinked component does not resolve via the cache" \
+	test_symlink_swap || failed=$((failed + 1))
+
+cleanup
+
+testok "$0" "$failed"
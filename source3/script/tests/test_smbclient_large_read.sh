@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# Read a large file with random content, written directly into the
+# share, over SMB2 with the given protection options and check that
+# every byte arrives intact.
+#
+
+if [ $# -lt 5 ]; then
+	cat <<EOF
+Usage: test_smbclient_large_read.sh SERVER USERNAME PASSWORD SMBCLIENT SHAREPATH <smbclient args>
+EOF
+	exit 1
+fi
+
+SERVER=${1}
+USERNAME=${2}
+PASSWORD=${3}
+SMBCLIENT=${4}
+SHAREPATH=${5}
+shift 5
+ADDARGS="$*"
+
+incdir=$(dirname "$0")/../../../testprogs/blackbox
+. "$incdir"/subunit.sh
+
+failed=0
+
+FNAME=large_read.dat
+LOCAL_COPY=$(mktemp)
+
+cleanup()
+{
+	rm -f "${SHAREPATH:?}/${FNAME}" "${LOCAL_COPY}"
+}
+
+# Not a multiple of any read size
+setup()
+{
+	head -c $((20 * 1024 * 1024 + 12345)) /dev/urandom \
+		>"${SHAREPATH}/${FNAME}"
+}
+
+test_get()
+{
+	rm -f "${LOCAL_COPY}"
+	${SMBCLIENT} //"${SERVER}"/tmp -U"${USERNAME}"%"${PASSWORD}" \
+		-mSMB3 "$@" ${ADDARGS} \
+		-c "get ${FNAME} ${LOCAL_COPY}" || return 1
+	cmp "${SHAREPATH}/${FNAME}" "${LOCAL_COPY}"
+}
+
+#
+# Kill the client while the server is still busy sending (and maybe
+# encrypting) the READ responses, then read the file again.
+#
+test_abort()
+{
+	${SMBCLIENT} //"${SERVER}"/tmp -U"${USERNAME}"%"${PASSWORD}" \
+		-mSMB3 --client-protection=encrypt ${ADDARGS} \
+		-c "get ${FNAME} ${LOCAL_COPY}" >/dev/null 2>&1 &
+	client=$!
+	sleep 0.5
+	kill -KILL $client
+	wait $client
+	test_get --client-protection=encrypt
+}
+
+testit "setup" setup || failed=$((failed + 1))
+testit "large read" test_get || failed=$((failed + 1))
+testit "large signed read" test_get --client-protection=sign ||
+	failed=$((failed + 1))
+testit "large encrypted read" test_get --client-protection=encrypt ||
+	failed=$((failed + 1))
+testit "aborted encrypted read" test_abort || failed=$((failed + 1))
+
+cleanup
+
+testok "$0" "$failed"
@@ -0,0 +1,182 @@
+#!/bin/sh
+#
+# "smbd:prefork children": idle spares have to answer messages and
+# signals, and a new connection has to be served by one of them via
+# the socket handed over with SCM_RIGHTS.
+#
+
+if [ $# -lt 7 ]; then
+	cat <<EOF
+Usage: test_smbd_prefork.sh SERVER USERNAME PASSWORD SMBCLIENT SMBCONTROL SMBSTATUS CONFIGURATION
+EOF
+	exit 1
+fi
+
+SERVER=${1}
+USERNAME=${2}
+PASSWORD=${3}
+SMBCLIENT=${4}
+SMBCONTROL=${5}
+SMBSTATUS=${6}
+CONFIGURATION=${7}
+shift 7
+ADDARGS="$*"
+
+incdir=$(dirname "$0")/../../../testprogs/blackbox
+. "$incdir"/subunit.sh
+
+failed=0
+
+# The environment has "smbd:prefork children = 3"
+NUM_SPARES=3
+
+parent=$(${SMBCONTROL} ${CONFIGURATION} smbd ping |
+	sed -n 's/^PONG from pid \([0-9]*\)$/\1/p' | head -n 1)
+if [ -z "$parent" ]; then
+	echo "Could not find the smbd parent"
+	exit 1
+fi
+
+list_spares()
+{
+	for comm in /proc/[0-9]*/comm; do
+		dir=$(dirname "$comm")
+		pid=$(basename "$dir")
+		name=$(cat "$comm" 2>/dev/null)
+		if [ "$name" != "smbd[spare]" ]; then
+			continue
+		fi
+		ppid=$(sed -n 's/^PPid:[[:space:]]*//p' "$dir"/status 2>/dev/null)
+		if [ "$ppid" = "$parent" ]; then
+			echo "$pid"
+		fi
+	done
+}
+
+wait_spares()
+{
+	i=0
+	while [ $i -lt 20 ]; do
+		num=$(list_spares | wc -l)
+		if [ "$num" -ge ${NUM_SPARES} ]; then
+			return 0
+		fi
+		sleep 0.5
+		i=$((i + 1))
+	done
+	echo "Only $num spares, expected ${NUM_SPARES}"
+	return 1
+}
+
+ping_spares()
+{
+	for pid in $(list_spares); do
+		out=$(${SMBCONTROL} ${CONFIGURATION} --timeout=5 "$pid" ping)
+		if ! echo "$out" | grep -q "^PONG from pid ${pid}$"; then
+			echo "spare $pid did not answer: $out"
+			return 1
+		fi
+	done
+	return 0
+}
+
+test_sighup()
+{
+	pid=$(list_spares | head -n 1)
+	kill -HUP "$pid" || return 1
+	sleep 1
+	out=$(${SMBCONTROL} ${CONFIGURATION} --timeout=5 "$pid" ping)
+	if ! echo "$out" | grep -q "^PONG from pid ${pid}$"; then
+		echo "spare $pid did not survive SIGHUP: $out"
+		return 1
+	fi
+	return 0
+}
+
+test_sigterm()
+{
+	pid=$(list_spares | head -n 1)
+	kill -TERM "$pid" || return 1
+	i=0
+	while [ -d /proc/"$pid" ] && [ $i -lt 20 ]; do
+		sleep 0.5
+		i=$((i + 1))
+	done
+	if [ -d /proc/"$pid" ]; then
+		echo "spare $pid did not exit on SIGTERM"
+		return 1
+	fi
+	return 0
+}
+
+#
+# The parent forwards reload-config to all children, spares included.
+# They have to survive it and keep answering.
+#
+test_reload_config()
+{
+	before=$(list_spares | sort)
+	${SMBCONTROL} ${CONFIGURATION} smbd reload-config || return 1
+	sleep 1
+	ping_spares || return 1
+	for pid in $before; do
+		if [ ! -d /proc/"$pid" ]; then
+			echo "spare $pid did not survive reload-config"
+			return 1
+		fi
+	done
+	return 0
+}
+
+#
+# Keep a connection open and check that smbstatus shows it served by
+# one of the processes that were idle spares before.
+#
+test_handoff()
+{
+	spares=$(list_spares)
+
+	(sleep 4; echo quit) |
+		${SMBCLIENT} //"${SERVER}"/tmp -U"${USERNAME}"%"${PASSWORD}" \
+			${ADDARGS} >/dev/null 2>&1 &
+	client=$!
+	sleep 2
+
+	served=$(${SMBSTATUS} ${CONFIGURATION} -p 2>/dev/null |
+		awk '$1 ~ /^[0-9]+$/ { print $1 }')
+	wait $client
+
+	for pid in $served; do
+		for spare in $spares; do
+			if [ "$pid" = "$spare" ]; then
+				return 0
+			fi
+		done
+	done
+	echo "Sessions served by [$served], spares were [$spares]"
+	return 1
+}
+
+test_connections()
+{
+	i=0
+	while [ $i -lt 5 ]; do
+		${SMBCLIENT} //"${SERVER}"/tmp -U"${USERNAME}"%"${PASSWORD}" \
+			${ADDARGS} -c "ls" >/dev/null || return 1
+		i=$((i + 1))
+	done
+	return 0
+}
+
+testit "spares forked" wait_spares || failed=$((failed + 1))
+testit "spares answer messages" ping_spares || failed=$((failed + 1))
+testit "spare survives SIGHUP" test_sighup || failed=$((failed + 1))
+testit "spare exits on SIGTERM" test_sigterm || failed=$((failed + 1))
+testit "spares replenished" wait_spares || failed=$((failed + 1))
+testit "spares survive reload-config" test_reload_config ||
+	failed=$((failed + 1))
+testit "connection handed to a spare" test_handoff || failed=$((failed + 1))
+testit "sequential connections" test_connections || failed=$((failed + 1))
+testit "spares replenished after use" wait_spares || failed=$((failed + 1))
+
+testok "$0" "$failed"
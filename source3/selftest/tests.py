@@ -448,6 +448,17 @@ plantestsuite("samba3.smbtorture_s3.plain.%s" % "SMB2-LIST-DIR-ASYNC",
                 smbtorture3,
                 "",
                 "-l $LOCAL_PATH"])
+
+plantestsuite("samba3.blackbox.async_dosmode_batch",
+              "simpleserver:local",
+              [os.path.join(samba3srcdir,
+                            "script/tests/test_async_dosmode_batch.sh"),
+               "$SERVER_IP",
+               "$USERNAME",
+               "$PASSWORD",
+               smbclient3,
+               "$LOCAL_PATH",
+               configuration])
 #
 # SMB2-DEL-ON-CLOSE-NONEMPTY needs to run against a special fileserver share veto_files_delete
 #
@@ -565,13 +576,18 @@ local_tests = [
     "LOCAL-MESSAGING-FDPASS2a",
     "LOCAL-MESSAGING-FDPASS2b",
     "LOCAL-MESSAGING-SEND-ALL",
+    "LOCAL-MESSAGING-RINGS",
+    "LOCAL-NOTIFY-FANOTIFY",
+    "LOCAL-BRLOCK-INDEX",
     "LOCAL-PTHREADPOOL-TEVENT",
     "LOCAL-CANONICALIZE-PATH",
     "LOCAL-DBWRAP-WATCH1",
     "LOCAL-DBWRAP-WATCH2",
     "LOCAL-DBWRAP-WATCH3",
     "LOCAL-DBWRAP-WATCH4",
+    "LOCAL-DBWRAP-WATCH5",
     "LOCAL-DBWRAP-DO-LOCKED1",
+    "LOCAL-DBWRAP-CACHE1",
     "LOCAL-G-LOCK1",
     "LOCAL-G-LOCK2",
     "LOCAL-G-LOCK3",
@@ -1442,6 +1458,47 @@ for t in vfs_io_uring_tests:
     plansmbtorture4testsuite(t, "fileserver",
                              '//$SERVER_IP/io_uring -U$USERNAME%$PASSWORD',
                              "vfs_io_uring")
+    plansmbtorture4testsuite(t, "fileserver",
+                             '//$SERVER_IP/io_uring_options -U$USERNAME%$PASSWORD',
+                             "vfs_io_uring_options")
+
+plantestsuite("samba3.smbtorture_s3.IO-URING-FILES",
+              "fileserver",
+              [os.path.join(samba3srcdir,
+                            "script/tests/test_smbtorture_s3.sh"),
+               'IO-URING-FILES',
+               '//$SERVER_IP/io_uring_options',
+               '$USERNAME',
+               '$PASSWORD',
+               smbtorture3,
+               "",
+               "-l $LOCAL_PATH"])
+
+plantestsuite("samba3.smbtorture_s3.SHARE-MODE-CACHE",
+              "fileserver",
+              [os.path.join(samba3srcdir,
+                            "script/tests/test_smbtorture_s3.sh"),
+               'SHARE-MODE-CACHE',
+               '//$SERVER_IP/tmp',
+               '$USERNAME',
+               '$PASSWORD',
+               smbtorture3,
+               "",
+               "-l $LOCAL_PATH"])
+
+# DOS and FCB opens sharing an fd handle need SMB1
+plantestsuite("samba3.smbtorture_s3.FILES-HASH",
+              "fileserver_smb1",
+              [os.path.join(samba3srcdir,
+                            "script/tests/test_smbtorture_s3.sh"),
+               'FILES-HASH',
+               '//$SERVER_IP/tmp',
+               '$USERNAME',
+               '$PASSWORD',
+               smbtorture3,
+               "",
+               "-l $LOCAL_PATH",
+               "-mNT1"])
 
 test = 'rpc.lsa.lookupsids'
 auth_options = ["", "ntlm", "spnego", "spnego,ntlm", "spnego,smb1", "spnego,smb2"]
@@ -1808,6 +1865,76 @@ plantestsuite("samba3.blackbox.smbclient-bug15435",
                smbclient3,
                configuration])
 
+plantestsuite("samba3.blackbox.pathref_dircache",
+              "fileserver",
+              [os.path.join(samba3srcdir, "script/tests/test_pathref_dircache.sh"),
+               "$SERVER",
+               "$USERNAME",
+               "$PASSWORD",
+               smbclient3,
+               "$LOCAL_PATH/pathref_dircache",
+               "$PREFIX",
+               configuration])
+
+plantestsuite("samba3.smbtorture_s3.CASEFOLD-INDEX",
+              "fileserver",
+              [os.path.join(samba3srcdir,
+                            "script/tests/test_smbtorture_s3.sh"),
+               'CASEFOLD-INDEX',
+               '//$SERVER_IP/casefold_index',
+               '$USERNAME',
+               '$PASSWORD',
+               smbtorture3,
+               "",
+               "-l $LOCAL_PATH"])
+
+plantestsuite("samba3.blackbox.dirlist_cache",
+              "fileserver",
+              [os.path.join(samba3srcdir, "script/tests/test_dirlist_cache.sh"),
+               "$SERVER",
+               "$USERNAME",
+               "$PASSWORD",
+               smbclient3,
+               "$LOCAL_PATH/dirlist_cache",
+               configuration])
+
+plantestsuite("samba3.blackbox.smbd_prefork",
+              "fileserver_smb1:local",
+              [os.path.join(samba3srcdir, "script/tests/test_smbd_prefork.sh"),
+               "$SERVER_IP",
+               "$USERNAME",
+               "$PASSWORD",
+               smbclient3,
+               smbcontrol,
+               smbstatus,
+               configuration])
+
+for env in ["fileserver_zerocopy", "fileserver_async_encryption"]:
+    plantestsuite("samba3.blackbox.smbclient_large_read",
+                  "%s:local" % env,
+                  [os.path.join(samba3srcdir,
+                                "script/tests/test_smbclient_large_read.sh"),
+                   "$SERVER_IP",
+                   "$USERNAME",
+                   "$PASSWORD",
+                   smbclient3,
+                   "$LOCAL_PATH",
+                   configuration])
+
+#
+# "smbd async encryption threshold" is low in fileserver_async_encryption,
+# the responses are encrypted in the thread pool.
+#
+for t in ["smb2.rw", "smb2.read", "smb2.compound"]:
+    plansmbtorture4testsuite(t, "fileserver_async_encryption",
+                             '//$SERVER_IP/tmp -U$USERNAME%$PASSWORD '
+                             '--client-protection=encrypt',
+                             "async encryption")
+plansmbtorture4testsuite("smb2.compound_async", "fileserver_async_encryption",
+                         '//$SERVER_IP/aio_delay_inject '
+                         '-U$USERNAME%$PASSWORD --client-protection=encrypt',
+                         "async encryption")
+
 
 if have_cluster_support:
     t = "readdir-timestamp"
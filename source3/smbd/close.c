@@ -1576,6 +1576,8 @@ static NTSTATUS close_directory(struct smb_request *req, files_struct *fsp,
 
 	if (NT_STATUS_IS_OK(status)) {
 		notify_status = NT_STATUS_DELETE_PENDING;
+		dirlist_cache_forget(fsp);
+		casefold_index_forget(fsp);
 	}
 
 done:
@@ -30,6 +30,7 @@
 #include "lib/util/string_wrappers.h"
 #include "libcli/smb/reparse.h"
 #include "source3/smbd/dir.h"
+#include "source3/smbd/dir_cache_tdb.h"
 
 /*
    This module implements directory related functions for Samba.
@@ -50,6 +51,16 @@ struct smb_Dir {
 	bool case_sensitive;
 	files_struct *fsp; /* Back pointer to containing fsp, only
 			      set from OpenDir_fsp(). */
+
+	/*
+	 * Snapshot of the raw directory names, loaded from or stored
+	 * into the dirlist cache. See dir_hnd_load_names().
+	 */
+	bool use_cache;
+	bool names_loaded;
+	uint8_t *names_buf;
+	const char **names;
+	uint32_t num_names;
 };
 
 struct dptr_struct {
@@ -1148,6 +1159,9 @@ static NTSTATUS OpenDir_fsp(
 		dir_hnd->case_sensitive = conn->case_sensitive;
 	}
 
+	dir_hnd->use_cache = (fsp->fsp_name->twrp == 0) &&
+		lp_parm_bool(SNUM(conn), "smbd", "dirlist cache", false);
+
 	talloc_set_destructor(dir_hnd, smb_Dir_destructor);
 
 	*_dir_hnd = dir_hnd;
@@ -1159,6 +1173,346 @@ static NTSTATUS OpenDir_fsp(
 }
 
 
+/*******************************************************************
+ Cross-process cache of directory name lists.
+
+ Listing a huge directory through SMB_VFS_READDIR is expensive and
+ every smbd process doing it for the same directory repeats the
+ work. With "smbd:dirlist cache = yes" the raw names are stored in
+ dirlist_cache.tdb, see dir_cache_tdb.c for how records are keyed,
+ invalidated and evicted.
+
+ Only names are cached. Stat information, DOS attributes and
+ visibility are per entry or per user and still come from the
+ file system.
+********************************************************************/
+
+#define DIRLIST_CACHE_VERSION 2
+#define DIRLIST_CACHE_MAX_SIZE (16 * 1024 * 1024)
+
+static struct dir_cache_tdb *dirlist_cache_db(void)
+{
+	static struct dir_cache_tdb *db;
+	static bool failed;
+
+	if ((db != NULL) || failed) {
+		return db;
+	}
+
+	db = dir_cache_tdb_open(NULL,
+				"dirlist_cache.tdb",
+				lp_parm_ulonglong(GLOBAL_SECTION_SNUM,
+						  "smbd",
+						  "dirlist cache size",
+						  64 * 1024 * 1024));
+	failed = (db == NULL);
+	return db;
+}
+
+static void dir_hnd_drop_names(struct smb_Dir *dir_hnd)
+{
+	TALLOC_FREE(dir_hnd->names);
+	TALLOC_FREE(dir_hnd->names_buf);
+	dir_hnd->num_names = 0;
+	dir_hnd->names_loaded = false;
+}
+
+/*
+ * Set up dir_hnd->names pointing into dir_hnd->names_buf, which holds
+ * num_names NUL-terminated strings.
+ */
+static bool dir_hnd_index_names(struct smb_Dir *dir_hnd,
+				size_t buflen,
+				uint32_t num_names)
+{
+	const char *p = (const char *)dir_hnd->names_buf;
+	const char *end = p + buflen;
+	uint32_t i;
+
+	if ((buflen != 0) && (end[-1] != '\0')) {
+		return false;
+	}
+
+	dir_hnd->names = talloc_array(dir_hnd, const char *, num_names);
+	if (dir_hnd->names == NULL) {
+		return false;
+	}
+
+	for (i=0; i<num_names; i++) {
+		if (p >= end) {
+			return false;
+		}
+		dir_hnd->names[i] = p;
+		p += strlen(p) + 1;
+	}
+	if (p != end) {
+		return false;
+	}
+
+	dir_hnd->num_names = num_names;
+	return true;
+}
+
+/*
+ * Payload: number of names, NUL-terminated names
+ */
+static bool dirlist_cache_parser(const uint8_t *buf, size_t buflen,
+				 void *private_data)
+{
+	struct smb_Dir *dir_hnd = private_data;
+	uint32_t num_names;
+
+	if (buflen < 4) {
+		return false;
+	}
+	num_names = IVAL(buf, 0);
+
+	dir_hnd->names_buf = talloc_memdup(dir_hnd, buf + 4, buflen - 4);
+	if (dir_hnd->names_buf == NULL) {
+		return false;
+	}
+
+	return dir_hnd_index_names(dir_hnd, buflen - 4, num_names);
+}
+
+static bool dirlist_cache_fetch(struct smb_Dir *dir_hnd,
+				TDB_DATA key,
+				const SMB_STRUCT_STAT *st)
+{
+	struct dir_cache_tdb *db = dirlist_cache_db();
+	bool ok;
+
+	if (db == NULL) {
+		return false;
+	}
+
+	ok = dir_cache_tdb_parse(db, key, DIRLIST_CACHE_VERSION, st,
+				 dirlist_cache_parser, dir_hnd);
+	if (!ok) {
+		dir_hnd_drop_names(dir_hnd);
+		return false;
+	}
+	return true;
+}
+
+static void dirlist_cache_store(struct smb_Dir *dir_hnd,
+				TDB_DATA key,
+				const SMB_STRUCT_STAT *st,
+				size_t buflen)
+{
+	struct dir_cache_tdb *db = dirlist_cache_db();
+	uint8_t hdr[4];
+	TDB_DATA payload[] = {
+		{ .dptr = hdr, .dsize = sizeof(hdr) },
+		{ .dptr = dir_hnd->names_buf, .dsize = buflen },
+	};
+
+	if (db == NULL) {
+		return;
+	}
+
+	SIVAL(hdr, 0, dir_hnd->num_names);
+
+	dir_cache_tdb_store(db, key, DIRLIST_CACHE_VERSION, st,
+			    payload, ARRAY_SIZE(payload));
+}
+
+/*
+ * The directory dirfsp was removed, drop its list. Records of other
+ * users are found stale or evicted later.
+ */
+void dirlist_cache_forget(struct files_struct *dirfsp)
+{
+	struct connection_struct *conn = dirfsp->conn;
+	struct dir_cache_tdb *db = NULL;
+	TDB_DATA key;
+
+	if (!lp_parm_bool(SNUM(conn), "smbd", "dirlist cache", false)) {
+		return;
+	}
+	db = dirlist_cache_db();
+	if (db == NULL) {
+		return;
+	}
+	key = dir_cache_tdb_key(talloc_tos(), conn, &dirfsp->file_id);
+	if (key.dptr == NULL) {
+		return;
+	}
+	dir_cache_tdb_delete(db, key);
+	TALLOC_FREE(key.dptr);
+}
+
+/*
+ * Read all names from the directory into dir_hnd->names_buf. Returns
+ * false if the directory is too large to be worth keeping in memory
+ * or reading it failed.
+ */
+static bool dir_hnd_read_names(struct smb_Dir *dir_hnd,
+			       size_t *_buflen,
+			       uint32_t *_num_names)
+{
+	connection_struct *conn = dir_hnd->conn;
+	size_t buflen = 0;
+	size_t bufsize = 0;
+	uint32_t num_names = 0;
+
+	while (true) {
+		struct dirent *de = NULL;
+		size_t namelen;
+
+		errno = 0;
+		de = SMB_VFS_READDIR(conn, dir_hnd->fsp, dir_hnd->dir);
+		if (de == NULL) {
+			if (errno != 0) {
+				return false;
+			}
+			break;
+		}
+		if (ISDOT(de->d_name) || ISDOTDOT(de->d_name)) {
+			continue;
+		}
+
+		namelen = strlen(de->d_name) + 1;
+		if (buflen + namelen > DIRLIST_CACHE_MAX_SIZE) {
+			return false;
+		}
+		if (buflen + namelen > bufsize) {
+			uint8_t *tmp = NULL;
+
+			bufsize = MAX(bufsize * 2, 4096);
+			bufsize = MAX(bufsize, buflen + namelen);
+			tmp = talloc_realloc(dir_hnd,
+					     dir_hnd->names_buf,
+					     uint8_t,
+					     bufsize);
+			if (tmp == NULL) {
+				return false;
+			}
+			dir_hnd->names_buf = tmp;
+		}
+		memcpy(dir_hnd->names_buf + buflen, de->d_name, namelen);
+		buflen += namelen;
+		num_names += 1;
+	}
+
+	*_buflen = buflen;
+	*_num_names = num_names;
+	return true;
+}
+
+/*
+ * Fill dir_hnd->names either from the dirlist cache or from the
+ * directory itself. If this fails, ReadDirName() falls back to
+ * reading the directory entry by entry.
+ */
+static void dir_hnd_load_names(struct smb_Dir *dir_hnd)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	connection_struct *conn = dir_hnd->conn;
+	SMB_STRUCT_STAT st;
+	size_t buflen = 0;
+	uint32_t num_names = 0;
+	int min_entries;
+	TDB_DATA key;
+	bool ok;
+	int ret;
+
+	/*
+	 * Only the first read of a scan decides, don't try again.
+	 */
+	dir_hnd->use_cache = false;
+
+	ret = SMB_VFS_FSTAT(dir_hnd->fsp, &st);
+	if (ret == -1) {
+		goto done;
+	}
+
+	key = dir_cache_tdb_key(frame, conn, &dir_hnd->fsp->file_id);
+	if (key.dptr == NULL) {
+		goto done;
+	}
+
+	ok = dirlist_cache_fetch(dir_hnd, key, &st);
+	if (ok) {
+		DBG_DEBUG("%s: %"PRIu32" names from cache\n",
+			  smb_fname_str_dbg(dir_hnd->dir_smb_fname),
+			  dir_hnd->num_names);
+		dir_hnd->names_loaded = true;
+		dir_hnd->use_cache = true;
+		goto done;
+	}
+
+	ok = dir_hnd_read_names(dir_hnd, &buflen, &num_names);
+	if (!ok) {
+		goto fallback;
+	}
+	ok = dir_hnd_index_names(dir_hnd, buflen, num_names);
+	if (!ok) {
+		goto fallback;
+	}
+	dir_hnd->names_loaded = true;
+	dir_hnd->use_cache = true;
+
+	/*
+	 * Small directories are cheap to list, don't bloat the
+	 * cache with them.
+	 */
+	min_entries = lp_parm_int(SNUM(conn),
+				  "smbd",
+				  "dirlist cache min entries",
+				  1024);
+	if (num_names < (uint32_t)MAX(min_entries, 0)) {
+		goto done;
+	}
+
+	ok = dir_cache_tdb_stable(dir_hnd->fsp, &st);
+	if (!ok) {
+		goto done;
+	}
+
+	dirlist_cache_store(dir_hnd, key, &st, buflen);
+	goto done;
+
+fallback:
+	dir_hnd_drop_names(dir_hnd);
+	SMB_VFS_REWINDDIR(conn, dir_hnd->dir);
+done:
+	TALLOC_FREE(frame);
+}
+
+static const char *dir_hnd_cached_name(struct smb_Dir *dir_hnd,
+				       char **ptalloced)
+{
+	unsigned int idx = dir_hnd->file_number - 2;
+	const char *dname = NULL;
+	char *translated = NULL;
+	NTSTATUS status;
+
+	*ptalloced = NULL;
+
+	if (idx >= dir_hnd->num_names) {
+		return NULL;
+	}
+	dname = dir_hnd->names[idx];
+
+	/*
+	 * Same as vfs_readdirname()
+	 */
+	status = SMB_VFS_TRANSLATE_NAME(dir_hnd->conn,
+					dname,
+					vfs_translate_to_windows,
+					talloc_tos(),
+					&translated);
+	if (NT_STATUS_EQUAL(status, NT_STATUS_NONE_MAPPED)) {
+		return dname;
+	}
+	*ptalloced = translated;
+	if (!NT_STATUS_IS_OK(status)) {
+		return NULL;
+	}
+	return translated;
+}
+
 /*******************************************************************
  Read from a directory.
  Return directory entry, current offset, and optional stat information.
@@ -1182,6 +1536,17 @@ const char *ReadDirName(struct smb_Dir *dir_hnd, char **ptalloced)
 		return n;
 	}
 
+	if (dir_hnd->use_cache && !dir_hnd->names_loaded) {
+		dir_hnd_load_names(dir_hnd);
+	}
+	if (dir_hnd->names_loaded) {
+		n = dir_hnd_cached_name(dir_hnd, ptalloced);
+		if (n != NULL) {
+			dir_hnd->file_number++;
+		}
+		return n;
+	}
+
 	while ((n = vfs_readdirname(conn,
 				    dir_hnd->fsp,
 				    dir_hnd->dir,
@@ -1207,6 +1572,12 @@ void RewindDir(struct smb_Dir *dir_hnd)
 {
 	SMB_VFS_REWINDDIR(dir_hnd->conn, dir_hnd->dir);
 	dir_hnd->file_number = 0;
+
+	/*
+	 * A restarted scan has to see changes done in the meantime,
+	 * revalidate against the cache on the next ReadDirName().
+	 */
+	dir_hnd_drop_names(dir_hnd);
 }
 
 struct files_below_forall_state {
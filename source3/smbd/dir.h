@@ -50,6 +50,7 @@ const char *dptr_wcard(struct smbd_server_connection *sconn, int key);
 bool have_file_open_below(connection_struct *conn,
 			  const struct smb_filename *name);
 bool init_dptrs(struct smbd_server_connection *sconn);
+void dirlist_cache_forget(struct files_struct *dirfsp);
 bool is_visible_fsp(files_struct *fsp);
 NTSTATUS OpenDir(TALLOC_CTX *mem_ctx,
 		 connection_struct *conn,
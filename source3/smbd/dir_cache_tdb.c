@@ -0,0 +1,476 @@
+/*
+   Unix SMB/CIFS implementation.
+   Cross-process caches of per-directory data
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * A tdb in the cache directory holding data derived from the
+ * contents of directories, shared by all smbd processes.
+ *
+ * Records are keyed by the file_id of the directory, the uid of the
+ * user and the share: VFS modules can show different users different
+ * names in the same directory. A record is only valid while mtime and
+ * ctime of the directory are unchanged, so any create, rename or
+ * delete in the directory invalidates it. Invalid records are deleted
+ * when they are found.
+ *
+ * The sum of key and data sizes of all records is kept below a limit.
+ * When a store exceeds it, the oldest records are thrown out.
+ *
+ * Record layout, all integers little endian:
+ *
+ *   version, mtime (sec, nsec), ctime (sec, nsec), time stored
+ *   payload
+ */
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "smbd/smbd.h"
+#include "util_tdb.h"
+#include "lib/tdb_wrap/tdb_wrap.h"
+#include "lib/util/tsort.h"
+#include "source3/lib/file_id.h"
+#include "source3/smbd/dir_cache_tdb.h"
+
+#define DIR_CACHE_TDB_HDR_LEN (4 + 12 + 12 + 8)
+
+/*
+ * Can't collide with a record key, they are longer
+ */
+#define DIR_CACHE_TDB_SIZE_KEY "SIZE"
+
+struct dir_cache_tdb {
+	struct tdb_wrap *db;
+	uint64_t max_size;
+};
+
+struct dir_cache_tdb *dir_cache_tdb_open(TALLOC_CTX *mem_ctx,
+					 const char *name,
+					 uint64_t max_size)
+{
+	struct dir_cache_tdb *c = NULL;
+	char *db_path = NULL;
+	int ret;
+
+	c = talloc_zero(mem_ctx, struct dir_cache_tdb);
+	if (c == NULL) {
+		return NULL;
+	}
+	c->max_size = max_size;
+
+	db_path = cache_path(c, name);
+	if (db_path == NULL) {
+		TALLOC_FREE(c);
+		return NULL;
+	}
+
+	/*
+	 * Directory contents are none of the business of other local
+	 * users.
+	 */
+	c->db = tdb_wrap_open(c, db_path, 0,
+			      TDB_INCOMPATIBLE_HASH | TDB_CLEAR_IF_FIRST,
+			      O_CREAT | O_RDWR, 0600);
+	if (c->db == NULL) {
+		DBG_ERR("Failed to open %s: %s\n", db_path, strerror(errno));
+		TALLOC_FREE(c);
+		return NULL;
+	}
+
+	/*
+	 * An older version created the file world readable
+	 */
+	ret = fchmod(tdb_fd(c->db->tdb), 0600);
+	if (ret == -1) {
+		DBG_ERR("fchmod on %s failed: %s\n", db_path, strerror(errno));
+		TALLOC_FREE(c);
+		return NULL;
+	}
+
+	TALLOC_FREE(db_path);
+	return c;
+}
+
+TDB_DATA dir_cache_tdb_key(TALLOC_CTX *mem_ctx,
+			   struct connection_struct *conn,
+			   const struct file_id *id)
+{
+	const char *servicename = lp_const_servicename(SNUM(conn));
+	size_t namelen = strlen(servicename);
+	uint8_t *buf = NULL;
+
+	buf = talloc_array(mem_ctx, uint8_t, 24 + 8 + namelen);
+	if (buf == NULL) {
+		return tdb_null;
+	}
+	push_file_id_24((char *)buf, id);
+	SBVAL(buf, 24, (uint64_t)get_current_uid(conn));
+	memcpy(buf + 32, servicename, namelen);
+
+	return make_tdb_data(buf, 32 + namelen);
+}
+
+struct dir_cache_tdb_parse_state {
+	uint32_t version;
+	const SMB_STRUCT_STAT *st;
+	bool (*parser)(const uint8_t *buf, size_t buflen, void *private_data);
+	void *private_data;
+	bool stale;
+	bool ok;
+};
+
+static int dir_cache_tdb_parser(TDB_DATA key, TDB_DATA data,
+				void *private_data)
+{
+	struct dir_cache_tdb_parse_state *state = private_data;
+	const SMB_STRUCT_STAT *st = state->st;
+
+	if ((data.dsize < DIR_CACHE_TDB_HDR_LEN) ||
+	    (IVAL(data.dptr, 0) != state->version)) {
+		state->stale = true;
+		return 0;
+	}
+	if ((BVAL(data.dptr, 4) != (uint64_t)st->st_ex_mtime.tv_sec) ||
+	    (IVAL(data.dptr, 12) != (uint32_t)st->st_ex_mtime.tv_nsec) ||
+	    (BVAL(data.dptr, 16) != (uint64_t)st->st_ex_ctime.tv_sec) ||
+	    (IVAL(data.dptr, 24) != (uint32_t)st->st_ex_ctime.tv_nsec)) {
+		DBG_DEBUG("stale record\n");
+		state->stale = true;
+		return 0;
+	}
+
+	state->ok = state->parser(data.dptr + DIR_CACHE_TDB_HDR_LEN,
+				  data.dsize - DIR_CACHE_TDB_HDR_LEN,
+				  state->private_data);
+	return 0;
+}
+
+/*
+ * Call "parser" with the payload of the record for "key" if it is
+ * valid for a directory with stat info "st". Returns what "parser"
+ * returned, false if there is no valid record.
+ */
+bool dir_cache_tdb_parse(struct dir_cache_tdb *c,
+			 TDB_DATA key,
+			 uint32_t version,
+			 const SMB_STRUCT_STAT *st,
+			 bool (*parser)(const uint8_t *buf,
+					size_t buflen,
+					void *private_data),
+			 void *private_data)
+{
+	struct dir_cache_tdb_parse_state state = {
+		.version = version,
+		.st = st,
+		.parser = parser,
+		.private_data = private_data,
+	};
+
+	tdb_parse_record(c->db->tdb, key, dir_cache_tdb_parser, &state);
+
+	if (state.stale) {
+		/*
+		 * The directory changed, or it is gone and a new one
+		 * got its file_id. Nobody can use this record anymore.
+		 */
+		dir_cache_tdb_delete(c, key);
+	}
+
+	return state.ok;
+}
+
+/*
+ * Changes within the granularity of the file system timestamps would
+ * not be visible in mtime/ctime. Only data of directories that have
+ * been quiet for a while and that did not change since "st" was
+ * taken can be stored.
+ */
+bool dir_cache_tdb_stable(struct files_struct *dirfsp,
+			  const SMB_STRUCT_STAT *st)
+{
+	SMB_STRUCT_STAT st2;
+	int ret;
+
+	if (timespec_elapsed(&st->st_ex_ctime) < 1.0) {
+		return false;
+	}
+	ret = SMB_VFS_FSTAT(dirfsp, &st2);
+	if (ret == -1) {
+		return false;
+	}
+	if ((timespec_compare(&st->st_ex_mtime, &st2.st_ex_mtime) != 0) ||
+	    (timespec_compare(&st->st_ex_ctime, &st2.st_ex_ctime) != 0)) {
+		return false;
+	}
+	return true;
+}
+
+static int dir_cache_tdb_size_parser(TDB_DATA key, TDB_DATA data,
+				     void *private_data)
+{
+	uint64_t *size = private_data;
+	*size = key.dsize + data.dsize;
+	return 0;
+}
+
+static int dir_cache_tdb_total_parser(TDB_DATA key, TDB_DATA data,
+				      void *private_data)
+{
+	uint64_t *total = private_data;
+	if (data.dsize == sizeof(uint64_t)) {
+		*total = BVAL(data.dptr, 0);
+	}
+	return 0;
+}
+
+/*
+ * Adjust the size counter by "delta", or set it to "*pset". Returns
+ * the new total.
+ */
+static uint64_t dir_cache_tdb_update_size(struct dir_cache_tdb *c,
+					  int64_t delta,
+					  const uint64_t *pset)
+{
+	struct tdb_context *tdb = c->db->tdb;
+	TDB_DATA key = string_term_tdb_data(DIR_CACHE_TDB_SIZE_KEY);
+	uint64_t total = 0;
+	uint8_t buf[8];
+	int ret;
+
+	ret = tdb_chainlock(tdb, key);
+	if (ret != 0) {
+		return 0;
+	}
+
+	if (pset != NULL) {
+		total = *pset;
+	} else {
+		tdb_parse_record(tdb, key, dir_cache_tdb_total_parser, &total);
+
+		if ((delta < 0) && ((uint64_t)-delta > total)) {
+			total = 0;
+		} else {
+			total += delta;
+		}
+	}
+	SBVAL(buf, 0, total);
+
+	ret = tdb_store(tdb, key, make_tdb_data(buf, sizeof(buf)),
+			TDB_REPLACE);
+	if (ret != 0) {
+		DBG_DEBUG("tdb_store failed: %s\n", tdb_errorstr(tdb));
+	}
+
+	tdb_chainunlock(tdb, key);
+	return total;
+}
+
+struct dir_cache_tdb_evict_rec {
+	uint64_t stored;
+	uint64_t size;
+	TDB_DATA key;
+};
+
+struct dir_cache_tdb_evict_state {
+	TALLOC_CTX *mem_ctx;
+	struct dir_cache_tdb_evict_rec *recs;
+	size_t num_recs;
+	uint64_t total;
+};
+
+static int dir_cache_tdb_evict_fn(struct tdb_context *tdb,
+				  TDB_DATA key,
+				  TDB_DATA data,
+				  void *private_data)
+{
+	struct dir_cache_tdb_evict_state *state = private_data;
+	struct dir_cache_tdb_evict_rec *rec = NULL;
+
+	if (tdb_data_equal(key,
+			   string_term_tdb_data(DIR_CACHE_TDB_SIZE_KEY))) {
+		return 0;
+	}
+
+	if (state->num_recs == talloc_array_length(state->recs)) {
+		size_t n = MAX(state->num_recs * 2, 64);
+		struct dir_cache_tdb_evict_rec *tmp = NULL;
+
+		tmp = talloc_realloc(state->mem_ctx,
+				     state->recs,
+				     struct dir_cache_tdb_evict_rec,
+				     n);
+		if (tmp == NULL) {
+			return -1;
+		}
+		state->recs = tmp;
+	}
+
+	rec = &state->recs[state->num_recs];
+	*rec = (struct dir_cache_tdb_evict_rec) {
+		.size = key.dsize + data.dsize,
+	};
+	if (data.dsize >= DIR_CACHE_TDB_HDR_LEN) {
+		rec->stored = BVAL(data.dptr, 28);
+	}
+	rec->key.dptr = talloc_memdup(state->recs, key.dptr, key.dsize);
+	if (rec->key.dptr == NULL) {
+		return -1;
+	}
+	rec->key.dsize = key.dsize;
+
+	state->num_recs += 1;
+	state->total += rec->size;
+	return 0;
+}
+
+static int dir_cache_tdb_evict_cmp(const struct dir_cache_tdb_evict_rec *r1,
+				   const struct dir_cache_tdb_evict_rec *r2)
+{
+	if (r1->stored < r2->stored) {
+		return -1;
+	}
+	if (r1->stored > r2->stored) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Throw out the oldest records until we are down to 3/4 of the limit,
+ * so that not every following store has to do this again. This also
+ * brings the size counter back in line if it drifted.
+ */
+static void dir_cache_tdb_evict(struct dir_cache_tdb *c)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct dir_cache_tdb_evict_state state = { .mem_ctx = frame };
+	struct tdb_context *tdb = c->db->tdb;
+	uint64_t target = c->max_size / 4 * 3;
+	uint64_t total;
+	size_t i;
+	int ret;
+
+	ret = tdb_traverse_read(tdb, dir_cache_tdb_evict_fn, &state);
+	if (ret == -1) {
+		DBG_DEBUG("tdb_traverse_read failed\n");
+		TALLOC_FREE(frame);
+		return;
+	}
+
+	TYPESAFE_QSORT(state.recs, state.num_recs, dir_cache_tdb_evict_cmp);
+
+	total = state.total;
+
+	for (i=0; (i<state.num_recs) && (total > target); i++) {
+		ret = tdb_delete(tdb, state.recs[i].key);
+		if (ret == 0) {
+			total -= state.recs[i].size;
+		}
+	}
+
+	DBG_DEBUG("Evicted %zu of %zu records, %"PRIu64" bytes left\n",
+		  i, state.num_recs, total);
+
+	dir_cache_tdb_update_size(c, 0, &total);
+
+	TALLOC_FREE(frame);
+}
+
+/*
+ * Store the payload for the directory with stat info "st"
+ */
+void dir_cache_tdb_store(struct dir_cache_tdb *c,
+			 TDB_DATA key,
+			 uint32_t version,
+			 const SMB_STRUCT_STAT *st,
+			 const TDB_DATA *payload,
+			 size_t num_payload)
+{
+	struct tdb_context *tdb = c->db->tdb;
+	uint8_t hdr[DIR_CACHE_TDB_HDR_LEN];
+	TDB_DATA dbufs[4];
+	uint64_t old_size = 0;
+	uint64_t new_size;
+	uint64_t total;
+	size_t i;
+	int ret;
+
+	SMB_ASSERT(num_payload < ARRAY_SIZE(dbufs));
+
+	SIVAL(hdr, 0, version);
+	SBVAL(hdr, 4, st->st_ex_mtime.tv_sec);
+	SIVAL(hdr, 12, st->st_ex_mtime.tv_nsec);
+	SBVAL(hdr, 16, st->st_ex_ctime.tv_sec);
+	SIVAL(hdr, 24, st->st_ex_ctime.tv_nsec);
+	SBVAL(hdr, 28, time(NULL));
+
+	dbufs[0] = make_tdb_data(hdr, sizeof(hdr));
+	new_size = key.dsize + sizeof(hdr);
+
+	for (i=0; i<num_payload; i++) {
+		dbufs[i+1] = payload[i];
+		new_size += payload[i].dsize;
+	}
+
+	if (new_size > c->max_size) {
+		DBG_DEBUG("%"PRIu64" bytes exceed the limit of %"PRIu64"\n",
+			  new_size, c->max_size);
+		return;
+	}
+
+	ret = tdb_chainlock(tdb, key);
+	if (ret != 0) {
+		return;
+	}
+	tdb_parse_record(tdb, key, dir_cache_tdb_size_parser, &old_size);
+	ret = tdb_storev(tdb, key, dbufs, num_payload + 1, TDB_REPLACE);
+	tdb_chainunlock(tdb, key);
+
+	if (ret != 0) {
+		DBG_DEBUG("tdb_storev failed: %s\n", tdb_errorstr(tdb));
+		return;
+	}
+
+	total = dir_cache_tdb_update_size(
+		c, (int64_t)new_size - (int64_t)old_size, NULL);
+	if (total > c->max_size) {
+		dir_cache_tdb_evict(c);
+	}
+}
+
+void dir_cache_tdb_delete(struct dir_cache_tdb *c, TDB_DATA key)
+{
+	struct tdb_context *tdb = c->db->tdb;
+	uint64_t old_size = 0;
+	int ret;
+
+	ret = tdb_chainlock(tdb, key);
+	if (ret != 0) {
+		return;
+	}
+	tdb_parse_record(tdb, key, dir_cache_tdb_size_parser, &old_size);
+	if (old_size != 0) {
+		ret = tdb_delete(tdb, key);
+		if (ret != 0) {
+			old_size = 0;
+		}
+	}
+	tdb_chainunlock(tdb, key);
+
+	if (old_size != 0) {
+		dir_cache_tdb_update_size(c, -(int64_t)old_size, NULL);
+	}
+}
@@ -0,0 +1,53 @@
+/*
+   Unix SMB/CIFS implementation.
+   Cross-process caches of per-directory data
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SMBD_DIR_CACHE_TDB_H_
+#define _SMBD_DIR_CACHE_TDB_H_
+
+struct dir_cache_tdb;
+
+struct dir_cache_tdb *dir_cache_tdb_open(TALLOC_CTX *mem_ctx,
+					 const char *name,
+					 uint64_t max_size);
+
+TDB_DATA dir_cache_tdb_key(TALLOC_CTX *mem_ctx,
+			   struct connection_struct *conn,
+			   const struct file_id *id);
+
+bool dir_cache_tdb_parse(struct dir_cache_tdb *c,
+			 TDB_DATA key,
+			 uint32_t version,
+			 const SMB_STRUCT_STAT *st,
+			 bool (*parser)(const uint8_t *buf,
+					size_t buflen,
+					void *private_data),
+			 void *private_data);
+
+bool dir_cache_tdb_stable(struct files_struct *dirfsp,
+			  const SMB_STRUCT_STAT *st);
+
+void dir_cache_tdb_store(struct dir_cache_tdb *c,
+			 TDB_DATA key,
+			 uint32_t version,
+			 const SMB_STRUCT_STAT *st,
+			 const TDB_DATA *payload,
+			 size_t num_payload);
+
+void dir_cache_tdb_delete(struct dir_cache_tdb *c, TDB_DATA key);
+
+#endif
@@ -675,7 +675,7 @@ NTSTATUS vfs_default_durable_reconnect(struct connection_struct *conn,
 	}
 
 	fh_set_private_options(fsp->fh, e.private_options);
-	fsp->file_id = file_id;
+	fsp_set_file_id(fsp, file_id);
 	fsp->file_pid = smb1req->smbpid;
 	fsp->vuid = smb1req->vuid;
 	fsp->open_time = e.time;
@@ -18,6 +18,7 @@
 */
 
 #include "includes.h"
+#include "smbd/smbd.h"
 #include "fd_handle.h"
 
 struct fd_handle {
@@ -144,4 +145,5 @@ void fsp_set_fd(struct files_struct *fsp, int fd)
 		   fd == AT_FDCWD);
 
 	fsp->fh->fd = fd;
+	file_fd_changed(fsp);
 }
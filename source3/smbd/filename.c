@@ -31,6 +31,7 @@
 #include "smbd/globals.h"
 #include "libcli/smb/reparse.h"
 #include "source3/smbd/dir.h"
+#include "source3/smbd/dir_cache_tdb.h"
 
 uint32_t ucf_flags_from_smb_request(struct smb_request *req)
 {
@@ -262,6 +263,421 @@ static bool sname_equal(const char *name1, const char *name2,
 	return match;
 }
 
+/****************************************************************************
+ Cross-process case-insensitive name index.
+
+ On a case sensitive file system every miss of a case-insensitive
+ lookup has to scan the whole directory. With "smbd:casefold index =
+ yes" the first such scan also builds an open-addressed hash table of
+ the upper-cased names and stores it in casefold_index.tdb. Later
+ misses in the same directory, from any smbd, are answered by probing
+ that table. Keys, invalidation and eviction work like for the
+ dirlist cache in dir.c, see dir_cache_tdb.c.
+
+ Payload layout, all integers little endian:
+
+   num_slots
+   num_slots * { hash, name offset + 1, 0 for an empty slot }
+   NUL-terminated names
+****************************************************************************/
+
+#define CASEFOLD_INDEX_VERSION 2
+#define CASEFOLD_INDEX_SLOT_LEN 8
+#define CASEFOLD_INDEX_MAX_SIZE (16 * 1024 * 1024)
+
+static struct dir_cache_tdb *casefold_index_db(void)
+{
+	static struct dir_cache_tdb *db;
+	static bool failed;
+
+	if ((db != NULL) || failed) {
+		return db;
+	}
+
+	db = dir_cache_tdb_open(NULL,
+				"casefold_index.tdb",
+				lp_parm_ulonglong(GLOBAL_SECTION_SNUM,
+						  "smbd",
+						  "casefold index size",
+						  64 * 1024 * 1024));
+	failed = (db == NULL);
+	return db;
+}
+
+/*
+ * strequal() compares upper-cased codepoints, so names it considers
+ * equal end up in the same slot chain.
+ */
+static bool casefold_index_hash(const char *name, uint32_t *_hash)
+{
+	char *upper = NULL;
+	TDB_DATA data;
+
+	upper = talloc_strdup_upper(talloc_tos(), name);
+	if (upper == NULL) {
+		return false;
+	}
+	data = make_tdb_data((uint8_t *)upper, strlen(upper));
+	*_hash = tdb_jenkins_hash(&data);
+	TALLOC_FREE(upper);
+	return true;
+}
+
+struct casefold_index_parse_state {
+	const char *name;
+	uint32_t hash;
+	TALLOC_CTX *mem_ctx;
+	char *found_name;
+	NTSTATUS status;
+};
+
+static bool casefold_index_parser(const uint8_t *buf, size_t buflen,
+				  void *private_data)
+{
+	struct casefold_index_parse_state *state = private_data;
+	const uint8_t *slots = NULL;
+	const char *names = NULL;
+	size_t names_len;
+	uint32_t num_slots, i;
+
+	if (buflen < 4) {
+		return false;
+	}
+
+	num_slots = IVAL(buf, 0);
+	if ((num_slots == 0) || ((num_slots & (num_slots - 1)) != 0)) {
+		return false;
+	}
+	if (num_slots > (buflen - 4) / CASEFOLD_INDEX_SLOT_LEN) {
+		return false;
+	}
+	slots = buf + 4;
+	names = (const char *)slots +
+		(size_t)num_slots * CASEFOLD_INDEX_SLOT_LEN;
+	names_len = buflen - PTR_DIFF(names, buf);
+
+	if ((names_len != 0) && (names[names_len - 1] != '\0')) {
+		return false;
+	}
+
+	for (i=0; i<num_slots; i++) {
+		const uint8_t *slot = slots +
+			(size_t)((state->hash + i) & (num_slots - 1)) *
+			CASEFOLD_INDEX_SLOT_LEN;
+		uint32_t ofs = IVAL(slot, 4);
+
+		if (ofs == 0) {
+			break;
+		}
+		if (IVAL(slot, 0) != state->hash) {
+			continue;
+		}
+		ofs -= 1;
+		if (ofs >= names_len) {
+			return false;
+		}
+		if (strequal(state->name, names + ofs)) {
+			state->found_name = talloc_strdup(state->mem_ctx,
+							  names + ofs);
+			state->status = (state->found_name != NULL) ?
+				NT_STATUS_OK : NT_STATUS_NO_MEMORY;
+			return true;
+		}
+	}
+
+	state->status = NT_STATUS_OBJECT_NAME_NOT_FOUND;
+	return true;
+}
+
+struct casefold_index_builder {
+	uint8_t *names_buf;
+	size_t buflen;
+	size_t bufsize;
+	uint32_t *offsets;
+	uint32_t *hashes;
+	uint32_t num_names;
+	bool failed;
+};
+
+static void casefold_index_add(struct casefold_index_builder *b,
+			       const char *name)
+{
+	size_t namelen = strlen(name) + 1;
+	uint32_t hash;
+	bool ok;
+
+	if (b->failed) {
+		return;
+	}
+
+	if (b->buflen + namelen > CASEFOLD_INDEX_MAX_SIZE) {
+		goto fail;
+	}
+
+	ok = casefold_index_hash(name, &hash);
+	if (!ok) {
+		goto fail;
+	}
+
+	if (b->buflen + namelen > b->bufsize) {
+		uint8_t *tmp = NULL;
+
+		b->bufsize = MAX(b->bufsize * 2, 4096);
+		b->bufsize = MAX(b->bufsize, b->buflen + namelen);
+		tmp = talloc_realloc(b, b->names_buf, uint8_t, b->bufsize);
+		if (tmp == NULL) {
+			goto fail;
+		}
+		b->names_buf = tmp;
+	}
+	if (b->num_names == talloc_array_length(b->offsets)) {
+		size_t n = MAX(b->num_names * 2, 256);
+		uint32_t *tmp = NULL;
+
+		tmp = talloc_realloc(b, b->offsets, uint32_t, n);
+		if (tmp == NULL) {
+			goto fail;
+		}
+		b->offsets = tmp;
+		tmp = talloc_realloc(b, b->hashes, uint32_t, n);
+		if (tmp == NULL) {
+			goto fail;
+		}
+		b->hashes = tmp;
+	}
+
+	memcpy(b->names_buf + b->buflen, name, namelen);
+	b->offsets[b->num_names] = b->buflen;
+	b->hashes[b->num_names] = hash;
+	b->buflen += namelen;
+	b->num_names += 1;
+	return;
+
+fail:
+	b->failed = true;
+	TALLOC_FREE(b->names_buf);
+	TALLOC_FREE(b->offsets);
+	TALLOC_FREE(b->hashes);
+}
+
+static void casefold_index_store(struct casefold_index_builder *b,
+				 TDB_DATA key,
+				 const SMB_STRUCT_STAT *st)
+{
+	struct dir_cache_tdb *db = casefold_index_db();
+	uint8_t hdr[4];
+	TDB_DATA payload[3];
+	uint8_t *slots = NULL;
+	size_t slots_len;
+	uint32_t num_slots = 8;
+	uint32_t i;
+
+	if (db == NULL) {
+		return;
+	}
+
+	/*
+	 * Keep the load factor at or below 1/2 so that probe
+	 * sequences stay short and misses hit an empty slot quickly.
+	 */
+	while (num_slots < b->num_names * 2) {
+		num_slots *= 2;
+	}
+
+	slots_len = (size_t)num_slots * CASEFOLD_INDEX_SLOT_LEN;
+
+	slots = talloc_zero_array(b, uint8_t, slots_len);
+	if (slots == NULL) {
+		return;
+	}
+
+	for (i=0; i<b->num_names; i++) {
+		uint32_t idx = b->hashes[i] & (num_slots - 1);
+		uint8_t *slot = slots + (size_t)idx * CASEFOLD_INDEX_SLOT_LEN;
+
+		while (IVAL(slot, 4) != 0) {
+			idx = (idx + 1) & (num_slots - 1);
+			slot = slots + (size_t)idx * CASEFOLD_INDEX_SLOT_LEN;
+		}
+		SIVAL(slot, 0, b->hashes[i]);
+		SIVAL(slot, 4, b->offsets[i] + 1);
+	}
+
+	SIVAL(hdr, 0, num_slots);
+
+	payload[0] = make_tdb_data(hdr, sizeof(hdr));
+	payload[1] = make_tdb_data(slots, slots_len);
+	payload[2] = make_tdb_data(b->names_buf, b->buflen);
+
+	dir_cache_tdb_store(db, key, CASEFOLD_INDEX_VERSION, st,
+			    payload, ARRAY_SIZE(payload));
+	TALLOC_FREE(slots);
+}
+
+/*
+ * The directory dirfsp was removed, drop its index. Records of other
+ * users are found stale or evicted later.
+ */
+void casefold_index_forget(struct files_struct *dirfsp)
+{
+	struct connection_struct *conn = dirfsp->conn;
+	struct dir_cache_tdb *db = NULL;
+	TDB_DATA key;
+
+	if (!lp_parm_bool(SNUM(conn), "smbd", "casefold index", false)) {
+		return;
+	}
+	db = casefold_index_db();
+	if (db == NULL) {
+		return;
+	}
+	key = dir_cache_tdb_key(talloc_tos(), conn, &dirfsp->file_id);
+	if (key.dptr == NULL) {
+		return;
+	}
+	dir_cache_tdb_delete(db, key);
+	TALLOC_FREE(key.dptr);
+}
+
+/*
+ * Look up "name" in the casefold index of dirfsp. If there is no
+ * valid index, scan the directory, answer the lookup from the scan
+ * and store a new index. NT_STATUS_NOT_SUPPORTED tells the caller to
+ * do a plain directory scan.
+ */
+static NTSTATUS get_real_filename_index_at(struct files_struct *dirfsp,
+					   const char *name,
+					   TALLOC_CTX *mem_ctx,
+					   char **found_name)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct connection_struct *conn = dirfsp->conn;
+	struct dir_cache_tdb *db = casefold_index_db();
+	struct casefold_index_parse_state state = {
+		.name = name,
+		.mem_ctx = mem_ctx,
+		.status = NT_STATUS_NOT_SUPPORTED,
+	};
+	struct casefold_index_builder *b = NULL;
+	struct smb_Dir *cur_dir = NULL;
+	const char *dname = NULL;
+	char *talloced = NULL;
+	char *found = NULL;
+	struct file_id id;
+	SMB_STRUCT_STAT st;
+	TDB_DATA key;
+	int min_entries;
+	NTSTATUS status;
+	bool ok;
+	int ret;
+
+	if (db == NULL) {
+		status = NT_STATUS_NOT_SUPPORTED;
+		goto done;
+	}
+
+	ret = SMB_VFS_FSTAT(dirfsp, &st);
+	if (ret == -1) {
+		status = NT_STATUS_NOT_SUPPORTED;
+		goto done;
+	}
+	id = vfs_file_id_from_sbuf(conn, &st);
+
+	key = dir_cache_tdb_key(frame, conn, &id);
+	if (key.dptr == NULL) {
+		status = NT_STATUS_NO_MEMORY;
+		goto done;
+	}
+
+	ok = casefold_index_hash(name, &state.hash);
+	if (!ok) {
+		status = NT_STATUS_NO_MEMORY;
+		goto done;
+	}
+
+	ok = dir_cache_tdb_parse(db, key, CASEFOLD_INDEX_VERSION, &st,
+				 casefold_index_parser, &state);
+	if (ok) {
+		*found_name = state.found_name;
+		status = state.status;
+		goto done;
+	}
+
+	b = talloc_zero(frame, struct casefold_index_builder);
+	if (b == NULL) {
+		status = NT_STATUS_NO_MEMORY;
+		goto done;
+	}
+
+	status = OpenDir_from_pathref(frame, dirfsp, NULL, 0, &cur_dir);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_NOTICE("scan dir didn't open dir [%s]: %s\n",
+			   fsp_str_dbg(dirfsp),
+			   nt_errstr(status));
+		goto done;
+	}
+
+	/*
+	 * Unlike get_real_filename_full_scan_at() we have to read
+	 * until the end to see all names.
+	 */
+	while ((dname = ReadDirName(cur_dir, &talloced))) {
+		if (ISDOT(dname) || ISDOTDOT(dname)) {
+			TALLOC_FREE(talloced);
+			continue;
+		}
+		if ((found == NULL) && strequal(name, dname)) {
+			found = talloc_strdup(frame, dname);
+			if (found == NULL) {
+				TALLOC_FREE(talloced);
+				status = NT_STATUS_NO_MEMORY;
+				goto done;
+			}
+		}
+		casefold_index_add(b, dname);
+		TALLOC_FREE(talloced);
+	}
+	TALLOC_FREE(cur_dir);
+
+	if (found != NULL) {
+		*found_name = talloc_move(mem_ctx, &found);
+		status = NT_STATUS_OK;
+	} else {
+		status = NT_STATUS_OBJECT_NAME_NOT_FOUND;
+	}
+
+	if (b->failed) {
+		goto done;
+	}
+
+	/*
+	 * Scanning small directories is cheap, don't bloat the index
+	 * with them.
+	 */
+	min_entries = lp_parm_int(SNUM(conn),
+				  "smbd",
+				  "casefold index min entries",
+				  1024);
+	if (b->num_names < (uint32_t)MAX(min_entries, 0)) {
+		goto done;
+	}
+
+	ok = dir_cache_tdb_stable(dirfsp, &st);
+	if (!ok) {
+		goto done;
+	}
+
+	DBG_DEBUG("storing index for %s with %"PRIu32" names\n",
+		  fsp_str_dbg(dirfsp),
+		  b->num_names);
+
+	casefold_index_store(b, key, &st);
+
+done:
+	TALLOC_FREE(frame);
+	return status;
+}
+
 /****************************************************************************
  Scan a directory to find a filename, matching without case sensitivity.
  If the name looks like a mangled name then try via the mangling functions
@@ -313,6 +729,18 @@ NTSTATUS get_real_filename_full_scan_at(struct files_struct *dirfsp,
 		}
 	}
 
+	if (!mangled &&
+	    !conn->case_sensitive &&
+	    (dirfsp->fsp_name->twrp == 0) &&
+	    lp_parm_bool(SNUM(conn), "smbd", "casefold index", false)) {
+		status = get_real_filename_index_at(
+			dirfsp, name, mem_ctx, found_name);
+		if (!NT_STATUS_EQUAL(status, NT_STATUS_NOT_SUPPORTED)) {
+			TALLOC_FREE(unmangled_name);
+			return status;
+		}
+	}
+
 	/* open the directory */
 	status = OpenDir_from_pathref(talloc_tos(), dirfsp, NULL, 0, &cur_dir);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -33,6 +33,204 @@
 static NTSTATUS fsp_attach_smb_fname(struct files_struct *fsp,
 				     struct smb_filename **_smb_fname);
 
+/*
+ * Hash tables over sconn->files, keyed by file_id and by fd. They
+ * chain through the files_struct_link structs embedded in the fsp,
+ * so indexing an fsp does not allocate. The bucket array doubles
+ * when there are more entries than buckets.
+ */
+
+struct files_hash {
+	size_t num_entries;
+	size_t num_buckets; /* power of 2 */
+	struct files_struct_link **buckets;
+};
+
+#define FILES_HASH_MIN_BUCKETS 64
+
+static uint64_t files_hash_mix(uint64_t h)
+{
+	h ^= h >> 30;
+	h *= UINT64_C(0xbf58476d1ce4e5b9);
+	h ^= h >> 27;
+	h *= UINT64_C(0x94d049bb133111eb);
+	h ^= h >> 31;
+	return h;
+}
+
+static uint64_t files_file_id_hash(const struct file_id *id)
+{
+	uint64_t h = files_hash_mix(id->extid);
+	h = files_hash_mix(h ^ id->inode);
+	h = files_hash_mix(h ^ id->devid);
+	return h;
+}
+
+static uint64_t files_fd_hash(int fd)
+{
+	return files_hash_mix((uint64_t)fd);
+}
+
+static struct files_hash *files_hash_create(TALLOC_CTX *mem_ctx)
+{
+	struct files_hash *h = NULL;
+
+	h = talloc_zero(mem_ctx, struct files_hash);
+	if (h == NULL) {
+		return NULL;
+	}
+	h->num_buckets = FILES_HASH_MIN_BUCKETS;
+	h->buckets = talloc_zero_array(h,
+				       struct files_struct_link *,
+				       h->num_buckets);
+	if (h->buckets == NULL) {
+		TALLOC_FREE(h);
+		return NULL;
+	}
+	return h;
+}
+
+static struct files_struct_link **files_hash_bucket(struct files_hash *h,
+						    uint64_t hash)
+{
+	return &h->buckets[hash & (h->num_buckets - 1)];
+}
+
+static void files_hash_grow(struct files_hash *h)
+{
+	size_t num_buckets = h->num_buckets * 2;
+	struct files_struct_link **buckets = NULL;
+	size_t i;
+
+	buckets = talloc_zero_array(h, struct files_struct_link *, num_buckets);
+	if (buckets == NULL) {
+		/*
+		 * Not fatal, we just live with longer chains
+		 */
+		return;
+	}
+
+	for (i=0; i<h->num_buckets; i++) {
+		struct files_struct_link *l = NULL;
+
+		/*
+		 * Each new bucket is fed from exactly one old one,
+		 * DLIST_ADD_END keeps the newest-first order.
+		 */
+		while ((l = h->buckets[i]) != NULL) {
+			DLIST_REMOVE(h->buckets[i], l);
+			DLIST_ADD_END(buckets[l->hash & (num_buckets - 1)], l);
+		}
+	}
+
+	TALLOC_FREE(h->buckets);
+	h->buckets = buckets;
+	h->num_buckets = num_buckets;
+}
+
+static void files_hash_add(struct files_hash *h,
+			   struct files_struct_link *l,
+			   struct files_struct *fsp,
+			   uint64_t hash)
+{
+	SMB_ASSERT(l->fsp == NULL);
+
+	l->fsp = fsp;
+	l->hash = hash;
+	DLIST_ADD(*files_hash_bucket(h, hash), l);
+	h->num_entries += 1;
+
+	if (h->num_entries > h->num_buckets) {
+		files_hash_grow(h);
+	}
+}
+
+static void files_hash_remove(struct files_hash *h,
+			      struct files_struct_link *l)
+{
+	if (l->fsp == NULL) {
+		return;
+	}
+	DLIST_REMOVE(*files_hash_bucket(h, l->hash), l);
+	SMB_ASSERT(h->num_entries > 0);
+	h->num_entries -= 1;
+	*l = (struct files_struct_link) { .fsp = NULL };
+}
+
+/*
+ * fsps only show up in the fd hash while they have a real fd
+ */
+static void files_fd_hash_update(struct files_struct *fsp)
+{
+	struct smbd_server_connection *sconn = fsp->conn->sconn;
+	int fd = fsp_get_pathref_fd(fsp);
+
+	files_hash_remove(sconn->files_by_fd, &fsp->fd_link);
+
+	if (fd >= 0) {
+		files_hash_add(sconn->files_by_fd,
+			       &fsp->fd_link,
+			       fsp,
+			       files_fd_hash(fd));
+	}
+}
+
+/*
+ * Called from fsp_set_fd(). DOS and FCB opens from dup_file_fsp()
+ * share one fh, so a new fd has to move all fsps using it, not just
+ * the one fsp_set_fd() was called on.
+ */
+void file_fd_changed(struct files_struct *fsp)
+{
+	struct smbd_server_connection *sconn = NULL;
+	struct files_struct *f = NULL;
+
+	if (fh_get_refcount(fsp->fh) <= 1) {
+		if (fsp->file_id_link.fsp == NULL) {
+			/*
+			 * Not in sconn->files, for example conn->cwd_fsp
+			 */
+			return;
+		}
+		files_fd_hash_update(fsp);
+		return;
+	}
+
+	/*
+	 * Shared fh's are rare, walking all files is fine here
+	 */
+	sconn = fsp->conn->sconn;
+
+	for (f = sconn->files; f != NULL; f = f->next) {
+		if ((f->fh == fsp->fh) && (f->file_id_link.fsp != NULL)) {
+			files_fd_hash_update(f);
+		}
+	}
+}
+
+/*
+ * All changes of fsp->file_id must go through here to keep
+ * file_find_dif() and file_find_di_first() working.
+ */
+void fsp_set_file_id(struct files_struct *fsp, struct file_id id)
+{
+	struct smbd_server_connection *sconn = NULL;
+
+	if (fsp->file_id_link.fsp == NULL) {
+		fsp->file_id = id;
+		return;
+	}
+
+	sconn = fsp->conn->sconn;
+
+	files_hash_remove(sconn->files_by_file_id, &fsp->file_id_link);
+	fsp->file_id = id;
+	files_hash_add(sconn->files_by_file_id,
+		       &fsp->file_id_link,
+		       fsp,
+		       files_file_id_hash(&fsp->file_id));
+}
+
 /**
  * create new fsp to be used for file_new or a durable handle reconnect
  */
@@ -70,9 +268,27 @@ NTSTATUS fsp_new(struct connection_struct *conn, TALLOC_CTX *mem_ctx,
 	fsp->conn = conn;
 	fsp->close_write_time = make_omit_timespec();
 
+	if (sconn->files_by_file_id == NULL) {
+		sconn->files_by_file_id = files_hash_create(sconn);
+		if (sconn->files_by_file_id == NULL) {
+			goto fail;
+		}
+	}
+	if (sconn->files_by_fd == NULL) {
+		sconn->files_by_fd = files_hash_create(sconn);
+		if (sconn->files_by_fd == NULL) {
+			goto fail;
+		}
+	}
+
 	DLIST_ADD(sconn->files, fsp);
 	sconn->num_files += 1;
 
+	files_hash_add(sconn->files_by_file_id,
+		       &fsp->file_id_link,
+		       fsp,
+		       files_file_id_hash(&fsp->file_id));
+
 	conn->num_files_open++;
 
 	DBG_INFO("allocated files structure (%u used)\n",
@@ -142,7 +358,6 @@ NTSTATUS fsp_bind_smb(struct files_struct *fsp, struct smb_request *req)
 NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 		  files_struct **result)
 {
-	struct smbd_server_connection *sconn = conn->sconn;
 	files_struct *fsp;
 	NTSTATUS status;
 
@@ -179,13 +394,6 @@ NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 
 	DBG_INFO("new file %s\n", fsp_fnum_dbg(fsp));
 
-	/* A new fsp invalidates the positive and
-	  negative fsp_fi_cache as the new fsp is pushed
-	  at the start of the list and we search from
-	  a cache hit to the *end* of the list. */
-
-	ZERO_STRUCT(sconn->fsp_fi_cache);
-
 	*result = fsp;
 	return NT_STATUS_OK;
 }
@@ -280,7 +488,7 @@ NTSTATUS open_internal_dirfsp(connection_struct *conn,
 		return NT_STATUS_NOT_A_DIRECTORY;
 	}
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 
 	*_fsp = fsp;
 	return NT_STATUS_OK;
@@ -327,7 +535,7 @@ NTSTATUS openat_internal_dir_from_pathref(
 	}
 
 	fsp->fsp_name->st = smb_dname->st;
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 	*_fsp = fsp;
 	return NT_STATUS_OK;
 }
@@ -472,7 +680,6 @@ static NTSTATUS openat_pathref_fullname(
 
 	GetTimeOfDay(&fsp->open_time);
 	fsp_set_gen_id(fsp);
-	ZERO_STRUCT(conn->sconn->fsp_fi_cache);
 
 	fsp->fsp_flags.is_pathref = true;
 
@@ -520,7 +727,7 @@ static NTSTATUS openat_pathref_fullname(
 
 	fsp->fsp_flags.is_directory = S_ISDIR(fsp->fsp_name->st.st_ex_mode);
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 
 	status = fsp_smb_fname_link(fsp,
 				    &smb_fname->fsp_link,
@@ -1012,6 +1219,313 @@ lookup:
 	return fd;
 }
 
+/*
+ * Per-connection LRU of O_PATH handles for directories that
+ * openat_pathref_fsp_nosymlink() walked to from the share root. A hit
+ * replaces the openat()/close() pair per path component by one
+ * fstatat(AT_SYMLINK_NOFOLLOW) per component, see
+ * pathref_dircache_validate(), and one openat() of "." relative to
+ * the cached handle.
+ *
+ * Enabled with "smbd:pathref dircache size = <entries>". Only paths
+ * that matched the client's spelling exactly are cached, case
+ * insensitive matches still go through smb_vfs_openat_ci().
+ */
+
+struct pathref_dircache_entry {
+	struct pathref_dircache_entry *prev, *next;
+	struct pathref_dircache *cache;
+	struct files_struct *fsp;
+	struct files_struct_link link; /* in cache->index, keyed by path */
+	struct timespec ctime;
+};
+
+struct pathref_dircache {
+	struct pathref_dircache_entry *entries; /* MRU first */
+	struct files_hash *index;
+	size_t num_entries;
+	size_t max_entries;
+};
+
+static uint64_t pathref_dircache_hash(const char *path)
+{
+	uint64_t h = UINT64_C(0xcbf29ce484222325);
+	const uint8_t *p = NULL;
+
+	for (p = (const uint8_t *)path; *p != '\0'; p++) {
+		h = (h ^ *p) * UINT64_C(0x100000001b3);
+	}
+	return files_hash_mix(h);
+}
+
+static int pathref_dircache_entry_destructor(
+	struct pathref_dircache_entry *e)
+{
+	struct pathref_dircache *cache = e->cache;
+
+	DLIST_REMOVE(cache->entries, e);
+	files_hash_remove(cache->index, &e->link);
+	cache->num_entries -= 1;
+
+	if (fsp_get_pathref_fd(e->fsp) != -1) {
+		fd_close(e->fsp);
+	}
+	return 0;
+}
+
+static struct pathref_dircache *pathref_dircache_get(
+	struct connection_struct *conn)
+{
+	struct pathref_dircache *cache = conn->pathref_dircache;
+	int max_entries;
+
+	if (cache != NULL) {
+		return cache;
+	}
+
+	max_entries = lp_parm_int(SNUM(conn),
+				  "smbd",
+				  "pathref dircache size",
+				  0);
+	if (max_entries <= 0) {
+		return NULL;
+	}
+
+	cache = talloc_zero(conn, struct pathref_dircache);
+	if (cache == NULL) {
+		return NULL;
+	}
+	cache->max_entries = max_entries;
+
+	cache->index = files_hash_create(cache);
+	if (cache->index == NULL) {
+		TALLOC_FREE(cache);
+		return NULL;
+	}
+
+	conn->pathref_dircache = cache;
+	return cache;
+}
+
+/*
+ * Has to happen while the VFS is still connected
+ */
+static void pathref_dircache_flush(struct connection_struct *conn)
+{
+	TALLOC_FREE(conn->pathref_dircache);
+}
+
+static struct pathref_dircache_entry *pathref_dircache_lookup(
+	struct pathref_dircache *cache,
+	const char *path)
+{
+	uint64_t hash = pathref_dircache_hash(path);
+	struct files_struct_link *l = NULL;
+
+	for (l = *files_hash_bucket(cache->index, hash);
+	     l != NULL;
+	     l = l->next)
+	{
+		if ((l->hash == hash) &&
+		    (strcmp(l->fsp->fsp_name->base_name, path) == 0)) {
+			return talloc_get_type_abort(
+				talloc_parent(l->fsp),
+				struct pathref_dircache_entry);
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Make sure e->fsp is still what the nosymlink walk would find.
+ *
+ * A single fstatat() of the whole path would follow symlinks in the
+ * intermediate components: If "a" is moved away and replaced by a
+ * symlink to it, "a/c" still has the same file_id and ctime. So we
+ * lstat every component from the share root and refuse anything
+ * that is not a directory. This is racy in the same way the openat()
+ * walk is: A component renamed after we looked at it is not noticed
+ * by either.
+ */
+static bool pathref_dircache_validate(struct connection_struct *conn,
+				      struct pathref_dircache_entry *e)
+{
+	const char *path = e->fsp->fsp_name->base_name;
+	size_t len = strlen(path);
+	char buf[len + 1];
+	struct smb_filename prefix = {
+		.base_name = buf,
+		.flags = e->fsp->fsp_name->flags,
+	};
+	SMB_STRUCT_STAT st;
+	struct file_id id;
+	size_t i;
+	int ret;
+
+	memcpy(buf, path, len + 1);
+
+	for (i = 0; i <= len; i++) {
+		if ((buf[i] != '/') && (buf[i] != '\0')) {
+			continue;
+		}
+		buf[i] = '\0';
+
+		ret = SMB_VFS_FSTATAT(conn,
+				      conn->cwd_fsp,
+				      &prefix,
+				      &st,
+				      AT_SYMLINK_NOFOLLOW);
+		if (ret == -1) {
+			DBG_DEBUG("fstatat(%s) failed: %s\n",
+				  buf,
+				  strerror(errno));
+			return false;
+		}
+		if (!S_ISDIR(st.st_ex_mode)) {
+			DBG_DEBUG("%s is not a directory anymore\n", buf);
+			return false;
+		}
+
+		buf[i] = path[i];
+	}
+
+	id = vfs_file_id_from_sbuf(conn, &st);
+	if (!file_id_equal(&id, &e->fsp->file_id) ||
+	    (timespec_compare(&st.st_ex_ctime, &e->ctime) != 0)) {
+		DBG_DEBUG("%s changed\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Open "path" relative to conn->cwd_fsp into fsp via a cached handle
+ */
+static bool pathref_dircache_fetch(struct connection_struct *conn,
+				   const char *path,
+				   struct files_struct *fsp,
+				   const struct vfs_open_how *how)
+{
+	struct pathref_dircache *cache = conn->pathref_dircache;
+	struct pathref_dircache_entry *e = NULL;
+	struct smb_filename dot = {
+		.base_name = discard_const_p(char, "."),
+		.flags = fsp->fsp_name->flags,
+	};
+	bool ok;
+	int fd;
+
+	DO_PROFILE_INC(dircache_lookups);
+
+	e = pathref_dircache_lookup(cache, path);
+	if (e == NULL) {
+		DO_PROFILE_INC(dircache_misses);
+		return false;
+	}
+
+	ok = pathref_dircache_validate(conn, e);
+	if (!ok) {
+		goto stale;
+	}
+
+	fd = SMB_VFS_OPENAT(conn, e->fsp, &dot, fsp, how);
+	if (fd == -1) {
+		DBG_DEBUG("openat(%s/.) failed: %s\n", path, strerror(errno));
+		goto stale;
+	}
+	fsp_set_fd(fsp, fd);
+
+	DLIST_PROMOTE(cache->entries, e);
+	DO_PROFILE_INC(dircache_hits);
+	return true;
+
+stale:
+	DO_PROFILE_INC(dircache_stale);
+	TALLOC_FREE(e);
+	return false;
+}
+
+static void pathref_dircache_store(struct connection_struct *conn,
+				   struct files_struct *dirfsp,
+				   const struct vfs_open_how *how)
+{
+	struct pathref_dircache *cache = conn->pathref_dircache;
+	struct pathref_dircache_entry *e = NULL;
+	struct files_struct *fsp = NULL;
+	struct smb_filename dot = {
+		.base_name = discard_const_p(char, "."),
+		.flags = dirfsp->fsp_name->flags,
+	};
+	int fd;
+
+	e = pathref_dircache_lookup(cache, dirfsp->fsp_name->base_name);
+	TALLOC_FREE(e);
+
+	if (cache->num_entries >= cache->max_entries) {
+		struct pathref_dircache_entry *lru =
+			DLIST_TAIL(cache->entries);
+		TALLOC_FREE(lru);
+	}
+
+	e = talloc_zero(cache, struct pathref_dircache_entry);
+	if (e == NULL) {
+		return;
+	}
+	e->cache = cache;
+	e->ctime = dirfsp->fsp_name->st.st_ex_ctime;
+
+	/*
+	 * Like vfs_at_fspcwd() this is not in sconn->files, so it
+	 * is invisible to file_find_subpath() and friends.
+	 */
+	fsp = talloc_zero(e, struct files_struct);
+	if (fsp == NULL) {
+		goto fail;
+	}
+	fsp->fh = fd_handle_create(fsp);
+	if (fsp->fh == NULL) {
+		goto fail;
+	}
+	fsp_set_fd(fsp, -1);
+	fsp->fnum = FNUM_FIELD_INVALID;
+	fsp->conn = conn;
+	fsp->fsp_flags.is_pathref = true;
+	fsp->fsp_flags.is_directory = true;
+	fsp->fsp_name = synthetic_smb_fname(fsp,
+					    dirfsp->fsp_name->base_name,
+					    NULL,
+					    &dirfsp->fsp_name->st,
+					    0,
+					    dirfsp->fsp_name->flags);
+	if (fsp->fsp_name == NULL) {
+		goto fail;
+	}
+	fsp_set_file_id(fsp, dirfsp->file_id);
+
+	fd = SMB_VFS_OPENAT(conn, dirfsp, &dot, fsp, how);
+	if (fd == -1) {
+		DBG_DEBUG("openat(%s/.) failed: %s\n",
+			  fsp_str_dbg(dirfsp),
+			  strerror(errno));
+		goto fail;
+	}
+	fsp_set_fd(fsp, fd);
+	e->fsp = fsp;
+
+	DLIST_ADD(cache->entries, e);
+	files_hash_add(cache->index,
+		       &e->link,
+		       fsp,
+		       pathref_dircache_hash(fsp->fsp_name->base_name));
+	cache->num_entries += 1;
+	talloc_set_destructor(e, pathref_dircache_entry_destructor);
+	return;
+
+fail:
+	TALLOC_FREE(e);
+}
+
 NTSTATUS openat_pathref_fsp_nosymlink(TALLOC_CTX *mem_ctx,
 				      struct connection_struct *conn,
 				      struct files_struct *in_dirfsp,
@@ -1037,6 +1551,7 @@ NTSTATUS openat_pathref_fsp_nosymlink(TALLOC_CTX *mem_ctx,
 	struct files_struct *fsp = NULL;
 	char *path = NULL, *next = NULL;
 	bool ok, is_toplevel;
+	bool use_dircache = false;
 	int fd;
 	NTSTATUS status;
 	struct vfs_open_how how = {
@@ -1054,7 +1569,6 @@ NTSTATUS openat_pathref_fsp_nosymlink(TALLOC_CTX *mem_ctx,
 
 	GetTimeOfDay(&fsp->open_time);
 	fsp_set_gen_id(fsp);
-	ZERO_STRUCT(conn->sconn->fsp_fi_cache);
 
 	fsp->fsp_name = &full_fname;
 
@@ -1199,6 +1713,32 @@ NTSTATUS openat_pathref_fsp_nosymlink(TALLOC_CTX *mem_ctx,
 		how.resolve = 0;
 	}
 
+#ifdef O_PATH
+	/*
+	 * With openat2() the walk above is a single syscall already,
+	 * the cache would not save anything.
+	 */
+	use_dircache = (in_dirfsp == conn->cwd_fsp) &&
+		(twrp == 0) &&
+		!(conn->open_how_resolve & VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS) &&
+		(pathref_dircache_get(conn) != NULL);
+#endif
+
+	if (use_dircache) {
+		ok = pathref_dircache_fetch(conn, path_in, fsp, &how);
+		if (ok) {
+			ok = full_path_extend(&full_fname.base_name, path_in);
+			if (!ok) {
+				goto nomem;
+			}
+			/*
+			 * Don't store it again below
+			 */
+			use_dircache = false;
+			goto done;
+		}
+	}
+
 	/*
 	 * Now we loop over all components
 	 * opening each one and using it
@@ -1401,7 +1941,13 @@ done:
 	 * open.c will use this to check if delete_on_close
 	 * has been set on the dirfsp.
 	 */
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
+
+	if (use_dircache &&
+	    S_ISDIR(fsp->fsp_name->st.st_ex_mode) &&
+	    (strcmp(fsp->fsp_name->base_name, path_in) == 0)) {
+		pathref_dircache_store(conn, fsp, &how);
+	}
 
 	result = cp_smb_filename(mem_ctx, fsp->fsp_name);
 	if (result == NULL) {
@@ -1497,7 +2043,6 @@ NTSTATUS openat_pathref_fsp_lcomp(struct files_struct *dirfsp,
 
 	GetTimeOfDay(&fsp->open_time);
 	fsp_set_gen_id(fsp);
-	ZERO_STRUCT(conn->sconn->fsp_fi_cache);
 
 	fsp->fsp_flags.is_pathref = true;
 
@@ -1585,7 +2130,7 @@ NTSTATUS openat_pathref_fsp_lcomp(struct files_struct *dirfsp,
 	}
 
 	fsp->fsp_flags.is_directory = S_ISDIR(fsp->fsp_name->st.st_ex_mode);
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 
 	smb_fname_rel->st = fsp->fsp_name->st;
 
@@ -1859,6 +2404,8 @@ void file_close_conn(connection_struct *conn, enum file_close_type close_type)
 	struct file_close_conn_state state = { .conn = conn,
 					       .close_type = close_type };
 
+	pathref_dircache_flush(conn);
+
 	files_forall(conn->sconn, file_close_conn_fn, &state);
 
 	if (state.fsp_left_behind) {
@@ -1993,14 +2540,44 @@ struct files_struct *files_forall(
 
 files_struct *file_find_fd(struct smbd_server_connection *sconn, int fd)
 {
-	int count=0;
-	files_struct *fsp;
+	uint64_t hash = files_fd_hash(fd);
+	struct files_struct_link *l = NULL;
 
-	for (fsp=sconn->files; fsp; fsp=fsp->next,count++) {
-		if (fsp_get_pathref_fd(fsp) == fd) {
-			if (count > 10) {
-				DLIST_PROMOTE(sconn->files, fsp);
-			}
+	if ((fd < 0) || (sconn->files_by_fd == NULL)) {
+		return NULL;
+	}
+
+	for (l = *files_hash_bucket(sconn->files_by_fd, hash);
+	     l != NULL;
+	     l = l->next) {
+		if ((l->hash == hash) && (fsp_get_pathref_fd(l->fsp) == fd)) {
+			return l->fsp;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Walk the file_id hash chain starting at "l" for the next fsp with
+ * file_id "id"
+ */
+static struct files_struct *file_find_di_from(struct files_struct_link *l,
+					      const struct file_id *id,
+					      bool need_fsa)
+{
+	uint64_t hash = files_file_id_hash(id);
+
+	for (; l != NULL; l = l->next) {
+		struct files_struct *fsp = l->fsp;
+
+		if (l->hash != hash) {
+			continue;
+		}
+		if (need_fsa && !fsp->fsp_flags.is_fsa) {
+			continue;
+		}
+		if (file_id_equal(&fsp->file_id, id)) {
 			return fsp;
 		}
 	}
@@ -2015,31 +2592,22 @@ files_struct *file_find_fd(struct smbd_server_connection *sconn, int fd)
 files_struct *file_find_dif(struct smbd_server_connection *sconn,
 			    struct file_id id, unsigned long gen_id)
 {
-	int count=0;
 	files_struct *fsp;
 
 	if (gen_id == 0) {
 		return NULL;
 	}
 
-	for (fsp = sconn->files; fsp; fsp = fsp->next,count++) {
-		/*
-		 * We can have a fsp->fh->fd == -1 here as it could be a stat
-		 * open.
-		 */
-		if (!file_id_equal(&fsp->file_id, &id)) {
-			continue;
-		}
-		if (!fsp->fsp_flags.is_fsa) {
-			continue;
-		}
-		if (fh_get_gen_id(fsp->fh) != gen_id) {
-			continue;
-		}
-		if (count > 10) {
-			DLIST_PROMOTE(sconn->files, fsp);
+	/*
+	 * We can have a fsp->fh->fd == -1 here as it could be a stat
+	 * open.
+	 */
+	for (fsp = file_find_di_first(sconn, id, true);
+	     fsp != NULL;
+	     fsp = file_find_di_next(fsp, true)) {
+		if (fh_get_gen_id(fsp->fh) == gen_id) {
+			return fsp;
 		}
-		return fsp;
 	}
 
 	return NULL;
@@ -2047,37 +2615,22 @@ files_struct *file_find_dif(struct smbd_server_connection *sconn,
 
 /****************************************************************************
  Find the first fsp given a device and inode.
- We use a singleton cache here to speed up searching from getfilepathinfo
- calls.
 ****************************************************************************/
 
 files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 				 struct file_id id,
 				 bool need_fsa)
 {
-	files_struct *fsp;
+	struct files_struct_link **bucket = NULL;
 
-	if (file_id_equal(&sconn->fsp_fi_cache.id, &id)) {
-		/* Positive or negative cache hit. */
-		return sconn->fsp_fi_cache.fsp;
+	if (sconn->files_by_file_id == NULL) {
+		return NULL;
 	}
 
-	sconn->fsp_fi_cache.id = id;
+	bucket = files_hash_bucket(sconn->files_by_file_id,
+				   files_file_id_hash(&id));
 
-	for (fsp=sconn->files;fsp;fsp=fsp->next) {
-		if (need_fsa && !fsp->fsp_flags.is_fsa) {
-			continue;
-		}
-		if (file_id_equal(&fsp->file_id, &id)) {
-			/* Setup positive cache. */
-			sconn->fsp_fi_cache.fsp = fsp;
-			return fsp;
-		}
-	}
-
-	/* Setup negative cache. */
-	sconn->fsp_fi_cache.fsp = NULL;
-	return NULL;
+	return file_find_di_from(*bucket, &id, need_fsa);
 }
 
 /****************************************************************************
@@ -2087,18 +2640,133 @@ files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 files_struct *file_find_di_next(files_struct *start_fsp,
 				bool need_fsa)
 {
-	files_struct *fsp;
+	return file_find_di_from(start_fsp->file_id_link.next,
+				 &start_fsp->file_id,
+				 need_fsa);
+}
 
-	for (fsp = start_fsp->next;fsp;fsp=fsp->next) {
-		if (need_fsa && !fsp->fsp_flags.is_fsa) {
+/*
+ * Cross-check the file_id and fd hashes against a walk of
+ * sconn->files. O(n^2), only for FSCTL_SMBTORTURE_FILES_HASH_CHECK.
+ */
+NTSTATUS files_hash_check(struct smbd_server_connection *sconn)
+{
+	struct files_struct *fsp = NULL;
+	size_t num_files = 0;
+	size_t num_fds = 0;
+
+	for (fsp = sconn->files; fsp != NULL; fsp = fsp->next) {
+		struct files_struct *f = NULL;
+		size_t num_walked = 0;
+		size_t num_walked_fsa = 0;
+		size_t num_hashed = 0;
+		size_t num_hashed_fsa = 0;
+		uint64_t gen_id = fh_get_gen_id(fsp->fh);
+		int fd = fsp_get_pathref_fd(fsp);
+		bool found = false;
+
+		num_files += 1;
+
+		if (fsp->file_id_link.fsp != fsp) {
+			DBG_ERR("%s not in the file_id hash\n", fsp_str_dbg(fsp));
+			return NT_STATUS_INTERNAL_DB_CORRUPTION;
+		}
+
+		for (f = sconn->files; f != NULL; f = f->next) {
+			if (!file_id_equal(&f->file_id, &fsp->file_id)) {
+				continue;
+			}
+			num_walked += 1;
+			if (f->fsp_flags.is_fsa) {
+				num_walked_fsa += 1;
+			}
+		}
+
+		for (f = file_find_di_first(sconn, fsp->file_id, false);
+		     f != NULL;
+		     f = file_find_di_next(f, false)) {
+			if (!file_id_equal(&f->file_id, &fsp->file_id)) {
+				DBG_ERR("%s: file_id lookup returned %s\n",
+					fsp_str_dbg(fsp),
+					fsp_str_dbg(f));
+				return NT_STATUS_INTERNAL_DB_CORRUPTION;
+			}
+			num_hashed += 1;
+			if (f == fsp) {
+				found = true;
+			}
+		}
+
+		for (f = file_find_di_first(sconn, fsp->file_id, true);
+		     f != NULL;
+		     f = file_find_di_next(f, true)) {
+			num_hashed_fsa += 1;
+		}
+
+		if (!found ||
+		    (num_hashed != num_walked) ||
+		    (num_hashed_fsa != num_walked_fsa)) {
+			DBG_ERR("%s: found=%d, %zu/%zu fsps, %zu/%zu fsa fsps "
+				"in hash/list\n",
+				fsp_str_dbg(fsp),
+				(int)found,
+				num_hashed,
+				num_walked,
+				num_hashed_fsa,
+				num_walked_fsa);
+			return NT_STATUS_INTERNAL_DB_CORRUPTION;
+		}
+
+		if (fsp->fsp_flags.is_fsa && (gen_id != 0)) {
+			/*
+			 * fsps from dup_file_fsp() share the gen_id
+			 */
+			f = file_find_dif(sconn, fsp->file_id, gen_id);
+			if ((f == NULL) || (f->fh != fsp->fh)) {
+				DBG_ERR("%s: gen_id %"PRIu64" not found\n",
+					fsp_str_dbg(fsp),
+					gen_id);
+				return NT_STATUS_INTERNAL_DB_CORRUPTION;
+			}
+		}
+
+		if (fd < 0) {
+			if (fsp->fd_link.fsp != NULL) {
+				DBG_ERR("%s: closed fsp in the fd hash\n",
+					fsp_str_dbg(fsp));
+				return NT_STATUS_INTERNAL_DB_CORRUPTION;
+			}
 			continue;
 		}
-		if (file_id_equal(&fsp->file_id, &start_fsp->file_id)) {
-			return fsp;
+
+		num_fds += 1;
+
+		if ((fsp->fd_link.fsp != fsp) ||
+		    (fsp->fd_link.hash != files_fd_hash(fd))) {
+			DBG_ERR("%s: fd %d not hashed\n", fsp_str_dbg(fsp), fd);
+			return NT_STATUS_INTERNAL_DB_CORRUPTION;
+		}
+
+		f = file_find_fd(sconn, fd);
+		if ((f == NULL) || (f->fh != fsp->fh)) {
+			DBG_ERR("%s: fd %d not found\n", fsp_str_dbg(fsp), fd);
+			return NT_STATUS_INTERNAL_DB_CORRUPTION;
 		}
 	}
 
-	return NULL;
+	if ((num_files != sconn->num_files) ||
+	    ((sconn->files_by_file_id != NULL) &&
+	     (sconn->files_by_file_id->num_entries != num_files)) ||
+	    ((sconn->files_by_fd != NULL) &&
+	     (sconn->files_by_fd->num_entries != num_fds))) {
+		DBG_ERR("%zu files, %zu with fds, num_files=%zu\n",
+			num_files,
+			num_fds,
+			sconn->num_files);
+		return NT_STATUS_INTERNAL_DB_CORRUPTION;
+	}
+
+	return NT_STATUS_OK;
 }
 
 struct files_struct *file_find_one_fsp_from_lease_key(
@@ -2128,6 +2796,9 @@ bool file_find_subpath(files_struct *dir_fsp)
 	files_struct *fsp;
 	size_t dlen;
 	char *d_fullname = NULL;
+	char *d1_fullname = NULL;
+	size_t d1_buflen = 0;
+	bool found = false;
 
 	d_fullname = talloc_asprintf(talloc_tos(), "%s/%s",
 				     dir_fsp->conn->connectpath,
@@ -2140,16 +2811,43 @@ bool file_find_subpath(files_struct *dir_fsp)
 	dlen = strlen(d_fullname);
 
 	for (fsp=dir_fsp->conn->sconn->files; fsp; fsp=fsp->next) {
-		char *d1_fullname;
+		const char *connectpath = fsp->conn->connectpath;
+		const char *base_name = fsp->fsp_name->base_name;
+		size_t cplen, bnlen, len;
 
 		if (fsp == dir_fsp) {
 			continue;
 		}
 
-		d1_fullname = talloc_asprintf(talloc_tos(),
-					"%s/%s",
-					fsp->conn->connectpath,
-					fsp->fsp_name->base_name);
+		cplen = strlen(connectpath);
+		bnlen = strlen(base_name);
+		len = cplen + 1 + bnlen;
+
+		if (len <= dlen) {
+			/*
+			 * Can't be a longer component
+			 */
+			continue;
+		}
+
+		/*
+		 * Reuse one buffer, with many open files the
+		 * allocations dominated this loop.
+		 */
+		if (len >= d1_buflen) {
+			char *tmp = talloc_realloc(talloc_tos(),
+						   d1_fullname,
+						   char,
+						   len + 1);
+			if (tmp == NULL) {
+				break;
+			}
+			d1_fullname = tmp;
+			d1_buflen = len + 1;
+		}
+		memcpy(d1_fullname, connectpath, cplen);
+		d1_fullname[cplen] = '/';
+		memcpy(d1_fullname + cplen + 1, base_name, bnlen + 1);
 
 		/*
 		 * If the open file has a path that is a longer
@@ -2157,15 +2855,14 @@ bool file_find_subpath(files_struct *dir_fsp)
 		 */
 		if (strnequal(d_fullname, d1_fullname, dlen) &&
 				(d1_fullname[dlen] == '/')) {
-			TALLOC_FREE(d1_fullname);
-			TALLOC_FREE(d_fullname);
-			return true;
+			found = true;
+			break;
 		}
-		TALLOC_FREE(d1_fullname);
 	}
 
+	TALLOC_FREE(d1_fullname);
 	TALLOC_FREE(d_fullname);
-	return false;
+	return found;
 }
 
 /****************************************************************************
@@ -2176,9 +2873,8 @@ static void fsp_free(files_struct *fsp)
 {
 	struct smbd_server_connection *sconn = fsp->conn->sconn;
 
-	if (fsp == sconn->fsp_fi_cache.fsp) {
-		ZERO_STRUCT(sconn->fsp_fi_cache);
-	}
+	files_hash_remove(sconn->files_by_file_id, &fsp->file_id_link);
+	files_hash_remove(sconn->files_by_fd, &fsp->fd_link);
 
 	DLIST_REMOVE(sconn->files, fsp);
 	SMB_ASSERT(sconn->num_files > 0);
@@ -2435,8 +3131,9 @@ NTSTATUS dup_file_fsp(
 	to->fh = from->fh;
 	new_refcount = fh_get_refcount(to->fh) + 1;
 	fh_set_refcount(to->fh, new_refcount);
+	file_fd_changed(to);
 
-	to->file_id = from->file_id;
+	fsp_set_file_id(to, from->file_id);
 	to->initial_allocation_size = from->initial_allocation_size;
 	to->file_pid = from->file_pid;
 	to->vuid = from->vuid;
@@ -30,12 +30,6 @@ struct smbd_dmapi_context;
 extern struct smbd_dmapi_context *dmapi_ctx;
 #endif
 
-/* A singleton cache to speed up searching by dev/inode. */
-struct fsp_singleton_cache {
-	files_struct *fsp;
-	struct file_id id;
-};
-
 extern const struct mangle_fns *mangle_fns;
 
 extern unsigned char *chartest;
@@ -445,6 +439,20 @@ struct smbXsrv_connection {
 		struct smbd_smb2_send_queue *send_queue;
 		size_t send_queue_len;
 
+		/*
+		 * MSG_ZEROCOPY state, see smbd_smb2_flush_with_sendmsg().
+		 *
+		 * PDUs sent with MSG_ZEROCOPY are moved to
+		 * zerocopy.queue until the kernel reported
+		 * that it no longer references their buffers.
+		 */
+		struct {
+			size_t threshold;
+			bool in_use;
+			uint32_t next_seq;
+			struct smbd_smb2_send_queue *queue;
+		} zerocopy;
+
 		struct {
 			/*
 			 * seq_low is the lowest sequence number
@@ -510,6 +518,7 @@ struct smbXsrv_connection {
 			uint32_t max_write;
 			uint16_t sign_algo;
 			uint16_t cipher;
+			struct smb3_compression_capabilities compression;
 			bool posix_extensions_negotiated;
 		} server;
 
@@ -593,12 +602,30 @@ struct smbd_smb2_send_queue {
 	struct iovec *vector;
 	int count;
 
+	/*
+	 * The PDU is still being encrypted in the
+	 * thread pool, we must not send it (or anything
+	 * queued behind it) yet.
+	 */
+	bool encryption_pending;
+
 	struct {
 		struct tevent_req *req;
 		struct timeval timeout;
 		uint64_t required_acked_bytes;
 	} ack;
 
+	/*
+	 * The sequence numbers of our MSG_ZEROCOPY sendmsg()
+	 * calls for this PDU are first_seq .. first_seq + num_seq - 1,
+	 * num_completed counts the ones the kernel has completed.
+	 */
+	struct {
+		uint32_t first_seq;
+		uint32_t num_seq;
+		uint32_t num_completed;
+	} zerocopy;
+
 	TALLOC_CTX *mem_ctx;
 };
 
@@ -624,6 +651,8 @@ struct smbd_smb2_request {
 	bool was_encrypted;
 	/* Should we encrypt? */
 	bool do_encryption;
+	/* Should we try to compress the response? */
+	bool compress_response;
 	struct tevent_timer *async_te;
 	bool compound_related;
 	NTSTATUS compound_create_err;
@@ -647,6 +676,18 @@ struct smbd_smb2_request {
 	struct smb2_signing_key *last_sign_key;
 	struct smbXsrv_preauth *preauth;
 
+	/*
+	 * State of an encryption job offloaded
+	 * to the thread pool, see
+	 * smbd_smb2_request_encrypt_send().
+	 */
+	struct {
+		struct tevent_req *subreq;
+		int count;
+		NTSTATUS status;
+		bool orphaned;
+	} async_encryption;
+
 	struct timeval request_time;
 
 	SMBPROFILE_IOBYTES_ASYNC_STATE(profile);
@@ -768,6 +809,7 @@ struct smbd_smb2_request {
 struct smbd_server_connection;
 
 struct pending_message_list;
+struct files_hash;
 struct pending_auth_data;
 
 struct pthreadpool_tevent;
@@ -793,7 +835,10 @@ struct smbd_server_connection {
 	struct files_struct *files;
 
 	int real_max_open_files;
-	struct fsp_singleton_cache fsp_fi_cache;
+
+	/* Hash tables over "files", see smbd/files.c */
+	struct files_hash *files_by_file_id;
+	struct files_hash *files_by_fd;
 
 	struct pending_message_list *deferred_open_queue;
 
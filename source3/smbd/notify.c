@@ -777,11 +777,13 @@ static void notify_fsp(files_struct *fsp, struct timespec when,
 	 * later.
 	 */
 
-	if ((fsp->notify->num_changes > 1000) || (name == NULL)) {
+	if ((fsp->notify->num_changes > 1000) ||
+	    (name == NULL) || (name[0] == '\0')) {
 		/*
 		 * The real number depends on the client buf, just provide a
-		 * guard against a DoS here.  If name == NULL the CN backend is
-		 * alerting us to a problem.  Possibly dropped events.  Clear
+		 * guard against a DoS here.  If name == NULL or empty the CN
+		 * backend is alerting us to a problem.  Possibly dropped
+		 * events, e.g. a fanotify queue overflow.  Clear
 		 * queued changes and send the catch-all response to the client
 		 * if a request is pending.
 		 */
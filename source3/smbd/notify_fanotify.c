@@ -0,0 +1,888 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   notify implementation using fanotify filesystem marks
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Unlike inotify, which needs one kernel watch per directory, we put
+ * one fanotify mark on each filesystem containing a watched
+ * directory. The kernel reports the file handle of the directory an
+ * event happened in together with the name of the entry
+ * (FAN_REPORT_DFID_NAME), we turn the handle back into a path and
+ * decide whether any watch is interested. That makes recursive
+ * watches (subdir_filter) cheap: kernel resources don't depend on
+ * the size of the tree below a watched directory.
+ *
+ * This needs CAP_SYS_ADMIN for fanotify_init() and
+ * CAP_DAC_READ_SEARCH for open_by_handle_at(), notifyd runs as root.
+ */
+
+#include "includes.h"
+#include "../librpc/gen_ndr/notify.h"
+#include "smbd/smbd.h"
+#include "system/filesys.h"
+
+#include <sys/fanotify.h>
+#include <sys/vfs.h>
+
+/*
+ * Events are read in batches of this size, a read returns as many
+ * complete events as fit.
+ */
+#define FANOTIFY_BUFSIZE 65536
+
+struct fanotify_private {
+	struct sys_notify_context *ctx;
+	int fd;
+	struct fanotify_fs *filesystems;
+	struct fanotify_watch_context *watches;
+	uint8_t *buf;
+};
+
+/*
+ * One per marked filesystem, shared by all watches on it
+ */
+struct fanotify_fs {
+	struct fanotify_fs *next, *prev;
+	struct fanotify_private *fa;
+	dev_t dev;
+	fsid_t fsid;
+	int mount_fd;	/* for open_by_handle_at() and unmarking */
+	uint64_t mask;	/* the mask currently marked */
+	size_t num_watches;
+};
+
+struct fanotify_watch_context {
+	struct fanotify_watch_context *next, *prev;
+	struct fanotify_private *fa;
+	struct fanotify_fs *fs;
+	void (*callback)(struct sys_notify_context *ctx,
+			 void *private_data,
+			 struct notify_event *ev,
+			 uint32_t filter);
+	void *private_data;
+	uint64_t mask; /* the fanotify mask */
+	uint32_t filter; /* the windows completion filter */
+	uint32_t subdir_filter; /* the same for subdirectories */
+	const char *path;
+	size_t pathlen;
+};
+
+/*
+  map from a change notify mask to a fanotify mask. Remove any bits
+  which we can handle
+*/
+static const struct {
+	uint32_t notify_mask;
+	uint64_t fanotify_mask;
+} fanotify_mapping[] = {
+	{FILE_NOTIFY_CHANGE_FILE_NAME,
+	 FAN_CREATE|FAN_DELETE|FAN_MOVED_FROM|FAN_MOVED_TO},
+	{FILE_NOTIFY_CHANGE_DIR_NAME,
+	 FAN_CREATE|FAN_DELETE|FAN_MOVED_FROM|FAN_MOVED_TO},
+	{FILE_NOTIFY_CHANGE_ATTRIBUTES,
+	 FAN_ATTRIB|FAN_MOVED_TO|FAN_MOVED_FROM|FAN_MODIFY},
+	{FILE_NOTIFY_CHANGE_LAST_WRITE,  FAN_ATTRIB},
+	{FILE_NOTIFY_CHANGE_LAST_ACCESS, FAN_ATTRIB},
+	{FILE_NOTIFY_CHANGE_EA,          FAN_ATTRIB},
+	{FILE_NOTIFY_CHANGE_SECURITY,    FAN_ATTRIB}
+};
+
+static uint64_t fanotify_map(uint32_t *filter)
+{
+	size_t i;
+	uint64_t out = 0;
+
+	for (i = 0; i < ARRAY_SIZE(fanotify_mapping); i++) {
+		if (fanotify_mapping[i].notify_mask & *filter) {
+			out |= fanotify_mapping[i].fanotify_mask;
+			*filter &= ~fanotify_mapping[i].notify_mask;
+		}
+	}
+	return out;
+}
+
+/*
+ * Map fanotify mask back to filter. This returns all filters that
+ * could have created the fanotify mark.
+ */
+static uint32_t fanotify_map_mask_to_filter(uint64_t mask)
+{
+	size_t i;
+	uint32_t filter = 0;
+
+	for (i = 0; i < ARRAY_SIZE(fanotify_mapping); i++) {
+		if (fanotify_mapping[i].fanotify_mask & mask) {
+			filter |= fanotify_mapping[i].notify_mask;
+		}
+	}
+
+	if (mask & FAN_ONDIR) {
+		filter &= ~FILE_NOTIFY_CHANGE_FILE_NAME;
+	} else {
+		filter &= ~FILE_NOTIFY_CHANGE_DIR_NAME;
+	}
+
+	return filter;
+}
+
+static int fanotify_destructor(struct fanotify_private *fa)
+{
+	close(fa->fd);
+	return 0;
+}
+
+static int fanotify_fs_destructor(struct fanotify_fs *fs)
+{
+	DLIST_REMOVE(fs->fa->filesystems, fs);
+	close(fs->mount_fd);
+	return 0;
+}
+
+static struct fanotify_fs *fanotify_find_fs_by_fsid(
+	struct fanotify_private *fa, const __kernel_fsid_t *fsid)
+{
+	struct fanotify_fs *fs;
+
+	for (fs = fa->filesystems; fs != NULL; fs = fs->next) {
+		if (memcmp(&fs->fsid, fsid, sizeof(fs->fsid)) == 0) {
+			return fs;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Find the watch interested in an event in directory "dir", either
+ * directly or as a subdirectory of the watched path.
+ *
+ * notifyd does its own matching against all the notify instances
+ * along the path when it gets the event, so one callback per event
+ * is enough even if many watches cover it.
+ */
+static struct fanotify_watch_context *fanotify_find_watch(
+	struct fanotify_private *fa,
+	struct fanotify_fs *fs,
+	const char *dir,
+	uint32_t filter,
+	bool skip_creation)
+{
+	struct fanotify_watch_context *w;
+	size_t dirlen = strlen(dir);
+
+	for (w = fa->watches; w != NULL; w = w->next) {
+		uint32_t w_filter;
+
+		if (w->fs != fs) {
+			continue;
+		}
+		if (dirlen < w->pathlen) {
+			continue;
+		}
+		if (memcmp(dir, w->path, w->pathlen) != 0) {
+			continue;
+		}
+
+		if (dirlen == w->pathlen) {
+			w_filter = w->filter;
+		} else if (dir[w->pathlen] == '/') {
+			w_filter = w->subdir_filter;
+		} else {
+			continue;
+		}
+
+		if ((w_filter & filter) == 0) {
+			continue;
+		}
+		if (skip_creation &&
+		    (w_filter & FILE_NOTIFY_CHANGE_CREATION)) {
+			continue;
+		}
+		return w;
+	}
+
+	return NULL;
+}
+
+/*
+ * Turn the directory file handle of an event into a path. Events
+ * come in bursts for the same directory, so remember the last one
+ * for the rest of the batch.
+ */
+struct fanotify_dir_cache {
+	TALLOC_CTX *mem_ctx;
+	struct fanotify_fs *fs;
+	struct file_handle *handle;
+	char *path;
+};
+
+static const char *fanotify_dir_path(struct fanotify_dir_cache *cache,
+				     struct fanotify_fs *fs,
+				     struct file_handle *handle)
+{
+	size_t handle_size = sizeof(*handle) + handle->handle_bytes;
+	struct sys_proc_fd_path_buf buf;
+	char path[PATH_MAX];
+	ssize_t len;
+	int fd;
+
+	if ((cache->fs == fs) &&
+	    (cache->handle != NULL) &&
+	    (cache->handle->handle_bytes == handle->handle_bytes) &&
+	    (memcmp(cache->handle, handle, handle_size) == 0)) {
+		return cache->path;
+	}
+
+	fd = open_by_handle_at(fs->mount_fd, handle, O_PATH);
+	if (fd == -1) {
+		/* The directory might already be gone */
+		DBG_DEBUG("open_by_handle_at failed: %s\n", strerror(errno));
+		return NULL;
+	}
+	len = readlink(sys_proc_fd_path(fd, &buf), path, sizeof(path)-1);
+	close(fd);
+	if (len == -1) {
+		DBG_DEBUG("readlink failed: %s\n", strerror(errno));
+		return NULL;
+	}
+	path[len] = '\0';
+
+	TALLOC_FREE(cache->handle);
+	TALLOC_FREE(cache->path);
+
+	cache->handle = talloc_memdup(cache->mem_ctx, handle, handle_size);
+	cache->path = talloc_strdup(cache->mem_ctx, path);
+	if ((cache->handle == NULL) || (cache->path == NULL)) {
+		TALLOC_FREE(cache->handle);
+		TALLOC_FREE(cache->path);
+		return NULL;
+	}
+	cache->fs = fs;
+
+	return cache->path;
+}
+
+/*
+ * Get the directory an event happened in and the name within it
+ */
+static bool fanotify_event_path(TALLOC_CTX *mem_ctx,
+				struct fanotify_private *fa,
+				struct fanotify_dir_cache *cache,
+				const struct fanotify_event_metadata *md,
+				struct fanotify_fs **pfs,
+				const char **pdir,
+				const char **pname)
+{
+	const struct fanotify_event_info_fid *info = NULL;
+	struct file_handle *handle = NULL;
+	struct fanotify_fs *fs = NULL;
+	const char *dir = NULL;
+	const char *name = NULL;
+	const char *end = (const char *)md + md->event_len;
+
+	if (md->event_len < md->metadata_len + sizeof(*info)) {
+		return false;
+	}
+
+	info = (const struct fanotify_event_info_fid *)
+		((const char *)md + md->metadata_len);
+	if (info->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+		DBG_DEBUG("Unexpected info type %u\n",
+			  (unsigned)info->hdr.info_type);
+		return false;
+	}
+
+	fs = fanotify_find_fs_by_fsid(fa, &info->fsid);
+	if (fs == NULL) {
+		/* Mark removed in between */
+		return false;
+	}
+
+	handle = (struct file_handle *)discard_const_p(
+		unsigned char, info->handle);
+	name = (const char *)handle->f_handle + handle->handle_bytes;
+	if ((name >= end) || (strnlen(name, end - name) == (size_t)(end - name))) {
+		DBG_WARNING("Invalid event name\n");
+		return false;
+	}
+
+	dir = fanotify_dir_path(cache, fs, handle);
+	if (dir == NULL) {
+		return false;
+	}
+
+	if (ISDOT(name)) {
+		/*
+		 * An event on the directory itself, report it in its
+		 * parent like inotify does.
+		 */
+		const char *p = strrchr(dir, '/');
+		char *parent = NULL;
+
+		if ((p == NULL) || (p == dir)) {
+			return false;
+		}
+		parent = talloc_strndup(mem_ctx, dir, p - dir);
+		if (parent == NULL) {
+			return false;
+		}
+		dir = parent;
+		name = p + 1;
+	}
+
+	*pfs = fs;
+	*pdir = dir;
+	*pname = name;
+	return true;
+}
+
+/*
+  dispatch one fanotify event
+
+  fanotify does not give us rename cookies. The kernel queues the
+  FAN_MOVED_FROM and FAN_MOVED_TO of one rename back to back, so we
+  pair them up by looking at the neighbouring events.
+*/
+static void fanotify_dispatch(struct fanotify_private *fa,
+			      struct fanotify_dir_cache *cache,
+			      const struct fanotify_event_metadata *md,
+			      uint64_t prev_mask,
+			      const struct fanotify_event_metadata *md2)
+{
+	TALLOC_CTX *frame = NULL;
+	struct fanotify_watch_context *w = NULL;
+	struct fanotify_fs *fs = NULL;
+	struct notify_event ne;
+	const char *dir = NULL;
+	const char *name = NULL;
+	uint32_t filter;
+	bool ok;
+
+	DBG_DEBUG("mask=%"PRIx64"\n", (uint64_t)md->mask);
+
+	if ((md->mask & (FAN_ATTRIB|FAN_MODIFY|FAN_CREATE|FAN_DELETE|
+			 FAN_MOVED_FROM|FAN_MOVED_TO)) == 0) {
+		return;
+	}
+
+	if (md->mask & FAN_CREATE) {
+		ne.action = NOTIFY_ACTION_ADDED;
+	} else if (md->mask & FAN_DELETE) {
+		ne.action = NOTIFY_ACTION_REMOVED;
+	} else if (md->mask & FAN_MOVED_FROM) {
+		if ((md2 != NULL) && (md2->mask & FAN_MOVED_TO)) {
+			ne.action = NOTIFY_ACTION_OLD_NAME;
+		} else {
+			ne.action = NOTIFY_ACTION_REMOVED;
+		}
+	} else if (md->mask & FAN_MOVED_TO) {
+		if (prev_mask & FAN_MOVED_FROM) {
+			ne.action = NOTIFY_ACTION_NEW_NAME;
+		} else {
+			ne.action = NOTIFY_ACTION_ADDED;
+		}
+	} else {
+		ne.action = NOTIFY_ACTION_MODIFIED;
+	}
+
+	frame = talloc_stackframe();
+
+	ok = fanotify_event_path(frame, fa, cache, md, &fs, &dir, &name);
+	if (!ok) {
+		TALLOC_FREE(frame);
+		return;
+	}
+
+	filter = fanotify_map_mask_to_filter(md->mask);
+
+	DBG_DEBUG("ne.action = %d, dir = %s, name = %s, filter = %"PRIu32"\n",
+		  ne.action, dir, name, filter);
+
+	ne.dir = dir;
+	ne.path = name;
+
+	w = fanotify_find_watch(fa, fs, dir, filter, false);
+	if (w != NULL) {
+		w->callback(fa->ctx, w->private_data, &ne, filter);
+	}
+
+	if ((ne.action == NOTIFY_ACTION_NEW_NAME) &&
+	    ((md->mask & FAN_ONDIR) == 0)) {
+
+		/*
+		 * SMB expects a file rename to generate three events, two for
+		 * the rename and the other for a modify of the
+		 * destination. Strange!
+		 */
+
+		ne.action = NOTIFY_ACTION_MODIFIED;
+		filter = fanotify_map_mask_to_filter(FAN_ATTRIB);
+
+		w = fanotify_find_watch(fa, fs, dir, filter, true);
+		if (w != NULL) {
+			w->callback(fa->ctx, w->private_data, &ne, filter);
+		}
+	}
+
+	TALLOC_FREE(frame);
+}
+
+/*
+ * The kernel dropped events, we can't tell which watches missed
+ * something. Tell all of them to rescan: An event with an empty name
+ * in the watched directory itself ends up as the
+ * NT_STATUS_NOTIFY_ENUM_DIR catch-all response in smbd.
+ */
+static void fanotify_rescan(struct fanotify_private *fa)
+{
+	struct fanotify_watch_context *w = NULL;
+	struct fanotify_watch_context *next = NULL;
+
+	for (w = fa->watches; w != NULL; w = next) {
+		struct notify_event ne = {
+			.action = NOTIFY_ACTION_MODIFIED,
+			.dir = w->path,
+			.path = "",
+		};
+
+		/* The callback might free the watch */
+		next = w->next;
+
+		w->callback(fa->ctx,
+			    w->private_data,
+			    &ne,
+			    w->filter | w->subdir_filter);
+	}
+}
+
+/*
+  called when the kernel has some events for us
+*/
+static void fanotify_handler(struct tevent_context *ev, struct tevent_fd *fde,
+			     uint16_t flags, void *private_data)
+{
+	struct fanotify_private *fa = talloc_get_type_abort(
+		private_data, struct fanotify_private);
+	struct fanotify_dir_cache cache = { .fs = NULL };
+	struct fanotify_event_metadata *md = NULL;
+	TALLOC_CTX *frame = NULL;
+	uint64_t prev_mask = 0;
+	ssize_t len;
+
+	len = read(fa->fd, fa->buf, FANOTIFY_BUFSIZE);
+	if (len == -1) {
+		if ((errno == EAGAIN) || (errno == EINTR)) {
+			return;
+		}
+		DBG_ERR("Failed to read fanotify events - %s\n",
+			strerror(errno));
+		TALLOC_FREE(fde);
+		return;
+	}
+
+	frame = talloc_stackframe();
+	cache.mem_ctx = frame;
+
+	md = (struct fanotify_event_metadata *)fa->buf;
+
+	/* we get all events that fit into the buffer in one go */
+	while (FAN_EVENT_OK(md, len)) {
+		struct fanotify_event_metadata *md2 = NULL;
+		ssize_t rest;
+
+		if (md->vers != FANOTIFY_METADATA_VERSION) {
+			DBG_ERR("fanotify metadata version mismatch: "
+				"got %u expected %u\n",
+				(unsigned)md->vers,
+				(unsigned)FANOTIFY_METADATA_VERSION);
+			TALLOC_FREE(fde);
+			break;
+		}
+
+		if (md->mask & FAN_Q_OVERFLOW) {
+			DBG_NOTICE("fanotify event queue overflowed\n");
+			fanotify_rescan(fa);
+		}
+
+		rest = len;
+		md2 = FAN_EVENT_NEXT(md, rest);
+		if (!FAN_EVENT_OK(md2, rest)) {
+			md2 = NULL;
+		}
+
+		fanotify_dispatch(fa, &cache, md, prev_mask, md2);
+
+		prev_mask = md->mask;
+		md = FAN_EVENT_NEXT(md, len);
+	}
+
+	TALLOC_FREE(frame);
+}
+
+/*
+  setup the fanotify handle - called the first time a watch is added on
+  this context
+*/
+static int fanotify_setup(struct sys_notify_context *ctx)
+{
+	struct fanotify_private *fa;
+	struct tevent_fd *fde;
+
+	fa = talloc_zero(ctx, struct fanotify_private);
+	if (fa == NULL) {
+		return ENOMEM;
+	}
+
+	fa->buf = talloc_array(fa, uint8_t, FANOTIFY_BUFSIZE);
+	if (fa->buf == NULL) {
+		TALLOC_FREE(fa);
+		return ENOMEM;
+	}
+
+	fa->fd = fanotify_init(FAN_CLASS_NOTIF|FAN_REPORT_DFID_NAME|
+			       FAN_CLOEXEC|FAN_NONBLOCK,
+			       O_RDONLY);
+	if (fa->fd == -1) {
+		int ret = errno;
+		DBG_ERR("Failed to init fanotify - %s\n", strerror(ret));
+		TALLOC_FREE(fa);
+		return ret;
+	}
+	fa->ctx = ctx;
+
+	ctx->private_data = fa;
+	talloc_set_destructor(fa, fanotify_destructor);
+
+	/* add a event waiting for the fanotify fd to be readable */
+	fde = tevent_add_fd(ctx->ev, fa, fa->fd, TEVENT_FD_READ,
+			    fanotify_handler, fa);
+	if (fde == NULL) {
+		ctx->private_data = NULL;
+		TALLOC_FREE(fa);
+		return ENOMEM;
+	}
+	return 0;
+}
+
+/*
+ * Make sure the filesystem "path" lives on is marked with at least
+ * "mask"
+ */
+static int fanotify_fs_add(struct fanotify_private *fa,
+			   const char *path,
+			   uint64_t mask,
+			   struct fanotify_fs **pfs)
+{
+	struct fanotify_fs *fs = NULL;
+	struct statfs sfs;
+	struct stat st;
+	int mount_fd;
+	int ret;
+
+	mount_fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if (mount_fd == -1) {
+		return errno;
+	}
+
+	ret = fstat(mount_fd, &st);
+	if (ret == -1) {
+		ret = errno;
+		close(mount_fd);
+		return ret;
+	}
+
+	for (fs = fa->filesystems; fs != NULL; fs = fs->next) {
+		if (fs->dev == st.st_dev) {
+			break;
+		}
+	}
+
+	if (fs != NULL) {
+		close(mount_fd);
+		mount_fd = -1;
+	} else {
+		ret = fstatfs(mount_fd, &sfs);
+		if (ret == -1) {
+			ret = errno;
+			close(mount_fd);
+			return ret;
+		}
+
+		fs = talloc_zero(fa, struct fanotify_fs);
+		if (fs == NULL) {
+			close(mount_fd);
+			return ENOMEM;
+		}
+		fs->fa = fa;
+		fs->dev = st.st_dev;
+		fs->fsid = sfs.f_fsid;
+		fs->mount_fd = mount_fd;
+		DLIST_ADD(fa->filesystems, fs);
+		talloc_set_destructor(fs, fanotify_fs_destructor);
+	}
+
+	if ((fs->mask & mask) != mask) {
+		ret = fanotify_mark(fa->fd,
+				    FAN_MARK_ADD|FAN_MARK_FILESYSTEM,
+				    mask|FAN_ONDIR,
+				    fs->mount_fd,
+				    NULL);
+		if (ret == -1) {
+			ret = errno;
+			DBG_WARNING("fanotify_mark for %s failed: %s\n",
+				    path, strerror(ret));
+			if (fs->num_watches == 0) {
+				TALLOC_FREE(fs);
+			}
+			return ret;
+		}
+		DBG_DEBUG("Marked filesystem of %s with %"PRIx64"\n",
+			  path, fs->mask | mask);
+		fs->mask |= mask;
+	}
+
+	fs->num_watches += 1;
+	*pfs = fs;
+	return 0;
+}
+
+/*
+  destroy a watch
+*/
+static int watch_destructor(struct fanotify_watch_context *w)
+{
+	struct fanotify_private *fa = w->fa;
+	struct fanotify_fs *fs = w->fs;
+	struct fanotify_watch_context *w2 = NULL;
+	uint64_t mask = 0;
+	int ret;
+
+	DLIST_REMOVE(fa->watches, w);
+
+	SMB_ASSERT(fs->num_watches > 0);
+	fs->num_watches -= 1;
+
+	if (fs->num_watches == 0) {
+		DBG_DEBUG("Removing fanotify mark for dev %ju\n",
+			  (uintmax_t)fs->dev);
+		ret = fanotify_mark(fa->fd,
+				    FAN_MARK_REMOVE|FAN_MARK_FILESYSTEM,
+				    fs->mask|FAN_ONDIR,
+				    fs->mount_fd,
+				    NULL);
+		if (ret == -1) {
+			DBG_NOTICE("fanotify_mark returned %s\n",
+				   strerror(errno));
+		}
+		TALLOC_FREE(fs);
+		return 0;
+	}
+
+	for (w2 = fa->watches; w2 != NULL; w2 = w2->next) {
+		if (w2->fs == fs) {
+			mask |= w2->mask;
+		}
+	}
+
+	if (mask != fs->mask) {
+		ret = fanotify_mark(fa->fd,
+				    FAN_MARK_REMOVE|FAN_MARK_FILESYSTEM,
+				    fs->mask & ~mask,
+				    fs->mount_fd,
+				    NULL);
+		if (ret == -1) {
+			DBG_NOTICE("fanotify_mark returned %s\n",
+				   strerror(errno));
+			return 0;
+		}
+		fs->mask = mask;
+	}
+
+	return 0;
+}
+
+/*
+ * Is any filesystem mounted somewhere below "path"? Our mark does not
+ * see events in there. If we can't tell, assume there is.
+ */
+static bool fanotify_has_submounts(const char *path)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	size_t pathlen = strlen(path);
+	char **lines = NULL;
+	int i, numlines;
+
+	lines = file_lines_load("/proc/self/mountinfo", &numlines, 0, frame);
+	if (lines == NULL) {
+		DBG_NOTICE("Could not read /proc/self/mountinfo\n");
+		TALLOC_FREE(frame);
+		return true;
+	}
+
+	for (i=0; i<numlines; i++) {
+		char *mnt = lines[i];
+		char *p = NULL;
+		char *q = NULL;
+		int field;
+
+		/*
+		 * The 5th field is the mount point, with space, tab,
+		 * newline and backslash escaped as \ooo
+		 */
+		for (field = 0; (field < 4) && (mnt != NULL); field++) {
+			mnt = strchr(mnt, ' ');
+			if (mnt != NULL) {
+				mnt += 1;
+			}
+		}
+		if (mnt == NULL) {
+			continue;
+		}
+		p = strchr(mnt, ' ');
+		if (p != NULL) {
+			*p = '\0';
+		}
+
+		for (p = q = mnt; *p != '\0'; q++) {
+			if ((p[0] == '\\') &&
+			    (p[1] >= '0') && (p[1] <= '3') &&
+			    (p[2] >= '0') && (p[2] <= '7') &&
+			    (p[3] >= '0') && (p[3] <= '7')) {
+				*q = ((p[1] - '0') << 6) |
+					((p[2] - '0') << 3) |
+					(p[3] - '0');
+				p += 4;
+			} else {
+				*q = *p++;
+			}
+		}
+		*q = '\0';
+
+		if (pathlen == 1) {
+			/* path is "/" */
+			if (mnt[1] != '\0') {
+				break;
+			}
+			continue;
+		}
+		if ((strncmp(mnt, path, pathlen) == 0) &&
+		    (mnt[pathlen] == '/')) {
+			break;
+		}
+	}
+
+	TALLOC_FREE(frame);
+	return (i < numlines);
+}
+
+/*
+  add a watch. The watch is removed when the caller calls
+  talloc_free() on *handle
+
+  The filesystem mark covers the whole tree below "path", so unlike
+  inotify we also take care of subdir_filter. Subdirectories that
+  are mount points of other filesystems are not covered by the mark,
+  if there are any we leave *subdir_filter alone so that notifyd
+  keeps reporting the events smbd sees itself in there. Mounts
+  showing up below "path" after the watch was set up go unnoticed.
+*/
+int fanotify_watch(TALLOC_CTX *mem_ctx,
+		   struct sys_notify_context *ctx,
+		   const char *path,
+		   uint32_t *filter,
+		   uint32_t *subdir_filter,
+		   void (*callback)(struct sys_notify_context *ctx,
+				    void *private_data,
+				    struct notify_event *ev,
+				    uint32_t filter),
+		   void *private_data,
+		   void *handle_p)
+{
+	struct fanotify_private *fa;
+	struct fanotify_watch_context *w;
+	uint32_t orig_filter = *filter;
+	uint32_t orig_subdir_filter = *subdir_filter;
+	void **handle = (void **)handle_p;
+	uint64_t mask;
+	int ret;
+
+	/* maybe setup the fanotify fd */
+	if (ctx->private_data == NULL) {
+		ret = fanotify_setup(ctx);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	fa = talloc_get_type_abort(ctx->private_data,
+				   struct fanotify_private);
+
+	mask = fanotify_map(filter);
+	mask |= fanotify_map(subdir_filter);
+	if (mask == 0) {
+		/* this filter can't be handled by fanotify */
+		return EINVAL;
+	}
+
+	w = talloc_zero(mem_ctx, struct fanotify_watch_context);
+	if (w == NULL) {
+		*filter = orig_filter;
+		*subdir_filter = orig_subdir_filter;
+		return ENOMEM;
+	}
+
+	w->fa = fa;
+	w->callback = callback;
+	w->private_data = private_data;
+	w->mask = mask;
+	w->filter = orig_filter;
+	w->subdir_filter = orig_subdir_filter;
+	w->path = talloc_strdup(w, path);
+	if (w->path == NULL) {
+		*filter = orig_filter;
+		*subdir_filter = orig_subdir_filter;
+		TALLOC_FREE(w);
+		return ENOMEM;
+	}
+	w->pathlen = strlen(w->path);
+
+	ret = fanotify_fs_add(fa, path, mask, &w->fs);
+	if (ret != 0) {
+		*filter = orig_filter;
+		*subdir_filter = orig_subdir_filter;
+		TALLOC_FREE(w);
+		DBG_NOTICE("fanotify_fs_add for %s returned %s\n",
+			   path, strerror(ret));
+		return ret;
+	}
+
+	if ((orig_subdir_filter != 0) && fanotify_has_submounts(path)) {
+		DBG_DEBUG("%s has mounts below it, not taking over "
+			  "subdir_filter %"PRIx32"\n",
+			  path, orig_subdir_filter);
+		*subdir_filter = orig_subdir_filter;
+	}
+
+	(*handle) = w;
+
+	DLIST_ADD(fa->watches, w);
+
+	/* the caller frees the handle to stop watching */
+	talloc_set_destructor(w, watch_destructor);
+
+	return 0;
+}
@@ -22,6 +22,7 @@
 #include "notifyd_private.h"
 #include "lib/util/server_id.h"
 #include "lib/util/data_blob.h"
+#include "lib/util/fault.h"
 #include "librpc/gen_ndr/notify.h"
 #include "librpc/gen_ndr/messaging.h"
 #include "librpc/gen_ndr/server_id.h"
@@ -45,6 +46,13 @@
 #endif
 
 struct notifyd_peer;
+struct notifyd_trie_node;
+struct notifyd_pending_event;
+
+/*
+ * Window for collecting duplicate events before sending them
+ */
+#define NOTIFYD_COALESCE_USEC 5000
 
 /*
  * All of notifyd's state
@@ -68,6 +76,26 @@ struct notifyd_state {
 	 */
 	struct db_context *entries;
 
+	/*
+	 * Path trie over the keys of "entries". notifyd_trigger only
+	 * looks at prefixes of the changed path somebody is
+	 * interested in and stops walking the path as soon as there
+	 * is no watched directory further down. NULL if we failed to
+	 * keep it up to date, then notifyd_trigger looks up every
+	 * prefix.
+	 */
+	struct notifyd_trie_node *trie;
+
+	/*
+	 * MSG_PVFS_NOTIFY messages to be sent. They are collected for
+	 * NOTIFYD_COALESCE_USEC so that duplicates, for example from
+	 * a series of writes to the same file, are only sent once.
+	 */
+	struct notifyd_pending_event *pending;
+	size_t num_pending;
+	struct db_context *pending_index;
+	struct tevent_timer *flush_timer;
+
 	/*
 	 * In the cluster case, this is the place where we store a log
 	 * of all MSG_SMB_NOTIFY_REC_CHANGE messages. We just 1:1
@@ -206,6 +234,11 @@ struct tevent_req *notifyd_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 		return tevent_req_post(req, ev);
 	}
 
+	state->trie = talloc_zero(state, struct notifyd_trie_node);
+	if (tevent_req_nomem(state->trie, req)) {
+		return tevent_req_post(req, ev);
+	}
+
 	status = messaging_register(msg_ctx, state, MSG_SMB_NOTIFY_REC_CHANGE,
 				    notifyd_rec_change);
 	if (tevent_req_nterror(req, status)) {
@@ -474,6 +507,179 @@ fail:
 	return ok;
 }
 
+/*
+ * One node per path component of a directory somebody watches.
+ * Children are sorted by name for binary search.
+ */
+struct notifyd_trie_node {
+	struct notifyd_trie_node *parent;
+	struct notifyd_trie_node **children;
+	size_t num_children;
+	bool has_entry;
+	size_t namelen;
+	char *name;
+};
+
+static struct notifyd_trie_node *notifyd_trie_child(
+	struct notifyd_trie_node *node,
+	const char *name,
+	size_t namelen,
+	size_t *pidx)
+{
+	size_t lo = 0;
+	size_t hi = node->num_children;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct notifyd_trie_node *child = node->children[mid];
+		int cmp;
+
+		cmp = memcmp(child->name, name, MIN(child->namelen, namelen));
+		if (cmp == 0) {
+			cmp = (child->namelen > namelen) -
+				(child->namelen < namelen);
+		}
+		if (cmp == 0) {
+			*pidx = mid;
+			return child;
+		}
+		if (cmp < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	*pidx = lo;
+	return NULL;
+}
+
+/*
+ * Walk "path" (not 0-terminated, like the entries keys) down the
+ * trie, optionally creating missing nodes
+ */
+static struct notifyd_trie_node *notifyd_trie_walk(
+	struct notifyd_trie_node *root,
+	const char *path,
+	size_t pathlen,
+	bool create)
+{
+	struct notifyd_trie_node *node = root;
+	size_t ofs = 0;
+
+	if (pathlen == 0) {
+		return root;
+	}
+	if (path[0] == '/') {
+		ofs = 1;
+	}
+
+	/*
+	 * Like in notifyd_trigger every '/' starts a new component,
+	 * so "/" is a single empty one.
+	 */
+	for (;;) {
+		const char *name = path + ofs;
+		const char *slash = memchr(name, '/', pathlen - ofs);
+		size_t namelen = (slash != NULL) ? slash - name : pathlen - ofs;
+		struct notifyd_trie_node *child = NULL;
+		struct notifyd_trie_node **tmp = NULL;
+		size_t idx;
+
+		child = notifyd_trie_child(node, name, namelen, &idx);
+		if (child == NULL) {
+			if (!create) {
+				return NULL;
+			}
+
+			tmp = talloc_realloc(node, node->children,
+					     struct notifyd_trie_node *,
+					     node->num_children + 1);
+			if (tmp == NULL) {
+				return NULL;
+			}
+			node->children = tmp;
+
+			child = talloc_zero(node, struct notifyd_trie_node);
+			if (child == NULL) {
+				return NULL;
+			}
+			child->name = talloc_memdup(child, name, namelen);
+			if ((namelen != 0) && (child->name == NULL)) {
+				TALLOC_FREE(child);
+				return NULL;
+			}
+			child->namelen = namelen;
+			child->parent = node;
+
+			memmove(&node->children[idx+1], &node->children[idx],
+				sizeof(*node->children) *
+				(node->num_children - idx));
+			node->children[idx] = child;
+			node->num_children += 1;
+		}
+
+		node = child;
+
+		if (slash == NULL) {
+			break;
+		}
+		ofs += namelen + 1;
+	}
+
+	return node;
+}
+
+static void notifyd_trie_remove(struct notifyd_trie_node *node)
+{
+	node->has_entry = false;
+
+	while ((node->parent != NULL) &&
+	       !node->has_entry &&
+	       (node->num_children == 0)) {
+		struct notifyd_trie_node *parent = node->parent;
+		size_t idx;
+
+		notifyd_trie_child(parent, node->name, node->namelen, &idx);
+		SMB_ASSERT(parent->children[idx] == node);
+
+		memmove(&parent->children[idx], &parent->children[idx+1],
+			sizeof(*parent->children) *
+			(parent->num_children - idx - 1));
+		parent->num_children -= 1;
+
+		TALLOC_FREE(node);
+		node = parent;
+	}
+}
+
+/*
+ * Make the trie reflect whether "entries" has a record for "path"
+ */
+static bool notifyd_trie_update(struct notifyd_trie_node *trie,
+				struct db_context *entries,
+				const char *path,
+				size_t pathlen)
+{
+	TDB_DATA key = make_tdb_data((const uint8_t *)path, pathlen);
+	struct notifyd_trie_node *node = NULL;
+
+	if (dbwrap_exists(entries, key)) {
+		node = notifyd_trie_walk(trie, path, pathlen, true);
+		if (node == NULL) {
+			return false;
+		}
+		node->has_entry = true;
+		return true;
+	}
+
+	node = notifyd_trie_walk(trie, path, pathlen, false);
+	if (node != NULL) {
+		notifyd_trie_remove(node);
+	}
+	return true;
+}
+
 static void notifyd_sys_callback(struct sys_notify_context *ctx,
 				 void *private_data, struct notify_event *ev,
 				 uint32_t filter)
@@ -556,6 +762,23 @@ static void notifyd_rec_change(struct messaging_context *msg_ctx,
 		&src, msg->path, pathlen, &instance,
 		state->entries, state->sys_notify_watch, state->sys_notify_ctx,
 		state->msg_ctx);
+
+	if ((state->trie != NULL) &&
+	    (pathlen > 0) && (msg->path[pathlen-1] == '\0')) {
+		bool updated = notifyd_trie_update(
+			state->trie, state->entries, msg->path, pathlen-1);
+		if (!updated) {
+			/*
+			 * Without the node notifyd_trigger would not
+			 * find the watchers. Fall back to looking up
+			 * every prefix of a changed path.
+			 */
+			DBG_WARNING("notifyd_trie_update failed, "
+				    "dropping the trie\n");
+			TALLOC_FREE(state->trie);
+		}
+	}
+
 	if (!ok) {
 		DBG_DEBUG("notifyd_apply_rec_change failed, ignoring\n");
 		return;
@@ -606,10 +829,11 @@ static void notifyd_rec_change(struct messaging_context *msg_ctx,
 }
 
 struct notifyd_trigger_state {
-	struct messaging_context *msg_ctx;
+	struct notifyd_state *state;
 	struct notify_trigger_msg *msg;
 	bool recursive;
 	bool covered_by_sys_notify;
+	bool rescan;
 };
 
 static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
@@ -623,8 +847,10 @@ static void notifyd_trigger(struct messaging_context *msg_ctx,
 		private_data, struct notifyd_state);
 	struct server_id my_id = messaging_server_id(msg_ctx);
 	struct notifyd_trigger_state tstate;
+	struct notifyd_trie_node *node = NULL;
+	bool use_trie = (state->trie != NULL);
 	const char *path;
-	const char *p, *next_p;
+	const char *p, *next_p, *name;
 
 	if (data->length < offsetof(struct notify_trigger_msg, path) + 1) {
 		DBG_WARNING("message too short, ignoring: %zu\n",
@@ -636,7 +862,7 @@ static void notifyd_trigger(struct messaging_context *msg_ctx,
 		return;
 	}
 
-	tstate.msg_ctx = msg_ctx;
+	tstate.state = state;
 
 	tstate.covered_by_sys_notify = (src.vnn == my_id.vnn);
 	tstate.covered_by_sys_notify &= !server_id_equal(&src, &my_id);
@@ -656,21 +882,51 @@ static void notifyd_trigger(struct messaging_context *msg_ctx,
 		return;
 	}
 
+	/*
+	 * A trailing slash with no name is a rescan request from the
+	 * sys_notify backend for just that directory, see
+	 * fanotify_rescan(). Watchers of parent directories are not
+	 * interested.
+	 */
+	tstate.rescan = (path[strlen(path)-1] == '/');
+
+	node = state->trie;
+	name = path + 1;
+
 	for (p = strchr(path+1, '/'); p != NULL; p = next_p) {
 		ptrdiff_t path_len = p - path;
 		TDB_DATA key;
+		size_t idx;
 		uint32_t i;
 
 		next_p = strchr(p+1, '/');
 		tstate.recursive = (next_p != NULL);
 
+		if (node != NULL) {
+			node = notifyd_trie_child(node, name, p - name, &idx);
+		}
+		name = p + 1;
+
+		if (use_trie && (node == NULL) && (state->peers == NULL)) {
+			/*
+			 * Nobody watches anything further down
+			 */
+			break;
+		}
+
+		if (tstate.rescan && tstate.recursive) {
+			continue;
+		}
+
 		DBG_DEBUG("Trying path %.*s\n", (int)path_len, path);
 
 		key = (TDB_DATA) { .dptr = discard_const_p(uint8_t, path),
 				   .dsize = path_len };
 
-		dbwrap_parse_record(state->entries, key,
-				    notifyd_trigger_parser, &tstate);
+		if (!use_trie || ((node != NULL) && node->has_entry)) {
+			dbwrap_parse_record(state->entries, key,
+					    notifyd_trigger_parser, &tstate);
+		}
 
 		if (state->peers == NULL) {
 			continue;
@@ -697,6 +953,202 @@ static void notifyd_send_delete(struct messaging_context *msg_ctx,
 				TDB_DATA key,
 				struct notifyd_instance *instance);
 
+/*
+ * A MSG_PVFS_NOTIFY waiting for the flush timer
+ */
+struct notifyd_pending_event {
+	struct server_id client;
+	struct notify_event_msg msg;
+	char *watch_path;	/* entries key, for notifyd_send_delete */
+	char *path;		/* relative to watch_path */
+};
+
+static void notifyd_flush_events(struct tevent_context *ev,
+				 struct tevent_timer *te,
+				 struct timeval current_time,
+				 void *private_data);
+
+static void notifyd_pending_index_parser(TDB_DATA key, TDB_DATA data,
+					 void *private_data)
+{
+	uint32_t *pidx = private_data;
+
+	if (data.dsize == sizeof(*pidx)) {
+		memcpy(pidx, data.dptr, sizeof(*pidx));
+	}
+}
+
+/*
+ * Queue an event for a client. If the last event queued for the
+ * same notify instance and name is the same action, the client would
+ * not learn anything new, drop it. We must not drop it if there was
+ * a different action in between, the order matters for
+ * added/removed/renamed.
+ */
+static void notifyd_queue_event(struct notifyd_state *state,
+				struct server_id client,
+				TDB_DATA watch_key,
+				const struct notify_event_msg *msg,
+				const char *path)
+{
+	struct notifyd_pending_event *tmp = NULL;
+	struct notifyd_pending_event *e = NULL;
+	size_t pathlen = strlen(path);
+	uint8_t *keybuf = NULL;
+	TDB_DATA key;
+	uint32_t idx = UINT32_MAX;
+	NTSTATUS status;
+
+	keybuf = talloc_array(state,
+			      uint8_t,
+			      SERVER_ID_BUF_LENGTH + sizeof(void *) + pathlen);
+	if (keybuf == NULL) {
+		DBG_WARNING("talloc_array failed\n");
+		return;
+	}
+	key = make_tdb_data(keybuf, talloc_get_size(keybuf));
+
+	server_id_put(keybuf, client);
+	memcpy(keybuf + SERVER_ID_BUF_LENGTH,
+	       &msg->private_data,
+	       sizeof(void *));
+	memcpy(keybuf + SERVER_ID_BUF_LENGTH + sizeof(void *), path, pathlen);
+
+	if (state->pending_index == NULL) {
+		state->pending_index = db_open_rbt(state);
+		if (state->pending_index == NULL) {
+			DBG_WARNING("db_open_rbt failed\n");
+			goto done;
+		}
+	}
+
+	dbwrap_parse_record(state->pending_index, key,
+			    notifyd_pending_index_parser, &idx);
+
+	if ((idx < state->num_pending) &&
+	    (state->pending[idx].msg.action == msg->action)) {
+		DBG_DEBUG("Dropping duplicate event %"PRIu32" for %s\n",
+			  msg->action, path);
+		goto done;
+	}
+
+	if (state->num_pending >= UINT32_MAX) {
+		DBG_WARNING("Too many pending events\n");
+		goto done;
+	}
+
+	tmp = talloc_realloc(state, state->pending,
+			     struct notifyd_pending_event,
+			     state->num_pending + 1);
+	if (tmp == NULL) {
+		DBG_WARNING("talloc_realloc failed\n");
+		goto done;
+	}
+	state->pending = tmp;
+
+	e = &state->pending[state->num_pending];
+	*e = (struct notifyd_pending_event) {
+		.client = client,
+		.msg = *msg,
+	};
+	e->watch_path = talloc_strndup(state->pending,
+				       (const char *)watch_key.dptr,
+				       watch_key.dsize);
+	e->path = talloc_strdup(state->pending, path);
+	if ((e->watch_path == NULL) || (e->path == NULL)) {
+		DBG_WARNING("talloc_strdup failed\n");
+		TALLOC_FREE(e->watch_path);
+		TALLOC_FREE(e->path);
+		goto done;
+	}
+
+	idx = state->num_pending;
+	status = dbwrap_store(state->pending_index, key,
+			      make_tdb_data((uint8_t *)&idx, sizeof(idx)), 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_DEBUG("dbwrap_store failed: %s\n", nt_errstr(status));
+	}
+
+	state->num_pending += 1;
+
+	if (state->flush_timer == NULL) {
+		state->flush_timer = tevent_add_timer(
+			state->ev,
+			state,
+			tevent_timeval_current_ofs(0, NOTIFYD_COALESCE_USEC),
+			notifyd_flush_events,
+			state);
+		if (state->flush_timer == NULL) {
+			DBG_WARNING("tevent_add_timer failed\n");
+			notifyd_flush_events(state->ev, NULL,
+					     tevent_timeval_zero(), state);
+		}
+	}
+done:
+	TALLOC_FREE(keybuf);
+}
+
+static void notifyd_flush_events(struct tevent_context *ev,
+				 struct tevent_timer *te,
+				 struct timeval current_time,
+				 void *private_data)
+{
+	struct notifyd_state *state = talloc_get_type_abort(
+		private_data, struct notifyd_state);
+	struct notifyd_pending_event *pending = state->pending;
+	size_t num_pending = state->num_pending;
+	size_t i;
+
+	state->flush_timer = NULL;
+	state->pending = NULL;
+	state->num_pending = 0;
+	TALLOC_FREE(state->pending_index);
+
+	DBG_DEBUG("Sending %zu events\n", num_pending);
+
+	for (i=0; i<num_pending; i++) {
+		struct notifyd_pending_event *e = &pending[i];
+		struct server_id_buf idbuf;
+		struct iovec iov[2];
+		NTSTATUS status;
+
+		iov[0].iov_base = &e->msg;
+		iov[0].iov_len = offsetof(struct notify_event_msg, path);
+		iov[1].iov_base = e->path;
+		iov[1].iov_len = strlen(e->path) + 1;
+
+		status = messaging_send_iov(
+			state->msg_ctx, e->client,
+			MSG_PVFS_NOTIFY, iov, ARRAY_SIZE(iov), NULL, 0);
+
+		DBG_DEBUG("messaging_send_iov to %s returned %s\n",
+			  server_id_str_buf(e->client, &idbuf),
+			  nt_errstr(status));
+
+		if (NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_NOT_FOUND) &&
+		    procid_is_local(&e->client)) {
+			/*
+			 * That process has died
+			 */
+			struct notifyd_instance instance = {
+				.client = e->client,
+				.instance.private_data = e->msg.private_data,
+			};
+			TDB_DATA key = string_tdb_data(e->watch_path);
+
+			notifyd_send_delete(state->msg_ctx, key, &instance);
+			continue;
+		}
+
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_WARNING("messaging_send_iov returned %s\n",
+				    nt_errstr(status));
+		}
+	}
+
+	TALLOC_FREE(pending);
+}
+
 static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 				   void *private_data)
 
@@ -704,8 +1156,8 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 	struct notifyd_trigger_state *tstate = private_data;
 	struct notify_event_msg msg = { .action = tstate->msg->action,
 					.when = tstate->msg->when };
-	struct iovec iov[2];
 	size_t path_len = key.dsize;
+	const char *path = tstate->msg->path + path_len + 1;
 	struct notifyd_instance *instances = NULL;
 	size_t num_instances = 0;
 	size_t i;
@@ -721,18 +1173,14 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 		  (int)key.dsize,
 		  (char *)key.dptr);
 
-	iov[0].iov_base = &msg;
-	iov[0].iov_len = offsetof(struct notify_event_msg, path);
-	iov[1].iov_base = tstate->msg->path + path_len + 1;
-	iov[1].iov_len = strlen((char *)(iov[1].iov_base)) + 1;
-
 	for (i=0; i<num_instances; i++) {
 		struct notifyd_instance *instance = &instances[i];
-		struct server_id_buf idbuf;
 		uint32_t i_filter;
-		NTSTATUS status;
 
-		if (tstate->covered_by_sys_notify) {
+		if (tstate->rescan) {
+			i_filter = instance->instance.filter |
+				instance->instance.subdir_filter;
+		} else if (tstate->covered_by_sys_notify) {
 			if (tstate->recursive) {
 				i_filter = instance->internal_subdir_filter;
 			} else {
@@ -752,27 +1200,8 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 
 		msg.private_data = instance->instance.private_data;
 
-		status = messaging_send_iov(
-			tstate->msg_ctx, instance->client,
-			MSG_PVFS_NOTIFY, iov, ARRAY_SIZE(iov), NULL, 0);
-
-		DBG_DEBUG("messaging_send_iov to %s returned %s\n",
-			  server_id_str_buf(instance->client, &idbuf),
-			  nt_errstr(status));
-
-		if (NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_NOT_FOUND) &&
-		    procid_is_local(&instance->client)) {
-			/*
-			 * That process has died
-			 */
-			notifyd_send_delete(tstate->msg_ctx, key, instance);
-			continue;
-		}
-
-		if (!NT_STATUS_IS_OK(status)) {
-			DBG_WARNING("messaging_send_iov returned %s\n",
-				    nt_errstr(status));
-		}
+		notifyd_queue_event(tstate->state, instance->client, key,
+				    &msg, path);
 	}
 }
 
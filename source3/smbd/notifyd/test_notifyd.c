@@ -311,6 +311,249 @@ static bool test_notifyd_dbtest1(struct torture_context *tctx)
 	return true;
 }
 
+static NTSTATUS notifyd_send_trigger(struct messaging_context *msg_ctx,
+				     struct server_id notifyd,
+				     const char *path,
+				     uint32_t action)
+{
+	struct notify_trigger_msg msg = {
+		.when = timespec_current(),
+		.action = action,
+		.filter = UINT32_MAX,
+	};
+	struct iovec iov[2];
+
+	iov[0] = (struct iovec) {
+		.iov_base = &msg,
+		.iov_len = offsetof(struct notify_trigger_msg, path),
+	};
+	iov[1] = (struct iovec) {
+		.iov_base = discard_const_p(char, path),
+		.iov_len = strlen(path)+1,
+	};
+
+	return messaging_send_iov(
+		msg_ctx,
+		notifyd,
+		MSG_SMB_NOTIFY_TRIGGER,
+		iov,
+		ARRAY_SIZE(iov),
+		NULL,
+		0);
+}
+
+struct coalesce_event {
+	uint32_t action;
+	const char *name;
+};
+
+struct coalesce_state {
+	TALLOC_CTX *mem_ctx;
+	struct coalesce_event events[16];
+	size_t num_events;
+	bool done;
+	NTSTATUS status;
+};
+
+static void coalesce_got_events(struct tevent_req *req)
+{
+	struct coalesce_state *state = tevent_req_callback_data_void(req);
+
+	while (true) {
+		uint32_t action;
+		char *path = NULL;
+		NTSTATUS status;
+
+		status = fcn_wait_recv(req, state->mem_ctx, NULL, &action,
+				       &path);
+		if (NT_STATUS_EQUAL(status, NT_STATUS_RETRY)) {
+			return;
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			state->status = status;
+			state->done = true;
+			return;
+		}
+		if (state->num_events == ARRAY_SIZE(state->events)) {
+			state->status = NT_STATUS_BUFFER_OVERFLOW;
+			continue;
+		}
+		state->events[state->num_events++] = (struct coalesce_event) {
+			.action = action, .name = path,
+		};
+	}
+}
+
+static void coalesce_timeout(struct tevent_context *ev,
+			     struct tevent_timer *te,
+			     struct timeval current_time,
+			     void *private_data)
+{
+	bool *timed_out = private_data;
+	*timed_out = true;
+}
+
+static bool test_notifyd_coalesce1(struct torture_context *tctx)
+{
+	struct tevent_context *ev = tctx->ev;
+	struct messaging_context *msg_ctx = NULL;
+	struct server_id_db *names = NULL;
+	struct server_id notifyd;
+	struct tevent_req *req = NULL;
+	struct tevent_timer *te = NULL;
+	struct coalesce_state state = {
+		.mem_ctx = tctx, .status = NT_STATUS_OK,
+	};
+	struct timeval start;
+	double elapsed;
+	bool timed_out = false;
+	size_t i, j, num_distinct;
+	NTSTATUS status;
+	bool ok;
+
+	/*
+	 * Sent back to back, so well within notifyd's 5ms coalescing
+	 * window (NOTIFYD_COALESCE_USEC)
+	 */
+	const struct coalesce_event triggers[] = {
+		{ NOTIFY_ACTION_ADDED, "a" },
+		{ NOTIFY_ACTION_MODIFIED, "b" },
+		{ NOTIFY_ACTION_MODIFIED, "b" },
+		{ NOTIFY_ACTION_MODIFIED, "b" },
+		{ NOTIFY_ACTION_REMOVED, "a" },
+		{ NOTIFY_ACTION_ADDED, "a" },
+		{ NOTIFY_ACTION_ADDED, "a" },
+		{ NOTIFY_ACTION_MODIFIED, "c" },
+	};
+
+	/*
+	 * Duplicates of the last event for a name are dropped. Other
+	 * events keep their order, also a re-add after a remove.
+	 */
+	const struct coalesce_event expected[] = {
+		{ NOTIFY_ACTION_ADDED, "a" },
+		{ NOTIFY_ACTION_MODIFIED, "b" },
+		{ NOTIFY_ACTION_REMOVED, "a" },
+		{ NOTIFY_ACTION_ADDED, "a" },
+		{ NOTIFY_ACTION_MODIFIED, "c" },
+	};
+
+	lp_load_global(tctx->lp_ctx->szConfigFile);
+
+	msg_ctx = messaging_init(tctx, ev);
+	torture_assert_not_null(tctx, msg_ctx, "messaging_init");
+
+	names = messaging_names_db(msg_ctx);
+	ok = server_id_db_lookup_one(names, "notify-daemon", &notifyd);
+	torture_assert(tctx, ok, "server_id_db_lookup_one");
+
+	/*
+	 * A directory that does not exist, so that no sys_notify
+	 * backend takes over the filter
+	 */
+	req = fcn_wait_send(msg_ctx, ev, msg_ctx, notifyd,
+			    "/notifyd-coalesce", UINT32_MAX, UINT32_MAX);
+	torture_assert_not_null(tctx, req, "fcn_wait_send");
+	tevent_req_set_callback(req, coalesce_got_events, &state);
+
+	start = timeval_current();
+
+	for (i=0; i<ARRAY_SIZE(triggers); i++) {
+		char *path = talloc_asprintf(tctx, "/notifyd-coalesce/%s",
+					     triggers[i].name);
+		torture_assert_not_null(tctx, path, "talloc_asprintf");
+
+		status = notifyd_send_trigger(msg_ctx, notifyd, path,
+					      triggers[i].action);
+		torture_assert_ntstatus_ok(tctx, status,
+					   "notifyd_send_trigger");
+		TALLOC_FREE(path);
+	}
+
+	elapsed = timeval_elapsed(&start);
+
+	/*
+	 * Give notifyd plenty of time to send anything it would
+	 * wrongly send on top
+	 */
+	te = tevent_add_timer(ev, tctx, timeval_current_ofs_msec(500),
+			      coalesce_timeout, &timed_out);
+	torture_assert_not_null(tctx, te, "tevent_add_timer");
+
+	while (!timed_out && !state.done) {
+		int ret = tevent_loop_once(ev);
+		torture_assert_int_equal(tctx, ret, 0, "tevent_loop_once");
+	}
+	TALLOC_FREE(te);
+
+	torture_assert(tctx, !state.done, "fcn_wait finished early");
+	torture_assert_ntstatus_ok(tctx, state.status, "fcn_wait_recv");
+
+	ok = tevent_req_cancel(req);
+	torture_assert(tctx, ok, "tevent_req_cancel");
+	while (!state.done) {
+		int ret = tevent_loop_once(ev);
+		torture_assert_int_equal(tctx, ret, 0, "tevent_loop_once");
+	}
+	torture_assert_ntstatus_equal(tctx, state.status, NT_STATUS_CANCELLED,
+				      "fcn_wait_recv");
+	TALLOC_FREE(req);
+
+	for (i=0; i<state.num_events; i++) {
+		torture_comment(tctx, "event %zu: %"PRIu32" %s\n",
+				i, state.events[i].action,
+				state.events[i].name);
+	}
+
+	/*
+	 * If we were too slow sending, the flush timer might have
+	 * fired in between and duplicates are legitimately seen. The
+	 * order must still be right: Drop duplicates of the previous
+	 * event for the same name and compare.
+	 */
+	num_distinct = 0;
+	for (i=0; i<state.num_events; i++) {
+		struct coalesce_event *e = &state.events[i];
+		bool dup = false;
+
+		for (j=i; j>0; j--) {
+			struct coalesce_event *prev = &state.events[j-1];
+			if (strcmp(prev->name, e->name) == 0) {
+				dup = (prev->action == e->action);
+				break;
+			}
+		}
+		if (dup) {
+			continue;
+		}
+
+		torture_assert(tctx, num_distinct < ARRAY_SIZE(expected),
+			       "too many events");
+		torture_assert_int_equal(tctx, e->action,
+					 expected[num_distinct].action,
+					 "action");
+		torture_assert_str_equal(tctx, e->name,
+					 expected[num_distinct].name,
+					 "name");
+		num_distinct += 1;
+	}
+	torture_assert_int_equal(tctx, num_distinct, ARRAY_SIZE(expected),
+				 "number of distinct events");
+
+	if (elapsed * 1000000 < 5000) {
+		torture_assert_int_equal(tctx, state.num_events,
+					 ARRAY_SIZE(expected),
+					 "duplicates not merged");
+	} else {
+		torture_comment(tctx, "Sending took %f seconds, not "
+				"checking for merged duplicates\n", elapsed);
+	}
+
+	TALLOC_FREE(msg_ctx);
+
+	return true;
+}
+
 NTSTATUS torture_notifyd_init(TALLOC_CTX *mem_ctx);
 NTSTATUS torture_notifyd_init(TALLOC_CTX *mem_ctx)
 {
@@ -334,6 +577,12 @@ NTSTATUS torture_notifyd_init(TALLOC_CTX *mem_ctx)
 	if (tcase == NULL) {
 		goto fail;
 	}
+
+	tcase = torture_suite_add_simple_test(
+		suite, "coalesce1", test_notifyd_coalesce1);
+	if (tcase == NULL) {
+		goto fail;
+	}
 	suite->description = "notifyd unit tests";
 
 	ok = torture_register_suite(mem_ctx, suite);
@@ -1571,7 +1571,7 @@ static NTSTATUS open_file(
 		}
 	}
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_fname->st));
 	fsp->vuid = req ? req->vuid : UID_FIELD_INVALID;
 	fsp->file_pid = req ? req->smbpid : 0;
 	fsp->fsp_flags.can_lock = true;
@@ -4087,7 +4087,7 @@ static NTSTATUS open_file_ntcreate(connection_struct *conn,
 		 * this won't do anything useful until the file
 		 * exists and has a valid stat struct.
 		 */
-		fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+		fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_fname->st));
 	}
 	fh_set_private_options(fsp->fh, private_flags);
 	fsp->access_mask = open_access_mask; /* We change this to the
@@ -4863,7 +4863,7 @@ static NTSTATUS open_directory(connection_struct *conn,
 	 * Setup the files_struct for it.
 	 */
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_dname->st));
 	fsp->vuid = req ? req->vuid : UID_FIELD_INVALID;
 	fsp->file_pid = req ? req->smbpid : 0;
 	fsp->fsp_flags.can_lock = false;
@@ -288,6 +288,7 @@ uint32_t filename_create_ucf_flags(struct smb_request *req, uint32_t create_disp
 NTSTATUS canonicalize_snapshot_path(struct smb_filename *smb_fname,
 				    uint32_t ucf_flags,
 				    NTTIME twrp);
+void casefold_index_forget(struct files_struct *dirfsp);
 NTSTATUS get_real_filename_full_scan_at(struct files_struct *dirfsp,
 					const char *name,
 					bool mangled,
@@ -307,6 +308,8 @@ NTSTATUS get_real_filename_at(struct files_struct *dirfsp,
 NTSTATUS fsp_new(struct connection_struct *conn, TALLOC_CTX *mem_ctx,
 		 files_struct **result);
 void fsp_set_gen_id(files_struct *fsp);
+void file_fd_changed(struct files_struct *fsp);
+void fsp_set_file_id(struct files_struct *fsp, struct file_id id);
 NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 		  files_struct **result);
 NTSTATUS fsp_bind_smb(struct files_struct *fsp, struct smb_request *req);
@@ -327,6 +330,7 @@ files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 				 bool need_fsa);
 files_struct *file_find_di_next(files_struct *start_fsp,
 				 bool need_fsa);
+NTSTATUS files_hash_check(struct smbd_server_connection *sconn);
 struct files_struct *file_find_one_fsp_from_lease_key(
 	struct smbd_server_connection *sconn,
 	const struct smb2_lease_key *lease_key);
@@ -587,6 +591,20 @@ int inotify_watch(TALLOC_CTX *mem_ctx,
 		  void *private_data,
 		  void *handle_p);
 
+/* The following definitions come from smbd/notify_fanotify.c  */
+
+int fanotify_watch(TALLOC_CTX *mem_ctx,
+		   struct sys_notify_context *ctx,
+		   const char *path,
+		   uint32_t *filter,
+		   uint32_t *subdir_filter,
+		   void (*callback)(struct sys_notify_context *ctx,
+				    void *private_data,
+				    struct notify_event *ev,
+				    uint32_t filter),
+		   void *private_data,
+		   void *handle_p);
+
 int fam_watch(TALLOC_CTX *mem_ctx,
 	      struct sys_notify_context *ctx,
 	      const char *path,
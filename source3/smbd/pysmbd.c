@@ -232,7 +232,7 @@ static NTSTATUS init_files_struct(TALLOC_CTX *mem_ctx,
 		return status;
 	}
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_fname->st));
 	fsp->vuid = UID_FIELD_INVALID;
 	fsp->file_pid = 0;
 	fsp->fsp_flags.can_lock = true;
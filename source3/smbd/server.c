@@ -58,6 +58,7 @@
 #include "cleanupdb.h"
 #include "g_lock.h"
 #include "lib/global_contexts.h"
+#include "lib/util/msghdr.h"
 #include "source3/lib/substitute.h"
 
 #ifdef CLUSTER_SUPPORT
@@ -66,6 +67,7 @@
 
 struct smbd_open_socket;
 struct smbd_child_pid;
+struct smbd_spare;
 
 struct smbd_parent_context {
 	bool interactive;
@@ -80,6 +82,11 @@ struct smbd_parent_context {
 	struct smbd_child_pid *children;
 	size_t num_children;
 
+	/* idle pre-forked children, see smbd_spares_replenish() */
+	struct smbd_spare *spares;
+	size_t num_spares;
+	struct tevent_immediate *spare_im;
+
 	struct server_id cleanupd;
 	struct server_id notifyd;
 
@@ -98,12 +105,21 @@ struct smbd_child_pid {
 	pid_t pid;
 };
 
+struct smbd_spare {
+	struct smbd_spare *prev, *next;
+	struct smbd_parent_context *parent;
+	pid_t pid;
+	int sock;
+};
+
 /*******************************************************************
  What to do when smb.conf is updated.
  ********************************************************************/
 
 static NTSTATUS messaging_send_to_children(struct messaging_context *msg_ctx,
 					   uint32_t msg_type, DATA_BLOB* data);
+static void smbd_spares_replenish(struct smbd_parent_context *parent);
+static void smbd_spare_exited(struct smbd_parent_context *parent, pid_t pid);
 
 static void smbd_parent_conf_updated(struct messaging_context *msg,
 				     void *private_data,
@@ -334,6 +350,12 @@ static struct tevent_req *notifyd_req(struct messaging_context *msg_ctx,
 		}
 #endif
 
+#ifdef HAVE_FANOTIFY
+		if (lp_parm_bool(-1, "notify", "fanotify", false)) {
+			sys_notify_watch = fanotify_watch;
+		}
+#endif
+
 #ifdef HAVE_FAM
 		if (lp_parm_bool(-1, "notify", "fam",
 				 (sys_notify_watch == NULL))) {
@@ -824,6 +846,8 @@ static void remove_child_pid(struct smbd_parent_context *parent,
 		return;
 	}
 
+	smbd_spare_exited(parent, pid);
+
 	if (pid == procid_to_pid(&parent->cleanupd)) {
 		struct tevent_req *req;
 
@@ -925,6 +949,12 @@ static void smbd_sig_chld_handler(struct tevent_context *ev,
 		}
 		remove_child_pid(parent, pid, unclean_shutdown);
 	}
+
+	/*
+	 * A spare might have died, or we are below "max smbd
+	 * processes" again.
+	 */
+	smbd_spares_replenish(parent);
 }
 
 static void smbd_setup_sig_chld_handler(struct smbd_parent_context *parent)
@@ -950,6 +980,474 @@ static void smbd_open_socket_close_fn(struct tevent_context *ev,
 	close(fd);
 }
 
+/*
+ * Common setup of a child that is going to serve a client
+ */
+static bool smbd_child_init(struct tevent_context *ev,
+			    struct messaging_context *msg_ctx)
+{
+	NTSTATUS status;
+
+	/* Stop zombies, the parent explicitly handles
+	 * them, counting worker smbds. */
+	CatchChild();
+
+	status = smbd_reinit_after_fork(msg_ctx, ev, true);
+	if (!NT_STATUS_IS_OK(status)) {
+		if (NT_STATUS_EQUAL(status,
+				    NT_STATUS_TOO_MANY_OPENED_FILES)) {
+			DEBUG(0,("child process cannot initialize "
+				 "because too many files are open\n"));
+			return false;
+		}
+		if (lp_clustering() &&
+		    (NT_STATUS_EQUAL(
+			    status, NT_STATUS_INTERNAL_DB_ERROR) ||
+		     NT_STATUS_EQUAL(
+			    status, NT_STATUS_CONNECTION_REFUSED))) {
+			DEBUG(1, ("child process cannot initialize "
+				  "because connection to CTDB "
+				  "has failed: %s\n",
+				  nt_errstr(status)));
+			return false;
+		}
+
+		DEBUG(0,("reinit_after_fork() failed\n"));
+		smb_panic("reinit_after_fork() failed");
+	}
+
+	return true;
+}
+
+/****************************************************************************
+ Pre-forked children.
+
+ With "smbd:prefork children = <n>" the parent keeps up to n idle
+ children around that have already done the per-process setup in
+ smbd_child_init(). An accepted socket is handed to one of them via
+ SCM_RIGHTS, so the client does not wait for fork() and the reinit.
+ Replacements are forked one per main loop iteration, which spreads
+ the fork load of a logon storm.
+
+ Spares count as smbd processes for "max smbd processes". An idle
+ spare waits for the socket in its tevent loop, so it handles SIGTERM,
+ SIGHUP and messages like any other child. If the parent goes away,
+ the spare sees EOF and exits.
+****************************************************************************/
+
+static int smbd_spare_destructor(struct smbd_spare *spare)
+{
+	DLIST_REMOVE(spare->parent->spares, spare);
+	spare->parent->num_spares -= 1;
+	close(spare->sock);
+	return 0;
+}
+
+static void smbd_spare_exited(struct smbd_parent_context *parent, pid_t pid)
+{
+	struct smbd_spare *spare = NULL;
+
+	for (spare = parent->spares; spare != NULL; spare = spare->next) {
+		if (spare->pid == pid) {
+			DBG_NOTICE("spare %d exited\n", (int)pid);
+			TALLOC_FREE(spare);
+			return;
+		}
+	}
+}
+
+static int smbd_spare_recv_fd(int sock)
+{
+	struct msghdr msg = { .msg_iovlen = 1 };
+	size_t bufsize = msghdr_prep_recv_fds(NULL, NULL, 0, 1);
+	uint8_t buf[bufsize];
+	struct iovec iov;
+	uint8_t c;
+	ssize_t n;
+
+	msghdr_prep_recv_fds(&msg, buf, bufsize, 1);
+
+	iov = (struct iovec) { .iov_base = &c, .iov_len = sizeof(c) };
+	msg.msg_iov = &iov;
+
+	do {
+		n = recvmsg(sock, &msg, 0);
+	} while ((n == -1) && (errno == EINTR));
+
+	if (n <= 0) {
+		return -1;
+	}
+
+	{
+		size_t num_fds = msghdr_extract_fds(&msg, NULL, 0);
+		int fds[num_fds];
+		size_t i;
+
+		msghdr_extract_fds(&msg, fds, num_fds);
+
+		if (num_fds == 1) {
+			return fds[0];
+		}
+		for (i=0; i<num_fds; i++) {
+			close(fds[i]);
+		}
+	}
+
+	return -1;
+}
+
+static bool smbd_spare_send_fd(struct smbd_spare *spare, int fd)
+{
+	struct msghdr msg = { .msg_iovlen = 1 };
+	size_t bufsize = msghdr_prep_fds(NULL, NULL, 0, &fd, 1);
+	uint8_t buf[bufsize];
+	struct iovec iov;
+	uint8_t c = 0;
+	ssize_t n;
+
+	msghdr_prep_fds(&msg, buf, bufsize, &fd, 1);
+
+	iov = (struct iovec) { .iov_base = &c, .iov_len = sizeof(c) };
+	msg.msg_iov = &iov;
+
+	do {
+		n = sendmsg(spare->sock, &msg, MSG_NOSIGNAL);
+	} while ((n == -1) && (errno == EINTR));
+
+	if (n != 1) {
+		DBG_NOTICE("sendmsg to spare %d failed: %s\n",
+			   (int)spare->pid,
+			   (n == -1) ? strerror(errno) : "short write");
+		return false;
+	}
+	return true;
+}
+
+struct smbd_spare_wait {
+	int sock;
+	int fd;
+	bool done;
+};
+
+static void smbd_spare_sock_handler(struct tevent_context *ev,
+				    struct tevent_fd *fde,
+				    uint16_t flags,
+				    void *private_data)
+{
+	struct smbd_spare_wait *state = talloc_get_type_abort(
+		private_data, struct smbd_spare_wait);
+
+	state->fd = smbd_spare_recv_fd(state->sock);
+	state->done = true;
+}
+
+static void smbd_spare_sig_term_handler(struct tevent_context *ev,
+					struct tevent_signal *se,
+					int signum,
+					int count,
+					void *siginfo,
+					void *private_data)
+{
+	exit_server_cleanly("termination signal");
+}
+
+static void smbd_spare_sig_hup_handler(struct tevent_context *ev,
+				       struct tevent_signal *se,
+				       int signum,
+				       int count,
+				       void *siginfo,
+				       void *private_data)
+{
+	DBG_NOTICE("Reloading services after SIGHUP\n");
+	change_to_root_user();
+	reload_services(NULL, NULL, false);
+}
+
+static void smbd_spare_conf_updated(struct messaging_context *msg,
+				    void *private_data,
+				    uint32_t msg_type,
+				    struct server_id server_id,
+				    DATA_BLOB *data)
+{
+	DBG_DEBUG("Got message saying smb.conf was updated. Reloading.\n");
+	change_to_root_user();
+	reload_services(NULL, NULL, false);
+}
+
+/*
+ * The spare inherits the message handlers open_sockets_smbd()
+ * registered for the parent. Most of them forward to the children
+ * via am_parent, which is NULL in the spare. Replace them before
+ * running the event loop, the same way smbd_process() does for the
+ * ones it takes over. MSG_SMB_CONF_UPDATED is registered with ev as
+ * private_data, so smbd_process() replaces it again.
+ */
+static void smbd_spare_msg_init(struct tevent_context *ev,
+				struct messaging_context *msg_ctx)
+{
+	messaging_deregister(msg_ctx, MSG_SMB_FORCE_TDIS, NULL);
+	messaging_deregister(msg_ctx, MSG_SMB_FORCE_TDIS_DENIED, NULL);
+	messaging_deregister(msg_ctx, MSG_SMB_KILL_CLIENT_IP, NULL);
+	messaging_deregister(msg_ctx, MSG_SMB_NOTIFY_STARTED, NULL);
+	messaging_deregister(msg_ctx, MSG_SMB_TELL_NUM_CHILDREN, NULL);
+	messaging_deregister(msg_ctx, ID_CACHE_KILL, NULL);
+
+	id_cache_register_msgs(msg_ctx);
+
+	messaging_deregister(msg_ctx, MSG_DEBUG, NULL);
+	messaging_register(msg_ctx, NULL, MSG_DEBUG, debug_message);
+
+	messaging_deregister(msg_ctx, MSG_SMB_CONF_UPDATED, ev);
+	messaging_register(msg_ctx, ev,
+			   MSG_SMB_CONF_UPDATED, smbd_spare_conf_updated);
+}
+
+/*
+ * Run the event loop until the parent hands us a client socket. The
+ * handlers are gone when we return, smbd_process() installs its own.
+ */
+static int smbd_spare_wait_fd(struct tevent_context *ev, int sock)
+{
+	struct smbd_spare_wait *state = NULL;
+	struct tevent_fd *fde = NULL;
+	struct tevent_signal *se = NULL;
+	int fd = -1;
+	int ret;
+
+	state = talloc_zero(ev, struct smbd_spare_wait);
+	if (state == NULL) {
+		return -1;
+	}
+	state->sock = sock;
+	state->fd = -1;
+
+	fde = tevent_add_fd(ev,
+			    state,
+			    sock,
+			    TEVENT_FD_READ,
+			    smbd_spare_sock_handler,
+			    state);
+	if (fde == NULL) {
+		goto done;
+	}
+
+	se = tevent_add_signal(ev,
+			       state,
+			       SIGTERM,
+			       0,
+			       smbd_spare_sig_term_handler,
+			       NULL);
+	if (se == NULL) {
+		goto done;
+	}
+
+	se = tevent_add_signal(ev,
+			       state,
+			       SIGHUP,
+			       0,
+			       smbd_spare_sig_hup_handler,
+			       NULL);
+	if (se == NULL) {
+		goto done;
+	}
+
+	while (!state->done) {
+		ret = tevent_loop_once(ev);
+		if (ret != 0) {
+			DBG_ERR("tevent_loop_once failed: %s\n",
+				strerror(errno));
+			goto done;
+		}
+	}
+
+	fd = state->fd;
+done:
+	TALLOC_FREE(state);
+	return fd;
+}
+
+static void smbd_spare_run(struct tevent_context *ev,
+			   struct messaging_context *msg_ctx,
+			   int sock)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	char addrstr[INET6_ADDRSTRLEN] = "";
+	int fd;
+	int ret;
+
+	if (!smbd_child_init(ev, msg_ctx)) {
+		close(sock);
+		exit_server_cleanly("spare init failed");
+		return;
+	}
+
+	process_set_title("smbd[spare]", "spare");
+
+	smbd_spare_msg_init(ev, msg_ctx);
+
+	fd = smbd_spare_wait_fd(ev, sock);
+	close(sock);
+	if (fd == -1) {
+		exit_server_cleanly("spare not needed anymore");
+		return;
+	}
+	smb_set_close_on_exec(fd);
+
+	ret = getpeername(fd, (struct sockaddr *)(void *)&addr, &addrlen);
+	if (ret == 0) {
+		print_sockaddr(addrstr, sizeof(addrstr), &addr);
+	}
+	process_set_title("smbd[%s]", "client [%s]", addrstr);
+
+	smbd_process(ev, msg_ctx, fd, false);
+	exit_server_cleanly("end of child");
+}
+
+static void smbd_spare_spawn(struct smbd_parent_context *parent)
+{
+	struct smbd_spare *spare = NULL;
+	int sv[2];
+	pid_t pid;
+	int ret;
+
+	spare = talloc_zero(parent, struct smbd_spare);
+	if (spare == NULL) {
+		return;
+	}
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	if (ret == -1) {
+		DBG_ERR("socketpair failed: %s\n", strerror(errno));
+		TALLOC_FREE(spare);
+		return;
+	}
+	smb_set_close_on_exec(sv[0]);
+	smb_set_close_on_exec(sv[1]);
+
+	pid = fork();
+	if (pid == 0) {
+		struct tevent_context *ev = parent->ev_ctx;
+		struct messaging_context *msg_ctx = parent->msg_ctx;
+
+		close(sv[0]);
+		TALLOC_FREE(spare);
+
+		/*
+		 * This also closes our listening sockets and the
+		 * parent ends of the other spares, so they see EOF
+		 * once the parent is gone.
+		 */
+		talloc_free(parent);
+		am_parent = NULL;
+
+		smbd_spare_run(ev, msg_ctx, sv[1]);
+		exit_server_cleanly("end of spare");
+		return;
+	}
+
+	close(sv[1]);
+
+	if (pid < 0) {
+		DBG_ERR("fork() failed: %s\n", strerror(errno));
+		close(sv[0]);
+		TALLOC_FREE(spare);
+		return;
+	}
+
+	add_child_pid(parent, pid);
+
+	spare->parent = parent;
+	spare->pid = pid;
+	spare->sock = sv[0];
+	DLIST_ADD_END(parent->spares, spare);
+	parent->num_spares += 1;
+	talloc_set_destructor(spare, smbd_spare_destructor);
+
+	DBG_DEBUG("forked spare %d, %zu idle\n", (int)pid, parent->num_spares);
+}
+
+static void smbd_spares_replenish_fn(struct tevent_context *ev,
+				     struct tevent_immediate *im,
+				     void *private_data)
+{
+	struct smbd_parent_context *parent = talloc_get_type_abort(
+		private_data, struct smbd_parent_context);
+	int target = lp_parm_int(GLOBAL_SECTION_SNUM,
+				 "smbd",
+				 "prefork children",
+				 0);
+
+	if ((target <= 0) || (parent->num_spares >= (size_t)target)) {
+		return;
+	}
+	if (!allowable_number_of_smbd_processes(parent)) {
+		return;
+	}
+
+	smbd_spare_spawn(parent);
+
+	/*
+	 * One fork per main loop iteration, accepting connections
+	 * goes first.
+	 */
+	smbd_spares_replenish(parent);
+}
+
+static void smbd_spares_replenish(struct smbd_parent_context *parent)
+{
+	int target;
+
+	if (parent->interactive) {
+		return;
+	}
+
+	target = lp_parm_int(GLOBAL_SECTION_SNUM,
+			     "smbd",
+			     "prefork children",
+			     0);
+	if ((target <= 0) || (parent->num_spares >= (size_t)target)) {
+		return;
+	}
+
+	if (parent->spare_im == NULL) {
+		parent->spare_im = tevent_create_immediate(parent);
+		if (parent->spare_im == NULL) {
+			return;
+		}
+	}
+	tevent_schedule_immediate(parent->spare_im,
+				  parent->ev_ctx,
+				  smbd_spares_replenish_fn,
+				  parent);
+}
+
+/*
+ * Hand an accepted socket to an idle spare
+ */
+static bool smbd_spare_take(struct smbd_parent_context *parent, int fd)
+{
+	struct smbd_spare *spare = NULL;
+
+	while ((spare = parent->spares) != NULL) {
+		bool ok = smbd_spare_send_fd(spare, fd);
+
+		/*
+		 * Either way it is not a spare anymore. It stays in
+		 * parent->children until it exits.
+		 */
+		TALLOC_FREE(spare);
+
+		if (ok) {
+			smbd_spares_replenish(parent);
+			return true;
+		}
+	}
+
+	smbd_spares_replenish(parent);
+	return false;
+}
+
 static void smbd_accept_connection(struct tevent_context *ev,
 				   struct tevent_fd *fde,
 				   uint16_t flags,
@@ -981,6 +1479,12 @@ static void smbd_accept_connection(struct tevent_context *ev,
 		return;
 	}
 
+	if (smbd_spare_take(s->parent, fd)) {
+		/* The spare has its own copy now */
+		close(fd);
+		return;
+	}
+
 	if (!allowable_number_of_smbd_processes(s->parent)) {
 		close(fd);
 		return;
@@ -989,7 +1493,6 @@ static void smbd_accept_connection(struct tevent_context *ev,
 	pid = fork();
 	if (pid == 0) {
 		char addrstr[INET6_ADDRSTRLEN];
-		NTSTATUS status = NT_STATUS_OK;
 
 		/*
 		 * Can't use TALLOC_FREE here. Nulling out the argument to it
@@ -998,32 +1501,8 @@ static void smbd_accept_connection(struct tevent_context *ev,
 		talloc_free(s->parent);
 		s = NULL;
 
-		/* Stop zombies, the parent explicitly handles
-		 * them, counting worker smbds. */
-		CatchChild();
-
-		status = smbd_reinit_after_fork(msg_ctx, ev, true);
-		if (!NT_STATUS_IS_OK(status)) {
-			if (NT_STATUS_EQUAL(status,
-					    NT_STATUS_TOO_MANY_OPENED_FILES)) {
-				DEBUG(0,("child process cannot initialize "
-					 "because too many files are open\n"));
-				goto exit;
-			}
-			if (lp_clustering() &&
-			    (NT_STATUS_EQUAL(
-				    status, NT_STATUS_INTERNAL_DB_ERROR) ||
-			     NT_STATUS_EQUAL(
-				    status, NT_STATUS_CONNECTION_REFUSED))) {
-				DEBUG(1, ("child process cannot initialize "
-					  "because connection to CTDB "
-					  "has failed: %s\n",
-					  nt_errstr(status)));
-				goto exit;
-			}
-
-			DEBUG(0,("reinit_after_fork() failed\n"));
-			smb_panic("reinit_after_fork() failed");
+		if (!smbd_child_init(ev, msg_ctx)) {
+			goto exit;
 		}
 
 		print_sockaddr(addrstr, sizeof(addrstr), &addr);
@@ -1367,6 +1846,8 @@ static void smbd_parent_loop(struct tevent_context *ev_ctx,
 	tevent_set_trace_callback(ev_ctx, smbd_parent_tevent_trace_callback,
 				  &trace_state);
 
+	smbd_spares_replenish(parent);
+
 	/* now accept incoming connections - forking a new process
 	   for each incoming connection */
 	DEBUG(2,("waiting for connections\n"));
@@ -2022,6 +2022,21 @@ static void call_nt_transact_ioctl(connection_struct *conn,
 		return;
 	}
 
+	/*
+	 * DOS and FCB opens sharing one fd handle only exist in SMB1,
+	 * so smbtorture needs this here as well as in SMB2.
+	 */
+	if ((function == FSCTL_SMBTORTURE_FILES_HASH_CHECK) &&
+	    lp_parm_bool(-1, "smbd", "FSCTL_SMBTORTURE", false)) {
+		status = files_hash_check(req->sconn);
+		if (!NT_STATUS_IS_OK(status)) {
+			reply_nterror(req, status);
+			return;
+		}
+		send_nt_replies(conn, req, NT_STATUS_OK, NULL, 0, NULL, 0);
+		return;
+	}
+
 	/*
 	 * out_data might be allocated by the VFS module, but talloc should be
 	 * used, and should be cleaned up when the request ends.
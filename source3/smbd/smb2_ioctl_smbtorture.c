@@ -214,6 +214,19 @@ struct tevent_req *smb2_ioctl_smbtorture(uint32_t ctl_code,
 		return req;
         }
 
+	case FSCTL_SMBTORTURE_FILES_HASH_CHECK:
+		if (state->in_input.length != 0) {
+			tevent_req_nterror(req, NT_STATUS_INVALID_PARAMETER);
+			return tevent_req_post(req, ev);
+		}
+
+		status = files_hash_check(state->smb2req->sconn);
+		if (tevent_req_nterror(req, status)) {
+			return tevent_req_post(req, ev);
+		}
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+
 	default:
 		goto not_supported;
 	}
@@ -217,11 +217,13 @@ NTSTATUS smbd_smb2_request_process_negprot(struct smbd_smb2_request *req)
 	struct smb2_negotiate_context *in_preauth = NULL;
 	struct smb2_negotiate_context *in_cipher = NULL;
 	struct smb2_negotiate_context *in_sign_algo = NULL;
+	struct smb2_negotiate_context *in_compression = NULL;
 	struct smb2_negotiate_contexts out_c = { .num_contexts = 0, };
 	const struct smb311_capabilities default_smb3_capabilities =
 		smb311_capabilities_parse("server",
 			lp_server_smb3_signing_algorithms(),
-			lp_server_smb3_encryption_algorithms());
+			lp_server_smb3_encryption_algorithms(),
+			lp_server_smb3_compression_algorithms());
 	DATA_BLOB out_negotiate_context_blob = data_blob_null;
 	uint32_t out_negotiate_context_offset = 0;
 	uint16_t out_negotiate_context_count = 0;
@@ -379,6 +381,8 @@ NTSTATUS smbd_smb2_request_process_negprot(struct smbd_smb2_request *req)
 					SMB2_ENCRYPTION_CAPABILITIES);
 	in_sign_algo = smb2_negotiate_context_find(&in_c,
 					SMB2_SIGNING_CAPABILITIES);
+	in_compression = smb2_negotiate_context_find(&in_c,
+					SMB2_COMPRESSION_CAPABILITIES);
 
 	/* negprot_spnego() returns the server guid in the first 16 bytes */
 	negprot_spnego_blob = negprot_spnego(req, xconn);
@@ -680,6 +684,49 @@ NTSTATUS smbd_smb2_request_process_negprot(struct smbd_smb2_request *req)
 		}
 	}
 
+	if (in_compression != NULL &&
+	    default_smb3_capabilities.compression.num_algos > 0)
+	{
+		struct smb3_compression_capabilities in_algos;
+		struct smb3_compression_capabilities *out_algos =
+			&xconn->smb2.server.compression;
+		DATA_BLOB b;
+
+		status = smb2_compression_capabilities_pull(in_compression->data,
+							    &in_algos);
+		if (!NT_STATUS_IS_OK(status)) {
+			return smbd_smb2_request_error(req, status);
+		}
+
+		smb2_compression_capabilities_select(
+			&default_smb3_capabilities.compression,
+			&in_algos,
+			out_algos);
+
+		/*
+		 * Only announce it if we have something in common,
+		 * otherwise compression is not used on this connection.
+		 */
+		if (out_algos->num_algos > 0) {
+			status = smb2_compression_capabilities_push(req,
+								    out_algos,
+								    &b);
+			if (!NT_STATUS_IS_OK(status)) {
+				return smbd_smb2_request_error(req, status);
+			}
+
+			status = smb2_negotiate_context_add(
+				req,
+				&out_c,
+				SMB2_COMPRESSION_CAPABILITIES,
+				b.data,
+				b.length);
+			if (!NT_STATUS_IS_OK(status)) {
+				return smbd_smb2_request_error(req, status);
+			}
+		}
+	}
+
 	status = smb311_capabilities_check(&default_smb3_capabilities,
 					   "smb2srv_negprot",
 					   DBGLVL_NOTICE,
@@ -45,6 +45,32 @@ static NTSTATUS smbd_smb2_read_recv(struct tevent_req *req,
 				    DATA_BLOB *out_data,
 				    uint32_t *out_remaining);
 
+static bool smbd_smb2_read_want_compression(struct smbd_smb2_request *req,
+					    struct files_struct *fsp,
+					    uint8_t in_flags)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+
+	if (xconn->smb2.server.compression.num_algos == 0) {
+		return false;
+	}
+
+	if (smbd_smb2_is_compound(req)) {
+		return false;
+	}
+
+	switch (lp_smb3_compression(SNUM(fsp->conn))) {
+	case SMB3_COMPRESSION_OFF:
+		return false;
+	case SMB3_COMPRESSION_REQUESTED:
+		return (in_flags & SMB2_READFLAG_REQUEST_COMPRESSED);
+	case SMB3_COMPRESSION_AUTO:
+		return true;
+	}
+
+	return false;
+}
+
 static void smbd_smb2_request_read_done(struct tevent_req *subreq);
 NTSTATUS smbd_smb2_request_process_read(struct smbd_smb2_request *req)
 {
@@ -97,6 +123,10 @@ NTSTATUS smbd_smb2_request_process_read(struct smbd_smb2_request *req)
 		return smbd_smb2_request_error(req, NT_STATUS_FILE_CLOSED);
 	}
 
+	req->compress_response = smbd_smb2_read_want_compression(req,
+								 in_fsp,
+								 in_flags);
+
 	subreq = smbd_smb2_read_send(req, req->sconn->ev_ctx,
 				     req, in_fsp,
 				     in_flags,
@@ -351,6 +381,7 @@ static NTSTATUS schedule_smb2_sendfile_read(struct smbd_smb2_request *smb2req,
 	 * We cannot use sendfile if...
 	 * We were not configured to do so OR
 	 * Signing is active OR
+	 * The response should be compressed OR
 	 * This is a compound SMB2 operation OR
 	 * fsp is a STREAM file OR
 	 * It's not a regular file OR
@@ -363,6 +394,7 @@ static NTSTATUS schedule_smb2_sendfile_read(struct smbd_smb2_request *smb2req,
 	if (!lp__use_sendfile(SNUM(fsp->conn)) ||
 	    smb2req->do_signing ||
 	    smb2req->do_encryption ||
+	    smb2req->compress_response ||
 	    smbd_smb2_is_compound(smb2req) ||
 	    fsp_is_alternate_stream(fsp) ||
 	    (!S_ISREG(fsp->fsp_name->st.st_ex_mode)) ||
@@ -36,6 +36,7 @@
 #include "auth.h"
 #include "libcli/smb/smbXcli_base.h"
 #include "source3/lib/substitute.h"
+#include "lib/pthreadpool/pthreadpool_tevent.h"
 
 #if defined(LINUX)
 /* SIOCOUTQ TIOCOUTQ are the same */
@@ -48,6 +49,11 @@
 #define __ALLOW_MULTI_CHANNEL_SUPPORT 1
 #endif
 
+#if defined(HAVE_LINUX_ERRQUEUE_H) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <linux/errqueue.h>
+#define __HAVE_MSG_ZEROCOPY 1
+#endif
+
 #include "lib/crypto/gnutls_helpers.h"
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
@@ -325,6 +331,25 @@ static NTSTATUS smbd_initialize_smb2(struct smbXsrv_connection *xconn,
 	}
 	tevent_fd_set_auto_close(xconn->transport.fde);
 
+#ifdef __HAVE_MSG_ZEROCOPY
+	if (lp_smbd_zerocopy_send_threshold() != 0) {
+		int one = 1;
+
+		rc = setsockopt(xconn->transport.sock,
+				SOL_SOCKET,
+				SO_ZEROCOPY,
+				&one,
+				sizeof(one));
+		if (rc == 0) {
+			xconn->smb2.zerocopy.threshold =
+				lp_smbd_zerocopy_send_threshold();
+		} else {
+			DBG_NOTICE("SO_ZEROCOPY failed: %s\n",
+				   strerror(errno));
+		}
+	}
+#endif /* __HAVE_MSG_ZEROCOPY */
+
 	/*
 	 * Ensure child is set to non-blocking mode,
 	 * unless the system supports MSG_DONTWAIT,
@@ -375,6 +400,18 @@ static bool smb2_setup_nbt_length(struct iovec *vector, int count)
 
 static int smbd_smb2_request_destructor(struct smbd_smb2_request *req)
 {
+	if (req->async_encryption.subreq != NULL) {
+		/*
+		 * A worker thread is still encrypting
+		 * our output buffers, we need to keep
+		 * them alive until it's done.
+		 * smbd_smb2_request_encrypt_done()
+		 * will free us.
+		 */
+		req->async_encryption.orphaned = true;
+		return -1;
+	}
+
 	TALLOC_FREE(req->first_enc_key);
 	TALLOC_FREE(req->last_sign_key);
 	return 0;
@@ -545,6 +582,52 @@ static NTSTATUS smbd_smb2_inbuf_parse_compound(struct smbXsrv_connection *xconn,
 			len = enc_len;
 		}
 
+		if (len >= 4 && IVAL(hdr, 0) == SMB2_COMP_TF_MAGIC) {
+			DATA_BLOB decompressed = data_blob_null;
+			NTSTATUS status;
+
+			if (xconn->smb2.server.compression.num_algos == 0) {
+				DBG_DEBUG("Got SMB2_COMPRESSION_TRANSFORM "
+					  "header, but not negotiated\n");
+				goto inval;
+			}
+
+			/*
+			 * The compression transform has to cover
+			 * the whole (decrypted) message.
+			 */
+			if (num_iov != 1 || taken + len != buflen) {
+				DBG_DEBUG("SMB2_COMPRESSION_TRANSFORM "
+					  "within a compound request\n");
+				goto inval;
+			}
+
+			/*
+			 * The original size is limited to
+			 * what fits into a NBT frame.
+			 */
+			status = smb2_compression_decompress(mem_ctx,
+							     hdr,
+							     len,
+							     0x00FFFFFF,
+							     &decompressed);
+			if (!NT_STATUS_IS_OK(status)) {
+				DBG_INFO("Decompression failed: %s\n",
+					 nt_errstr(status));
+				TALLOC_FREE(iov_alloc);
+				return status;
+			}
+
+			first_hdr = decompressed.data;
+			buflen = decompressed.length;
+			taken = 0;
+			hdr = first_hdr;
+			len = buflen;
+			if (tf != NULL) {
+				verified_buflen = buflen;
+			}
+		}
+
 		/*
 		 * We need the header plus the body length field
 		 */
@@ -1548,9 +1631,29 @@ static NTSTATUS smbXsrv_client_pending_breaks_updated(struct smbXsrv_client *cli
 	return NT_STATUS_OK;
 }
 
+/*
+ * The kernel may still transmit from the buffers of a PDU sent
+ * with MSG_ZEROCOPY after we closed the socket, but we will never
+ * learn when it's done with them. Keep them until the process exits.
+ */
+static void smbd_smb2_zerocopy_orphan(struct smbd_smb2_send_queue *e)
+{
+	static TALLOC_CTX *orphans = NULL;
+
+	if (orphans == NULL) {
+		/* On failure they just end up on the NULL context */
+		orphans = talloc_named_const(NULL, 0,
+					     "smbd_smb2_zerocopy_orphans");
+	}
+
+	talloc_steal(orphans, e->mem_ctx);
+}
+
 void smbXsrv_connection_disconnect_transport(struct smbXsrv_connection *xconn,
 					     NTSTATUS status)
 {
+	struct smbd_smb2_send_queue *e = NULL;
+
 	if (!NT_STATUS_IS_OK(xconn->transport.status)) {
 		return;
 	}
@@ -1561,8 +1664,23 @@ void smbXsrv_connection_disconnect_transport(struct smbXsrv_connection *xconn,
 		xconn->transport.sock = -1;
 	}
 	smbd_smb2_send_queue_ack_fail(&xconn->ack.queue, status);
+
+	/*
+	 * Only the head of the send queue can be
+	 * partially sent with MSG_ZEROCOPY.
+	 */
+	e = xconn->smb2.send_queue;
+	if (e != NULL && e->zerocopy.num_completed < e->zerocopy.num_seq) {
+		smbd_smb2_zerocopy_orphan(e);
+	}
 	smbd_smb2_send_queue_ack_fail(&xconn->smb2.send_queue, status);
 	xconn->smb2.send_queue_len = 0;
+
+	while (xconn->smb2.zerocopy.queue != NULL) {
+		e = xconn->smb2.zerocopy.queue;
+		DLIST_REMOVE(xconn->smb2.zerocopy.queue, e);
+		smbd_smb2_zerocopy_orphan(e);
+	}
 	DO_PROFILE_INC(disconnect);
 }
 
@@ -3609,6 +3727,230 @@ static void smbd_smb2_request_reply_update_counts(struct smbd_smb2_request *req)
 	}
 }
 
+static void smbd_smb2_request_encrypt_job(void *private_data)
+{
+	struct smbd_smb2_request *req = talloc_get_type_abort(
+		private_data, struct smbd_smb2_request);
+	struct iovec *firsttf = SMBD_SMB2_IDX_TF_IOV(req,out,1);
+
+	/*
+	 * This runs in a worker thread, the main thread
+	 * doesn't touch req->out.vector nor req->first_enc_key
+	 * until smbd_smb2_request_encrypt_done() was called.
+	 */
+	req->async_encryption.status = smb2_signing_encrypt_pdu(
+		req->first_enc_key,
+		firsttf,
+		req->async_encryption.count);
+}
+
+static void smbd_smb2_request_encrypt_done(struct tevent_req *subreq);
+
+/*
+ * Try to offload the encryption of a (large) response
+ * to the thread pool, so that multiple responses
+ * can be encrypted on multiple cpus in parallel.
+ *
+ * The response will still be added to the
+ * send queue in order, but smbd_smb2_flush_with_sendmsg()
+ * will stop at it until the encryption is done.
+ */
+static bool smbd_smb2_request_encrypt_async(struct smbd_smb2_request *req,
+					    struct iovec *firsttf,
+					    int count)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+	struct tevent_req *subreq = NULL;
+	size_t threshold = lp_smbd_async_encryption_threshold();
+	ssize_t m_total;
+
+	if (threshold == 0) {
+		return false;
+	}
+
+	if (req->preauth != NULL) {
+		return false;
+	}
+
+	if (req->sconn->pool == NULL) {
+		return false;
+	}
+
+	if (pthreadpool_tevent_max_threads(req->sconn->pool) == 0) {
+		return false;
+	}
+
+	/*
+	 * Only the GCM ciphers are guaranteed to use
+	 * gnutls_aead_cipher_encryptv2(), the fallback
+	 * code in smb2_signing_encrypt_pdu() uses talloc_tos(),
+	 * which must not be used from a worker thread.
+	 */
+	switch (req->first_enc_key->cipher_algo_id) {
+	case SMB2_ENCRYPTION_AES128_GCM:
+	case SMB2_ENCRYPTION_AES256_GCM:
+		break;
+	default:
+		return false;
+	}
+
+	m_total = iov_buflen(&firsttf[1], count - 1);
+	if (m_total == -1) {
+		return false;
+	}
+	if ((size_t)m_total < threshold) {
+		return false;
+	}
+
+	req->async_encryption.count = count;
+	req->async_encryption.status = NT_STATUS_INTERNAL_ERROR;
+
+	subreq = pthreadpool_tevent_job_send(req,
+					     xconn->client->raw_ev_ctx,
+					     req->sconn->pool,
+					     smbd_smb2_request_encrypt_job,
+					     req);
+	if (subreq == NULL) {
+		return false;
+	}
+	tevent_req_set_callback(subreq, smbd_smb2_request_encrypt_done, req);
+	req->async_encryption.subreq = subreq;
+
+	return true;
+}
+
+static void smbd_smb2_request_encrypt_done(struct tevent_req *subreq)
+{
+	struct smbd_smb2_request *req =
+		tevent_req_callback_data(subreq,
+		struct smbd_smb2_request);
+	struct smbXsrv_connection *xconn = NULL;
+	NTSTATUS status;
+	int ret;
+
+	SMB_ASSERT(req->async_encryption.subreq == subreq);
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+	req->async_encryption.subreq = NULL;
+	req->queue_entry.encryption_pending = false;
+
+	if (req->async_encryption.orphaned) {
+		/*
+		 * Someone tried to free the request
+		 * while the job was running, the connection
+		 * may already be gone, so just cleanup.
+		 */
+		TALLOC_FREE(req);
+		return;
+	}
+
+	xconn = req->xconn;
+
+	if (ret != 0) {
+		/*
+		 * The job didn't run, e.g. the pthreadpool
+		 * failed to create a new thread (EAGAIN).
+		 * Fallback to sync processing in that case.
+		 */
+		smbd_smb2_request_encrypt_job(req);
+	}
+	TALLOC_FREE(req->first_enc_key);
+
+	status = req->async_encryption.status;
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
+	}
+
+	status = smbd_smb2_flush_send_queue(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
+	}
+}
+
+/*
+ * Replace the body and dynamic part of a single (non compound)
+ * response by a SMB2_COMPRESSION_TRANSFORM message, if
+ * the caller asked for it and the data is compressible.
+ */
+static NTSTATUS smbd_smb2_request_compress(struct smbd_smb2_request *req)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+	struct iovec *outhdr = SMBD_SMB2_IDX_HDR_IOV(req,out,1);
+	struct iovec *outdyn = SMBD_SMB2_IDX_DYN_IOV(req,out,1);
+	TALLOC_CTX *frame = NULL;
+	uint8_t *prefix = NULL;
+	ssize_t prefix_len;
+	DATA_BLOB blob = data_blob_null;
+	NTSTATUS status;
+	bool ok;
+
+	if (!req->compress_response) {
+		return NT_STATUS_OK;
+	}
+	req->compress_response = false;
+
+	if (xconn->smb2.server.compression.num_algos == 0) {
+		return NT_STATUS_OK;
+	}
+	if (req->out.vector_count != 1 + SMBD_SMB2_NUM_IOV_PER_REQ) {
+		return NT_STATUS_OK;
+	}
+	if (req->preauth != NULL) {
+		return NT_STATUS_OK;
+	}
+	if (outdyn->iov_base == NULL) {
+		/* sendfile */
+		return NT_STATUS_OK;
+	}
+
+	frame = talloc_stackframe();
+
+	/*
+	 * The header and the fixed body are sent uncompressed.
+	 */
+	prefix_len = iov_buflen(outhdr, 2);
+	if (prefix_len == -1) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_INVALID_PARAMETER_MIX;
+	}
+	prefix = talloc_array(frame, uint8_t, prefix_len);
+	if (prefix == NULL) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+	iov_buf(outhdr, 2, prefix, prefix_len);
+
+	status = smb2_compression_compress(req,
+					   &xconn->smb2.server.compression,
+					   prefix,
+					   prefix_len,
+					   outdyn->iov_base,
+					   outdyn->iov_len,
+					   &blob);
+	TALLOC_FREE(frame);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+	if (blob.length == 0) {
+		/* not compressible */
+		return NT_STATUS_OK;
+	}
+
+	outhdr->iov_base = (void *)blob.data;
+	outhdr->iov_len = blob.length;
+	req->out.vector_count = 1 + SMBD_SMB2_HDR_IOV_OFS + 1;
+
+	ok = smb2_setup_nbt_length(req->out.vector, req->out.vector_count);
+	if (!ok) {
+		return NT_STATUS_INVALID_PARAMETER_MIX;
+	}
+
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 {
 	struct smbXsrv_connection *xconn = req->xconn;
@@ -3616,6 +3958,7 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	struct iovec *firsttf = SMBD_SMB2_IDX_TF_IOV(req,out,first_idx);
 	struct iovec *outhdr = SMBD_SMB2_OUT_HDR_IOV(req);
 	struct iovec *outdyn = SMBD_SMB2_OUT_DYN_IOV(req);
+	bool encrypt_async = false;
 	NTSTATUS status;
 	bool ok;
 
@@ -3765,14 +4108,7 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	/*
 	 * now check if we need to sign the current response
 	 */
-	if (firsttf->iov_len == SMB2_TF_HDR_SIZE) {
-		status = smb2_signing_encrypt_pdu(req->first_enc_key,
-					firsttf,
-					req->out.vector_count - first_idx);
-		if (!NT_STATUS_IS_OK(status)) {
-			return status;
-		}
-	} else if (req->do_signing) {
+	if (firsttf->iov_len == 0 && req->do_signing) {
 		struct smbXsrv_session *x = req->session;
 		struct smb2_signing_key *signing_key =
 			smbd_smb2_signing_key(x, xconn, NULL);
@@ -3784,7 +4120,34 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 			return status;
 		}
 	}
-	TALLOC_FREE(req->first_enc_key);
+
+	/*
+	 * A signed message is compressed after signing,
+	 * an encrypted message before encryption.
+	 */
+	status = smbd_smb2_request_compress(req);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	if (firsttf->iov_len == SMB2_TF_HDR_SIZE) {
+		int count = req->out.vector_count - first_idx;
+
+		encrypt_async = smbd_smb2_request_encrypt_async(req,
+								firsttf,
+								count);
+		if (!encrypt_async) {
+			status = smb2_signing_encrypt_pdu(req->first_enc_key,
+							  firsttf,
+							  count);
+			if (!NT_STATUS_IS_OK(status)) {
+				return status;
+			}
+		}
+	}
+	if (!encrypt_async) {
+		TALLOC_FREE(req->first_enc_key);
+	}
 
 	if (req->preauth != NULL) {
 		gnutls_hash_hd_t hash_hnd = NULL;
@@ -3852,6 +4215,7 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	req->queue_entry.mem_ctx = req;
 	req->queue_entry.vector = req->out.vector;
 	req->queue_entry.count = req->out.vector_count;
+	req->queue_entry.encryption_pending = encrypt_async;
 	DLIST_ADD_END(xconn->smb2.send_queue, &req->queue_entry);
 	xconn->smb2.send_queue_len++;
 
@@ -4730,6 +5094,134 @@ static int socket_error_from_errno(int ret,
 	return sys_errno;
 }
 
+#ifdef __HAVE_MSG_ZEROCOPY
+/*
+ * Account the completed MSG_ZEROCOPY sequence numbers lo..hi
+ * to e, returns true if all sendmsg() calls of e are completed.
+ */
+static bool smbd_smb2_zerocopy_account(struct smbd_smb2_send_queue *e,
+				       uint32_t lo,
+				       uint32_t hi)
+{
+	int64_t first = (int32_t)(e->zerocopy.first_seq - lo);
+	int64_t last = first + e->zerocopy.num_seq - 1;
+	int64_t range = (uint32_t)(hi - lo);
+	int64_t n;
+
+	n = MIN(last, range) - MAX(first, 0) + 1;
+	if (n > 0) {
+		e->zerocopy.num_completed += n;
+	}
+
+	return (e->zerocopy.num_completed >= e->zerocopy.num_seq);
+}
+
+static void smbd_smb2_zerocopy_completed(struct smbXsrv_connection *xconn,
+					 uint32_t lo,
+					 uint32_t hi)
+{
+	struct smbd_smb2_send_queue *e = NULL;
+	struct smbd_smb2_send_queue *n = NULL;
+
+	/*
+	 * Only the head of the send queue can
+	 * be partially sent.
+	 */
+	e = xconn->smb2.send_queue;
+	if (e != NULL && e->zerocopy.num_seq != 0) {
+		smbd_smb2_zerocopy_account(e, lo, hi);
+	}
+
+	for (e = xconn->smb2.zerocopy.queue; e != NULL; e = n) {
+		bool done;
+
+		n = e->next;
+
+		done = smbd_smb2_zerocopy_account(e, lo, hi);
+		if (!done) {
+			continue;
+		}
+
+		DLIST_REMOVE(xconn->smb2.zerocopy.queue, e);
+		talloc_free(e->mem_ctx);
+	}
+}
+
+/*
+ * Drain the socket error queue, which is where the kernel
+ * reports the completion of MSG_ZEROCOPY sendmsg() calls.
+ */
+static NTSTATUS smbd_smb2_zerocopy_reap(struct smbXsrv_connection *xconn)
+{
+	while (true) {
+		union {
+			uint8_t buf[CMSG_SPACE(sizeof(struct sock_extended_err)) +
+				    CMSG_SPACE(sizeof(struct sockaddr_storage))];
+			struct cmsghdr align;
+		} control;
+		struct msghdr msg = {
+			.msg_control = control.buf,
+			.msg_controllen = sizeof(control.buf),
+		};
+		struct cmsghdr *cmsg = NULL;
+		int ret;
+
+		ret = recvmsg(xconn->transport.sock,
+			      &msg,
+			      MSG_ERRQUEUE|MSG_DONTWAIT);
+		if (ret == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return NT_STATUS_OK;
+			}
+			if (errno == EINTR) {
+				continue;
+			}
+			return map_nt_error_from_unix_common(errno);
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(&msg);
+		     cmsg != NULL;
+		     cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			struct sock_extended_err serr;
+
+			if (!(cmsg->cmsg_level == SOL_IP &&
+			      cmsg->cmsg_type == IP_RECVERR) &&
+			    !(cmsg->cmsg_level == SOL_IPV6 &&
+			      cmsg->cmsg_type == IPV6_RECVERR))
+			{
+				continue;
+			}
+
+			memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+			if (serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+			    serr.ee_errno != 0)
+			{
+				continue;
+			}
+
+			if ((serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) &&
+			    xconn->smb2.zerocopy.threshold != 0)
+			{
+				/*
+				 * The kernel had to copy the data
+				 * anyway (e.g. loopback or a nic
+				 * without scatter/gather support),
+				 * so we only get the overhead.
+				 */
+				DBG_INFO("MSG_ZEROCOPY copied the data, "
+					 "not using it anymore\n");
+				xconn->smb2.zerocopy.threshold = 0;
+			}
+
+			smbd_smb2_zerocopy_completed(xconn,
+						     serr.ee_info,
+						     serr.ee_data);
+		}
+	}
+}
+#endif /* __HAVE_MSG_ZEROCOPY */
+
 static NTSTATUS smbd_smb2_advance_send_queue(struct smbXsrv_connection *xconn,
 					     struct smbd_smb2_send_queue **_e,
 					     size_t n)
@@ -4753,6 +5245,14 @@ static NTSTATUS smbd_smb2_advance_send_queue(struct smbXsrv_connection *xconn,
 
 	if (e->ack.req == NULL) {
 		*_e = NULL;
+		if (e->zerocopy.num_completed < e->zerocopy.num_seq) {
+			/*
+			 * The kernel still references our buffers,
+			 * smbd_smb2_zerocopy_completed() will free them.
+			 */
+			DLIST_ADD_END(xconn->smb2.zerocopy.queue, e);
+			return NT_STATUS_OK;
+		}
 		talloc_free(e->mem_ctx);
 		return NT_STATUS_OK;
 	}
@@ -4791,6 +5291,16 @@ static NTSTATUS smbd_smb2_flush_with_sendmsg(struct smbXsrv_connection *xconn)
 			continue;
 		}
 
+		if (e->encryption_pending) {
+			/*
+			 * We need to wait for the encryption
+			 * to finish, smbd_smb2_request_encrypt_done()
+			 * will call us again.
+			 */
+			TEVENT_FD_NOT_WRITEABLE(xconn->transport.fde);
+			return NT_STATUS_OK;
+		}
+
 		if (e->sendfile_header != NULL) {
 			size_t size = 0;
 			size_t i = 0;
@@ -4855,6 +5365,21 @@ static NTSTATUS smbd_smb2_flush_with_sendmsg(struct smbXsrv_connection *xconn)
 #ifdef MSG_DONTWAIT
 		sendmsg_flags |= MSG_DONTWAIT;
 #endif
+#ifdef __HAVE_MSG_ZEROCOPY
+		/*
+		 * Large PDUs (typically READ responses) are sent
+		 * without copying the data into the socket buffers.
+		 * PDUs waiting for an ack are excluded, as they
+		 * are freed by the ack logic.
+		 */
+		if (xconn->smb2.zerocopy.threshold != 0 &&
+		    e->ack.req == NULL &&
+		    (size_t)iov_buflen(e->vector, e->count) >=
+		    xconn->smb2.zerocopy.threshold)
+		{
+			sendmsg_flags |= MSG_ZEROCOPY;
+		}
+#endif /* __HAVE_MSG_ZEROCOPY */
 
 		ret = sendmsg(xconn->transport.sock, &e->msg, sendmsg_flags);
 		if (ret == 0) {
@@ -4874,6 +5399,22 @@ static NTSTATUS smbd_smb2_flush_with_sendmsg(struct smbXsrv_connection *xconn)
 			return status;
 		}
 
+#ifdef __HAVE_MSG_ZEROCOPY
+		if (sendmsg_flags & MSG_ZEROCOPY) {
+			/*
+			 * The kernel counts every successful
+			 * MSG_ZEROCOPY sendmsg() call.
+			 */
+			if (e->zerocopy.num_seq == 0) {
+				e->zerocopy.first_seq =
+					xconn->smb2.zerocopy.next_seq;
+			}
+			e->zerocopy.num_seq += 1;
+			xconn->smb2.zerocopy.next_seq += 1;
+			xconn->smb2.zerocopy.in_use = true;
+		}
+#endif /* __HAVE_MSG_ZEROCOPY */
+
 		status = smbd_smb2_advance_send_queue(xconn, &e, ret);
 		if (NT_STATUS_EQUAL(status, NT_STATUS_RETRY)) {
 			/* retry later */
@@ -5132,6 +5673,35 @@ static NTSTATUS smbd_smb2_io_handler(struct smbXsrv_connection *xconn,
 		return NT_STATUS_OK;
 	}
 
+#ifdef __HAVE_MSG_ZEROCOPY
+	if ((fde_flags & TEVENT_FD_ERROR) && xconn->smb2.zerocopy.in_use) {
+		int poll_error;
+
+		/*
+		 * POLLERR is also reported for pending
+		 * MSG_ZEROCOPY completions.
+		 */
+		status = smbd_smb2_zerocopy_reap(xconn);
+		if (!NT_STATUS_IS_OK(status)) {
+			smbXsrv_connection_disconnect_transport(xconn,
+								status);
+			return status;
+		}
+
+		poll_error = samba_socket_poll_error(xconn->transport.sock);
+		if (poll_error == 0 ||
+		    (poll_error == POLLERR &&
+		     samba_socket_sock_error(xconn->transport.sock) == 0))
+		{
+			/*
+			 * Only completions, which may have arrived
+			 * again in the meantime, not a real error.
+			 */
+			fde_flags &= ~TEVENT_FD_ERROR;
+		}
+	}
+#endif /* __HAVE_MSG_ZEROCOPY */
+
 	if (fde_flags & TEVENT_FD_ERROR) {
 		ret = samba_socket_poll_or_sock_error(xconn->transport.sock);
 		if (ret == -1) {
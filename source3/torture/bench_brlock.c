@@ -0,0 +1,190 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Byte range lock latency benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+
+extern int torture_numops;
+
+/*
+ * Number of probes per step to average over
+ */
+#define BENCH_BRLOCK_PROBES 100
+
+/*
+ * Lock every other byte, so that probing the bytes in between
+ * never conflicts.
+ */
+static uint32_t bench_brlock_ofs(unsigned int i)
+{
+	return i * 2;
+}
+
+static bool bench_brlock_probe(struct cli_state *cli,
+			       uint16_t fnum2,
+			       unsigned int num_locks)
+{
+	struct timeval start;
+	double conflict_usec, read_usec;
+	unsigned int i;
+	NTSTATUS status;
+
+	/*
+	 * Reads of locked bytes through the second handle have to
+	 * find the lock held by the first one. We don't use lock
+	 * attempts here, smbd delays retries of a failed lock.
+	 */
+	start = timeval_current();
+	for (i=0; i<BENCH_BRLOCK_PROBES; i++) {
+		uint32_t ofs = bench_brlock_ofs((i * 7919) % num_locks);
+		char buf;
+		size_t nread;
+
+		status = cli_read(cli, fnum2, &buf, ofs, 1, &nread);
+		if (!NT_STATUS_EQUAL(status, NT_STATUS_FILE_LOCK_CONFLICT)) {
+			d_fprintf(stderr, "read at %"PRIu32" returned %s, "
+				  "expected FILE_LOCK_CONFLICT\n",
+				  ofs, nt_errstr(status));
+			return false;
+		}
+	}
+	conflict_usec = timeval_elapsed(&start) * 1000000 /
+		BENCH_BRLOCK_PROBES;
+
+	/*
+	 * Reads of the unlocked bytes in between also go through
+	 * the lock test and succeed.
+	 */
+	start = timeval_current();
+	for (i=0; i<BENCH_BRLOCK_PROBES; i++) {
+		uint32_t ofs = bench_brlock_ofs((i * 7919) % num_locks) + 1;
+		char buf;
+		size_t nread;
+
+		status = cli_read(cli, fnum2, &buf, ofs, 1, &nread);
+		if (!NT_STATUS_IS_OK(status)) {
+			d_fprintf(stderr, "read at %"PRIu32" failed: %s\n",
+				  ofs, nt_errstr(status));
+			return false;
+		}
+	}
+	read_usec = timeval_elapsed(&start) * 1000000 / BENCH_BRLOCK_PROBES;
+
+	printf("%8u locks: conflict %8.1f us, read %8.1f us\n",
+	       num_locks, conflict_usec, read_usec);
+
+	return true;
+}
+
+bool run_bench_brlock(int dummy)
+{
+	struct cli_state *cli = NULL;
+	const char *fname = "\\bench_brlock.dat";
+	uint16_t fnum1 = UINT16_MAX, fnum2 = UINT16_MAX;
+	unsigned int num_locks = 0;
+	unsigned int step;
+	struct timeval start;
+	NTSTATUS status;
+	bool ret = false;
+
+	printf("starting brlock benchmark with %d locks\n", torture_numops);
+
+	if (torture_numops < 1) {
+		return false;
+	}
+
+	if (!torture_open_connection(&cli, 0)) {
+		return false;
+	}
+
+	cli_unlink(cli, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+
+	status = cli_openx(cli, fname, O_RDWR|O_CREAT|O_EXCL, DENY_NONE,
+			   &fnum1);
+	if (!NT_STATUS_IS_OK(status)) {
+		d_fprintf(stderr, "cli_openx failed: %s\n", nt_errstr(status));
+		goto done;
+	}
+	status = cli_openx(cli, fname, O_RDWR, DENY_NONE, &fnum2);
+	if (!NT_STATUS_IS_OK(status)) {
+		d_fprintf(stderr, "cli_openx failed: %s\n", nt_errstr(status));
+		goto done;
+	}
+
+	status = cli_ftruncate(cli, fnum1,
+			       bench_brlock_ofs(torture_numops) + 1);
+	if (!NT_STATUS_IS_OK(status)) {
+		d_fprintf(stderr, "cli_ftruncate failed: %s\n",
+			  nt_errstr(status));
+		goto done;
+	}
+
+	/*
+	 * Grow the number of locks held in powers of ten and look at
+	 * the lock and test latency at each step.
+	 */
+	for (step = 1; num_locks < (unsigned int)torture_numops; step *= 10) {
+		unsigned int target = MIN(step, (unsigned int)torture_numops);
+		unsigned int added = target - num_locks;
+
+		start = timeval_current();
+		while (num_locks < target) {
+			status = cli_lock32(cli, fnum1,
+					    bench_brlock_ofs(num_locks), 1,
+					    0, WRITE_LOCK);
+			if (!NT_STATUS_IS_OK(status)) {
+				d_fprintf(stderr, "lock %u failed: %s\n",
+					  num_locks, nt_errstr(status));
+				goto done;
+			}
+			num_locks += 1;
+		}
+		printf("%8u locks: lock %8.1f us\n", num_locks,
+		       timeval_elapsed(&start) * 1000000 / added);
+
+		if (!bench_brlock_probe(cli, fnum2, num_locks)) {
+			goto done;
+		}
+	}
+
+	start = timeval_current();
+	while (num_locks > 0) {
+		num_locks -= 1;
+		status = cli_unlock(cli, fnum1, bench_brlock_ofs(num_locks), 1);
+		if (!NT_STATUS_IS_OK(status)) {
+			d_fprintf(stderr, "unlock %u failed: %s\n",
+				  num_locks, nt_errstr(status));
+			goto done;
+		}
+	}
+	printf("unlock %8.1f us\n",
+	       timeval_elapsed(&start) * 1000000 / torture_numops);
+
+	ret = true;
+done:
+	if (fnum2 != UINT16_MAX) {
+		cli_close(cli, fnum2);
+	}
+	if (fnum1 != UINT16_MAX) {
+		cli_close(cli, fnum1);
+	}
+	cli_unlink(cli, fname, FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	torture_close_connection(cli);
+	return ret;
+}
@@ -29,9 +29,68 @@ static void null_job(void *private_data)
 	return;
 }
 
+/*
+ * Queue torture_numops jobs at once and wait for all of them, so
+ * that several helper threads compete for the queued jobs.
+ */
+static bool bench_pthreadpool_threads(unsigned num_threads)
+{
+	struct pthreadpool_pipe *pool;
+	struct timeval start;
+	double elapsed;
+	int jobids[1024];
+	int i, ret;
+	int num_finished = 0;
+
+	ret = pthreadpool_pipe_init(num_threads, &pool);
+	if (ret != 0) {
+		d_fprintf(stderr, "pthreadpool_pipe_init failed: %s\n",
+			  strerror(ret));
+		return false;
+	}
+
+	start = timeval_current();
+
+	for (i=0; i<torture_numops; i++) {
+		ret = pthreadpool_pipe_add_job(pool, i, null_job, NULL);
+		if (ret != 0) {
+			d_fprintf(stderr, "pthreadpool_pipe_add_job "
+				  "failed: %s\n", strerror(ret));
+			break;
+		}
+	}
+
+	while (num_finished < i) {
+		ret = pthreadpool_pipe_finished_jobs(
+			pool, jobids, ARRAY_SIZE(jobids));
+		if (ret < 0) {
+			d_fprintf(stderr, "pthreadpool_pipe_finished_job "
+				  "failed: %s\n", strerror(-ret));
+			break;
+		}
+		num_finished += ret;
+	}
+
+	elapsed = timeval_elapsed(&start);
+
+	if (num_finished != torture_numops) {
+		pthreadpool_pipe_destroy(pool);
+		return false;
+	}
+
+	d_printf("%2u threads: %d jobs in %.3f seconds, %.0f jobs/sec\n",
+		 num_threads, num_finished, elapsed,
+		 elapsed > 0 ? num_finished / elapsed : 0.0);
+
+	ret = pthreadpool_pipe_destroy(pool);
+
+	return (ret == 0);
+}
+
 bool run_bench_pthreadpool(int dummy)
 {
 	struct pthreadpool_pipe *pool;
+	unsigned num_threads;
 	int i, ret;
 
 	ret = pthreadpool_pipe_init(1, &pool);
@@ -63,6 +122,19 @@ bool run_bench_pthreadpool(int dummy)
 	}
 
 	ret = pthreadpool_pipe_destroy(pool);
+	if (ret != 0) {
+		return false;
+	}
 
-	return (ret == 0);
+	/*
+	 * Throughput with an increasing number of helper threads
+	 */
+	for (num_threads = 1; num_threads <= 32; num_threads *= 2) {
+		bool ok = bench_pthreadpool_threads(num_threads);
+		if (!ok) {
+			return false;
+		}
+	}
+
+	return true;
 }
@@ -154,11 +154,14 @@ bool run_dbwrap_watch1(int dummy);
 bool run_dbwrap_watch2(int dummy);
 bool run_dbwrap_watch3(int dummy);
 bool run_dbwrap_watch4(int dummy);
+bool run_dbwrap_watch5(int dummy);
 bool run_dbwrap_do_locked1(int dummy);
+bool run_dbwrap_cache1(int dummy);
 bool run_idmap_tdb_common_test(int dummy);
 bool run_local_dbwrap_ctdb1(int dummy);
 bool run_qpathinfo_bufsize(int dummy);
 bool run_bench_pthreadpool(int dummy);
+bool run_bench_brlock(int dummy);
 bool run_messaging_read1(int dummy);
 bool run_messaging_read2(int dummy);
 bool run_messaging_read3(int dummy);
@@ -168,6 +171,9 @@ bool run_messaging_fdpass2(int dummy);
 bool run_messaging_fdpass2a(int dummy);
 bool run_messaging_fdpass2b(int dummy);
 bool run_messaging_send_all(int dummy);
+bool run_messaging_rings(int dummy);
+bool run_notify_fanotify(int dummy);
+bool run_brlock_index(int dummy);
 bool run_oplock_cancel(int dummy);
 bool run_pthreadpool_tevent(int dummy);
 bool run_g_lock1(int dummy);
@@ -183,6 +189,10 @@ bool run_g_lock_ping_pong(int dummy);
 bool run_local_namemap_cache1(int dummy);
 bool run_local_idmap_cache1(int dummy);
 bool run_hidenewfiles(int dummy);
+bool run_casefold_index(int dummy);
+bool run_io_uring_files(int dummy);
+bool run_share_mode_cache(int dummy);
+bool run_files_hash(int dummy);
 bool run_hidenewfiles_showdirs(int dummy);
 bool run_readdir_timestamp(int dummy);
 bool run_ctdbd_conn1(int dummy);
@@ -0,0 +1,195 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test the brlock overlap index against a linear scan
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "locking/proto.h"
+#include "lib/util/tsort.h"
+
+#define BRLOCK_INDEX_NUM_PROBES 2000
+
+/*
+ * Offsets and sizes from a small range, so that locks overlap, share
+ * their start and touch each other. Every now and then a zero length
+ * range, the {0, 0} range or a range up to the last byte.
+ */
+static void brlock_index_range(br_off *pstart, br_off *psize)
+{
+	br_off start = random() % 64;
+	br_off size = random() % 8;
+
+	switch (random() % 8) {
+	case 0:
+		size = 0;
+		break;
+	case 1:
+		start = 0;
+		size = 0;
+		break;
+	case 2:
+		/* Ends at UINT64_MAX */
+		start = UINT64_MAX - (random() % 4);
+		size = UINT64_MAX - start + 1;
+		break;
+	case 3:
+		/* From somewhere to the end */
+		size = UINT64_MAX - start + 1;
+		break;
+	case 4:
+		/* Wraps, treated as ending at UINT64_MAX */
+		size = UINT64_MAX;
+		break;
+	case 5:
+		start = UINT64_MAX - (random() % 4);
+		size = 0;
+		break;
+	default:
+		break;
+	}
+
+	*pstart = start;
+	*psize = size;
+}
+
+static bool brlock_index_conflict(const struct lock_struct *lck,
+				  const struct lock_struct *probe)
+{
+	if ((lck->lock_type == READ_LOCK) && (probe->lock_type == READ_LOCK)) {
+		return false;
+	}
+	return byte_range_overlap(lck->start, lck->size,
+				  probe->start, probe->size);
+}
+
+static int brlock_index_cmp(const struct lock_struct *l1,
+			    const struct lock_struct *l2)
+{
+	if (l1->start < l2->start) {
+		return -1;
+	}
+	if (l1->start > l2->start) {
+		return 1;
+	}
+	return 0;
+}
+
+static bool brlock_index_one(unsigned int num_locks)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct lock_struct *locks = NULL;
+	br_off *max_last = NULL;
+	unsigned int i, j;
+	bool ret = false;
+
+	locks = talloc_zero_array(frame, struct lock_struct, num_locks);
+	if (locks == NULL) {
+		fprintf(stderr, "talloc failed\n");
+		goto done;
+	}
+
+	for (i=0; i<num_locks; i++) {
+		brlock_index_range(&locks[i].start, &locks[i].size);
+		locks[i].lock_type = (random() % 2) ? READ_LOCK : WRITE_LOCK;
+		locks[i].lock_flav = WINDOWS_LOCK;
+	}
+	TYPESAFE_QSORT(locks, num_locks, brlock_index_cmp);
+
+	max_last = brl_index_build(frame, locks, num_locks);
+	if (max_last == NULL) {
+		fprintf(stderr, "brl_index_build failed\n");
+		goto done;
+	}
+
+	for (i=0; i<BRLOCK_INDEX_NUM_PROBES; i++) {
+		struct lock_struct probe = { .lock_flav = WINDOWS_LOCK };
+		unsigned int begin, end;
+		int linear_conflict = -1;
+		int index_conflict = -1;
+
+		brlock_index_range(&probe.start, &probe.size);
+		probe.lock_type = (random() % 2) ? READ_LOCK : WRITE_LOCK;
+
+		brl_index_range(locks, num_locks, max_last,
+				probe.start, probe.size, &begin, &end);
+
+		if ((begin > end) || (end > num_locks)) {
+			fprintf(stderr, "Invalid slice [%u, %u) of %u\n",
+				begin, end, num_locks);
+			goto done;
+		}
+
+		for (j=0; j<num_locks; j++) {
+			bool overlap = byte_range_overlap(
+				locks[j].start, locks[j].size,
+				probe.start, probe.size);
+
+			if (overlap && ((j < begin) || (j >= end))) {
+				fprintf(stderr,
+					"Lock %u {%"PRIu64", %"PRIu64"} "
+					"overlaps {%"PRIu64", %"PRIu64"} "
+					"but is outside of [%u, %u)\n",
+					j, locks[j].start, locks[j].size,
+					probe.start, probe.size, begin, end);
+				goto done;
+			}
+
+			if ((linear_conflict == -1) &&
+			    brlock_index_conflict(&locks[j], &probe)) {
+				linear_conflict = j;
+			}
+		}
+
+		for (j=begin; j<end; j++) {
+			if (brlock_index_conflict(&locks[j], &probe)) {
+				index_conflict = j;
+				break;
+			}
+		}
+
+		if (linear_conflict != index_conflict) {
+			fprintf(stderr,
+				"{%"PRIu64", %"PRIu64"} %s: linear scan "
+				"found conflict %d, index found %d\n",
+				probe.start, probe.size,
+				lock_type_name(probe.lock_type),
+				linear_conflict, index_conflict);
+			goto done;
+		}
+	}
+
+	ret = true;
+done:
+	TALLOC_FREE(frame);
+	return ret;
+}
+
+bool run_brlock_index(int dummy)
+{
+	unsigned int nums[] = { 9, 10, 16, 33, 100, 1000 };
+	size_t i;
+
+	for (i=0; i<ARRAY_SIZE(nums); i++) {
+		bool ok = brlock_index_one(nums[i]);
+		if (!ok) {
+			fprintf(stderr, "Failed with %u locks\n", nums[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,225 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test "smbd:casefold index"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "client.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "libcli/security/security.h"
+#include "libsmb/proto.h"
+
+#define CASEFOLD_DIR "casefold"
+#define CASEFOLD_NUM_FILES 2000
+
+static NTSTATUS casefold_open(struct cli_state *cli, const char *name)
+{
+	uint16_t fnum;
+	NTSTATUS status;
+
+	status = cli_ntcreate(cli,
+			      name,
+			      0,
+			      FILE_READ_ATTRIBUTES,
+			      0,
+			      FILE_SHARE_READ|FILE_SHARE_WRITE|
+			      FILE_SHARE_DELETE,
+			      FILE_OPEN,
+			      0,
+			      0,
+			      &fnum,
+			      NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+	return cli_close(cli, fnum);
+}
+
+static bool casefold_expect(struct cli_state *cli,
+			    const char *name,
+			    NTSTATUS expected)
+{
+	NTSTATUS status = casefold_open(cli, name);
+
+	if (!NT_STATUS_EQUAL(status, expected)) {
+		printf("open(%s) returned %s, expected %s\n",
+		       name,
+		       nt_errstr(status),
+		       nt_errstr(expected));
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Case-insensitive opens in a directory with CASEFOLD_NUM_FILES
+ * entries: The first miss builds the index, later ones are answered
+ * from it. A rename has to invalidate it.
+ */
+bool run_casefold_index(int dummy)
+{
+	struct cli_state *cli = NULL;
+	NTSTATUS status;
+	bool ret = false;
+	bool ok;
+	int i;
+
+	printf("Starting CASEFOLD-INDEX\n");
+
+	if (!torture_init_connection(&cli)) {
+		return false;
+	}
+
+	status = smbXcli_negprot(cli->conn,
+				 cli->timeout,
+				 PROTOCOL_SMB2_02,
+				 PROTOCOL_SMB3_11,
+				 NULL,
+				 NULL,
+				 NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smbXcli_negprot returned %s\n", nt_errstr(status));
+		return false;
+	}
+
+	status = cli_session_setup_creds(cli, torture_creds);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_session_setup returned %s\n", nt_errstr(status));
+		return false;
+	}
+
+	status = cli_tree_connect(cli, share, "?????", NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_tree_connect returned %s\n", nt_errstr(status));
+		return false;
+	}
+
+	torture_deltree(cli, CASEFOLD_DIR);
+
+	status = cli_mkdir(cli, CASEFOLD_DIR);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_mkdir returned %s\n", nt_errstr(status));
+		goto done;
+	}
+
+	for (i=0; i<CASEFOLD_NUM_FILES; i++) {
+		char name[64];
+		uint16_t fnum;
+
+		snprintf(name, sizeof(name), CASEFOLD_DIR "\\File%04d", i);
+
+		status = cli_ntcreate(cli,
+				      name,
+				      0,
+				      FILE_GENERIC_WRITE,
+				      FILE_ATTRIBUTE_NORMAL,
+				      FILE_SHARE_READ|FILE_SHARE_WRITE|
+				      FILE_SHARE_DELETE,
+				      FILE_CREATE,
+				      0,
+				      0,
+				      &fnum,
+				      NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("create(%s) returned %s\n",
+			       name,
+			       nt_errstr(status));
+			goto done;
+		}
+		cli_close(cli, fnum);
+	}
+
+	/*
+	 * smbd only indexes directories that did not change for a
+	 * second.
+	 */
+	smb_msleep(2000);
+
+	/*
+	 * The first miss scans and stores the index, the second one
+	 * is answered from it.
+	 */
+	ok = casefold_expect(cli, CASEFOLD_DIR "\\FILE0042", NT_STATUS_OK);
+	if (!ok) {
+		goto done;
+	}
+	ok = casefold_expect(cli, CASEFOLD_DIR "\\file1999", NT_STATUS_OK);
+	if (!ok) {
+		goto done;
+	}
+	ok = casefold_expect(cli, CASEFOLD_DIR "\\fILE0000", NT_STATUS_OK);
+	if (!ok) {
+		goto done;
+	}
+
+	ok = casefold_expect(cli,
+			     CASEFOLD_DIR "\\file2000",
+			     NT_STATUS_OBJECT_NAME_NOT_FOUND);
+	if (!ok) {
+		goto done;
+	}
+	ok = casefold_expect(cli,
+			     CASEFOLD_DIR "\\nonexisting",
+			     NT_STATUS_OBJECT_NAME_NOT_FOUND);
+	if (!ok) {
+		goto done;
+	}
+
+	status = cli_rename(cli,
+			    CASEFOLD_DIR "\\File0100",
+			    CASEFOLD_DIR "\\Renamed0100",
+			    false);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_rename returned %s\n", nt_errstr(status));
+		goto done;
+	}
+
+	/*
+	 * Right after the rename the index is stale and must not be
+	 * used. After a second it is rebuilt with the new name.
+	 */
+	for (i=0; i<2; i++) {
+		ok = casefold_expect(cli,
+				     CASEFOLD_DIR "\\RENAMED0100",
+				     NT_STATUS_OK);
+		if (!ok) {
+			goto done;
+		}
+		ok = casefold_expect(cli,
+				     CASEFOLD_DIR "\\FILE0100",
+				     NT_STATUS_OBJECT_NAME_NOT_FOUND);
+		if (!ok) {
+			goto done;
+		}
+		ok = casefold_expect(cli,
+				     CASEFOLD_DIR "\\file0101",
+				     NT_STATUS_OK);
+		if (!ok) {
+			goto done;
+		}
+
+		if (i == 0) {
+			smb_msleep(2000);
+		}
+	}
+
+	ret = true;
+done:
+	torture_deltree(cli, CASEFOLD_DIR);
+	torture_close_connection(cli);
+	return ret;
+}
@@ -0,0 +1,153 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test dbwrap_cache
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "system/filesys.h"
+#include "lib/dbwrap/dbwrap.h"
+#include "lib/dbwrap/dbwrap_open.h"
+#include "lib/util/util_tdb.h"
+
+static bool dbwrap_cache1_check(struct db_context *db,
+				const char *keystr,
+				const char *expected)
+{
+	TDB_DATA value;
+	NTSTATUS status;
+	bool ok = false;
+
+	status = dbwrap_fetch_bystring(db, talloc_tos(), keystr, &value);
+
+	if (expected == NULL) {
+		if (!NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND)) {
+			fprintf(stderr, "fetch %s returned %s, "
+				"expected NOT_FOUND\n",
+				keystr, nt_errstr(status));
+			return false;
+		}
+		return true;
+	}
+
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "fetch %s failed: %s\n",
+			keystr, nt_errstr(status));
+		return false;
+	}
+
+	if (tdb_data_cmp(value, string_term_tdb_data(expected)) != 0) {
+		fprintf(stderr, "fetch %s returned %.*s, expected %s\n",
+			keystr, (int)value.dsize, (char *)value.dptr,
+			expected);
+		goto done;
+	}
+
+	ok = true;
+done:
+	TALLOC_FREE(value.dptr);
+	return ok;
+}
+
+bool run_dbwrap_cache1(int dummy)
+{
+	struct db_context *db = NULL;
+	const char *dbname = "test_dbwrap_cache.tdb";
+	NTSTATUS status;
+	bool ret = false;
+	int res;
+	int i;
+
+	unlink(dbname);
+
+	db = db_open(talloc_tos(), dbname, 0, TDB_DEFAULT,
+		     O_CREAT|O_RDWR, 0644,
+		     DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_CACHE);
+	if (db == NULL) {
+		fprintf(stderr, "db_open failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	/* Negative entries must not survive a store */
+	if (!dbwrap_cache1_check(db, "key", NULL)) {
+		goto fail;
+	}
+	status = dbwrap_store_bystring(db, "key",
+				       string_term_tdb_data("value1"), 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "dbwrap_store failed: %s\n",
+			nt_errstr(status));
+		goto fail;
+	}
+
+	/* Fill the cache and then overwrite */
+	for (i=0; i<2; i++) {
+		if (!dbwrap_cache1_check(db, "key", "value1")) {
+			goto fail;
+		}
+	}
+	status = dbwrap_store_bystring(db, "key",
+				       string_term_tdb_data("value2"), 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "dbwrap_store failed: %s\n",
+			nt_errstr(status));
+		goto fail;
+	}
+	if (!dbwrap_cache1_check(db, "key", "value2")) {
+		goto fail;
+	}
+
+	/* A cancelled transaction must not leave anything behind */
+	res = dbwrap_transaction_start(db);
+	if (res != 0) {
+		fprintf(stderr, "dbwrap_transaction_start failed\n");
+		goto fail;
+	}
+	status = dbwrap_store_bystring(db, "key",
+				       string_term_tdb_data("value3"), 0);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "dbwrap_store failed: %s\n",
+			nt_errstr(status));
+		goto fail;
+	}
+	if (!dbwrap_cache1_check(db, "key", "value3")) {
+		goto fail;
+	}
+	res = dbwrap_transaction_cancel(db);
+	if (res != 0) {
+		fprintf(stderr, "dbwrap_transaction_cancel failed\n");
+		goto fail;
+	}
+	if (!dbwrap_cache1_check(db, "key", "value2")) {
+		goto fail;
+	}
+
+	status = dbwrap_delete_bystring(db, "key");
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "dbwrap_delete failed: %s\n",
+			nt_errstr(status));
+		goto fail;
+	}
+	if (!dbwrap_cache1_check(db, "key", NULL)) {
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(db);
+	unlink(dbname);
+	return ret;
+}
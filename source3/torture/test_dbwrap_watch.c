@@ -465,3 +465,188 @@ fail:
 	TALLOC_FREE(ev);
 	return ret;
 }
+
+/*
+ * Test that dbwrap_watched_watch_set_alert_count() alerts the first
+ * n watchers in the order they started to wait, all of them
+ * living in one process and thus sharing one message.
+ */
+
+#define DBWRAP_WATCH5_NUM 3
+
+struct dbwrap_watch5_state {
+	TALLOC_CTX *mem_ctx;
+	struct tevent_context *ev;
+
+	size_t idx;
+	struct tevent_req *reqs[DBWRAP_WATCH5_NUM];
+	NTSTATUS statuses[DBWRAP_WATCH5_NUM];
+
+	NTSTATUS status;
+};
+
+static void dbwrap_watch5_done(struct tevent_req *subreq);
+
+static void dbwrap_watch5_watch_fn(struct db_record *rec,
+				   TDB_DATA value,
+				   void *private_data)
+{
+	struct dbwrap_watch5_state *state = private_data;
+	size_t idx = state->idx;
+	bool ok;
+
+	state->reqs[idx] = dbwrap_watched_watch_send(
+		state->mem_ctx, state->ev, rec, 0, (struct server_id) { .pid=0 });
+	if (state->reqs[idx] == NULL) {
+		goto nomem;
+	}
+	tevent_req_set_callback(state->reqs[idx], dbwrap_watch5_done, state);
+	state->statuses[idx] = NT_STATUS_EVENT_PENDING;
+
+	ok = tevent_req_set_endtime(
+		state->reqs[idx], state->ev, timeval_current_ofs(1, 0));
+	if (!ok) {
+		goto nomem;
+	}
+
+	state->status = NT_STATUS_OK;
+	return;
+
+	nomem:
+	state->status = NT_STATUS_NO_MEMORY;
+}
+
+static void dbwrap_watch5_store_fn(struct db_record *rec,
+				   TDB_DATA value,
+				   void *private_data)
+{
+	struct dbwrap_watch5_state *state = private_data;
+	TDB_DATA key = dbwrap_record_get_key(rec);
+
+	dbwrap_watched_watch_set_alert_count(rec, DBWRAP_WATCH5_NUM-1);
+
+	state->status = dbwrap_record_store(rec, key, 0);
+}
+
+static void dbwrap_watch5_done(struct tevent_req *subreq)
+{
+	struct dbwrap_watch5_state *state = tevent_req_callback_data_void(subreq);
+	uint64_t instance;
+	size_t i;
+
+	for (i=0; i<DBWRAP_WATCH5_NUM; i++) {
+		if (state->reqs[i] == subreq) {
+			break;
+		}
+	}
+	SMB_ASSERT(i < DBWRAP_WATCH5_NUM);
+
+	/*
+	 * Keep our instance, we don't want to pass on the
+	 * wakeup to the next waiter.
+	 */
+	state->statuses[i] = dbwrap_watched_watch_recv(
+		subreq, &instance, NULL, NULL);
+	TALLOC_FREE(subreq);
+	printf("req%zu finished: %s\n", i+1, nt_errstr(state->statuses[i]));
+	state->reqs[i] = NULL;
+}
+
+bool run_dbwrap_watch5(int dummy)
+{
+	struct tevent_context *ev = NULL;
+	struct messaging_context *msg = NULL;
+	struct db_context *backend = NULL;
+	struct db_context *db = NULL;
+	const char *keystr = "key";
+	TDB_DATA key = string_term_tdb_data(keystr);
+	struct dbwrap_watch5_state state = { 0 };
+	NTSTATUS status;
+	bool ret = false;
+	bool ok;
+	size_t i;
+
+	ok = test_dbwrap_watch_init(
+		talloc_tos(), "test_watch.tdb", &ev, &msg, &backend, &db);
+	if (!ok) {
+		goto fail;
+	}
+
+	state = (struct dbwrap_watch5_state) {
+		.mem_ctx = talloc_tos(),
+		.ev = ev,
+	};
+
+	for (i=0; i<DBWRAP_WATCH5_NUM; i++) {
+		state.idx = i;
+		status = dbwrap_do_locked(db, key, dbwrap_watch5_watch_fn, &state);
+		if (!NT_STATUS_IS_OK(status)) {
+			fprintf(stderr,
+				"dbwrap_do_locked failed: %s\n",
+				nt_errstr(status));
+			goto fail;
+		}
+		if (!NT_STATUS_IS_OK(state.status)) {
+			fprintf(stderr,
+				"dbwrap_watch5_watch_fn failed: %s\n",
+				nt_errstr(state.status));
+			goto fail;
+		}
+	}
+
+	status = dbwrap_do_locked(db, key, dbwrap_watch5_store_fn, &state);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr,
+			"dbwrap_do_locked failed: %s\n",
+			nt_errstr(status));
+		goto fail;
+	}
+	if (!NT_STATUS_IS_OK(state.status)) {
+		fprintf(stderr,
+			"dbwrap_watch5_store_fn failed: %s\n",
+			nt_errstr(state.status));
+		goto fail;
+	}
+
+	for (i=0; i<DBWRAP_WATCH5_NUM; i++) {
+		while (NT_STATUS_EQUAL(state.statuses[i],
+				       NT_STATUS_EVENT_PENDING)) {
+			int res = tevent_loop_once(ev);
+			if (res != 0) {
+				fprintf(stderr,
+					"tevent_loop_once failed: %s\n",
+					strerror(errno));
+				goto fail;
+			}
+		}
+	}
+
+	for (i=0; i<DBWRAP_WATCH5_NUM-1; i++) {
+		if (!NT_STATUS_IS_OK(state.statuses[i])) {
+			fprintf(stderr,
+				"req%zu returned %s\n",
+				i+1,
+				nt_errstr(state.statuses[i]));
+			goto fail;
+		}
+	}
+
+	if (!NT_STATUS_EQUAL(state.statuses[i], NT_STATUS_IO_TIMEOUT)) {
+		fprintf(stderr,
+			"req%zu returned %s\n",
+			i+1,
+			nt_errstr(state.statuses[i]));
+		goto fail;
+	}
+
+	(void)unlink("test_watch.tdb");
+	ret = true;
+fail:
+	for (i=0; i<DBWRAP_WATCH5_NUM; i++) {
+		TALLOC_FREE(state.reqs[i]);
+	}
+	TALLOC_FREE(db);
+	TALLOC_FREE(msg);
+	TALLOC_FREE(ev);
+	return ret;
+}
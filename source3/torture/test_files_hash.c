@@ -0,0 +1,255 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test the smbd lookup hashes for open files
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "libsmb/libsmb.h"
+#include "libcli/security/security.h"
+
+/*
+ * More handles than the initial 64 hash buckets, so the tables
+ * have to grow while we open them.
+ */
+#define FILES_HASH_NUM_FILES 40
+#define FILES_HASH_NUM_OPENS 4
+#define FILES_HASH_NUM_FNUMS (FILES_HASH_NUM_FILES * FILES_HASH_NUM_OPENS)
+
+/*
+ * Ask smbd to compare file_find_dif(), file_find_di_first/next() and
+ * file_find_fd() with a walk of all its open files.
+ */
+static bool files_hash_check(struct cli_state *cli, uint16_t fnum)
+{
+	uint16_t setup[4];
+	NTSTATUS status;
+
+	SIVAL(setup, 0, FSCTL_SMBTORTURE_FILES_HASH_CHECK);
+	SSVAL(setup, 4, fnum);
+	SCVAL(setup, 6, 0x1);   /* It is an fsctl */
+	SCVAL(setup, 7, 0x0);
+
+	status = cli_trans(talloc_tos(), cli, SMBnttrans,
+			   NULL, fnum,
+			   NT_TRANSACT_IOCTL, 0,
+			   setup, 4, 4,
+			   NULL, 0, 0,    /* param, param_num, max_param */
+			   NULL, 0, 0,    /* data, data_len, max_data */
+			   NULL,          /* recv_flags2 */
+			   NULL, 0, NULL, /* rsetup, min_rsetup, num_rsetup */
+			   NULL, 0, NULL, /* rparam, min_rparam, num_rparam */
+			   NULL, 0, NULL); /* rdata, ... */
+	if (!NT_STATUS_IS_OK(status)) {
+		d_fprintf(stderr,
+			  "FSCTL_SMBTORTURE_FILES_HASH_CHECK returned %s\n",
+			  nt_errstr(status));
+		return false;
+	}
+	return true;
+}
+
+bool run_files_hash(int dummy)
+{
+	struct cli_state *cli = NULL;
+	uint16_t fnums[FILES_HASH_NUM_FNUMS];
+	bool is_open[FILES_HASH_NUM_FNUMS] = { false, };
+	uint16_t dos_fnum = 0;
+	uint16_t dup_fnums[2] = { 0, };
+	uint16_t check_fnum = 0;
+	char fname[32];
+	NTSTATUS status;
+	size_t i, j;
+	bool ret = false;
+
+	printf("Starting FILES-HASH\n");
+
+	if (!torture_open_connection(&cli, 0)) {
+		return false;
+	}
+
+	/*
+	 * Every file is opened FILES_HASH_NUM_OPENS times, so the
+	 * file_id hash sees several fsps with the same file_id. The
+	 * last open of each file is a stat open.
+	 */
+	for (i = 0; i < FILES_HASH_NUM_FILES; i++) {
+		snprintf(fname, sizeof(fname), "files_hash_%zu.dat", i);
+
+		for (j = 0; j < FILES_HASH_NUM_OPENS; j++) {
+			size_t idx = i * FILES_HASH_NUM_OPENS + j;
+			uint32_t access_mask = FILE_READ_DATA|FILE_WRITE_DATA;
+
+			if (j == FILES_HASH_NUM_OPENS - 1) {
+				access_mask = FILE_READ_ATTRIBUTES;
+			}
+
+			status = cli_ntcreate(cli,
+					      fname,
+					      0,
+					      access_mask,
+					      FILE_ATTRIBUTE_NORMAL,
+					      FILE_SHARE_READ|
+					      FILE_SHARE_WRITE|
+					      FILE_SHARE_DELETE,
+					      FILE_OPEN_IF,
+					      0,
+					      0,
+					      &fnums[idx],
+					      NULL);
+			if (!NT_STATUS_IS_OK(status)) {
+				d_fprintf(stderr,
+					  "cli_ntcreate(%s) returned %s\n",
+					  fname,
+					  nt_errstr(status));
+				goto fail;
+			}
+			is_open[idx] = true;
+		}
+	}
+
+	check_fnum = fnums[0];
+
+	if (!files_hash_check(cli, check_fnum)) {
+		goto fail;
+	}
+
+	/*
+	 * A second DOS open by the same pid shares the first one's fd
+	 * handle via dup_file_fsp(), a third one via an FCB open.
+	 */
+	status = cli_openx(cli,
+			   "files_hash_dos.dat",
+			   O_RDWR|O_CREAT,
+			   DENY_DOS,
+			   &dos_fnum);
+	if (!NT_STATUS_IS_OK(status)) {
+		d_fprintf(stderr, "cli_openx(DENY_DOS) returned %s\n",
+			  nt_errstr(status));
+		goto fail;
+	}
+	status = cli_openx(cli,
+			   "files_hash_dos.dat",
+			   O_RDWR,
+			   DENY_DOS,
+			   &dup_fnums[0]);
+	if (!NT_STATUS_IS_OK(status)) {
+		d_fprintf(stderr, "second cli_openx(DENY_DOS) returned %s\n",
+			  nt_errstr(status));
+		goto fail;
+	}
+	status = cli_openx(cli,
+			   "files_hash_dos.dat",
+			   O_RDWR,
+			   DENY_FCB,
+			   &dup_fnums[1]);
+	if (!NT_STATUS_IS_OK(status)) {
+		d_fprintf(stderr, "cli_openx(DENY_FCB) returned %s\n",
+			  nt_errstr(status));
+		goto fail;
+	}
+
+	if (!files_hash_check(cli, check_fnum)) {
+		goto fail;
+	}
+
+	/*
+	 * Closing the first DOS open leaves the shared fd handle with
+	 * the dups
+	 */
+	status = cli_close(cli, dos_fnum);
+	dos_fnum = 0;
+	if (!NT_STATUS_IS_OK(status)) {
+		d_fprintf(stderr, "cli_close returned %s\n",
+			  nt_errstr(status));
+		goto fail;
+	}
+
+	/*
+	 * Close every other handle, taking out fsps from the middle of
+	 * the hash chains
+	 */
+	for (i = 1; i < FILES_HASH_NUM_FNUMS; i += 2) {
+		status = cli_close(cli, fnums[i]);
+		is_open[i] = false;
+		if (!NT_STATUS_IS_OK(status)) {
+			d_fprintf(stderr, "cli_close returned %s\n",
+				  nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	if (!files_hash_check(cli, check_fnum)) {
+		goto fail;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(dup_fnums); i++) {
+		status = cli_close(cli, dup_fnums[i]);
+		dup_fnums[i] = 0;
+		if (!NT_STATUS_IS_OK(status)) {
+			d_fprintf(stderr, "cli_close returned %s\n",
+				  nt_errstr(status));
+			goto fail;
+		}
+		if (!files_hash_check(cli, check_fnum)) {
+			goto fail;
+		}
+	}
+
+	for (i = FILES_HASH_NUM_FNUMS; i > 1; i--) {
+		if (!is_open[i-1]) {
+			continue;
+		}
+		status = cli_close(cli, fnums[i-1]);
+		is_open[i-1] = false;
+		if (!NT_STATUS_IS_OK(status)) {
+			d_fprintf(stderr, "cli_close returned %s\n",
+				  nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	if (!files_hash_check(cli, check_fnum)) {
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	if (dos_fnum != 0) {
+		cli_close(cli, dos_fnum);
+	}
+	for (i = 0; i < ARRAY_SIZE(dup_fnums); i++) {
+		if (dup_fnums[i] != 0) {
+			cli_close(cli, dup_fnums[i]);
+		}
+	}
+	for (i = 0; i < FILES_HASH_NUM_FNUMS; i++) {
+		if (is_open[i]) {
+			cli_close(cli, fnums[i]);
+		}
+	}
+	for (i = 0; i < FILES_HASH_NUM_FILES; i++) {
+		snprintf(fname, sizeof(fname), "files_hash_%zu.dat", i);
+		cli_unlink(cli,
+			   fname,
+			   FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	}
+	cli_unlink(cli,
+		   "files_hash_dos.dat",
+		   FILE_ATTRIBUTE_SYSTEM | FILE_ATTRIBUTE_HIDDEN);
+	torture_close_connection(cli);
+	return ret;
+}
@@ -0,0 +1,244 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test "io_uring:registered_files"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "client.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "libcli/security/security.h"
+#include "libsmb/proto.h"
+
+/*
+ * More files than the share has slots in the registered file table
+ */
+#define IO_URING_NUM_FILES 16
+#define IO_URING_FILE_SIZE 65536
+
+static void io_uring_files_fill(uint8_t *buf, size_t len, unsigned seed)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		buf[i] = (uint8_t)(i * 7 + seed);
+	}
+}
+
+static bool io_uring_files_check(struct cli_state *cli,
+				 uint16_t fnum,
+				 unsigned seed)
+{
+	uint8_t expected[IO_URING_FILE_SIZE];
+	uint8_t buf[IO_URING_FILE_SIZE];
+	size_t nread = 0;
+	NTSTATUS status;
+
+	status = cli_read(cli, fnum, (char *)buf, 0, sizeof(buf), &nread);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_read returned %s\n", nt_errstr(status));
+		return false;
+	}
+	if (nread != sizeof(buf)) {
+		printf("cli_read returned %zu bytes, expected %zu\n",
+		       nread,
+		       sizeof(buf));
+		return false;
+	}
+
+	io_uring_files_fill(expected, sizeof(expected), seed);
+	if (memcmp(buf, expected, sizeof(buf)) != 0) {
+		printf("Data mismatch in file %u\n", seed);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Do io on more files at the same time than fit into the registered
+ * file table, close them, so their slots are reused, and make sure
+ * the data is right when reading it back through new handles.
+ */
+bool run_io_uring_files(int dummy)
+{
+	struct cli_state *cli = NULL;
+	uint16_t fnums[IO_URING_NUM_FILES];
+	uint8_t buf[IO_URING_FILE_SIZE];
+	NTSTATUS status;
+	bool ret = false;
+	unsigned i, round;
+
+	printf("Starting IO-URING-FILES\n");
+
+	if (!torture_init_connection(&cli)) {
+		return false;
+	}
+
+	status = smbXcli_negprot(cli->conn,
+				 cli->timeout,
+				 PROTOCOL_SMB2_02,
+				 PROTOCOL_SMB3_11,
+				 NULL,
+				 NULL,
+				 NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smbXcli_negprot returned %s\n", nt_errstr(status));
+		return false;
+	}
+
+	status = cli_session_setup_creds(cli, torture_creds);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_session_setup returned %s\n", nt_errstr(status));
+		return false;
+	}
+
+	status = cli_tree_connect(cli, share, "?????", NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_tree_connect returned %s\n", nt_errstr(status));
+		return false;
+	}
+
+	for (i=0; i<IO_URING_NUM_FILES; i++) {
+		fnums[i] = UINT16_MAX;
+	}
+
+	for (round=0; round<2; round++) {
+		uint32_t disposition = (round == 0) ? FILE_OVERWRITE_IF
+						    : FILE_OPEN;
+
+		for (i=0; i<IO_URING_NUM_FILES; i++) {
+			char name[64];
+
+			snprintf(name, sizeof(name), "io_uring_%02u.dat", i);
+
+			status = cli_ntcreate(cli,
+					      name,
+					      0,
+					      FILE_GENERIC_READ|
+					      FILE_GENERIC_WRITE|
+					      DELETE_ACCESS,
+					      FILE_ATTRIBUTE_NORMAL,
+					      FILE_SHARE_READ|FILE_SHARE_WRITE|
+					      FILE_SHARE_DELETE,
+					      disposition,
+					      0,
+					      0,
+					      &fnums[i],
+					      NULL);
+			if (!NT_STATUS_IS_OK(status)) {
+				printf("create(%s) returned %s\n",
+				       name,
+				       nt_errstr(status));
+				goto done;
+			}
+		}
+
+		for (i=0; i<IO_URING_NUM_FILES; i++) {
+			if (round == 0) {
+				io_uring_files_fill(buf, sizeof(buf), i);
+				status = cli_writeall(cli,
+						      fnums[i],
+						      0,
+						      buf,
+						      0,
+						      sizeof(buf),
+						      NULL);
+				if (!NT_STATUS_IS_OK(status)) {
+					printf("cli_writeall returned %s\n",
+					       nt_errstr(status));
+					goto done;
+				}
+				status = cli_flush(NULL, cli, fnums[i]);
+				if (!NT_STATUS_IS_OK(status)) {
+					printf("cli_flush returned %s\n",
+					       nt_errstr(status));
+					goto done;
+				}
+			}
+			if (!io_uring_files_check(cli, fnums[i], i)) {
+				goto done;
+			}
+		}
+
+		for (i=0; i<IO_URING_NUM_FILES; i++) {
+			if (round == 1) {
+				status = cli_nt_delete_on_close(
+					cli, fnums[i], true);
+				if (!NT_STATUS_IS_OK(status)) {
+					printf("cli_nt_delete_on_close "
+					       "returned %s\n",
+					       nt_errstr(status));
+					goto done;
+				}
+			}
+			status = cli_close(cli, fnums[i]);
+			fnums[i] = UINT16_MAX;
+			if (!NT_STATUS_IS_OK(status)) {
+				printf("cli_close returned %s\n",
+				       nt_errstr(status));
+				goto done;
+			}
+		}
+	}
+
+	/*
+	 * The delete on close must have happened, the files were
+	 * unregistered from the table before they were closed
+	 */
+	for (i=0; i<IO_URING_NUM_FILES; i++) {
+		char name[64];
+		uint16_t fnum;
+
+		snprintf(name, sizeof(name), "io_uring_%02u.dat", i);
+
+		status = cli_ntcreate(cli,
+				      name,
+				      0,
+				      FILE_READ_ATTRIBUTES,
+				      0,
+				      FILE_SHARE_READ|FILE_SHARE_WRITE|
+				      FILE_SHARE_DELETE,
+				      FILE_OPEN,
+				      0,
+				      0,
+				      &fnum,
+				      NULL);
+		if (!NT_STATUS_EQUAL(status,
+				     NT_STATUS_OBJECT_NAME_NOT_FOUND)) {
+			printf("open(%s) after delete returned %s\n",
+			       name,
+			       nt_errstr(status));
+			if (NT_STATUS_IS_OK(status)) {
+				cli_close(cli, fnum);
+			}
+			goto done;
+		}
+	}
+
+	ret = true;
+done:
+	for (i=0; i<IO_URING_NUM_FILES; i++) {
+		char name[64];
+
+		if (fnums[i] != UINT16_MAX) {
+			cli_close(cli, fnums[i]);
+		}
+		snprintf(name, sizeof(name), "io_uring_%02u.dat", i);
+		cli_unlink(cli, name, FILE_ATTRIBUTE_HIDDEN|FILE_ATTRIBUTE_SYSTEM);
+	}
+	torture_close_connection(cli);
+	return ret;
+}
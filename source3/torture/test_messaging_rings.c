@@ -0,0 +1,316 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test messaging through "messaging:shm rings"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "lib/util/tevent_unix.h"
+#include "messages.h"
+#include "lib/messaging/messages_dgm.h"
+#include "lib/param/param.h"
+#include "lib/async_req/async_sock.h"
+
+#define RINGS_NUM_MSGS 200000
+
+/*
+ * Every RINGS_BIG_EVERY message is too large for a ring and has to go
+ * through the socket, interleaved with the ring traffic.
+ */
+#define RINGS_BIG_EVERY 997
+#define RINGS_BIG_LEN 20000
+
+struct rings_sender_state {
+	struct tevent_context *ev;
+	struct messaging_context *msg_ctx;
+	struct server_id dst;
+	uint32_t next;
+	NTSTATUS status;
+};
+
+static void rings_sender_batch(struct tevent_context *ev,
+			       struct tevent_immediate *im,
+			       void *private_data)
+{
+	struct rings_sender_state *state = private_data;
+	static uint8_t big[RINGS_BIG_LEN];
+	size_t i;
+
+	/*
+	 * Send in batches and go through the event loop in between,
+	 * this is where RING_ACK and RING_SPACE are received.
+	 */
+	for (i=0; (i<100) && (state->next < RINGS_NUM_MSGS); i++) {
+		uint32_t seq = state->next;
+		struct iovec iov[2] = {
+			{ .iov_base = &seq, .iov_len = sizeof(seq) },
+			{ .iov_base = big, .iov_len = 0 },
+		};
+		NTSTATUS status;
+
+		if ((seq % RINGS_BIG_EVERY) == 0) {
+			iov[1].iov_len = sizeof(big);
+		}
+
+		status = messaging_send_iov(state->msg_ctx, state->dst,
+					    MSG_PONG, iov, ARRAY_SIZE(iov),
+					    NULL, 0);
+		if (!NT_STATUS_IS_OK(status)) {
+			state->status = status;
+			return;
+		}
+		state->next += 1;
+	}
+
+	if (state->next < RINGS_NUM_MSGS) {
+		tevent_schedule_immediate(im, ev, rings_sender_batch, state);
+	}
+}
+
+static void rings_sender(struct messaging_context *msg_ctx,
+			 struct server_id dst,
+			 int exit_fd)
+{
+	struct tevent_context *ev = messaging_tevent_context(msg_ctx);
+	struct rings_sender_state state = {
+		.ev = ev, .msg_ctx = msg_ctx, .dst = dst,
+		.status = NT_STATUS_OK,
+	};
+	struct tevent_immediate *im = NULL;
+	struct tevent_req *req = NULL;
+	NTSTATUS status;
+	bool ok;
+	int err;
+
+	status = messaging_reinit(msg_ctx);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "messaging_reinit failed: %s\n",
+			nt_errstr(status));
+		exit(1);
+	}
+
+	/*
+	 * After messaging_reinit(), we must not touch the parent's
+	 * socket. The sender always wants rings.
+	 */
+	messaging_dgm_enable_rings(true);
+
+	im = tevent_create_immediate(ev);
+	if (im == NULL) {
+		fprintf(stderr, "tevent_create_immediate failed\n");
+		exit(1);
+	}
+	tevent_schedule_immediate(im, ev, rings_sender_batch, &state);
+
+	/*
+	 * Keep the event loop running until the parent is done, we
+	 * might still have messages pending for it.
+	 */
+	req = wait_for_read_send(ev, ev, exit_fd, false);
+	if (req == NULL) {
+		fprintf(stderr, "wait_for_read_send failed\n");
+		exit(1);
+	}
+
+	ok = tevent_req_poll_unix(req, ev, &err);
+	if (!ok) {
+		fprintf(stderr, "tevent_req_poll_unix failed: %s\n",
+			strerror(err));
+		exit(1);
+	}
+
+	if (!NT_STATUS_IS_OK(state.status)) {
+		fprintf(stderr, "messaging_send_iov failed: %s\n",
+			nt_errstr(state.status));
+		exit(1);
+	}
+
+	exit(0);
+}
+
+struct rings_receiver_state {
+	uint32_t num_received;
+	bool ok;
+};
+
+static void rings_receive_msg(struct messaging_context *msg_ctx,
+			      void *private_data,
+			      uint32_t msg_type,
+			      struct server_id server_id,
+			      DATA_BLOB *data)
+{
+	struct rings_receiver_state *state = private_data;
+	uint32_t seq;
+	size_t expected_len = sizeof(seq);
+
+	if (!state->ok) {
+		return;
+	}
+
+	if (data->length < sizeof(seq)) {
+		fprintf(stderr, "Got short message: %zu\n", data->length);
+		state->ok = false;
+		return;
+	}
+	memcpy(&seq, data->data, sizeof(seq));
+
+	if (seq != state->num_received) {
+		fprintf(stderr, "Expected message %"PRIu32", got %"PRIu32"\n",
+			state->num_received, seq);
+		state->ok = false;
+		return;
+	}
+
+	if ((seq % RINGS_BIG_EVERY) == 0) {
+		expected_len += RINGS_BIG_LEN;
+	}
+	if (data->length != expected_len) {
+		fprintf(stderr, "Message %"PRIu32" has length %zu, "
+			"expected %zu\n", seq, data->length, expected_len);
+		state->ok = false;
+		return;
+	}
+
+	state->num_received += 1;
+}
+
+/*
+ * Let a child send RINGS_NUM_MSGS messages to us and check they all
+ * arrive in order. With "receiver_rings" false we don't ack the
+ * sender's ring, it has to fall back to the socket.
+ */
+
+static bool rings_one_run(struct tevent_context *ev,
+			  struct messaging_context *msg_ctx,
+			  bool receiver_rings)
+{
+	struct rings_receiver_state state = { .ok = true };
+	struct timeval endtime = timeval_current_ofs(120, 0);
+	int exit_pipe[2];
+	pid_t child, waited;
+	NTSTATUS status;
+	int ret, wstatus;
+
+	messaging_dgm_enable_rings(receiver_rings);
+
+	status = messaging_register(msg_ctx, &state, MSG_PONG,
+				    rings_receive_msg);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "messaging_register failed: %s\n",
+			nt_errstr(status));
+		return false;
+	}
+
+	ret = pipe(exit_pipe);
+	if (ret == -1) {
+		perror("pipe failed");
+		return false;
+	}
+
+	child = fork();
+	if (child == -1) {
+		perror("fork failed");
+		return false;
+	}
+	if (child == 0) {
+		close(exit_pipe[1]);
+		rings_sender(msg_ctx, messaging_server_id(msg_ctx),
+			     exit_pipe[0]);
+	}
+	close(exit_pipe[0]);
+
+	while (state.ok && (state.num_received < RINGS_NUM_MSGS)) {
+		if (timeval_expired(&endtime)) {
+			fprintf(stderr, "Timed out after %"PRIu32" "
+				"messages\n", state.num_received);
+			state.ok = false;
+			break;
+		}
+		ret = tevent_loop_once(ev);
+		if (ret == -1) {
+			perror("tevent_loop_once failed");
+			state.ok = false;
+			break;
+		}
+	}
+
+	messaging_deregister(msg_ctx, MSG_PONG, &state);
+
+	close(exit_pipe[1]);
+
+	do {
+		waited = waitpid(child, &wstatus, 0);
+	} while ((waited == -1) && (errno == EINTR));
+
+	if (waited != child) {
+		perror("waitpid failed");
+		return false;
+	}
+	if (!WIFEXITED(wstatus) || (WEXITSTATUS(wstatus) != 0)) {
+		fprintf(stderr, "sender failed\n");
+		return false;
+	}
+
+	printf("received %"PRIu32" messages, receiver rings %s\n",
+	       state.num_received, receiver_rings ? "on" : "off");
+
+	return state.ok;
+}
+
+bool run_messaging_rings(int dummy)
+{
+	struct loadparm_context *lp_ctx = NULL;
+	struct tevent_context *ev = NULL;
+	struct messaging_context *msg_ctx = NULL;
+	bool ok;
+
+	lp_ctx = loadparm_init_s3(talloc_tos(), loadparm_s3_helpers());
+	if (lp_ctx == NULL) {
+		fprintf(stderr, "loadparm_init_s3 failed\n");
+		return false;
+	}
+	ok = lpcfg_set_cmdline(lp_ctx, "messaging:shm rings", "yes");
+	TALLOC_FREE(lp_ctx);
+	if (!ok) {
+		fprintf(stderr, "Could not set messaging:shm rings\n");
+		return false;
+	}
+
+	ev = samba_tevent_context_init(talloc_tos());
+	if (ev == NULL) {
+		fprintf(stderr, "tevent_context_init failed\n");
+		return false;
+	}
+	msg_ctx = messaging_init(ev, ev);
+	if (msg_ctx == NULL) {
+		fprintf(stderr, "messaging_init failed\n");
+		return false;
+	}
+
+	ok = rings_one_run(ev, msg_ctx, true);
+	if (!ok) {
+		return false;
+	}
+
+	ok = rings_one_run(ev, msg_ctx, false);
+	if (!ok) {
+		return false;
+	}
+
+	TALLOC_FREE(msg_ctx);
+	TALLOC_FREE(ev);
+	return true;
+}
@@ -0,0 +1,236 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test the fanotify sys_notify backend
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "smbd/smbd.h"
+#include "system/filesys.h"
+#include "../librpc/gen_ndr/notify.h"
+
+#ifdef HAVE_FANOTIFY
+
+/*
+ * More files than the default fanotify queue (16384 events) holds
+ */
+#define FANOTIFY_NUM_FILES 20000
+
+struct fanotify_test_state {
+	const char *dir;
+	size_t num_events;
+	bool got_rescan;
+	bool timed_out;
+};
+
+static void fanotify_test_cb(struct sys_notify_context *ctx,
+			     void *private_data,
+			     struct notify_event *ev,
+			     uint32_t filter)
+{
+	struct fanotify_test_state *state = private_data;
+
+	if (ev->path[0] == '\0') {
+		if (strcmp(ev->dir, state->dir) != 0) {
+			fprintf(stderr, "rescan for %s, expected %s\n",
+				ev->dir, state->dir);
+			return;
+		}
+		state->got_rescan = true;
+		return;
+	}
+	state->num_events += 1;
+}
+
+static void fanotify_test_timeout(struct tevent_context *ev,
+				  struct tevent_timer *te,
+				  struct timeval current_time,
+				  void *private_data)
+{
+	struct fanotify_test_state *state = private_data;
+	state->timed_out = true;
+}
+
+/*
+ * Watch "path" with FILE_NAME for itself and its subdirectories,
+ * return what is left for notifyd to do for subdirectories.
+ */
+static int fanotify_test_watch(TALLOC_CTX *mem_ctx,
+			       struct sys_notify_context *ctx,
+			       const char *path,
+			       struct fanotify_test_state *state,
+			       uint32_t *psubdir_filter,
+			       void *handle_p)
+{
+	uint32_t filter = FILE_NOTIFY_CHANGE_FILE_NAME;
+	uint32_t subdir_filter = FILE_NOTIFY_CHANGE_FILE_NAME;
+	int ret;
+
+	ret = fanotify_watch(mem_ctx, ctx, path, &filter, &subdir_filter,
+			     fanotify_test_cb, state, handle_p);
+	if (ret != 0) {
+		return ret;
+	}
+	if (filter != 0) {
+		fprintf(stderr, "filter for %s not taken over: %"PRIx32"\n",
+			path, filter);
+		return EINVAL;
+	}
+	*psubdir_filter = subdir_filter;
+	return 0;
+}
+
+bool run_notify_fanotify(int dummy)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct tevent_context *ev = NULL;
+	struct sys_notify_context *ctx = NULL;
+	struct tevent_timer *te = NULL;
+	struct fanotify_test_state state = { .dir = NULL };
+	void *root_handle = NULL;
+	void *dir_handle = NULL;
+	uint32_t subdir_filter;
+	char tmpl[] = "/tmp/fanotify_test_XXXXXX";
+	char *dir = NULL;
+	bool result = false;
+	int i, ret;
+
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		fprintf(stderr, "tevent_context_init failed\n");
+		goto fail;
+	}
+	ctx = sys_notify_context_create(frame, ev);
+	if (ctx == NULL) {
+		fprintf(stderr, "sys_notify_context_create failed\n");
+		goto fail;
+	}
+
+	dir = mkdtemp(tmpl);
+	if (dir == NULL) {
+		perror("mkdtemp failed");
+		goto fail;
+	}
+	state.dir = dir;
+
+	/*
+	 * Below "/" there's at least /proc mounted, the subdir_filter
+	 * has to stay with notifyd.
+	 */
+	ret = fanotify_test_watch(frame, ctx, "/", &state, &subdir_filter,
+				  &root_handle);
+	if ((ret == EPERM) || (ret == EACCES) || (ret == ENOSYS)) {
+		printf("fanotify not available: %s, skipping\n",
+		       strerror(ret));
+		result = true;
+		goto done;
+	}
+	if (ret != 0) {
+		fprintf(stderr, "fanotify_watch(/) failed: %s\n",
+			strerror(ret));
+		goto done;
+	}
+	if (subdir_filter != FILE_NOTIFY_CHANGE_FILE_NAME) {
+		fprintf(stderr, "subdir_filter for / consumed\n");
+		goto done;
+	}
+	TALLOC_FREE(root_handle);
+
+	/*
+	 * Nothing is mounted in a fresh directory, fanotify covers
+	 * subdirectories.
+	 */
+	ret = fanotify_test_watch(frame, ctx, dir, &state, &subdir_filter,
+				  &dir_handle);
+	if (ret != 0) {
+		fprintf(stderr, "fanotify_watch(%s) failed: %s\n",
+			dir, strerror(ret));
+		goto done;
+	}
+	if (subdir_filter != 0) {
+		fprintf(stderr, "subdir_filter for %s not taken over\n", dir);
+		goto done;
+	}
+
+	/*
+	 * Overflow the queue without reading it, we must get told to
+	 * rescan.
+	 */
+	for (i=0; i<FANOTIFY_NUM_FILES; i++) {
+		char name[PATH_MAX];
+		int fd;
+
+		snprintf(name, sizeof(name), "%s/file%d", dir, i);
+		fd = open(name, O_CREAT|O_WRONLY, 0600);
+		if (fd == -1) {
+			fprintf(stderr, "open(%s) failed: %s\n",
+				name, strerror(errno));
+			goto done;
+		}
+		close(fd);
+	}
+
+	te = tevent_add_timer(ev, frame, timeval_current_ofs(30, 0),
+			      fanotify_test_timeout, &state);
+	if (te == NULL) {
+		fprintf(stderr, "tevent_add_timer failed\n");
+		goto done;
+	}
+
+	while (!state.got_rescan && !state.timed_out) {
+		ret = tevent_loop_once(ev);
+		if (ret == -1) {
+			perror("tevent_loop_once failed");
+			goto done;
+		}
+	}
+
+	if (!state.got_rescan) {
+		fprintf(stderr, "No rescan after %zu events\n",
+			state.num_events);
+		goto done;
+	}
+	if (state.num_events == 0) {
+		fprintf(stderr, "No events before the overflow\n");
+		goto done;
+	}
+
+	printf("got %zu events and a rescan\n", state.num_events);
+
+	result = true;
+done:
+	TALLOC_FREE(dir_handle);
+	TALLOC_FREE(root_handle);
+	for (i=0; i<FANOTIFY_NUM_FILES; i++) {
+		char name[PATH_MAX];
+		snprintf(name, sizeof(name), "%s/file%d", dir, i);
+		unlink(name);
+	}
+	rmdir(dir);
+fail:
+	TALLOC_FREE(frame);
+	return result;
+}
+
+#else
+
+bool run_notify_fanotify(int dummy)
+{
+	printf("fanotify not compiled in, skipping\n");
+	return true;
+}
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test that share mode data cached by unlocked fetches is invalidated
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "client.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "libcli/security/security.h"
+#include "libsmb/proto.h"
+#include "libsmb/clirap.h"
+
+#define SHARE_MODE_CACHE_FNAME "share_mode_cache.dat"
+#define SHARE_MODE_CACHE_ROUNDS 10
+
+static bool share_mode_cache_connect(struct cli_state **pcli)
+{
+	struct cli_state *cli = NULL;
+	NTSTATUS status;
+
+	if (!torture_init_connection(&cli)) {
+		return false;
+	}
+
+	status = smbXcli_negprot(cli->conn,
+				 cli->timeout,
+				 PROTOCOL_SMB2_02,
+				 PROTOCOL_SMB3_11,
+				 NULL,
+				 NULL,
+				 NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("smbXcli_negprot returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_session_setup_creds(cli, torture_creds);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_session_setup returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	status = cli_tree_connect(cli, share, "?????", NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_tree_connect returned %s\n", nt_errstr(status));
+		goto fail;
+	}
+
+	*pcli = cli;
+	return true;
+fail:
+	torture_close_connection(cli);
+	return false;
+}
+
+static bool share_mode_cache_check(struct cli_state *cli,
+				   uint16_t fnum,
+				   time_t expected)
+{
+	struct timespec write_time = { .tv_sec = 0 };
+	NTSTATUS status;
+
+	status = cli_qfileinfo_basic(cli,
+				     fnum,
+				     NULL,
+				     NULL,
+				     NULL,
+				     NULL,
+				     &write_time,
+				     NULL,
+				     NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("cli_qfileinfo_basic returned %s\n", nt_errstr(status));
+		return false;
+	}
+	if (write_time.tv_sec != expected) {
+		printf("write time %jd, expected %jd\n",
+		       (intmax_t)write_time.tv_sec,
+		       (intmax_t)expected);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Two smbd processes have the file open. The second one sets the
+ * write time via its handle, which ends up in the share mode data
+ * and changes its unique_content_epoch. The first one reads the
+ * write time from the share mode data without taking the lock and
+ * keeps the parsed data around. It must notice the change and must
+ * not return the write time it has seen before.
+ */
+bool run_share_mode_cache(int dummy)
+{
+	struct cli_state *cli1 = NULL;
+	struct cli_state *cli2 = NULL;
+	uint16_t fnum1 = UINT16_MAX;
+	uint16_t fnum2 = UINT16_MAX;
+	struct timespec omit = make_omit_timespec();
+	time_t base = 1577836800; /* 2020-01-01 */
+	NTSTATUS status;
+	bool ret = false;
+	int i, j;
+
+	printf("Starting SHARE-MODE-CACHE\n");
+
+	if (!share_mode_cache_connect(&cli1)) {
+		return false;
+	}
+	if (!share_mode_cache_connect(&cli2)) {
+		torture_close_connection(cli1);
+		return false;
+	}
+
+	cli_unlink(cli1,
+		   SHARE_MODE_CACHE_FNAME,
+		   FILE_ATTRIBUTE_HIDDEN|FILE_ATTRIBUTE_SYSTEM);
+
+	status = cli_ntcreate(cli1,
+			      SHARE_MODE_CACHE_FNAME,
+			      0,
+			      FILE_READ_ATTRIBUTES,
+			      FILE_ATTRIBUTE_NORMAL,
+			      FILE_SHARE_READ|FILE_SHARE_WRITE|
+			      FILE_SHARE_DELETE,
+			      FILE_CREATE,
+			      0,
+			      0,
+			      &fnum1,
+			      NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("create returned %s\n", nt_errstr(status));
+		goto done;
+	}
+
+	status = cli_ntcreate(cli2,
+			      SHARE_MODE_CACHE_FNAME,
+			      0,
+			      FILE_WRITE_ATTRIBUTES,
+			      FILE_ATTRIBUTE_NORMAL,
+			      FILE_SHARE_READ|FILE_SHARE_WRITE|
+			      FILE_SHARE_DELETE,
+			      FILE_OPEN,
+			      0,
+			      0,
+			      &fnum2,
+			      NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		printf("open returned %s\n", nt_errstr(status));
+		goto done;
+	}
+
+	for (i=0; i<SHARE_MODE_CACHE_ROUNDS; i++) {
+		struct timespec write_time = {
+			.tv_sec = base + i * 3600,
+		};
+
+		status = cli_setfileinfo_ext(cli2,
+					     fnum2,
+					     omit,
+					     omit,
+					     write_time,
+					     omit,
+					     (uint32_t)-1);
+		if (!NT_STATUS_IS_OK(status)) {
+			printf("cli_setfileinfo_ext returned %s\n",
+			       nt_errstr(status));
+			goto done;
+		}
+
+		/*
+		 * The first query has to see the new epoch, the
+		 * second one is served from the cached data.
+		 */
+		for (j=0; j<2; j++) {
+			if (!share_mode_cache_check(cli1,
+						    fnum1,
+						    write_time.tv_sec)) {
+				printf("round %d, query %d\n", i, j);
+				goto done;
+			}
+		}
+	}
+
+	ret = true;
+done:
+	if (fnum2 != UINT16_MAX) {
+		cli_close(cli2, fnum2);
+	}
+	if (fnum1 != UINT16_MAX) {
+		cli_close(cli1, fnum1);
+	}
+	cli_unlink(cli1,
+		   SHARE_MODE_CACHE_FNAME,
+		   FILE_ATTRIBUTE_HIDDEN|FILE_ATTRIBUTE_SYSTEM);
+	torture_close_connection(cli2);
+	torture_close_connection(cli1);
+	return ret;
+}
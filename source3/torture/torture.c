@@ -15429,6 +15429,10 @@ static struct {
 		.name = "LOCK13",
 		.fn   =  run_locktest13,
 	},
+	{
+		.name = "BRLOCK-BENCH",
+		.fn   =  run_bench_brlock,
+	},
 	{
 		.name = "UNLINK",
 		.fn   = run_unlinktest,
@@ -15884,6 +15888,22 @@ static struct {
 		.name  = "SMB2-QUOTA1",
 		.fn    = run_smb2_quota1,
 	},
+	{
+		.name  = "CASEFOLD-INDEX",
+		.fn    = run_casefold_index,
+	},
+	{
+		.name  = "IO-URING-FILES",
+		.fn    = run_io_uring_files,
+	},
+	{
+		.name  = "SHARE-MODE-CACHE",
+		.fn    = run_share_mode_cache,
+	},
+	{
+		.name  = "FILES-HASH",
+		.fn    = run_files_hash,
+	},
 	{
 		.name  = "SMB2-INVALID-PIPENAME",
 		.fn    = run_smb2_invalid_pipename,
@@ -16000,10 +16020,18 @@ static struct {
 		.name  = "LOCAL-DBWRAP-WATCH4",
 		.fn    = run_dbwrap_watch4,
 	},
+	{
+		.name  = "LOCAL-DBWRAP-WATCH5",
+		.fn    = run_dbwrap_watch5,
+	},
 	{
 		.name  = "LOCAL-DBWRAP-DO-LOCKED1",
 		.fn    = run_dbwrap_do_locked1,
 	},
+	{
+		.name  = "LOCAL-DBWRAP-CACHE1",
+		.fn    = run_dbwrap_cache1,
+	},
 	{
 		.name  = "LOCAL-MESSAGING-READ1",
 		.fn    = run_messaging_read1,
@@ -16040,6 +16068,18 @@ static struct {
 		.name  = "LOCAL-MESSAGING-SEND-ALL",
 		.fn    = run_messaging_send_all,
 	},
+	{
+		.name  = "LOCAL-MESSAGING-RINGS",
+		.fn    = run_messaging_rings,
+	},
+	{
+		.name  = "LOCAL-NOTIFY-FANOTIFY",
+		.fn    = run_notify_fanotify,
+	},
+	{
+		.name  = "LOCAL-BRLOCK-INDEX",
+		.fn    = run_brlock_index,
+	},
 	{
 		.name  = "LOCAL-BASE64",
 		.fn    = run_local_base64,
@@ -61,7 +61,8 @@ void lpcfg_smbcli_options(struct loadparm_context *lp_ctx,
 		.max_credits = WINDOWS_CLIENT_PURE_SMB2_NEGPROT_INITIAL_CREDIT_ASK,
 		.smb3_capabilities = smb311_capabilities_parse("client",
 			lpcfg_client_smb3_signing_algorithms(lp_ctx),
-			lpcfg_client_smb3_encryption_algorithms(lp_ctx)),
+			lpcfg_client_smb3_encryption_algorithms(lp_ctx),
+			lpcfg_client_smb3_compression_algorithms(lp_ctx)),
 	};
 }
 